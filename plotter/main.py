@@ -1,6 +1,7 @@
 # plot_data.py
 
 import struct
+import sys
 import pandas as pd
 import matplotlib
 import os
@@ -14,7 +15,8 @@ import matplotlib.pyplot as plt
 plt.ion()
 
 # --- Configuration ---
-LOG_FILE_PATH = "pm_table_log.bin"
+# pm_table_log.bin (pm_reader) or pm_table_log.pmcol (pm_reader --columnar)
+LOG_FILE_PATH = sys.argv[1] if len(sys.argv) > 1 else "pm_table_log.bin"
 
 # --- PM Table Metric Offsets (in bytes) ---
 # NOTE: These offsets are for a common AMD Ryzen 5000 "Vermeer" PM Table (version 0x380905).
@@ -135,11 +137,44 @@ def parse_log_file(filepath: Path, fast: bool = False) -> pd.DataFrame:
     return df
 
 
+def parse_columnar_file(filepath: Path, fast: bool = False) -> pd.DataFrame:
+    """
+    Loads the same metrics as parse_log_file() from a column-major .pmcol
+    recording via numpy.memmap; only the columns used are read from disk.
+    """
+    sys.path.insert(0, str(Path(__file__).resolve().parent.parent / "reader" / "python"))
+    from pm_columnar import ColumnarLog
+
+    log = ColumnarLog(filepath)
+    df = pd.DataFrame(index=pd.to_datetime(log.timestamps(), unit="ns"))
+    df.index.name = "timestamp"
+    if fast:
+        return df
+    for name, offset in METRIC_OFFSETS.items():
+        if "core_" not in name:
+            df[name] = log.cell(offset // 4) if offset // 4 < log.n_cells else np.nan
+    first = METRIC_OFFSETS["core_power"] // 4
+    if first + TABLE_CORE_COUNT <= log.n_cells:
+        core_powers = log.cells(range(first, first + TABLE_CORE_COUNT))
+        df["total_core_power"] = np.where(core_powers > 0, core_powers, 0).sum(axis=0)
+    first = METRIC_OFFSETS["core_freq_eff"] // 4
+    if first + TABLE_CORE_COUNT <= log.n_cells:
+        core_freqs = log.cells(range(first, first + TABLE_CORE_COUNT))
+        active = np.where(core_freqs > 100, core_freqs, np.nan)
+        with np.errstate(all="ignore"):
+            df["avg_core_freq"] = np.nan_to_num(np.nanmean(active, axis=0))
+            df["peak_core_freq"] = np.nan_to_num(np.nanmax(active, axis=0))
+    return df
+
+
 
 
 log_path = Path(LOG_FILE_PATH)
 print(f"Attempting to parse log file: {log_path.resolve()}")
-data_df = parse_log_file(log_path, False)
+if log_path.suffix == ".pmcol":
+    data_df = parse_columnar_file(log_path, False)
+else:
+    data_df = parse_log_file(log_path, False)
 print(f"Successfully parsed {len(data_df)} records.")
 # --- Jitter Calculation ---
 # Calculate the difference between consecutive timestamps in milliseconds,
@@ -7,12 +7,14 @@ from PyQt6.QtWidgets import (
 )
 from PyQt6.QtCore import pyqtSlot
 from config_loader import load_config
-from pm_table_reader import PMTableReader
+from pm_table_reader import PMTableReader, ShmTableReader
 from data_plotter import DataPlotter
 
 # Path to the pm_table file. For development, you might want to use a dummy file.
 PM_TABLE_PATH = "/sys/kernel/ryzen_smu_drv/pm_table"
 # PM_TABLE_PATH = "dummy_pm_table" # <-- Use this for testing without the driver
+# Set by --shm <name>: take the samples from a running pm_acqd instead.
+SHM_NAME = None
 
 class MainWindow(QMainWindow):
     def __init__(self):
@@ -47,7 +49,10 @@ class MainWindow(QMainWindow):
             controls_layout.addWidget(checkbox, i // 8, i % 8)
 
         # Initialize and start the reader thread
-        self.reader_thread = PMTableReader(PM_TABLE_PATH, frequency=1000)
+        if SHM_NAME:
+            self.reader_thread = ShmTableReader(SHM_NAME, frequency=1000)
+        else:
+            self.reader_thread = PMTableReader(PM_TABLE_PATH, frequency=1000)
         self.reader_thread.data_ready.connect(self.handle_data)
         self.reader_thread.error.connect(self.show_error)
         self.reader_thread.start()
@@ -85,7 +90,11 @@ if __name__ == "__main__":
     import struct
     import numpy as np
 
-    if not os.path.exists(PM_TABLE_PATH):
+    if "--shm" in sys.argv:
+        index = sys.argv.index("--shm")
+        SHM_NAME = sys.argv[index + 1] if index + 1 < len(sys.argv) else "pm_table"
+        del sys.argv[index:index + 2]
+    elif not os.path.exists(PM_TABLE_PATH):
         print(f"'{PM_TABLE_PATH}' not found. Creating a dummy file for testing.")
         PM_TABLE_PATH = "dummy_pm_table"
         try:
@@ -1,5 +1,7 @@
+import sys
 import time
 import struct
+from pathlib import Path
 from PyQt6.QtCore import QThread, pyqtSignal
 import numpy as np
 
@@ -52,4 +54,48 @@ class PMTableReader(QThread):
 
     def stop(self):
         """Stops the reading loop."""
-        self._is_running = False
\ No newline at end of file
+        self._is_running = False
+
+class ShmTableReader(QThread):
+    """
+    Takes the samples pm_acqd publishes to shared memory instead of reading
+    sysfs, so the monitor runs next to pm_reader/pm_measure without adding
+    its own reads. Same signals as PMTableReader; the timestamp is the
+    daemon's wall-clock time of the read.
+    """
+    data_ready = pyqtSignal(float, np.ndarray)
+    error = pyqtSignal(str)
+
+    def __init__(self, name="pm_table", frequency=1000):
+        super().__init__()
+        self.name = name
+        self._is_running = True
+        self.interval = 1.0 / frequency
+
+    def run(self):
+        try:
+            # reader/python is not a package; it sits next to this project.
+            sys.path.insert(0, str(Path(__file__).resolve().parent.parent / "reader" / "python"))
+            from pm_shm import ShmRing
+            ring = ShmRing(self.name)
+        except (OSError, ValueError) as e:
+            self.error.emit(f"Cannot attach to pm_acqd ring '{self.name}': {e}")
+            return
+
+        # The daemon may publish faster than the plot needs; emit the newest
+        # sample once per interval.
+        last_seq = 0
+        while self._is_running:
+            sample = ring.latest()
+            if sample is not None and sample.seq != last_seq:
+                last_seq = sample.seq
+                self.data_ready.emit(sample.realtime_ns / 1e9, sample.data)
+            elif not ring.alive():
+                self.error.emit("pm_acqd stopped publishing.")
+                break
+            time.sleep(self.interval)
+        ring.close()
+
+    def stop(self):
+        """Stops the reading loop."""
+        self._is_running = False
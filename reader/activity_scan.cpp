@@ -0,0 +1,109 @@
+/**
+ * @file activity_scan.cpp
+ * @brief ActivityScan: per-cell variance kernel and early stop.
+ */
+
+#include "activity_scan.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+ActivityScan::ActivityScan(size_t n_floats)
+    : ActivityScan(n_floats, Config{}) {}
+
+ActivityScan::ActivityScan(size_t n_floats, const Config &config)
+    : config_(config), n_floats_(n_floats), reference_(n_floats),
+      previous_(n_floats), block_sum_(n_floats), block_sum_sq_(n_floats),
+      sum_(n_floats), sum_sq_(n_floats), active_(n_floats) {
+  config_.block_samples = std::max<size_t>(1, config_.block_samples);
+}
+
+void ActivityScan::expect(const std::vector<int> &indices) {
+  expected_.assign(n_floats_, 0);
+  for (int i : indices) {
+    if (i >= 0 && static_cast<size_t>(i) < n_floats_)
+      expected_[i] = 1;
+  }
+}
+
+bool ActivityScan::add(const float *table, int64_t t_ns) {
+  if (done_)
+    return true;
+
+  if (n_ == 0) {
+    std::copy_n(table, n_floats_, reference_.begin());
+  } else if (std::memcmp(table, previous_.data(),
+                         n_floats_ * sizeof(float)) != 0) {
+    if (changes_++ == 0)
+      first_change_ns_ = t_ns;
+    last_change_ns_ = t_ns;
+  }
+  std::copy_n(table, n_floats_, previous_.begin());
+
+  // Shifted by the first sample, so float sums stay exact enough within a
+  // block; the blocks are folded into doubles.
+  const float *ref = reference_.data();
+  float *sum = block_sum_.data();
+  float *sum_sq = block_sum_sq_.data();
+  for (size_t i = 0; i < n_floats_; ++i) {
+    const float d = table[i] - ref[i];
+    sum[i] += d;
+    sum_sq[i] += d * d;
+  }
+  ++n_;
+
+  if (n_ % config_.block_samples == 0 || n_ >= config_.max_samples)
+    classify();
+  return done_;
+}
+
+void ActivityScan::classify() {
+  for (size_t i = 0; i < n_floats_; ++i) {
+    sum_[i] += block_sum_[i];
+    sum_sq_[i] += block_sum_sq_[i];
+  }
+  std::fill(block_sum_.begin(), block_sum_.end(), 0.0f);
+  std::fill(block_sum_sq_.begin(), block_sum_sq_.end(), 0.0f);
+
+  bool changed = false;
+  if (n_ >= 2) {
+    const double n = static_cast<double>(n_);
+    for (size_t i = 0; i < n_floats_; ++i) {
+      const double variance =
+          (sum_sq_[i] - sum_[i] * sum_[i] / n) / (n - 1.0);
+      const uint8_t active = variance > config_.min_variance;
+      changed |= active != active_[i];
+      active_[i] = active;
+    }
+  }
+  const size_t block = n_ % config_.block_samples == 0
+                           ? config_.block_samples
+                           : n_ % config_.block_samples;
+  stable_ = changed ? 0 : stable_ + block;
+  matched_ = n_ >= 2 && !expected_.empty() && active_ == expected_;
+
+  done_ = matched_ || n_ >= config_.max_samples ||
+          (config_.stable_samples > 0 && n_ >= config_.min_samples &&
+           stable_ >= config_.stable_samples);
+}
+
+void ActivityScan::finish() {
+  if (!done_ && n_ % config_.block_samples != 0)
+    classify();
+}
+
+std::vector<int> ActivityScan::active() const {
+  std::vector<int> indices;
+  for (size_t i = 0; i < n_floats_; ++i) {
+    if (active_[i])
+      indices.push_back(static_cast<int>(i));
+  }
+  return indices;
+}
+
+double ActivityScan::update_period_ms() const {
+  if (changes_ < 2)
+    return 0.0;
+  return static_cast<double>(last_change_ns_ - first_change_ns_) / 1e6 /
+         static_cast<double>(changes_ - 1);
+}
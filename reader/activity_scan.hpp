@@ -0,0 +1,85 @@
+/**
+ * @file activity_scan.hpp
+ * @brief Find the changing pm_table cells at startup, stopping as soon as
+ * the answer settles.
+ *
+ * The statistics are arrays per quantity (shifted sum and sum of squares
+ * over all cells), so the per-sample update is one pass over contiguous
+ * floats that the compiler vectorizes. A per-cell StreamingStats, by
+ * contrast, is a strided update with a division. Every block of samples the
+ * cells are classified with the old rule, sample variance > 1e-9. The scan
+ * ends when the classification has not changed for a number of samples, or,
+ * given an expected set (a cached result), at the first block that
+ * reproduces it.
+ */
+
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+class ActivityScan {
+public:
+  struct Config {
+    size_t max_samples = 1000;
+    size_t min_samples = 200;
+    size_t block_samples = 50; ///< Classification interval
+    /// Stop after this many samples without a classification change
+    /// (0 = always scan max_samples).
+    size_t stable_samples = 250;
+    float min_variance = 1e-9f;
+  };
+
+  explicit ActivityScan(size_t n_floats);
+  ActivityScan(size_t n_floats, const Config &config);
+
+  /**
+   * @brief Add one table sampled at @p t_ns (any monotonic clock).
+   * @return true once the scan is done; further samples are ignored.
+   */
+  bool add(const float *table, int64_t t_ns);
+
+  /**
+   * @brief Use @p indices as a prior: the scan ends at the first block whose
+   * classification equals it. Otherwise the normal early stop applies.
+   */
+  void expect(const std::vector<int> &indices);
+
+  /** @brief Classify the last partial block, for a source that ended. */
+  void finish();
+
+  bool done() const noexcept { return done_; }
+  size_t samples() const noexcept { return n_; }
+  /** @brief Whether the scan ended on the expect() set. */
+  bool matched_expected() const noexcept { return matched_; }
+
+  /** @brief Indices of the changing cells, ascending. */
+  std::vector<int> active() const;
+
+  /**
+   * @brief Mean time between table updates in ms: the SMU refreshes the
+   * table less often than it can be read. 0 if it changed fewer than twice.
+   */
+  double update_period_ms() const;
+
+private:
+  void classify();
+
+  Config config_;
+  size_t n_floats_;
+  size_t n_ = 0;
+  bool done_ = false;
+  size_t stable_ = 0; ///< Samples since the classification last changed
+
+  std::vector<float> reference_; ///< First sample, the shift
+  std::vector<float> previous_;
+  std::vector<float> block_sum_, block_sum_sq_; ///< Since the last classify
+  std::vector<double> sum_, sum_sq_;
+  std::vector<uint8_t> active_;
+  std::vector<uint8_t> expected_; ///< Empty without a prior
+  bool matched_ = false;
+
+  uint64_t changes_ = 0;
+  int64_t first_change_ns_ = 0;
+  int64_t last_change_ns_ = 0;
+};
@@ -0,0 +1,287 @@
+/**
+ * @file async_log_writer.cpp
+ * @brief AsyncLogWriter: block ring, writer thread and file handling.
+ */
+
+#include "async_log_writer.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <spdlog/spdlog.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+using namespace std::chrono_literals;
+
+namespace {
+
+constexpr size_t IO_ALIGNMENT = 4096;
+constexpr auto POLL_INTERVAL = 5ms;
+
+double elapsed_ms(std::chrono::steady_clock::time_point since) {
+  return std::chrono::duration<double, std::milli>(
+             std::chrono::steady_clock::now() - since)
+      .count();
+}
+
+void store_max(std::atomic<double> &target, double value) {
+  if (value > target.load(std::memory_order_relaxed))
+    target.store(value, std::memory_order_relaxed);
+}
+
+} // namespace
+
+/**
+ * @brief Open the file, allocate and prefault the ring, start the writer.
+ *
+ * Failures are logged; the writer then evaluates false and drops everything.
+ */
+AsyncLogWriter::AsyncLogWriter(const std::string &path, Config config)
+    : config_{config}, path_{path},
+      arena_{((config.block_bytes + IO_ALIGNMENT - 1) / IO_ALIGNMENT) *
+             IO_ALIGNMENT * std::max<size_t>(config.n_blocks, 2)} {
+  config_.block_bytes =
+      ((config_.block_bytes + IO_ALIGNMENT - 1) / IO_ALIGNMENT) * IO_ALIGNMENT;
+  config_.n_blocks = std::max<size_t>(config_.n_blocks, 2);
+  if (!arena_) {
+    SPDLOG_ERROR("Failed to allocate the {} x {} byte log ring.",
+                 config_.n_blocks, config_.block_bytes);
+    return;
+  }
+  arena_size_ = config_.block_bytes * config_.n_blocks;
+  // Touch every page now so the sampling thread never takes a page fault.
+  std::memset(arena_.data(), 0, arena_size_);
+
+  const bool aligned =
+      reinterpret_cast<uintptr_t>(arena_.data()) % IO_ALIGNMENT == 0;
+  const int flags = O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC;
+  if (config_.direct_io && aligned) {
+    fd_ = ::open(path.c_str(), flags | O_DIRECT, 0644);
+    direct_ = fd_ >= 0;
+    if (fd_ < 0) {
+      SPDLOG_DEBUG("O_DIRECT open of {} failed ({}), using buffered I/O.",
+                   path, std::strerror(errno));
+    }
+  }
+  if (fd_ < 0)
+    fd_ = ::open(path.c_str(), flags, 0644);
+  if (fd_ < 0) {
+    SPDLOG_ERROR("Failed to open log file {}: {}", path, std::strerror(errno));
+    return;
+  }
+
+  preallocate(config_.preallocate_bytes);
+  SPDLOG_INFO("Logging to {} ({} x {} KiB ring{}, {}).", path,
+              config_.n_blocks, config_.block_bytes / 1024,
+              arena_.locked() ? ", locked" : "",
+              direct_ ? "O_DIRECT" : "buffered");
+  writer_ = std::thread(&AsyncLogWriter::run_writer, this);
+}
+
+AsyncLogWriter::~AsyncLogWriter() { close(); }
+
+void AsyncLogWriter::copy_in(uint64_t pos, const void *data,
+                             size_t length) noexcept {
+  auto *arena = static_cast<char *>(arena_.data());
+  const size_t offset = pos % arena_size_;
+  const size_t first = std::min(length, arena_size_ - offset);
+  std::memcpy(arena + offset, data, first);
+  std::memcpy(arena, static_cast<const char *>(data) + first, length - first);
+}
+
+/**
+ * @brief Check that length bytes fit into the ring; count drops and stalls.
+ */
+bool AsyncLogWriter::reserve(size_t length) noexcept {
+  if (closed_ || !*this)
+    return false;
+  const uint64_t tail = written_.load(std::memory_order_acquire);
+  if (head_ + length - tail > arena_size_) {
+    dropped_.fetch_add(1, std::memory_order_relaxed);
+    if (!in_stall_) {
+      stalls_.fetch_add(1, std::memory_order_relaxed);
+      in_stall_ = true;
+    }
+    return false;
+  }
+  in_stall_ = false;
+  return true;
+}
+
+void AsyncLogWriter::commit(size_t length) noexcept {
+  head_ += length;
+  committed_.store(head_, std::memory_order_release);
+  records_.fetch_add(1, std::memory_order_relaxed);
+  const uint64_t backlog =
+      head_ - written_.load(std::memory_order_relaxed);
+  if (backlog > max_backlog_.load(std::memory_order_relaxed))
+    max_backlog_.store(backlog, std::memory_order_relaxed);
+}
+
+bool AsyncLogWriter::append(const void *data, size_t length) noexcept {
+  if (!reserve(length))
+    return false;
+  copy_in(head_, data, length);
+  commit(length);
+  return true;
+}
+
+bool AsyncLogWriter::append_record(uint64_t timestamp_ns, const void *blob,
+                                   uint64_t size) noexcept {
+  const uint64_t header[2] = {timestamp_ns, size};
+  const size_t length = sizeof(header) + size;
+  if (!reserve(length))
+    return false;
+  copy_in(head_, header, sizeof(header));
+  copy_in(head_ + sizeof(header), blob, size);
+  commit(length);
+  return true;
+}
+
+/**
+ * @brief Flush the remaining bytes, sync and close the file.
+ */
+void AsyncLogWriter::close() {
+  if (closed_)
+    return;
+  closed_ = true;
+  stop_.store(true, std::memory_order_release);
+  if (writer_.joinable())
+    writer_.join();
+  if (fd_ >= 0) {
+    // Give back the FALLOC_FL_KEEP_SIZE reservation past the data, and fix
+    // the length in case a failed write left a partial range behind it.
+    if (preallocated_ > file_end_ &&
+        ::fallocate(fd_, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE,
+                    static_cast<off_t>(file_end_),
+                    static_cast<off_t>(preallocated_ - file_end_)) != 0)
+      SPDLOG_DEBUG("Releasing the preallocation of {} failed: {}", path_,
+                   std::strerror(errno));
+    if (::ftruncate(fd_, static_cast<off_t>(file_end_)) != 0)
+      SPDLOG_WARN("Failed to truncate {}: {}", path_, std::strerror(errno));
+    ::fdatasync(fd_);
+    ::close(fd_);
+    fd_ = -1;
+  }
+}
+
+AsyncLogWriter::Stats AsyncLogWriter::stats() const {
+  Stats s;
+  s.records = records_.load(std::memory_order_relaxed);
+  s.bytes = committed_.load(std::memory_order_relaxed);
+  s.written_bytes = written_.load(std::memory_order_relaxed);
+  s.dropped_records = dropped_.load(std::memory_order_relaxed);
+  s.stalls = stalls_.load(std::memory_order_relaxed);
+  s.backlog_bytes = s.bytes - std::min(s.bytes, s.written_bytes);
+  s.max_backlog_bytes = max_backlog_.load(std::memory_order_relaxed);
+  s.max_write_ms = max_write_ms_.load(std::memory_order_relaxed);
+  s.max_sync_ms = max_sync_ms_.load(std::memory_order_relaxed);
+  s.direct_io = direct_;
+  s.lost_bytes = lost_bytes_.load(std::memory_order_relaxed);
+  s.failed = failed_.load(std::memory_order_relaxed);
+  return s;
+}
+
+/**
+ * @brief Extend the on-disk allocation ahead of the write position.
+ *
+ * FALLOC_FL_KEEP_SIZE reserves blocks without changing the file size, so a
+ * crash never leaves a tail of zeros that would look like records.
+ */
+void AsyncLogWriter::preallocate(uint64_t up_to) {
+  if (preallocate_failed_ || config_.preallocate_bytes == 0 ||
+      up_to <= preallocated_)
+    return;
+  const uint64_t target = up_to + config_.preallocate_bytes;
+  if (::fallocate(fd_, FALLOC_FL_KEEP_SIZE, static_cast<off_t>(preallocated_),
+                  static_cast<off_t>(target - preallocated_)) != 0) {
+    SPDLOG_DEBUG("fallocate on {} failed ({}), not preallocating.", path_,
+                 std::strerror(errno));
+    preallocate_failed_ = true;
+    return;
+  }
+  preallocated_ = target;
+}
+
+/**
+ * @brief Write the ring bytes [from, to) at file offset from.
+ *
+ * The range is written with one pwritev (two iovecs if it wraps the ring).
+ * The final, partial block is written with O_DIRECT switched off since its
+ * length is not aligned.
+ */
+void AsyncLogWriter::write_range(uint64_t from, uint64_t to,
+                                 bool final_block) {
+  if (failed_.load(std::memory_order_relaxed)) {
+    // Keep draining so the sampler is not backed up, but write nothing.
+    lost_bytes_.fetch_add(to - from, std::memory_order_relaxed);
+    written_.store(to, std::memory_order_release);
+    return;
+  }
+  if (final_block && direct_) {
+    const int flags = ::fcntl(fd_, F_GETFL);
+    ::fcntl(fd_, F_SETFL, flags & ~O_DIRECT);
+  }
+  preallocate(to);
+
+  auto *arena = static_cast<char *>(arena_.data());
+  const auto start = std::chrono::steady_clock::now();
+  uint64_t pos = from;
+  while (pos < to) {
+    const size_t offset = pos % arena_size_;
+    const size_t remaining = to - pos;
+    const size_t first = std::min(remaining, arena_size_ - offset);
+    iovec iov[2] = {{arena + offset, first}, {arena, remaining - first}};
+    const ssize_t n = ::pwritev(fd_, iov, remaining > first ? 2 : 1,
+                                static_cast<off_t>(pos));
+    if (n < 0) {
+      if (errno == EINTR)
+        continue;
+      // Do not let a broken disk back up into the sampler: drop the range
+      // and everything after it, so the file ends at the last good byte.
+      SPDLOG_ERROR("Write to {} failed at offset {}, no further data is "
+                   "written: {}",
+                   path_, pos, std::strerror(errno));
+      lost_bytes_.fetch_add(to - pos, std::memory_order_relaxed);
+      failed_.store(true, std::memory_order_relaxed);
+      break;
+    }
+    pos += static_cast<uint64_t>(n);
+  }
+  file_end_ = pos;
+  store_max(max_write_ms_, elapsed_ms(start));
+  written_.store(to, std::memory_order_release);
+}
+
+void AsyncLogWriter::run_writer() {
+  auto last_sync = std::chrono::steady_clock::now();
+  uint64_t synced = 0;
+  while (true) {
+    const bool stopping = stop_.load(std::memory_order_acquire);
+    const uint64_t committed = committed_.load(std::memory_order_acquire);
+    const uint64_t written = written_.load(std::memory_order_relaxed);
+    const uint64_t full_end = committed - committed % config_.block_bytes;
+
+    if (full_end > written) {
+      write_range(written, full_end, false);
+    } else if (stopping) {
+      if (committed > written)
+        write_range(written, committed, true);
+      break;
+    } else {
+      std::this_thread::sleep_for(POLL_INTERVAL);
+    }
+
+    if (const uint64_t now_written = written_.load(std::memory_order_relaxed);
+        now_written > synced &&
+        std::chrono::steady_clock::now() - last_sync >= config_.sync_interval) {
+      const auto start = std::chrono::steady_clock::now();
+      ::fdatasync(fd_);
+      store_max(max_sync_ms_, elapsed_ms(start));
+      last_sync = std::chrono::steady_clock::now();
+      synced = now_written;
+    }
+  }
+}
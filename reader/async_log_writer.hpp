@@ -0,0 +1,128 @@
+/**
+ * @file async_log_writer.hpp
+ * @brief Byte-stream log writer that keeps file I/O off the sampling thread.
+ *
+ * The sampling thread copies records into a ring of preallocated blocks; a
+ * writer thread flushes complete blocks with pwritev (O_DIRECT when the file
+ * system supports it), preallocates the file with fallocate and calls
+ * fdatasync periodically. Records may straddle block boundaries, so every
+ * write except the final one is a whole, aligned block.
+ */
+
+#pragma once
+#include "locked_buffer.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <thread>
+
+/**
+ * @class AsyncLogWriter
+ * @brief Single-producer, single-writer-thread log file.
+ *
+ * append() never blocks and never enters the kernel: if the ring is full
+ * (the disk cannot keep up for longer than the ring covers) the record is
+ * dropped and counted instead of stalling the sampler.
+ */
+class AsyncLogWriter {
+public:
+  struct Config {
+    size_t block_bytes = 1 << 20; ///< Rounded up to a multiple of 4 KiB
+    size_t n_blocks = 32;
+    bool direct_io = true;        ///< Falls back to buffered I/O if refused
+    size_t preallocate_bytes = 64u << 20; ///< fallocate ahead in this step
+    std::chrono::milliseconds sync_interval{1000};
+  };
+
+  /** @brief Counters, safe to read from any thread. */
+  struct Stats {
+    uint64_t records = 0;
+    uint64_t bytes = 0;          ///< Accepted into the ring
+    uint64_t written_bytes = 0;  ///< Handed to the kernel
+    uint64_t dropped_records = 0;
+    uint64_t stalls = 0;         ///< Episodes of a full ring
+    uint64_t backlog_bytes = 0;  ///< Currently waiting in the ring
+    uint64_t max_backlog_bytes = 0;
+    double max_write_ms = 0.0;   ///< Longest single pwritev
+    double max_sync_ms = 0.0;    ///< Longest fdatasync
+    bool direct_io = false;
+    /// After the first write error nothing more is written (later data
+    /// would land behind a hole); the bytes not written count here.
+    uint64_t lost_bytes = 0;
+    bool failed = false;
+  };
+
+  AsyncLogWriter(const std::string &path, Config config);
+  explicit AsyncLogWriter(const std::string &path)
+      : AsyncLogWriter(path, Config{}) {}
+  ~AsyncLogWriter();
+
+  AsyncLogWriter(const AsyncLogWriter &) = delete;
+  AsyncLogWriter &operator=(const AsyncLogWriter &) = delete;
+
+  /** @brief False if the file could not be opened or the ring allocated. */
+  explicit operator bool() const noexcept { return fd_ >= 0 && arena_; }
+
+  /**
+   * @brief Append raw bytes as one unit (all or nothing). Producer only.
+   * @return false if the record was dropped because the ring is full.
+   */
+  bool append(const void *data, size_t length) noexcept;
+
+  /**
+   * @brief Append one pm_reader record: u64 timestamp, u64 size, blob.
+   */
+  bool append_record(uint64_t timestamp_ns, const void *blob,
+                     uint64_t size) noexcept;
+
+  /**
+   * @brief Flush everything, truncate to the exact length (releasing the
+   * preallocation beyond it) and close.
+   *
+   * Called by the destructor; further appends are ignored.
+   */
+  void close();
+
+  Stats stats() const;
+
+private:
+  bool reserve(size_t length) noexcept;
+  void commit(size_t length) noexcept;
+  void copy_in(uint64_t pos, const void *data, size_t length) noexcept;
+  void run_writer();
+  void write_range(uint64_t from, uint64_t to, bool final_block);
+  void preallocate(uint64_t up_to);
+
+  Config config_;
+  std::string path_;
+  int fd_ = -1;
+  bool direct_ = false;
+  LockedBuffer arena_;
+  size_t arena_size_ = 0;
+
+  // Producer side.
+  uint64_t head_ = 0; ///< Producer-local copy of committed_
+  bool in_stall_ = false;
+
+  std::atomic<uint64_t> committed_{0}; ///< Bytes appended (absolute)
+  std::atomic<uint64_t> written_{0};   ///< Bytes written out (absolute)
+  uint64_t preallocated_ = 0;
+  bool preallocate_failed_ = false;
+  uint64_t file_end_ = 0; ///< Writer: end of the data written without error
+
+  std::atomic<uint64_t> records_{0};
+  std::atomic<uint64_t> dropped_{0};
+  std::atomic<uint64_t> stalls_{0};
+  std::atomic<uint64_t> max_backlog_{0};
+  std::atomic<double> max_write_ms_{0.0};
+  std::atomic<double> max_sync_ms_{0.0};
+  std::atomic<uint64_t> lost_bytes_{0};
+  std::atomic<bool> failed_{false};
+
+  std::atomic<bool> stop_{false};
+  bool closed_ = false;
+  std::thread writer_;
+};
@@ -0,0 +1,44 @@
+/**
+ * @file column_list.hpp
+ * @brief Command-line selection of pm_table cells ("17,20-31" or "all").
+ */
+
+#pragma once
+#include <cstddef>
+#include <numeric>
+#include <sstream>
+#include <string>
+#include <vector>
+
+/**
+ * @brief Parse "all" or a comma separated list of indices and ranges
+ * ("17,20-31") into pm_table float indices.
+ * @return false on syntax errors or indices outside the table.
+ */
+inline bool parse_column_list(const std::string &spec, size_t n_measurements,
+                              std::vector<int> &columns) {
+  columns.clear();
+  if (spec == "all") {
+    columns.resize(n_measurements);
+    std::iota(columns.begin(), columns.end(), 0);
+    return true;
+  }
+  std::istringstream in(spec);
+  std::string item;
+  while (std::getline(in, item, ',')) {
+    int first = 0, last = 0;
+    char dash = 0;
+    std::istringstream range(item);
+    if (!(range >> first))
+      return false;
+    last = first;
+    if (range >> dash && (dash != '-' || !(range >> last)))
+      return false;
+    if (first < 0 || last < first ||
+        static_cast<size_t>(last) >= n_measurements)
+      return false;
+    for (int i = first; i <= last; ++i)
+      columns.push_back(i);
+  }
+  return !columns.empty();
+}
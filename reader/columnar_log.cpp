@@ -0,0 +1,401 @@
+/**
+ * @file columnar_log.cpp
+ * @brief ColumnarFileWriter, ColumnarReader and ColumnarLogWriter.
+ */
+
+#include "columnar_log.hpp"
+#include "time_pyramid.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <filesystem>
+#include <fstream>
+#include <pthread.h>
+#include <sched.h>
+#include <spdlog/spdlog.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+/// Chunks are padded to a multiple of this so every chunk is page aligned.
+constexpr uint64_t CHUNK_ALIGN_BYTES = 4096;
+
+bool pwrite_all(int fd, const void *data, size_t length, uint64_t offset) {
+  const auto *p = static_cast<const char *>(data);
+  while (length > 0) {
+    const ssize_t n = ::pwrite(fd, p, length, static_cast<off_t>(offset));
+    if (n < 0) {
+      if (errno == EINTR)
+        continue;
+      return false;
+    }
+    p += n;
+    length -= static_cast<size_t>(n);
+    offset += static_cast<uint64_t>(n);
+  }
+  return true;
+}
+
+} // namespace
+
+uint64_t columnar_chunk_bytes(uint32_t chunk_samples, uint32_t n_cells) {
+  const uint64_t bytes = uint64_t{chunk_samples} * (8 + 4 * uint64_t{n_cells});
+  return (bytes + CHUNK_ALIGN_BYTES - 1) / CHUNK_ALIGN_BYTES *
+         CHUNK_ALIGN_BYTES;
+}
+
+ColumnarFileWriter::ColumnarFileWriter(const std::string &path,
+                                       uint32_t sample_bytes,
+                                       uint32_t pm_table_version,
+                                       uint32_t chunk_samples,
+                                       std::string sidecar_extra)
+    : path_{path}, n_cells_{sample_bytes / 4},
+      chunk_samples_{std::max<uint32_t>(chunk_samples, 1)},
+      pm_table_version_{pm_table_version},
+      chunk_bytes_{columnar_chunk_bytes(chunk_samples_, n_cells_)},
+      sidecar_extra_{std::move(sidecar_extra)} {
+  if (sample_bytes == 0 || sample_bytes % 4 != 0) {
+    SPDLOG_ERROR("Columnar log needs a table size that is a multiple of 4, "
+                 "got {}.",
+                 sample_bytes);
+    return;
+  }
+  fd_ = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  if (fd_ < 0) {
+    SPDLOG_ERROR("Failed to open {}: {}", path, std::strerror(errno));
+    return;
+  }
+  chunk_.assign(chunk_bytes_, 0);
+
+  std::vector<uint8_t> header_page(COLUMNAR_HEADER_BYTES, 0);
+  ColumnarFileHeader header{};
+  std::memcpy(header.magic, COLUMNAR_FILE_MAGIC, 4);
+  header.header_bytes = COLUMNAR_HEADER_BYTES;
+  header.chunk_samples = chunk_samples_;
+  header.n_cells = n_cells_;
+  header.pm_table_version = pm_table_version_;
+  header.chunk_bytes = chunk_bytes_;
+  std::memcpy(header_page.data(), &header, sizeof(header));
+  if (!pwrite_all(fd_, header_page.data(), header_page.size(), 0)) {
+    SPDLOG_ERROR("Write to {} failed: {}", path, std::strerror(errno));
+    ::close(fd_);
+    fd_ = -1;
+    return;
+  }
+  write_sidecar(false);
+}
+
+ColumnarFileWriter::~ColumnarFileWriter() { close(); }
+
+uint64_t ColumnarFileWriter::file_bytes() const {
+  return COLUMNAR_HEADER_BYTES + index_.size() * chunk_bytes_;
+}
+
+/**
+ * @brief Transpose rows into the chunk: per cell, a run of consecutive
+ * samples is written contiguously.
+ */
+bool ColumnarFileWriter::add_rows(const uint64_t *timestamps,
+                                  const uint32_t *rows, size_t n) {
+  if (fd_ < 0)
+    return false;
+  auto *ts_column = reinterpret_cast<uint64_t *>(chunk_.data());
+  auto *cells = reinterpret_cast<uint32_t *>(chunk_.data() +
+                                             8 * size_t{chunk_samples_});
+  while (n > 0) {
+    const size_t batch = std::min<size_t>(n, chunk_samples_ - fill_);
+    std::copy_n(timestamps, batch, ts_column + fill_);
+    for (size_t c = 0; c < n_cells_; ++c) {
+      uint32_t *column = cells + c * chunk_samples_ + fill_;
+      for (size_t i = 0; i < batch; ++i)
+        column[i] = rows[i * n_cells_ + c];
+    }
+    fill_ += static_cast<uint32_t>(batch);
+    n_samples_ += batch;
+    timestamps += batch;
+    rows += batch * n_cells_;
+    n -= batch;
+    if (fill_ == chunk_samples_ && !write_chunk())
+      return false;
+  }
+  return true;
+}
+
+bool ColumnarFileWriter::write_chunk() {
+  const auto *ts_column = reinterpret_cast<const uint64_t *>(chunk_.data());
+  const uint64_t offset = file_bytes();
+  if (!pwrite_all(fd_, chunk_.data(), chunk_bytes_, offset)) {
+    SPDLOG_ERROR("Write to {} failed: {}", path_, std::strerror(errno));
+    return false;
+  }
+  index_.push_back(
+      {offset, ts_column[0], ts_column[fill_ - 1], fill_, 0});
+  fill_ = 0;
+  write_sidecar(false);
+  return true;
+}
+
+bool ColumnarFileWriter::sync() { return fd_ >= 0 && ::fdatasync(fd_) == 0; }
+
+bool ColumnarFileWriter::close() {
+  if (fd_ < 0)
+    return false;
+  bool ok = true;
+  if (fill_ > 0) {
+    // Zero the unused tail of every column so stale samples never show up.
+    auto *ts_column = reinterpret_cast<uint64_t *>(chunk_.data());
+    std::fill(ts_column + fill_, ts_column + chunk_samples_, 0);
+    auto *cells = reinterpret_cast<uint32_t *>(chunk_.data() +
+                                               8 * size_t{chunk_samples_});
+    for (size_t c = 0; c < n_cells_; ++c)
+      std::fill(cells + c * chunk_samples_ + fill_,
+                cells + (c + 1) * chunk_samples_, 0);
+    ok = write_chunk();
+  }
+
+  uint64_t offset = file_bytes();
+  ColumnarTrailer trailer{};
+  trailer.index_offset = offset;
+  trailer.n_chunks = static_cast<uint32_t>(index_.size());
+  std::memcpy(trailer.magic, COLUMNAR_END_MAGIC, 4);
+  const size_t index_bytes = index_.size() * sizeof(ColumnarIndexEntry);
+  ok = pwrite_all(fd_, COLUMNAR_INDEX_MAGIC, 4, offset) && ok;
+  ok = pwrite_all(fd_, index_.data(), index_bytes, offset + 4) && ok;
+  ok = pwrite_all(fd_, &trailer, sizeof(trailer), offset + 4 + index_bytes) &&
+       ok;
+
+  ::fdatasync(fd_);
+  ::close(fd_);
+  fd_ = -1;
+  return write_sidecar(true) && ok;
+}
+
+/**
+ * @brief Write <path>.json via a temporary file and rename, so readers never
+ * see a half-written sidecar.
+ */
+bool ColumnarFileWriter::write_sidecar(bool complete) const {
+  const std::string sidecar = path_ + ".json";
+  const std::string tmp = sidecar + ".tmp";
+  {
+    std::ofstream meta(tmp);
+    meta << "{\n"
+         << "  \"format\": \"pm_columnar\",\n"
+         << "  \"format_version\": 1,\n"
+         << "  \"data_file\": \""
+         << std::filesystem::path(path_).filename().string() << "\",\n"
+         << "  \"complete\": " << (complete ? "true" : "false") << ",\n"
+         << "  \"pm_table_version\": " << pm_table_version_ << ",\n"
+         << "  \"byte_order\": \"little\",\n"
+         << "  \"header_bytes\": " << COLUMNAR_HEADER_BYTES << ",\n"
+         << "  \"chunk_bytes\": " << chunk_bytes_ << ",\n"
+         << "  \"chunk_samples\": " << chunk_samples_ << ",\n"
+         << "  \"n_cells\": " << n_cells_ << ",\n"
+         << "  \"n_chunks\": " << index_.size() << ",\n"
+         << "  \"n_samples\": " << (n_samples_ - fill_) << ",\n"
+         << "  \"chunk_layout\": [\n"
+         << "    {\"name\": \"timestamp_ns\", \"dtype\": \"<u8\", "
+         << "\"offset\": 0, \"shape\": [" << chunk_samples_ << "]},\n"
+         << "    {\"name\": \"cells\", \"dtype\": \"<f4\", \"offset\": "
+         << 8 * uint64_t{chunk_samples_} << ", \"shape\": [" << n_cells_
+         << ", " << chunk_samples_ << "]}\n"
+         << "  ]" << (sidecar_extra_.empty() ? "" : ",\n  ")
+         << sidecar_extra_ << "\n"
+         << "}\n";
+    if (!meta)
+      return false;
+  }
+  return std::rename(tmp.c_str(), sidecar.c_str()) == 0;
+}
+
+ColumnarReader::ColumnarReader(const std::string &path) {
+  fd_ = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  struct stat st{};
+  if (fd_ < 0 || ::fstat(fd_, &st) != 0 ||
+      ::pread(fd_, &header_, sizeof(header_), 0) !=
+          static_cast<ssize_t>(sizeof(header_)) ||
+      std::memcmp(header_.magic, COLUMNAR_FILE_MAGIC, 4) != 0 ||
+      header_.chunk_bytes == 0) {
+    SPDLOG_ERROR("{} is not a columnar log.", path);
+    if (fd_ >= 0)
+      ::close(fd_);
+    fd_ = -1;
+    return;
+  }
+  const auto file_size = static_cast<uint64_t>(st.st_size);
+  if (!load_footer(file_size))
+    rebuild_index(file_size);
+}
+
+ColumnarReader::~ColumnarReader() {
+  if (fd_ >= 0)
+    ::close(fd_);
+}
+
+bool ColumnarReader::load_footer(uint64_t file_size) {
+  ColumnarTrailer trailer{};
+  if (file_size < header_.header_bytes + sizeof(trailer) ||
+      ::pread(fd_, &trailer, sizeof(trailer),
+              static_cast<off_t>(file_size - sizeof(trailer))) !=
+          static_cast<ssize_t>(sizeof(trailer)) ||
+      std::memcmp(trailer.magic, COLUMNAR_END_MAGIC, 4) != 0)
+    return false;
+  const uint64_t index_bytes =
+      uint64_t{trailer.n_chunks} * sizeof(ColumnarIndexEntry);
+  if (trailer.index_offset + 4 + index_bytes + sizeof(trailer) != file_size)
+    return false;
+  index_.resize(trailer.n_chunks);
+  return ::pread(fd_, index_.data(), index_bytes,
+                 static_cast<off_t>(trailer.index_offset + 4)) ==
+         static_cast<ssize_t>(index_bytes);
+}
+
+void ColumnarReader::rebuild_index(uint64_t file_size) {
+  const uint64_t n_chunks =
+      (file_size - std::min<uint64_t>(file_size, header_.header_bytes)) /
+      header_.chunk_bytes;
+  index_.clear();
+  for (uint64_t k = 0; k < n_chunks; ++k) {
+    const uint64_t offset = header_.header_bytes + k * header_.chunk_bytes;
+    uint64_t first = 0, last = 0;
+    ::pread(fd_, &first, 8, static_cast<off_t>(offset));
+    ::pread(fd_, &last, 8,
+            static_cast<off_t>(offset + 8 * (header_.chunk_samples - 1)));
+    index_.push_back({offset, first, last, header_.chunk_samples, 0});
+  }
+}
+
+uint64_t ColumnarReader::n_samples() const {
+  uint64_t n = 0;
+  for (const auto &chunk : index_)
+    n += chunk.n_samples;
+  return n;
+}
+
+uint64_t ColumnarReader::first_timestamp_ns() const {
+  return index_.empty() ? 0 : index_.front().first_timestamp_ns;
+}
+
+uint64_t ColumnarReader::last_timestamp_ns() const {
+  return index_.empty() ? 0 : index_.back().last_timestamp_ns;
+}
+
+void ColumnarReader::read_window(uint32_t cell, uint64_t t0_ns,
+                                 uint64_t t1_ns,
+                                 std::vector<uint64_t> &timestamps,
+                                 std::vector<float> &values) const {
+  if (fd_ < 0 || cell >= header_.n_cells)
+    return;
+  const auto first = std::ranges::lower_bound(
+      index_, t0_ns, {}, &ColumnarIndexEntry::last_timestamp_ns);
+  std::vector<uint64_t> ts(header_.chunk_samples);
+  std::vector<float> column(header_.chunk_samples);
+  for (auto it = first; it != index_.end() && it->first_timestamp_ns <= t1_ns;
+       ++it) {
+    const size_t n = it->n_samples;
+    const uint64_t cell_offset =
+        it->offset + 8 * uint64_t{header_.chunk_samples} +
+        4 * uint64_t{cell} * header_.chunk_samples;
+    if (::pread(fd_, ts.data(), 8 * n, static_cast<off_t>(it->offset)) !=
+            static_cast<ssize_t>(8 * n) ||
+        ::pread(fd_, column.data(), 4 * n, static_cast<off_t>(cell_offset)) !=
+            static_cast<ssize_t>(4 * n))
+      return;
+    for (size_t i = 0; i < n; ++i) {
+      if (ts[i] >= t0_ns && ts[i] <= t1_ns) {
+        timestamps.push_back(ts[i]);
+        values.push_back(column[i]);
+      }
+    }
+  }
+}
+
+ColumnarLogWriter::ColumnarLogWriter(const std::string &path,
+                                     uint32_t sample_bytes,
+                                     uint32_t pm_table_version, Config config)
+    : config_{config},
+      ring_{sample_bytes, config.block_samples, config.n_blocks} {
+  if (!ring_)
+    return;
+  file_ = std::make_unique<ColumnarFileWriter>(path, sample_bytes,
+                                               pm_table_version,
+                                               config_.chunk_samples);
+  if (!*file_)
+    return;
+  if (config_.pyramid) {
+    pyramid_ =
+        std::make_unique<PyramidWriter>(path, sample_bytes, pm_table_version);
+    if (!*pyramid_) {
+      SPDLOG_WARN("Failed to create the zoom levels for {}; continuing "
+                  "without them.",
+                  path);
+      pyramid_.reset();
+    }
+  }
+  SPDLOG_INFO("Logging columnar to {} ({} slots of {} samples{}).", path,
+              ring_.n_blocks(), ring_.block_samples(),
+              ring_.locked() ? ", locked" : "");
+  writer_ = std::thread(&ColumnarLogWriter::run_writer, this);
+}
+
+ColumnarLogWriter::~ColumnarLogWriter() { close(); }
+
+bool ColumnarLogWriter::append_record(uint64_t timestamp_ns, const void *blob,
+                                      uint64_t size) noexcept {
+  if (closed_ || !*this || size != ring_.sample_bytes())
+    return false;
+  return ring_.push(timestamp_ns, blob);
+}
+
+void ColumnarLogWriter::close() {
+  if (closed_)
+    return;
+  closed_ = true;
+  ring_.seal();
+  stop_.store(true, std::memory_order_release);
+  if (writer_.joinable())
+    writer_.join();
+  if (file_ && *file_) {
+    file_->close();
+    file_bytes_.store(file_->file_bytes(), std::memory_order_relaxed);
+  }
+  if (pyramid_)
+    pyramid_->close();
+}
+
+ColumnarLogWriter::Stats ColumnarLogWriter::stats() const {
+  Stats s;
+  s.records = ring_.records();
+  s.dropped_records = ring_.dropped();
+  s.stalls = ring_.stalls();
+  s.file_bytes = file_bytes_.load(std::memory_order_relaxed);
+  return s;
+}
+
+void ColumnarLogWriter::run_writer() {
+  if (config_.writer_core >= 0) {
+    cpu_set_t cpuset;
+    CPU_ZERO(&cpuset);
+    CPU_SET(config_.writer_core, &cpuset);
+    if (pthread_setaffinity_np(pthread_self(), sizeof(cpuset), &cpuset) != 0)
+      SPDLOG_WARN("Failed to pin the columnar writer to CPU {}.",
+                  config_.writer_core);
+  }
+
+  auto last_sync = std::chrono::steady_clock::now();
+  ring_.drain(stop_, [&](const SampleBlockRing::Block &block) {
+    file_->add_rows(block.timestamps, block.words, block.n);
+    if (pyramid_)
+      pyramid_->add_rows(block.timestamps, block.words, block.n);
+    file_bytes_.store(file_->file_bytes(), std::memory_order_relaxed);
+
+    if (std::chrono::steady_clock::now() - last_sync >= config_.sync_interval) {
+      file_->sync();
+      last_sync = std::chrono::steady_clock::now();
+    }
+  });
+}
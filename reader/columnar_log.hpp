@@ -0,0 +1,220 @@
+/**
+ * @file columnar_log.hpp
+ * @brief Column-major chunked pm_table recording (.pmcol) for numpy.memmap.
+ *
+ * Layout of a .pmcol file:
+ *  - a 4 KiB header (ColumnarFileHeader, zero padded),
+ *  - chunks of chunk_bytes, chunk_samples * (8 + 4 * n_cells) rounded up
+ *    to a page multiple (columnar_chunk_bytes):
+ *      uint64 timestamps[chunk_samples]
+ *      float  cells[n_cells][chunk_samples]
+ *      zero padding
+ *    the last chunk may be partially filled (zero padded),
+ *  - on clean close, a footer index (ColumnarIndexEntry per chunk) and a
+ *    ColumnarTrailer.
+ *
+ * A JSON sidecar (<path>.json) describes dtype, shape and layout and the
+ * number of valid samples; it is rewritten after every chunk, so it stays
+ * usable after a crash. Chunks are page multiples, so with the header every
+ * chunk starts page aligned and a single structured numpy.memmap over the
+ * chunk area exposes any cell's full-rate series without parsing.
+ */
+
+#pragma once
+#include "sample_block_ring.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+class PyramidWriter;
+
+inline constexpr char COLUMNAR_FILE_MAGIC[4] = {'P', 'M', 'C', '1'};
+inline constexpr char COLUMNAR_INDEX_MAGIC[4] = {'P', 'M', 'C', 'I'};
+inline constexpr char COLUMNAR_END_MAGIC[4] = {'P', 'M', 'C', 'E'};
+inline constexpr uint32_t COLUMNAR_HEADER_BYTES = 4096;
+
+struct ColumnarFileHeader {
+  char magic[4];
+  uint32_t header_bytes;
+  uint32_t chunk_samples;
+  uint32_t n_cells;
+  uint32_t pm_table_version;
+  uint32_t reserved;
+  uint64_t chunk_bytes;
+};
+
+struct ColumnarIndexEntry {
+  uint64_t offset;
+  uint64_t first_timestamp_ns;
+  uint64_t last_timestamp_ns;
+  uint32_t n_samples;
+  uint32_t reserved;
+};
+
+struct ColumnarTrailer {
+  uint64_t index_offset;
+  uint32_t n_chunks;
+  char magic[4];
+};
+
+/** @brief Size of one chunk on disk and of the writer's chunk buffer. */
+uint64_t columnar_chunk_bytes(uint32_t chunk_samples, uint32_t n_cells);
+
+/**
+ * @class ColumnarFileWriter
+ * @brief Synchronous .pmcol writer: transposes row-major samples into chunks.
+ */
+class ColumnarFileWriter {
+public:
+  /**
+   * @param sidecar_extra Optional JSON members (without braces) appended to
+   * the sidecar, e.g. to describe what the cells of a derived file mean.
+   */
+  ColumnarFileWriter(const std::string &path, uint32_t sample_bytes,
+                     uint32_t pm_table_version, uint32_t chunk_samples = 4096,
+                     std::string sidecar_extra = {});
+  ~ColumnarFileWriter();
+
+  ColumnarFileWriter(const ColumnarFileWriter &) = delete;
+  ColumnarFileWriter &operator=(const ColumnarFileWriter &) = delete;
+
+  explicit operator bool() const noexcept { return fd_ >= 0; }
+
+  /** @brief Append n row-major samples (any n). */
+  bool add_rows(const uint64_t *timestamps, const uint32_t *rows, size_t n);
+
+  /** @brief Append one sample. */
+  bool add(uint64_t timestamp_ns, const void *blob) {
+    return add_rows(&timestamp_ns, static_cast<const uint32_t *>(blob), 1);
+  }
+
+  /** @brief fdatasync the data written so far. */
+  bool sync();
+
+  /** @brief Write the partial chunk, footer and final sidecar; close. */
+  bool close();
+
+  uint64_t n_samples() const { return n_samples_; }
+  uint64_t file_bytes() const;
+
+private:
+  bool write_chunk();
+  bool write_sidecar(bool complete) const;
+
+  int fd_ = -1;
+  std::string path_;
+  uint32_t n_cells_;
+  uint32_t chunk_samples_;
+  uint32_t pm_table_version_;
+  uint64_t chunk_bytes_;
+  std::string sidecar_extra_;
+  std::vector<uint8_t> chunk_; ///< Column-major chunk being filled
+  uint32_t fill_ = 0;
+  uint64_t n_samples_ = 0;
+  std::vector<ColumnarIndexEntry> index_;
+};
+
+/**
+ * @class ColumnarReader
+ * @brief Reads single-cell windows of a .pmcol file with bounded I/O.
+ *
+ * Only the timestamp and cell columns of the chunks overlapping the window
+ * are read. Uses the footer index when present; after a crash every chunk
+ * on disk is complete, so the index is rebuilt from the chunk timestamps.
+ */
+class ColumnarReader {
+public:
+  explicit ColumnarReader(const std::string &path);
+  ~ColumnarReader();
+
+  ColumnarReader(const ColumnarReader &) = delete;
+  ColumnarReader &operator=(const ColumnarReader &) = delete;
+
+  explicit operator bool() const noexcept { return fd_ >= 0; }
+
+  uint32_t n_cells() const { return header_.n_cells; }
+  uint32_t pm_table_version() const { return header_.pm_table_version; }
+  const std::vector<ColumnarIndexEntry> &chunks() const { return index_; }
+  uint64_t n_samples() const;
+  uint64_t first_timestamp_ns() const;
+  uint64_t last_timestamp_ns() const;
+
+  /**
+   * @brief Append the samples of cell with t0 <= timestamp <= t1.
+   */
+  void read_window(uint32_t cell, uint64_t t0_ns, uint64_t t1_ns,
+                   std::vector<uint64_t> &timestamps,
+                   std::vector<float> &values) const;
+
+private:
+  bool load_footer(uint64_t file_size);
+  void rebuild_index(uint64_t file_size);
+
+  int fd_ = -1;
+  ColumnarFileHeader header_{};
+  std::vector<ColumnarIndexEntry> index_;
+};
+
+/**
+ * @class ColumnarLogWriter
+ * @brief pm_reader front end: SampleBlockRing plus a writer thread.
+ *
+ * The sampling thread only copies into the ring; the writer thread
+ * transposes full ring blocks into chunks and writes them, and feeds the
+ * same blocks to the zoom-level pyramid.
+ */
+class ColumnarLogWriter {
+public:
+  struct Config {
+    uint32_t chunk_samples = 4096; ///< ~4 s at 1 kHz
+    uint32_t block_samples = 500;  ///< Ring block (hand-over granularity)
+    size_t n_blocks = 16;
+    int writer_core = -1;          ///< Pin the writer thread; -1 = no pin
+    std::chrono::milliseconds sync_interval{1000};
+    bool pyramid = true; ///< Also write the zoom levels (time_pyramid.hpp)
+  };
+
+  struct Stats {
+    uint64_t records = 0;
+    uint64_t dropped_records = 0;
+    uint64_t stalls = 0;
+    uint64_t file_bytes = 0;
+  };
+
+  ColumnarLogWriter(const std::string &path, uint32_t sample_bytes,
+                    uint32_t pm_table_version, Config config);
+  ~ColumnarLogWriter();
+
+  ColumnarLogWriter(const ColumnarLogWriter &) = delete;
+  ColumnarLogWriter &operator=(const ColumnarLogWriter &) = delete;
+
+  explicit operator bool() const noexcept {
+    return file_ && static_cast<bool>(*file_) && ring_;
+  }
+
+  /** @brief Queue one sample; size must equal sample_bytes. Producer only. */
+  bool append_record(uint64_t timestamp_ns, const void *blob,
+                     uint64_t size) noexcept;
+
+  void close();
+
+  Stats stats() const;
+
+private:
+  void run_writer();
+
+  Config config_;
+  SampleBlockRing ring_;
+  std::unique_ptr<ColumnarFileWriter> file_;
+  std::unique_ptr<PyramidWriter> pyramid_;
+  std::atomic<uint64_t> file_bytes_{0};
+  std::atomic<bool> stop_{false};
+  bool closed_ = false;
+  std::thread writer_;
+};
@@ -0,0 +1,235 @@
+/**
+ * @file csv_log_writer.cpp
+ * @brief CsvLogWriter formatting thread.
+ */
+
+#include "csv_log_writer.hpp"
+#include "float_bits.hpp"
+
+#include <bit>
+#include <cerrno>
+#include <charconv>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <filesystem>
+#include <limits>
+#include <spdlog/spdlog.h>
+#include <unistd.h>
+
+using namespace std::chrono_literals;
+
+namespace {
+
+/// Write a partly filled buffer when idle for this long, so a crash loses
+/// little without giving up large writes at full rate.
+constexpr auto IDLE_FLUSH = 1s;
+
+/// Longest to_chars output of a float ("-1.17549435e-38") or int64.
+constexpr size_t MAX_NUMBER_CHARS = 24;
+
+template <typename T> char *put(char *out, T value) {
+  return std::to_chars(out, out + MAX_NUMBER_CHARS, value).ptr;
+}
+
+} // namespace
+
+CsvLogWriter::CsvLogWriter(const std::string &path, Config config)
+    : path_{path}, config_{std::move(config)},
+      ring_{static_cast<uint32_t>(
+                4 * (HEADER_WORDS + config_.columns.size())),
+            config_.block_samples, config_.n_blocks},
+      row_(HEADER_WORDS + config_.columns.size()),
+      max_row_bytes_{(4 + config_.columns.size()) * (MAX_NUMBER_CHARS + 1)} {
+  if (!ring_ || config_.columns.empty())
+    return;
+  header_ = "round,core_id,timestamp_ns,worker_state";
+  for (const int column : config_.columns)
+    header_ += ",v" + std::to_string(column);
+  header_ += '\n';
+  buffer_.resize(std::max(config_.buffer_bytes, 2 * max_row_bytes_));
+  if (!open_next_file())
+    return;
+
+  SPDLOG_INFO("Writing CSV to {} ({} columns, {} slots of {} samples{}).",
+              path_, config_.columns.size(), ring_.n_blocks(),
+              ring_.block_samples(), ring_.locked() ? ", locked" : "");
+  writer_ = std::thread(&CsvLogWriter::run_writer, this);
+}
+
+CsvLogWriter::~CsvLogWriter() { close(); }
+
+bool CsvLogWriter::append(uint64_t timestamp_ns, int round, int core_id,
+                          int worker_state, const float *table,
+                          size_t n_floats) noexcept {
+  // Not operator bool: the writer thread replaces fd_ on a split.
+  if (closed_ || !writer_.joinable())
+    return false;
+  row_[0] = std::bit_cast<uint32_t>(round);
+  row_[1] = std::bit_cast<uint32_t>(core_id);
+  row_[2] = std::bit_cast<uint32_t>(worker_state);
+  uint32_t *cells = row_.data() + HEADER_WORDS;
+  for (size_t i = 0; i < config_.columns.size(); ++i) {
+    const auto column = static_cast<size_t>(config_.columns[i]);
+    cells[i] = std::bit_cast<uint32_t>(
+        column < n_floats ? table[column]
+                          : std::numeric_limits<float>::quiet_NaN());
+  }
+  return ring_.push(timestamp_ns, row_.data());
+}
+
+void CsvLogWriter::close() {
+  if (closed_)
+    return;
+  closed_ = true;
+  ring_.seal();
+  stop_.store(true, std::memory_order_release);
+  if (writer_.joinable())
+    writer_.join();
+  if (fd_ >= 0) {
+    flush();
+    ::close(fd_);
+    fd_ = -1;
+  }
+}
+
+CsvLogWriter::Stats CsvLogWriter::stats() const {
+  Stats s;
+  s.records = ring_.records();
+  s.dropped_records = ring_.dropped();
+  s.stalls = ring_.stalls();
+  s.bytes = bytes_.load(std::memory_order_relaxed);
+  s.files = files_.load(std::memory_order_relaxed);
+  s.max_block_ms = max_block_ms_.load(std::memory_order_relaxed);
+  s.lost_records = lost_.load(std::memory_order_relaxed);
+  s.failed = failed_.load(std::memory_order_relaxed);
+  return s;
+}
+
+/**
+ * @brief Open output.csv, then output.001.csv, ... and write the header.
+ */
+bool CsvLogWriter::open_next_file() {
+  const uint64_t n = files_.load(std::memory_order_relaxed);
+  std::string path = path_;
+  if (n > 0) {
+    const std::filesystem::path base(path_);
+    char suffix[24];
+    std::snprintf(suffix, sizeof(suffix), ".%03llu",
+                  static_cast<unsigned long long>(n));
+    path = (base.parent_path() / base.stem()).string() + suffix +
+           base.extension().string();
+  }
+  const int fd =
+      ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  if (fd < 0) {
+    SPDLOG_ERROR("Failed to open {}: {}", path, std::strerror(errno));
+    return false;
+  }
+  if (fd_ >= 0)
+    ::close(fd_);
+  fd_ = fd;
+  files_.store(n + 1, std::memory_order_relaxed);
+  file_bytes_ = 0;
+  std::memcpy(buffer_.data() + fill_, header_.data(), header_.size());
+  fill_ += header_.size();
+  return true;
+}
+
+bool CsvLogWriter::flush() {
+  if (failed_.load(std::memory_order_relaxed))
+    return false;
+  size_t done = 0;
+  while (done < fill_) {
+    const ssize_t n = ::write(fd_, buffer_.data() + done, fill_ - done);
+    if (n < 0) {
+      if (errno == EINTR)
+        continue;
+      // A partly written buffer may end mid-row; count all of it as lost
+      // and stop, rather than continue after a gap.
+      SPDLOG_ERROR("CSV write failed, no further rows are written: {}",
+                   std::strerror(errno));
+      file_bytes_ += done;
+      bytes_.fetch_add(done, std::memory_order_relaxed);
+      lost_.fetch_add(buffered_rows_, std::memory_order_relaxed);
+      failed_.store(true, std::memory_order_relaxed);
+      fill_ = 0;
+      buffered_rows_ = 0;
+      return false;
+    }
+    done += static_cast<size_t>(n);
+  }
+  file_bytes_ += fill_;
+  bytes_.fetch_add(fill_, std::memory_order_relaxed);
+  fill_ = 0;
+  buffered_rows_ = 0;
+  return true;
+}
+
+void CsvLogWriter::format_block(const SampleBlockRing::Block &block) {
+  const size_t row_words = HEADER_WORDS + config_.columns.size();
+  for (uint32_t r = 0; r < block.n; ++r) {
+    if (failed_.load(std::memory_order_relaxed) ||
+        (fill_ + max_row_bytes_ > buffer_.size() && !flush())) {
+      lost_.fetch_add(block.n - r, std::memory_order_relaxed);
+      return;
+    }
+    if (fill_ == 0) {
+      // Split only between rows, so every file is a complete CSV.
+      // A failed split keeps the previous, complete file and latches the
+      // error like a failed write.
+      if (config_.split_bytes && file_bytes_ >= config_.split_bytes &&
+          !open_next_file()) {
+        failed_.store(true, std::memory_order_relaxed);
+        lost_.fetch_add(block.n - r, std::memory_order_relaxed);
+        return;
+      }
+    }
+    const uint32_t *row = block.words + r * row_words;
+    char *out = buffer_.data() + fill_;
+    out = put(out, std::bit_cast<int32_t>(row[0]));
+    *out++ = ',';
+    out = put(out, std::bit_cast<int32_t>(row[1]));
+    *out++ = ',';
+    out = put(out, block.timestamps[r]);
+    *out++ = ',';
+    out = put(out, std::bit_cast<int32_t>(row[2]));
+    for (size_t c = HEADER_WORDS; c < row_words; ++c) {
+      *out++ = ',';
+      const float value = std::bit_cast<float>(row[c]);
+      if (is_nan(value))
+        continue; // Empty field; pandas reads it as NaN
+      out = put(out, value);
+    }
+    *out++ = '\n';
+    fill_ = static_cast<size_t>(out - buffer_.data());
+    ++buffered_rows_;
+  }
+}
+
+/**
+ * @brief Format full blocks in fill order; write whenever the buffer fills.
+ */
+void CsvLogWriter::run_writer() {
+  auto last_flush = std::chrono::steady_clock::now();
+  // Runs until close() even after a write error, so format_block() counts
+  // every later row as lost.
+  ring_.drain(
+      stop_,
+      [&](const SampleBlockRing::Block &block) {
+        const auto start = std::chrono::steady_clock::now();
+        format_block(block);
+        const double ms = std::chrono::duration<double, std::milli>(
+                              std::chrono::steady_clock::now() - start)
+                              .count();
+        if (ms > max_block_ms_.load(std::memory_order_relaxed))
+          max_block_ms_.store(ms, std::memory_order_relaxed);
+      },
+      [&] {
+        if (fill_ > 0 &&
+            std::chrono::steady_clock::now() - last_flush >= IDLE_FLUSH) {
+          flush();
+          last_flush = std::chrono::steady_clock::now();
+        }
+      });
+}
@@ -0,0 +1,99 @@
+/**
+ * @file csv_log_writer.hpp
+ * @brief Long-format CSV export of pm_measure samples, formatted off the
+ * acquisition path.
+ *
+ * Columns: round, core_id, timestamp_ns, worker_state, vNN... (one per
+ * selected pm_table index), as read by python/plot_measure.py. The producer
+ * only copies the selected cells into a SampleBlockRing; a writer thread
+ * formats whole blocks with std::to_chars into a large reusable buffer and
+ * writes it in multi-MiB chunks. Optionally the output is split into
+ * output.csv, output.001.csv, ... each with its own header.
+ */
+
+#pragma once
+#include "sample_block_ring.hpp"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <thread>
+#include <vector>
+
+/**
+ * @class CsvLogWriter
+ * @brief Single-producer CSV writer; append() never blocks.
+ */
+class CsvLogWriter {
+public:
+  struct Config {
+    std::vector<int> columns;     ///< pm_table float indices, written as vNN
+    uint64_t split_bytes = 0;     ///< Start a new file after this; 0 = never
+    uint32_t block_samples = 250; ///< Ring block (hand-over granularity)
+    size_t n_blocks = 32;         ///< 8 s of backlog at 1 kHz
+    size_t buffer_bytes = 4u << 20;
+  };
+
+  struct Stats {
+    uint64_t records = 0;
+    uint64_t dropped_records = 0;
+    uint64_t stalls = 0;
+    uint64_t bytes = 0;
+    uint64_t files = 0;
+    double max_block_ms = 0.0; ///< Longest format (+ write) of one block
+    /// Rows lost to a write error or a failed split; after the first one
+    /// nothing more is written and the rest of the run counts here.
+    uint64_t lost_records = 0;
+    bool failed = false;
+  };
+
+  CsvLogWriter(const std::string &path, Config config);
+  ~CsvLogWriter();
+
+  CsvLogWriter(const CsvLogWriter &) = delete;
+  CsvLogWriter &operator=(const CsvLogWriter &) = delete;
+
+  explicit operator bool() const noexcept { return fd_ >= 0 && ring_; }
+
+  /**
+   * @brief Queue one sample. Producer thread only.
+   * @param table The full pm_table; selected indices >= n_floats become NaN.
+   */
+  bool append(uint64_t timestamp_ns, int round, int core_id, int worker_state,
+              const float *table, size_t n_floats) noexcept;
+
+  /** @brief Format and write everything queued, then close. */
+  void close();
+
+  Stats stats() const;
+
+private:
+  static constexpr size_t HEADER_WORDS = 3; ///< round, core_id, worker_state
+
+  bool open_next_file();
+  bool flush();
+  void format_block(const SampleBlockRing::Block &block);
+  void run_writer();
+
+  std::string path_;
+  Config config_;
+  SampleBlockRing ring_;
+  std::vector<uint32_t> row_;   ///< Producer scratch: one ring row
+  std::vector<char> buffer_;    ///< Writer-owned output buffer
+  size_t fill_ = 0;
+  size_t buffered_rows_ = 0; ///< Rows in buffer_[0, fill_)
+  size_t max_row_bytes_;
+  std::string header_;
+  int fd_ = -1;
+  uint64_t file_bytes_ = 0;
+
+  std::atomic<uint64_t> bytes_{0};
+  std::atomic<uint64_t> files_{0};
+  std::atomic<double> max_block_ms_{0.0};
+  std::atomic<uint64_t> lost_{0};
+  std::atomic<bool> failed_{false};
+  std::atomic<bool> stop_{false};
+  bool closed_ = false;
+  std::thread writer_;
+};
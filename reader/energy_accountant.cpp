@@ -0,0 +1,248 @@
+#include "energy_accountant.hpp"
+#include "float_bits.hpp"
+
+#include <cmath>
+#include <filesystem>
+#include <fstream>
+#include <limits>
+#include <spdlog/spdlog.h>
+
+namespace {
+
+bool read_sysfs_u64(const std::string &path, uint64_t &value) {
+  std::ifstream file(path);
+  return static_cast<bool>(file >> value);
+}
+
+} // namespace
+
+/**
+ * @brief Locate the package-0 powercap zone, if any.
+ */
+RaplCounter::RaplCounter() {
+  std::error_code ec;
+  const std::filesystem::path root{"/sys/class/powercap"};
+  for (const auto &entry : std::filesystem::directory_iterator(root, ec)) {
+    std::ifstream name_file(entry.path() / "name");
+    std::string name;
+    if (!(name_file >> name) || name != "package-0")
+      continue;
+    uint64_t probe = 0;
+    const auto energy = (entry.path() / "energy_uj").string();
+    if (!read_sysfs_u64(energy, probe)) {
+      SPDLOG_DEBUG("RAPL zone {} is not readable, cross-check disabled.",
+                   entry.path().string());
+      continue;
+    }
+    read_sysfs_u64((entry.path() / "max_energy_range_uj").string(),
+                   max_range_uj_);
+    energy_path_ = energy;
+    break;
+  }
+}
+
+bool RaplCounter::read_uj(uint64_t &value) const {
+  return read_sysfs_u64(energy_path_, value);
+}
+
+/**
+ * @brief Accumulate the counter since the first call, handling wrap-around.
+ *
+ * Must be called at least once per wrap period (minutes at typical package
+ * power) to stay correct.
+ */
+double RaplCounter::joules_since_start() {
+  uint64_t now = 0;
+  if (!available() || !read_uj(now))
+    return std::numeric_limits<double>::quiet_NaN();
+  if (!started_) {
+    started_ = true;
+  } else if (now >= last_uj_) {
+    accumulated_j_ += static_cast<double>(now - last_uj_) * 1e-6;
+  } else if (max_range_uj_ > 0) {
+    accumulated_j_ +=
+        static_cast<double>(max_range_uj_ - last_uj_ + now) * 1e-6;
+  }
+  last_uj_ = now;
+  return accumulated_j_;
+}
+
+EnergyAccountant::EnergyAccountant(const PmTableLayout &layout)
+    : layout_{layout}, previous_core_(layout.n_cores, 0.0f),
+      core_scratch_(layout.n_cores, 0.0) {
+  total_.name = "total";
+  total_.core_joules.assign(layout_.n_cores, 0.0);
+}
+
+int EnergyAccountant::add_dimension(std::string name) {
+  dimensions_.push_back(std::move(name));
+  active_.push_back(-1);
+  booked_.push_back(-1);
+  return static_cast<int>(dimensions_.size()) - 1;
+}
+
+void EnergyAccountant::set_phase(int dimension, std::string_view label) {
+  if (dimension < 0 || dimension >= static_cast<int>(dimensions_.size()))
+    return;
+  if (label.empty()) {
+    active_[dimension] = -1;
+    return;
+  }
+  std::string key = dimensions_[dimension];
+  key += '=';
+  key += label;
+  auto it = phase_index_.find(key);
+  if (it == phase_index_.end()) {
+    PhaseEnergy phase;
+    phase.name = key;
+    phase.core_joules.assign(layout_.n_cores, 0.0);
+    phases_.push_back(std::move(phase));
+    it = phase_index_.emplace(std::move(key),
+                              static_cast<int>(phases_.size()) - 1)
+             .first;
+  }
+  active_[dimension] = it->second;
+}
+
+void EnergyAccountant::book(PhaseEnergy &phase, double dt, double socket_j,
+                            double cpu_j, double soc_j,
+                            const std::vector<double> &core_j, uint64_t work) {
+  phase.duration_s += dt;
+  phase.socket_joules += socket_j;
+  phase.cpu_joules += cpu_j;
+  phase.soc_joules += soc_j;
+  for (size_t i = 0; i < core_j.size(); ++i)
+    phase.core_joules[i] += core_j[i];
+  phase.work += work;
+  ++phase.samples;
+}
+
+/**
+ * @brief Integrate one interval and book it to the phases active at its start.
+ */
+void EnergyAccountant::add_sample(int64_t timestamp_ns,
+                                  std::span<const float> cells,
+                                  uint64_t work_count) {
+  if (cells.size() < layout_.min_floats)
+    return;
+
+  const float socket = cells[layout_.socket_power];
+  const float cpu = cells[layout_.vddcr_cpu_power];
+  const float soc = cells[layout_.vddcr_soc_power];
+
+  if (!has_previous_) {
+    rapl_j_ = rapl_.joules_since_start();
+    rapl_at_start_j_ = rapl_j_;
+    rapl_polled_ns_ = timestamp_ns;
+  } else if (timestamp_ns > previous_ns_) {
+    const double dt = static_cast<double>(timestamp_ns - previous_ns_) * 1e-9;
+    const uint64_t work =
+        work_count >= previous_work_ ? work_count - previous_work_ : 0;
+    if (dt <= max_gap_s) {
+      const double socket_j = 0.5 * (socket + previous_socket_) * dt;
+      const double cpu_j = 0.5 * (cpu + previous_cpu_) * dt;
+      const double soc_j = 0.5 * (soc + previous_soc_) * dt;
+      for (size_t i = 0; i < layout_.n_cores; ++i) {
+        core_scratch_[i] =
+            0.5 * (cells[layout_.core_power + i] + previous_core_[i]) * dt;
+      }
+      book(total_, dt, socket_j, cpu_j, soc_j, core_scratch_, work);
+      for (int id : booked_) {
+        if (id >= 0)
+          book(phases_[id], dt, socket_j, cpu_j, soc_j, core_scratch_, work);
+      }
+    }
+  } else {
+    return; // out of order or duplicate
+  }
+
+  has_previous_ = true;
+  previous_ns_ = timestamp_ns;
+  previous_work_ = work_count;
+  previous_socket_ = socket;
+  previous_cpu_ = cpu;
+  previous_soc_ = soc;
+  for (size_t i = 0; i < layout_.n_cores; ++i)
+    previous_core_[i] = cells[layout_.core_power + i];
+  booked_ = active_;
+
+  // The counter wraps within minutes; poll it here so no wrap is missed
+  // between the first sample and the report.
+  if (timestamp_ns - rapl_polled_ns_ >= RAPL_POLL_NS) {
+    rapl_j_ = rapl_.joules_since_start();
+    rapl_polled_ns_ = timestamp_ns;
+  }
+}
+
+/**
+ * @brief Write the per-phase energy table as CSV.
+ *
+ * Columns: phase, duration_s, samples, socket_j, cpu_j, soc_j, mean_w, work,
+ * j_per_work, core0_j..coreN_j, rapl_j. rapl_j is only filled on the total row
+ * and left empty if RAPL is not readable.
+ */
+bool EnergyAccountant::write_csv(const std::string &path) {
+  std::ofstream out(path);
+  if (!out) {
+    SPDLOG_ERROR("Failed to open energy report {}.", path);
+    return false;
+  }
+  out << "phase,duration_s,samples,socket_j,cpu_j,soc_j,mean_w,work,j_per_work";
+  for (size_t i = 0; i < layout_.n_cores; ++i)
+    out << ",core" << i << "_j";
+  out << ",rapl_j\n";
+
+  const double rapl = rapl_j_ - rapl_at_start_j_;
+  auto write_row = [&](const PhaseEnergy &phase, bool with_rapl) {
+    out << phase.name << ',' << phase.duration_s << ',' << phase.samples << ','
+        << phase.socket_joules << ',' << phase.cpu_joules << ','
+        << phase.soc_joules << ',' << phase.mean_socket_watts() << ','
+        << phase.work << ',' << phase.joules_per_work();
+    for (double joules : phase.core_joules)
+      out << ',' << joules;
+    out << ',';
+    if (with_rapl && !is_nan(rapl))
+      out << rapl;
+    out << '\n';
+  };
+  for (const auto &phase : phases_)
+    write_row(phase, false);
+  write_row(total_, true);
+  return static_cast<bool>(out);
+}
+
+void EnergyAccountant::log_summary() {
+  for (const auto &phase : phases_) {
+    SPDLOG_INFO("{:<24} {:8.2f} s {:10.3f} J {:7.3f} W  work {:>12}  {:.3e} "
+                "J/work",
+                phase.name, phase.duration_s, phase.socket_joules,
+                phase.mean_socket_watts(), phase.work,
+                phase.joules_per_work());
+  }
+  SPDLOG_INFO("{:<24} {:8.2f} s {:10.3f} J {:7.3f} W  (cpu {:.3f} J, soc "
+              "{:.3f} J)",
+              total_.name, total_.duration_s, total_.socket_joules,
+              total_.mean_socket_watts(), total_.cpu_joules,
+              total_.soc_joules);
+  const double rapl = rapl_j_ - rapl_at_start_j_;
+  if (!is_nan(rapl) && total_.socket_joules > 0) {
+    SPDLOG_INFO("RAPL package energy {:.3f} J ({:+.1f}% vs. pm_table).", rapl,
+                100.0 * (rapl / total_.socket_joules - 1.0));
+  }
+}
+
+/**
+ * @brief Drop all accumulated energy; dimensions and active phases are kept.
+ */
+void EnergyAccountant::reset() {
+  for (auto &phase : phases_) {
+    PhaseEnergy cleared;
+    cleared.name = std::move(phase.name);
+    cleared.core_joules.assign(layout_.n_cores, 0.0);
+    phase = std::move(cleared);
+  }
+  total_ = PhaseEnergy{};
+  total_.name = "total";
+  total_.core_joules.assign(layout_.n_cores, 0.0);
+  has_previous_ = false;
+}
@@ -0,0 +1,151 @@
+/**
+ * @file energy_accountant.hpp
+ * @brief Integrates pm_table power channels into energy per experiment phase.
+ *
+ * Power cells (per-core, VDDCR_CPU, VDDCR_SOC, socket) are integrated with the
+ * trapezoidal rule on the real sample timestamps. Each interval between two
+ * samples is booked to every phase that was active at the start of the
+ * interval, one phase per dimension (e.g. worker=busy and marker=3 at the same
+ * time). Work reported by the workload is booked the same way so energy can be
+ * normalised to joules per unit of work.
+ */
+
+#pragma once
+#include "pm_table_layout.hpp"
+
+#include <cstdint>
+#include <map>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/**
+ * @struct PhaseEnergy
+ * @brief Energy and work accumulated while one phase was active.
+ */
+struct PhaseEnergy {
+  std::string name; ///< "<dimension>=<label>", or "total".
+  double duration_s = 0.0;
+  double socket_joules = 0.0;
+  double cpu_joules = 0.0; ///< VDDCR_CPU rail
+  double soc_joules = 0.0; ///< VDDCR_SOC rail
+  std::vector<double> core_joules;
+  uint64_t work = 0;
+  uint64_t samples = 0;
+
+  /** @brief Socket energy per unit of work, 0 if no work was reported. */
+  double joules_per_work() const {
+    return work ? socket_joules / static_cast<double>(work) : 0.0;
+  }
+  /** @brief Mean socket power over the phase. */
+  double mean_socket_watts() const {
+    return duration_s > 0 ? socket_joules / duration_s : 0.0;
+  }
+};
+
+/**
+ * @class RaplCounter
+ * @brief Package energy from the powercap interface, used as a cross-check.
+ *
+ * Looks for a powercap zone named "package-0" (intel-rapl, also used for AMD
+ * RAPL MSRs). Reading energy_uj typically requires root. Counter wrap-around is
+ * handled using max_energy_range_uj.
+ */
+class RaplCounter {
+public:
+  RaplCounter();
+  bool available() const { return !energy_path_.empty(); }
+  /** @brief Energy in joules since the first call; NaN if unavailable. */
+  double joules_since_start();
+
+private:
+  bool read_uj(uint64_t &value) const;
+
+  std::string energy_path_;
+  uint64_t max_range_uj_{0};
+  uint64_t last_uj_{0};
+  double accumulated_j_{0.0};
+  bool started_{false};
+};
+
+/**
+ * @class EnergyAccountant
+ * @brief Trapezoidal energy integration over the pm_table stream, per phase.
+ *
+ * Not thread-safe; feed it from a single thread (the processing thread in
+ * pm_measure, a mutex-guarded pipeline stage in pm_monitor).
+ */
+class EnergyAccountant {
+public:
+  explicit EnergyAccountant(const PmTableLayout &layout);
+
+  /**
+   * @brief Register a phase dimension such as "worker" or "marker".
+   * @return Id to pass to set_phase().
+   */
+  int add_dimension(std::string name);
+
+  /**
+   * @brief Set the active phase of a dimension for the following samples.
+   * @param label Phase label; an empty label means the dimension is inactive.
+   */
+  void set_phase(int dimension, std::string_view label);
+
+  /**
+   * @brief Integrate from the previous sample to this one.
+   *
+   * Samples not newer than the previous one are ignored, gaps longer than
+   * max_gap_s are skipped instead of being bridged.
+   *
+   * @param timestamp_ns Sample time (steady clock).
+   * @param cells The full pm_table as floats.
+   * @param work_count Monotonic work counter of the workload.
+   */
+  void add_sample(int64_t timestamp_ns, std::span<const float> cells,
+                  uint64_t work_count);
+
+  /** @brief All phases seen so far, in order of first appearance. */
+  const std::vector<PhaseEnergy> &phases() const { return phases_; }
+  /** @brief Accumulation over all samples, independent of phases. */
+  const PhaseEnergy &total() const { return total_; }
+
+  /**
+   * @brief Write one CSV row per phase plus a total row (with the RAPL
+   * cross-check, if available, as of the last poll in add_sample()).
+   * @return false if the file could not be written.
+   */
+  bool write_csv(const std::string &path);
+
+  /** @brief Print the per-phase summary through spdlog. */
+  void log_summary();
+
+  void reset();
+
+  double max_gap_s = 1.0;
+
+private:
+  void book(PhaseEnergy &phase, double dt, double socket_j, double cpu_j,
+            double soc_j, const std::vector<double> &core_j, uint64_t work);
+
+  const PmTableLayout &layout_;
+  std::vector<std::string> dimensions_;
+  std::vector<int> active_; ///< Phase id per dimension, -1 when inactive.
+  std::vector<int> booked_; ///< active_ as of the previous sample.
+  std::map<std::string, int, std::less<>> phase_index_;
+  std::vector<PhaseEnergy> phases_;
+  PhaseEnergy total_;
+
+  bool has_previous_{false};
+  int64_t previous_ns_{0};
+  uint64_t previous_work_{0};
+  float previous_socket_{0}, previous_cpu_{0}, previous_soc_{0};
+  std::vector<float> previous_core_;
+  std::vector<double> core_scratch_;
+
+  static constexpr int64_t RAPL_POLL_NS = 1'000'000'000;
+  RaplCounter rapl_;
+  double rapl_at_start_j_{0.0};
+  double rapl_j_{0.0};         ///< Counter as of the last poll.
+  int64_t rapl_polled_ns_{0}; ///< Sample time of the last poll.
+};
@@ -0,0 +1,109 @@
+/**
+ * @file eye_density.cpp
+ * @brief EyeDensity: incremental histogram updates, range rebuilds and the
+ * intensity image.
+ */
+
+#include "eye_density.hpp"
+#include "float_bits.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace {
+
+constexpr float RANGE_MARGIN = 0.1f; // Of the data's span, on each side
+
+} // namespace
+
+EyeDensity::EyeDensity(int time_bins)
+    : time_bins_(time_bins),
+      counts_(static_cast<size_t>(time_bins) * VALUE_BINS, 0) {}
+
+int EyeDensity::value_bin(float value) const {
+  const float position = (value - lo_) * scale_;
+  if (!(position >= 0.0f && position < static_cast<float>(VALUE_BINS)))
+    return -1; // Also NaN
+  return static_cast<int>(position);
+}
+
+void EyeDensity::add(int time_bin, float value) {
+  const int bin = has_range_ ? value_bin(value) : -1;
+  if (bin < 0) {
+    out_of_range_ = true; // Counted by the rebuild
+    return;
+  }
+  ++counts_[static_cast<size_t>(time_bin) * VALUE_BINS + bin];
+}
+
+void EyeDensity::remove(int time_bin, float value) {
+  if (out_of_range_ || !has_range_)
+    return; // The rebuild recounts from what is left
+  const int bin = value_bin(value);
+  if (bin < 0)
+    return;
+  auto &count = counts_[static_cast<size_t>(time_bin) * VALUE_BINS + bin];
+  if (count > 0)
+    --count;
+}
+
+void EyeDensity::clear() {
+  std::ranges::fill(counts_, 0u);
+  has_range_ = false;
+  out_of_range_ = false;
+}
+
+void EyeDensity::rebuild(const std::vector<std::deque<float>> &bins) {
+  float lo = std::numeric_limits<float>::max();
+  float hi = std::numeric_limits<float>::lowest();
+  for (const auto &bin : bins) {
+    for (const float value : bin) {
+      if (is_finite(value)) {
+        lo = std::min(lo, value);
+        hi = std::max(hi, value);
+      }
+    }
+  }
+  std::ranges::fill(counts_, 0u);
+  out_of_range_ = false;
+  has_range_ = lo <= hi;
+  if (!has_range_)
+    return;
+  const float margin =
+      hi > lo ? (hi - lo) * RANGE_MARGIN
+              : std::max(std::abs(lo) * 0.01f, 1e-6f); // Constant so far
+  lo_ = lo - margin;
+  scale_ = VALUE_BINS / (hi - lo + 2.0f * margin);
+
+  const int n = std::min(time_bins_, static_cast<int>(bins.size()));
+  for (int t = 0; t < n; ++t) {
+    for (const float value : bins[t]) {
+      if (const int bin = value_bin(value); bin >= 0)
+        ++counts_[static_cast<size_t>(t) * VALUE_BINS + bin];
+    }
+  }
+}
+
+bool EyeDensity::render(std::vector<uint8_t> &image, float &lo,
+                        float &hi) const {
+  image.clear();
+  if (!has_range_)
+    return false;
+  lo = lo_;
+  hi = lo_ + VALUE_BINS / scale_;
+  const uint32_t max_count = *std::ranges::max_element(counts_);
+  const float norm =
+      max_count > 0 ? 255.0f / std::log1p(static_cast<float>(max_count))
+                    : 0.0f;
+  image.resize(static_cast<size_t>(time_bins_) * VALUE_BINS);
+  for (int t = 0; t < time_bins_; ++t) {
+    const uint32_t *column = &counts_[static_cast<size_t>(t) * VALUE_BINS];
+    for (int v = 0; v < VALUE_BINS; ++v) {
+      const float intensity = std::log1p(static_cast<float>(column[v])) * norm;
+      image[static_cast<size_t>(VALUE_BINS - 1 - v) * time_bins_ + t] =
+          static_cast<uint8_t>(intensity + 0.5f);
+    }
+  }
+  return true;
+}
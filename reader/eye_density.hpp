@@ -0,0 +1,55 @@
+/**
+ * @file eye_density.hpp
+ * @brief Persistence-style eye diagrams: for one sensor, a 2D histogram of
+ * the accumulated traces over (time bin, value bin).
+ *
+ * The processing thread keeps it in step with the accumulation, adding each
+ * value pushed into a time bin and removing each value dropped from it, so
+ * an update costs one increment per value regardless of the trace count.
+ * The value range adapts: a value outside it marks the histogram for a
+ * rebuild from the accumulation with a fresh range, which publish_display()
+ * also requests periodically so the range can shrink again.
+ */
+
+#pragma once
+#include <cstdint>
+#include <deque>
+#include <vector>
+
+class EyeDensity {
+public:
+  static constexpr int VALUE_BINS = 64;
+
+  explicit EyeDensity(int time_bins);
+
+  void add(int time_bin, float value);
+  void remove(int time_bin, float value);
+  void clear();
+
+  /**
+   * @brief A value fell outside the range since the last rebuild, or there
+   * is no range yet (e.g. after a resume filled the accumulation).
+   */
+  bool needs_rebuild() const noexcept { return out_of_range_ || !has_range_; }
+
+  /** @brief Range from @p bins (one deque per time bin), then recount. */
+  void rebuild(const std::vector<std::deque<float>> &bins);
+
+  /**
+   * @brief The histogram as 8-bit intensities, log scaled to the fullest
+   * cell: VALUE_BINS rows (highest values first) of time_bins columns.
+   * @param lo Value at the bottom edge of the image.
+   * @param hi Value at the top edge of the image.
+   * @return false while there is no range yet (no image).
+   */
+  bool render(std::vector<uint8_t> &image, float &lo, float &hi) const;
+
+private:
+  int value_bin(float value) const;
+
+  int time_bins_;
+  bool has_range_ = false;
+  bool out_of_range_ = false;
+  float lo_ = 0.0f, scale_ = 0.0f; // value_bin = (value - lo_) * scale_
+  std::vector<uint32_t> counts_;   // [time bin][value bin]
+};
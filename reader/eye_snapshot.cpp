@@ -0,0 +1,230 @@
+/**
+ * @file eye_snapshot.cpp
+ * @brief .pmes serialization and the EyeSnapshotWriter thread.
+ */
+
+#include "eye_snapshot.hpp"
+#include "shared_data_types.hpp"
+
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <numeric>
+#include <spdlog/spdlog.h>
+
+using namespace std::chrono_literals;
+
+namespace {
+
+constexpr auto POLL_INTERVAL = 5ms;
+
+int64_t steady_now_ns() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+template <typename T>
+void write_array(std::ofstream &out, const std::vector<T> &v) {
+  out.write(reinterpret_cast<const char *>(v.data()),
+            static_cast<std::streamsize>(v.size() * sizeof(T)));
+}
+
+template <typename T>
+bool read_array(std::ifstream &in, std::vector<T> &v, size_t n) {
+  v.resize(n);
+  in.read(reinterpret_cast<char *>(v.data()),
+          static_cast<std::streamsize>(n * sizeof(T)));
+  return static_cast<bool>(in);
+}
+
+} // namespace
+
+bool write_eye_snapshot(const std::string &path, const EyeSnapshot &snapshot) {
+  EyeSnapshotHeader header{};
+  std::memcpy(header.magic, EYE_SNAPSHOT_MAGIC, 4);
+  header.format_version = EYE_SNAPSHOT_FORMAT_VERSION;
+  header.n_floats = snapshot.n_floats;
+  header.pm_table_version = snapshot.pm_table_version;
+  header.n_interesting = static_cast<uint32_t>(snapshot.interesting.size());
+  header.window_before_ms = snapshot.window_before_ms;
+  header.window_after_ms = snapshot.window_after_ms;
+  header.trim_percent = snapshot.trim_percent;
+  header.max_accumulations = snapshot.max_accumulations;
+  header.core = snapshot.core;
+  header.n_samples = snapshot.n_samples;
+  header.n_windows = snapshot.n_windows;
+  header.n_values = snapshot.values.size();
+
+  const std::string tmp_path = path + ".tmp";
+  {
+    std::ofstream out(tmp_path, std::ios::binary | std::ios::trunc);
+    out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    write_array(out, snapshot.interesting);
+    write_array(out, snapshot.counts);
+    write_array(out, snapshot.values);
+    if (!out) {
+      SPDLOG_ERROR("Failed to write eye snapshot {}.", tmp_path);
+      return false;
+    }
+  }
+  if (std::rename(tmp_path.c_str(), path.c_str()) != 0) {
+    SPDLOG_ERROR("Failed to rename {} to {}: {}", tmp_path, path,
+                 std::strerror(errno));
+    return false;
+  }
+  return true;
+}
+
+bool read_eye_snapshot(const std::string &path, EyeSnapshot &snapshot) {
+  std::ifstream in(path, std::ios::binary);
+  EyeSnapshotHeader header{};
+  in.read(reinterpret_cast<char *>(&header), sizeof(header));
+  if (!in || std::memcmp(header.magic, EYE_SNAPSHOT_MAGIC, 4) != 0) {
+    SPDLOG_ERROR("{} is not an eye snapshot.", path);
+    return false;
+  }
+  if (header.format_version != EYE_SNAPSHOT_FORMAT_VERSION) {
+    SPDLOG_ERROR("{}: unsupported snapshot format {} (expected {}).", path,
+                 header.format_version, EYE_SNAPSHOT_FORMAT_VERSION);
+    return false;
+  }
+  if (header.n_floats == 0 || header.n_floats > PM_TABLE_MAX_FLOATS ||
+      header.window_before_ms < 0 ||
+      header.window_before_ms > EYE_SNAPSHOT_MAX_WINDOW_MS ||
+      header.window_after_ms <= 0 ||
+      header.window_after_ms > EYE_SNAPSHOT_MAX_WINDOW_MS ||
+      header.n_interesting > header.n_floats) {
+    SPDLOG_ERROR("{}: inconsistent snapshot header.", path);
+    return false;
+  }
+  // The arrays must fill the rest of the file exactly; checked before any
+  // allocation, so a corrupt header cannot request gigabytes.
+  std::error_code ec;
+  const uint64_t file_bytes = std::filesystem::file_size(path, ec);
+  const uint64_t n_counts_total =
+      uint64_t{header.n_interesting} *
+      static_cast<uint64_t>(header.window_before_ms + header.window_after_ms);
+  const uint64_t array_bytes =
+      file_bytes - std::min<uint64_t>(file_bytes, sizeof(header));
+  const uint64_t n_words =
+      uint64_t{header.n_interesting} + n_counts_total + header.n_values;
+  if (ec || header.n_values > array_bytes / 4 || n_words * 4 != array_bytes) {
+    SPDLOG_ERROR("{} is truncated or corrupt.", path);
+    return false;
+  }
+  snapshot.n_floats = header.n_floats;
+  snapshot.pm_table_version = header.pm_table_version;
+  snapshot.window_before_ms = header.window_before_ms;
+  snapshot.window_after_ms = header.window_after_ms;
+  snapshot.trim_percent = header.trim_percent;
+  snapshot.max_accumulations = header.max_accumulations;
+  snapshot.core = header.core;
+  snapshot.n_samples = header.n_samples;
+  snapshot.n_windows = header.n_windows;
+
+  const size_t n_counts = size_t{header.n_interesting} *
+                          static_cast<size_t>(snapshot.n_bins());
+  if (!read_array(in, snapshot.interesting, header.n_interesting) ||
+      !read_array(in, snapshot.counts, n_counts) ||
+      std::accumulate(snapshot.counts.begin(), snapshot.counts.end(),
+                      uint64_t{0}) != header.n_values ||
+      !read_array(in, snapshot.values, header.n_values)) {
+    SPDLOG_ERROR("{} is truncated or corrupt.", path);
+    return false;
+  }
+  for (const int index : snapshot.interesting) {
+    if (index < 0 || static_cast<uint32_t>(index) >= header.n_floats) {
+      SPDLOG_ERROR("{}: sensor index {} out of range.", path, index);
+      return false;
+    }
+  }
+  return true;
+}
+
+EyeSnapshotWriter::EyeSnapshotWriter(std::string path, double interval_seconds)
+    : path_{std::move(path)},
+      interval_ns_{static_cast<int64_t>(interval_seconds * 1e9)},
+      next_due_ns_{steady_now_ns() + interval_ns_} {
+  writer_ = std::thread(&EyeSnapshotWriter::run_writer, this);
+}
+
+EyeSnapshotWriter::~EyeSnapshotWriter() { close(); }
+
+bool EyeSnapshotWriter::due() {
+  if (interval_ns_ <= 0)
+    return false;
+  const int64_t now = steady_now_ns();
+  if (now < next_due_ns_)
+    return false;
+  next_due_ns_ = now + interval_ns_;
+  return true;
+}
+
+EyeSnapshot *EyeSnapshotWriter::acquire(bool wait) {
+  while (busy_.load(std::memory_order_acquire)) {
+    if (!wait || !writer_.joinable()) {
+      skipped_.fetch_add(1, std::memory_order_relaxed);
+      return nullptr;
+    }
+    std::this_thread::sleep_for(POLL_INTERVAL);
+  }
+  busy_.store(true, std::memory_order_relaxed);
+  return &staging_;
+}
+
+void EyeSnapshotWriter::publish() {
+  pending_.store(true, std::memory_order_release);
+}
+
+void EyeSnapshotWriter::close() {
+  stop_.store(true, std::memory_order_release);
+  if (writer_.joinable())
+    writer_.join();
+}
+
+EyeSnapshotWriter::Stats EyeSnapshotWriter::stats() const {
+  Stats s;
+  s.written = written_.load(std::memory_order_relaxed);
+  s.skipped = skipped_.load(std::memory_order_relaxed);
+  s.failed = failed_.load(std::memory_order_relaxed);
+  s.last_write_ms = last_write_ms_.load(std::memory_order_relaxed);
+  return s;
+}
+
+/**
+ * @brief Write each published snapshot; a pending one is still written after
+ * close() so the final snapshot on exit is not lost.
+ */
+void EyeSnapshotWriter::run_writer() {
+  while (true) {
+    // Read stop_ before pending_: a publish() followed by close() is then
+    // seen as pending on this pass or the next.
+    const bool stopping = stop_.load(std::memory_order_acquire);
+    if (!pending_.load(std::memory_order_acquire)) {
+      if (stopping)
+        break;
+      std::this_thread::sleep_for(POLL_INTERVAL);
+      continue;
+    }
+    const auto start = std::chrono::steady_clock::now();
+    if (write_eye_snapshot(path_, staging_)) {
+      written_.fetch_add(1, std::memory_order_relaxed);
+      const double ms = std::chrono::duration<double, std::milli>(
+                            std::chrono::steady_clock::now() - start)
+                            .count();
+      last_write_ms_.store(ms, std::memory_order_relaxed);
+      SPDLOG_INFO("Eye snapshot written to {} ({} windows, {:.1f} MiB, "
+                  "{:.0f} ms).",
+                  path_, staging_.n_windows,
+                  staging_.values.size() * sizeof(float) / 1048576.0, ms);
+    } else {
+      failed_.fetch_add(1, std::memory_order_relaxed);
+    }
+    pending_.store(false, std::memory_order_relaxed);
+    busy_.store(false, std::memory_order_release);
+  }
+}
@@ -0,0 +1,132 @@
+/**
+ * @file eye_snapshot.hpp
+ * @brief Save and restore pm_measure's eye-diagram accumulation.
+ *
+ * A `.pmes` snapshot holds everything the processing thread needs to resume
+ * accumulating, or the GUI needs to show the result without hardware: the
+ * eye configuration, the interesting cells, the core under test, the
+ * counters, and every bin's accumulated values (oldest first).
+ *
+ * Layout (little endian): a 64-byte EyeSnapshotHeader, then
+ * int32 interesting[n_interesting], uint32 counts[n_interesting][n_bins],
+ * float values[sum(counts)] in the same order.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <thread>
+#include <vector>
+
+inline constexpr char EYE_SNAPSHOT_MAGIC[4] = {'P', 'M', 'E', 'S'};
+inline constexpr uint32_t EYE_SNAPSHOT_FORMAT_VERSION = 1;
+/// Longest window_before_ms / window_after_ms a snapshot may declare.
+inline constexpr int32_t EYE_SNAPSHOT_MAX_WINDOW_MS = 60'000;
+
+struct EyeSnapshotHeader {
+  char magic[4];
+  uint32_t format_version;
+  uint32_t n_floats;
+  uint32_t pm_table_version;
+  uint32_t n_interesting;
+  int32_t window_before_ms;
+  int32_t window_after_ms;
+  float trim_percent;
+  int32_t max_accumulations;
+  int32_t core;
+  uint64_t n_samples;
+  uint64_t n_windows;
+  uint64_t n_values; ///< sum(counts); the arrays must fill the file exactly
+};
+static_assert(sizeof(EyeSnapshotHeader) == 64);
+
+/**
+ * @struct EyeSnapshot
+ * @brief In-memory form of a `.pmes` file.
+ */
+struct EyeSnapshot {
+  uint32_t n_floats = 0;
+  uint32_t pm_table_version = 0;
+  int window_before_ms = 50;
+  int window_after_ms = 150;
+  float trim_percent = 10.0f;
+  int max_accumulations = 30;
+  int core = -1;
+  uint64_t n_samples = 0;
+  uint64_t n_windows = 0;
+  std::vector<int> interesting;  ///< pm_table index per accumulated sensor
+  std::vector<uint32_t> counts;  ///< [sensor][bin]
+  std::vector<float> values;     ///< Bin contents, concatenated
+
+  int n_bins() const { return window_before_ms + window_after_ms; }
+};
+
+/** @brief Write via a temporary file and rename, so a crash keeps the old one. */
+bool write_eye_snapshot(const std::string &path, const EyeSnapshot &snapshot);
+
+/** @brief Read and validate a snapshot; logs the reason on failure. */
+bool read_eye_snapshot(const std::string &path, EyeSnapshot &snapshot);
+
+/**
+ * @class EyeSnapshotWriter
+ * @brief Writes snapshots on its own thread, double-buffered.
+ *
+ * The processing thread copies its accumulation into the staging snapshot
+ * returned by acquire() and hands it over with publish(); the writer thread
+ * serializes it while accumulation continues. If the previous snapshot is
+ * still being written, acquire() returns null and the request is skipped
+ * rather than stalling the processing thread.
+ */
+class EyeSnapshotWriter {
+public:
+  struct Stats {
+    uint64_t written = 0;
+    uint64_t skipped = 0; ///< Requests while a write was in flight
+    uint64_t failed = 0;
+    double last_write_ms = 0.0;
+  };
+
+  /** @param interval_seconds Periodic snapshots (0 = on demand and on exit only). */
+  EyeSnapshotWriter(std::string path, double interval_seconds);
+  ~EyeSnapshotWriter();
+
+  EyeSnapshotWriter(const EyeSnapshotWriter &) = delete;
+  EyeSnapshotWriter &operator=(const EyeSnapshotWriter &) = delete;
+
+  /** @brief True when a periodic snapshot is due. Processing thread only. */
+  bool due();
+
+  /**
+   * @brief Staging snapshot to fill, or null while a write is in flight.
+   * @param wait Block until the writer is free (final snapshot on exit).
+   */
+  EyeSnapshot *acquire(bool wait = false);
+
+  /** @brief Hand the filled staging snapshot to the writer thread. */
+  void publish();
+
+  /** @brief Finish the pending write and stop the thread. */
+  void close();
+
+  const std::string &path() const { return path_; }
+  Stats stats() const;
+
+private:
+  void run_writer();
+
+  std::string path_;
+  int64_t interval_ns_;
+  int64_t next_due_ns_;
+
+  EyeSnapshot staging_;
+  std::atomic<bool> busy_{false};    ///< staging_ belongs to the writer
+  std::atomic<bool> pending_{false}; ///< staging_ is filled, not yet written
+  std::atomic<bool> stop_{false};
+
+  std::atomic<uint64_t> written_{0}, skipped_{0}, failed_{0};
+  std::atomic<double> last_write_ms_{0.0};
+  std::thread writer_;
+};
@@ -0,0 +1,460 @@
+/**
+ * @file flight_recorder.cpp
+ * @brief FlightRecorder: arena ring, delta encoding and the dump thread.
+ */
+
+#include "flight_recorder.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <ctime>
+#include <fcntl.h>
+#include <filesystem>
+#include <fstream>
+#include <spdlog/fmt/chrono.h>
+#include <spdlog/spdlog.h>
+#include <unistd.h>
+
+using namespace std::chrono_literals;
+
+namespace {
+
+constexpr auto POLL_INTERVAL = 10ms;
+constexpr size_t STAGING_BYTES = 1 << 20;
+constexpr uint64_t RECORDS_PER_PASS = 4096;
+constexpr size_t DELTA_INDEX_FACTOR = 4;
+
+int64_t steady_ns() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+bool write_all(int fd, const char *data, size_t length) {
+  while (length > 0) {
+    const ssize_t n = ::write(fd, data, length);
+    if (n < 0) {
+      if (errno == EINTR)
+        continue;
+      return false;
+    }
+    data += n;
+    length -= static_cast<size_t>(n);
+  }
+  return true;
+}
+
+} // namespace
+
+/// State of the dump currently being written; owned by the writer thread.
+struct FlightRecorder::Dump {
+  bool active = false;
+  int fd = -1;
+  std::string path;
+  std::string reasons;
+  uint64_t trigger_seq = 0;
+  int64_t trigger_steady_ns = 0;
+  uint64_t start_seq = 0; ///< First sample written to the file
+  uint64_t end_seq = 0;   ///< One past the last sample written
+  uint64_t cursor = 0;    ///< Next sample to read (may precede start_seq)
+  uint64_t samples = 0;
+  uint64_t lost = 0;
+  uint64_t first_ts = 0;
+  uint64_t last_ts = 0;
+  uint64_t trigger_ts = 0;
+  std::vector<uint32_t> frame;
+  bool frame_valid = false;
+  std::vector<uint8_t> payload;
+  std::vector<char> staging;
+};
+
+/**
+ * @brief Allocate the arena and index and start the dump thread.
+ *
+ * Allocation failures are logged and leave the recorder disabled
+ * (operator bool() is false, record() and trigger() do nothing).
+ */
+FlightRecorder::FlightRecorder(Config config)
+    : config_{std::move(config)}, n_words_{config_.sample_bytes / 4},
+      bitmap_bytes_{((n_words_ + 31) / 32) * 4},
+      arena_{config_.sample_bytes * to_samples(config_.history_seconds)} {
+  if (!arena_ || config_.sample_bytes == 0) {
+    SPDLOG_ERROR("Flight recorder disabled: no arena for {:.1f} s.",
+                 config_.history_seconds);
+    return;
+  }
+  if (config_.delta && config_.sample_bytes % 4 != 0) {
+    SPDLOG_WARN("pm_table size {} is not a multiple of 4, delta compression "
+                "disabled.",
+                config_.sample_bytes);
+    config_.delta = false;
+  }
+  config_.keyframe_interval = std::max<size_t>(config_.keyframe_interval, 1);
+  if (config_.pre_seconds + config_.post_seconds > config_.history_seconds) {
+    config_.pre_seconds =
+        std::max(0.0, config_.history_seconds - config_.post_seconds);
+    SPDLOG_WARN("Flight recorder pre-trigger window clamped to {:.1f} s.",
+                config_.pre_seconds);
+  }
+
+  arena_size_ = arena_.size();
+  const uint64_t history = to_samples(config_.history_seconds);
+  index_ = std::vector<IndexEntry>(config_.delta ? history * DELTA_INDEX_FACTOR
+                                                 : history);
+  previous_.assign(n_words_, 0);
+  scratch_.assign(bitmap_bytes_ + config_.sample_bytes, 0);
+
+  SPDLOG_INFO("Flight recorder: {:.1f} MiB arena ({}), {:.1f} s history, "
+              "dump window -{:.1f}/+{:.1f} s{}.",
+              arena_size_ / (1024.0 * 1024.0),
+              arena_.locked() ? "locked" : "not locked",
+              config_.history_seconds, config_.pre_seconds,
+              config_.post_seconds, config_.delta ? ", delta" : "");
+
+  writer_ = std::thread(&FlightRecorder::run_writer, this);
+}
+
+FlightRecorder::~FlightRecorder() {
+  stop_.store(true);
+  if (writer_.joinable())
+    writer_.join();
+}
+
+uint64_t FlightRecorder::to_samples(double seconds) const {
+  return static_cast<uint64_t>(std::max(0.0, seconds) *
+                               config_.sample_rate_hz);
+}
+
+/**
+ * @brief Build the stored form of a sample in scratch_.
+ * @return Stored length; for keyframes the caller stores the blob directly.
+ */
+size_t FlightRecorder::encode(const uint32_t *words, bool keyframe) {
+  if (keyframe)
+    return config_.sample_bytes;
+
+  uint8_t *bitmap = scratch_.data();
+  uint8_t *values = scratch_.data() + bitmap_bytes_;
+  std::memset(bitmap, 0, bitmap_bytes_);
+  size_t changed = 0;
+  for (size_t i = 0; i < n_words_; ++i) {
+    if (words[i] != previous_[i]) {
+      bitmap[i >> 3] |= static_cast<uint8_t>(1u << (i & 7));
+      std::memcpy(values + changed * 4, &words[i], 4);
+      ++changed;
+    }
+  }
+  return bitmap_bytes_ + changed * 4;
+}
+
+void FlightRecorder::record(uint64_t timestamp_ns, const void *blob) noexcept {
+  if (!arena_ || index_.empty())
+    return;
+
+  const uint64_t n = next_seq_;
+  const bool keyframe = !config_.delta || n % config_.keyframe_interval == 0;
+  const auto *words = static_cast<const uint32_t *>(blob);
+  const size_t length = encode(words, keyframe);
+  const auto *src = keyframe ? static_cast<const uint8_t *>(blob)
+                             : scratch_.data();
+
+  // Seqlock: invalidate the index slot and claim the arena bytes before
+  // overwriting them, publish afterwards.
+  IndexEntry &entry = index_[n % index_.size()];
+  const uint64_t pos = write_pos_;
+  entry.seq.store(0, std::memory_order_relaxed);
+  reserved_end_.store(pos + length, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+
+  auto *arena = static_cast<uint8_t *>(arena_.data());
+  const size_t offset = pos % arena_size_;
+  const size_t first = std::min(length, arena_size_ - offset);
+  std::memcpy(arena + offset, src, first);
+  std::memcpy(arena, src + first, length - first);
+
+  entry.timestamp_ns = timestamp_ns;
+  entry.pos = pos;
+  entry.length = static_cast<uint32_t>(length);
+  entry.keyframe = keyframe;
+  entry.seq.store(n + 1, std::memory_order_release);
+  published_.store(n + 1, std::memory_order_release);
+
+  write_pos_ = pos + length;
+  next_seq_ = n + 1;
+  if (config_.delta)
+    std::memcpy(previous_.data(), blob, n_words_ * 4);
+
+  bytes_in_ += config_.sample_bytes;
+  bytes_stored_ += length;
+  if (n % 1024 == 0) {
+    compression_ratio_.store(static_cast<double>(bytes_in_) /
+                                 static_cast<double>(bytes_stored_),
+                             std::memory_order_relaxed);
+  }
+}
+
+void FlightRecorder::trigger(const char *reason) noexcept {
+  if (!arena_)
+    return;
+  int expected = 0;
+  if (!trigger_state_.compare_exchange_strong(expected, 1,
+                                              std::memory_order_acq_rel)) {
+    // A trigger is already waiting for the writer; this one falls into the
+    // same window.
+    coalesced_.fetch_add(1, std::memory_order_relaxed);
+    return;
+  }
+  trigger_seq_ = published_.load(std::memory_order_acquire);
+  trigger_steady_ns_ = steady_ns();
+  std::strncpy(trigger_reason_.data(), reason ? reason : "",
+               trigger_reason_.size() - 1);
+  trigger_reason_.back() = '\0';
+  trigger_state_.store(2, std::memory_order_release);
+}
+
+FlightRecorder::Stats FlightRecorder::stats() const {
+  Stats s;
+  s.recorded = published_.load(std::memory_order_relaxed);
+  s.dumps = dumps_.load(std::memory_order_relaxed);
+  s.coalesced_triggers = coalesced_.load(std::memory_order_relaxed);
+  s.lost_samples = lost_.load(std::memory_order_relaxed);
+  s.last_latency_ms = last_latency_ms_.load(std::memory_order_relaxed);
+  s.compression_ratio = compression_ratio_.load(std::memory_order_relaxed);
+  s.dumping = dumping_.load(std::memory_order_relaxed);
+  return s;
+}
+
+void FlightRecorder::copy_out(uint64_t pos, void *dst, size_t length) const {
+  const auto *arena = static_cast<const uint8_t *>(arena_.data());
+  const size_t offset = pos % arena_size_;
+  const size_t first = std::min(length, arena_size_ - offset);
+  std::memcpy(dst, arena + offset, first);
+  std::memcpy(static_cast<uint8_t *>(dst) + first, arena, length - first);
+}
+
+/**
+ * @brief Copy record n out of the ring.
+ * @return false if it was overwritten (or not yet written).
+ */
+bool FlightRecorder::read_record(uint64_t n, Record &record,
+                                 std::vector<uint8_t> &payload) {
+  const IndexEntry &entry = index_[n % index_.size()];
+  if (entry.seq.load(std::memory_order_acquire) != n + 1)
+    return false;
+  record = {entry.timestamp_ns, entry.pos, entry.length, entry.keyframe != 0};
+  if (record.length > payload.size())
+    return false;
+  copy_out(record.pos, payload.data(), record.length);
+
+  std::atomic_thread_fence(std::memory_order_acquire);
+  if (entry.seq.load(std::memory_order_relaxed) != n + 1)
+    return false;
+  return reserved_end_.load(std::memory_order_relaxed) - record.pos <=
+         arena_size_;
+}
+
+bool FlightRecorder::start_dump(Dump &dump) {
+  std::error_code ec;
+  std::filesystem::create_directories(config_.directory, ec);
+  const uint64_t number = dumps_.load() + 1;
+  dump.path =
+      fmt::format("{}/{}_{:%Y%m%d_%H%M%S}_{}.bin", config_.directory,
+                  config_.prefix, fmt::localtime(std::time(nullptr)), number);
+  dump.fd = ::open(dump.path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC,
+                   0644);
+  if (dump.fd < 0) {
+    SPDLOG_ERROR("Flight recorder: cannot create {}: {}", dump.path,
+                 std::strerror(errno));
+    return false;
+  }
+
+  const uint64_t pre = to_samples(config_.pre_seconds);
+  dump.start_seq = dump.trigger_seq > pre ? dump.trigger_seq - pre : 0;
+  dump.end_seq = dump.trigger_seq + to_samples(config_.post_seconds);
+  // Delta records can only be decoded from the preceding keyframe.
+  dump.cursor =
+      dump.start_seq - dump.start_seq % (config_.delta
+                                             ? config_.keyframe_interval
+                                             : 1);
+  dump.samples = dump.lost = dump.first_ts = dump.last_ts = 0;
+  dump.trigger_ts = 0;
+  dump.frame.assign(n_words_, 0);
+  dump.frame_valid = false;
+  dump.payload.assign(bitmap_bytes_ + config_.sample_bytes, 0);
+  dump.staging.clear();
+  dump.staging.reserve(STAGING_BYTES + config_.sample_bytes + 16);
+  dump.active = true;
+  dumping_.store(true);
+  SPDLOG_INFO("Flight recorder triggered ({}), writing {}.", dump.reasons,
+              dump.path);
+  return true;
+}
+
+/**
+ * @brief Read and write out what the producer has published so far.
+ * @return true if any record was processed.
+ */
+bool FlightRecorder::advance_dump(Dump &dump) {
+  const uint64_t available = published_.load(std::memory_order_acquire);
+  const uint64_t limit =
+      std::min({available, dump.end_seq, dump.cursor + RECORDS_PER_PASS});
+  if (dump.cursor >= limit)
+    return false;
+
+  const uint64_t keyframe_interval =
+      config_.delta ? config_.keyframe_interval : 1;
+  Record record{};
+  while (dump.cursor < limit) {
+    const uint64_t n = dump.cursor;
+    if (!read_record(n, record, dump.payload)) {
+      // Overwritten before we got to it: resume at the next keyframe.
+      const uint64_t next = (n / keyframe_interval + 1) * keyframe_interval;
+      const uint64_t from = std::max(n, dump.start_seq);
+      const uint64_t to = std::min(next, dump.end_seq);
+      if (to > from)
+        dump.lost += to - from;
+      dump.cursor = next;
+      dump.frame_valid = false;
+      continue;
+    }
+    ++dump.cursor;
+
+    if (record.keyframe) {
+      std::memcpy(dump.frame.data(), dump.payload.data(), n_words_ * 4);
+      dump.frame_valid = true;
+    } else if (dump.frame_valid) {
+      const uint8_t *bitmap = dump.payload.data();
+      const uint8_t *values = dump.payload.data() + bitmap_bytes_;
+      size_t k = 0;
+      for (size_t i = 0; i < n_words_; ++i) {
+        if (bitmap[i >> 3] & (1u << (i & 7)))
+          std::memcpy(&dump.frame[i], values + 4 * k++, 4);
+      }
+    }
+    if (n < dump.start_seq || !dump.frame_valid)
+      continue;
+
+    const uint64_t size = config_.sample_bytes;
+    const auto *frame = reinterpret_cast<const char *>(dump.frame.data());
+    const auto *ts = reinterpret_cast<const char *>(&record.timestamp_ns);
+    const auto *sz = reinterpret_cast<const char *>(&size);
+    dump.staging.insert(dump.staging.end(), ts, ts + sizeof(uint64_t));
+    dump.staging.insert(dump.staging.end(), sz, sz + sizeof(uint64_t));
+    dump.staging.insert(dump.staging.end(), frame, frame + size);
+
+    if (dump.samples == 0)
+      dump.first_ts = record.timestamp_ns;
+    if (n + 1 == std::max<uint64_t>(dump.trigger_seq, 1))
+      dump.trigger_ts = record.timestamp_ns;
+    dump.last_ts = record.timestamp_ns;
+    ++dump.samples;
+
+    if (dump.staging.size() >= STAGING_BYTES) {
+      if (!write_all(dump.fd, dump.staging.data(), dump.staging.size()))
+        SPDLOG_ERROR("Flight recorder: write to {} failed: {}", dump.path,
+                     std::strerror(errno));
+      dump.staging.clear();
+    }
+  }
+  return true;
+}
+
+void FlightRecorder::finish_dump(Dump &dump) {
+  if (!dump.staging.empty() &&
+      !write_all(dump.fd, dump.staging.data(), dump.staging.size())) {
+    SPDLOG_ERROR("Flight recorder: write to {} failed: {}", dump.path,
+                 std::strerror(errno));
+  }
+  dump.staging.clear();
+  ::fdatasync(dump.fd);
+  ::close(dump.fd);
+  dump.fd = -1;
+
+  const double latency_ms =
+      static_cast<double>(steady_ns() - dump.trigger_steady_ns) * 1e-6;
+  last_latency_ms_.store(latency_ms);
+  lost_.fetch_add(dump.lost);
+  dumps_.fetch_add(1);
+
+  // Reasons are free text from callers; keep the JSON valid.
+  std::string reasons = dump.reasons;
+  std::ranges::replace_if(
+      reasons, [](char c) { return c == '"' || c == '\\' || c < 0x20; }, '_');
+
+  std::ofstream meta(dump.path + ".json");
+  meta << "{\n"
+       << "  \"format\": \"pm_table_log\",\n"
+       << "  \"reasons\": \"" << reasons << "\",\n"
+       << "  \"trigger_timestamp_ns\": " << dump.trigger_ts << ",\n"
+       << "  \"first_timestamp_ns\": " << dump.first_ts << ",\n"
+       << "  \"last_timestamp_ns\": " << dump.last_ts << ",\n"
+       << "  \"samples\": " << dump.samples << ",\n"
+       << "  \"lost_samples\": " << dump.lost << ",\n"
+       << "  \"pre_seconds\": " << config_.pre_seconds << ",\n"
+       << "  \"post_seconds\": " << config_.post_seconds << ",\n"
+       << "  \"sample_rate_hz\": " << config_.sample_rate_hz << ",\n"
+       << "  \"sample_bytes\": " << config_.sample_bytes << ",\n"
+       << "  \"pm_table_version\": " << config_.pm_table_version << ",\n"
+       << "  \"delta_compressed_ring\": "
+       << (config_.delta ? "true" : "false") << ",\n"
+       << "  \"trigger_to_disk_ms\": " << latency_ms << "\n"
+       << "}\n";
+
+  SPDLOG_INFO("Flight recorder wrote {} samples ({} lost) to {} in {:.0f} ms.",
+              dump.samples, dump.lost, dump.path, latency_ms);
+  dump.active = false;
+  dumping_.store(false);
+}
+
+void FlightRecorder::run_writer() {
+  Dump dump;
+  while (true) {
+    const bool stopping = stop_.load();
+    bool progressed = false;
+
+    if (trigger_state_.load(std::memory_order_acquire) == 2) {
+      const uint64_t seq = trigger_seq_;
+      const int64_t when = trigger_steady_ns_;
+      const std::string reason(trigger_reason_.data());
+      trigger_state_.store(0, std::memory_order_release);
+      progressed = true;
+
+      if (dump.active) {
+        const uint64_t max_end =
+            dump.start_seq + to_samples(config_.max_dump_seconds);
+        dump.end_seq = std::min(
+            std::max(dump.end_seq, seq + to_samples(config_.post_seconds)),
+            max_end);
+        dump.reasons += "; " + reason;
+        coalesced_.fetch_add(1, std::memory_order_relaxed);
+      } else {
+        dump.trigger_seq = seq;
+        dump.trigger_steady_ns = when;
+        dump.reasons = reason;
+        start_dump(dump);
+      }
+    }
+
+    if (dump.active) {
+      if (stopping) {
+        // Shutting down: write what has been recorded and close the file.
+        dump.end_seq = std::min(dump.end_seq,
+                                published_.load(std::memory_order_acquire));
+        while (advance_dump(dump)) {
+        }
+        finish_dump(dump);
+      } else {
+        progressed |= advance_dump(dump);
+        if (dump.cursor >= dump.end_seq)
+          finish_dump(dump);
+      }
+    }
+
+    if (stopping)
+      break;
+    if (!progressed)
+      std::this_thread::sleep_for(POLL_INTERVAL);
+  }
+}
@@ -0,0 +1,150 @@
+/**
+ * @file flight_recorder.hpp
+ * @brief Full-rate ring of raw pm_table samples, dumped to disk on triggers.
+ *
+ * The recorder keeps the last few seconds of raw samples in a preallocated,
+ * mlocked arena (LockedBuffer). Nothing is written to disk until trigger() is
+ * called; then a background thread streams the window [trigger - pre,
+ * trigger + post] into a file in the pm_reader log format
+ * (u64 timestamp_ns, u64 size, blob) plus a JSON sidecar with metadata.
+ */
+
+#pragma once
+#include "locked_buffer.hpp"
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <thread>
+#include <vector>
+
+/**
+ * @class FlightRecorder
+ * @brief Single-producer ring with seqlock-validated readout by a dump thread.
+ *
+ * record() is the acquisition path: it only copies into the locked arena and
+ * updates atomics (no syscalls, no allocation). With delta compression enabled
+ * every sample that is not a keyframe is stored as a change bitmap plus the
+ * changed 32-bit words, which typically stretches the same arena over several
+ * times more history.
+ *
+ * The dump thread starts writing the pre-trigger part immediately and follows
+ * the producer until the post-trigger window is complete, so the time from
+ * trigger to fdatasync() is bounded by post_seconds plus one poll interval and
+ * the write itself. Triggers that arrive while a dump is still collecting
+ * extend it (up to max_dump_seconds) instead of producing a second file.
+ */
+class FlightRecorder {
+public:
+  struct Config {
+    size_t sample_bytes = 0;       ///< pm_table size in bytes
+    double sample_rate_hz = 1000.0;
+    double history_seconds = 10.0; ///< Raw history kept in the arena
+    double pre_seconds = 8.0;      ///< Dumped before the trigger
+    double post_seconds = 2.0;     ///< Dumped after the trigger
+    double max_dump_seconds = 60.0;
+    bool delta = false;            ///< Delta-compress samples in the arena
+    size_t keyframe_interval = 256;
+    uint32_t pm_table_version = 0; ///< Only written to the metadata
+    std::string directory = "results";
+    std::string prefix = "flight";
+  };
+
+  /** @brief Counters for the GUI and log output. */
+  struct Stats {
+    uint64_t recorded = 0;
+    uint64_t dumps = 0;
+    uint64_t coalesced_triggers = 0;
+    uint64_t lost_samples = 0; ///< Overwritten before the dump read them
+    double last_latency_ms = 0.0; ///< Trigger to fdatasync of the last dump
+    double compression_ratio = 1.0;
+    bool dumping = false;
+  };
+
+  explicit FlightRecorder(Config config);
+  ~FlightRecorder();
+
+  FlightRecorder(const FlightRecorder &) = delete;
+  FlightRecorder &operator=(const FlightRecorder &) = delete;
+
+  /** @brief False if the arena could not be allocated. */
+  explicit operator bool() const noexcept { return static_cast<bool>(arena_); }
+
+  /**
+   * @brief Append one sample. Producer thread only.
+   * @param timestamp_ns Wall-clock timestamp (as in pm_table_log.bin).
+   * @param blob Raw pm_table, at least sample_bytes long.
+   */
+  void record(uint64_t timestamp_ns, const void *blob) noexcept;
+
+  /**
+   * @brief Request a dump around the latest recorded sample.
+   *
+   * Safe to call from any thread; does not allocate or block. Only the first
+   * 47 characters of the reason are kept.
+   */
+  void trigger(const char *reason) noexcept;
+
+  Stats stats() const;
+
+private:
+  struct IndexEntry {
+    std::atomic<uint64_t> seq{0}; ///< n + 1 when entry n is valid, 0 while written
+    uint64_t timestamp_ns = 0;
+    uint64_t pos = 0;   ///< Absolute arena byte position
+    uint32_t length = 0;
+    uint32_t keyframe = 0;
+  };
+  struct Record {
+    uint64_t timestamp_ns;
+    uint64_t pos;
+    uint32_t length;
+    bool keyframe;
+  };
+  struct Dump;
+
+  uint64_t to_samples(double seconds) const;
+  size_t encode(const uint32_t *words, bool keyframe);
+  void copy_out(uint64_t pos, void *dst, size_t length) const;
+  bool read_record(uint64_t n, Record &record, std::vector<uint8_t> &payload);
+  void run_writer();
+  bool start_dump(Dump &dump);
+  bool advance_dump(Dump &dump);
+  void finish_dump(Dump &dump);
+
+  Config config_;
+  size_t n_words_;
+  size_t bitmap_bytes_;
+  LockedBuffer arena_;
+  size_t arena_size_ = 0;
+  std::vector<IndexEntry> index_;
+
+  // Producer state.
+  uint64_t next_seq_ = 0;
+  uint64_t write_pos_ = 0;
+  std::vector<uint32_t> previous_;
+  std::vector<uint8_t> scratch_;
+  uint64_t bytes_in_ = 0;
+  uint64_t bytes_stored_ = 0;
+
+  std::atomic<uint64_t> published_{0};    ///< Samples fully recorded
+  std::atomic<uint64_t> reserved_end_{0}; ///< Arena bytes claimed by producer
+
+  // Trigger mailbox: 0 empty, 1 being filled, 2 pending.
+  std::atomic<int> trigger_state_{0};
+  uint64_t trigger_seq_ = 0;
+  int64_t trigger_steady_ns_ = 0;
+  std::array<char, 48> trigger_reason_{};
+
+  std::atomic<uint64_t> dumps_{0};
+  std::atomic<uint64_t> coalesced_{0};
+  std::atomic<uint64_t> lost_{0};
+  std::atomic<double> last_latency_ms_{0.0};
+  std::atomic<double> compression_ratio_{1.0};
+  std::atomic<bool> dumping_{false};
+
+  std::atomic<bool> stop_{false};
+  std::thread writer_;
+};
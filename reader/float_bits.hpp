@@ -0,0 +1,33 @@
+/**
+ * @file float_bits.hpp
+ * @brief NaN and infinity tests that survive -ffast-math.
+ *
+ * Release builds use -ffast-math, which implies -ffinite-math-only: the
+ * compiler may assume no value is NaN or infinite and fold std::isnan and
+ * std::isfinite to constants. These tests look at the exponent bits
+ * instead, which is integer code the flag does not touch.
+ */
+
+#pragma once
+#include <bit>
+#include <cstdint>
+
+/** @brief Not NaN and not infinite; the exponent is not all ones. */
+constexpr bool is_finite(float value) noexcept {
+  return (std::bit_cast<uint32_t>(value) & 0x7f800000u) != 0x7f800000u;
+}
+
+constexpr bool is_finite(double value) noexcept {
+  return (std::bit_cast<uint64_t>(value) & 0x7ff0000000000000u) !=
+         0x7ff0000000000000u;
+}
+
+/** @brief Exponent all ones and a non-zero mantissa. */
+constexpr bool is_nan(float value) noexcept {
+  return (std::bit_cast<uint32_t>(value) & 0x7fffffffu) > 0x7f800000u;
+}
+
+constexpr bool is_nan(double value) noexcept {
+  return (std::bit_cast<uint64_t>(value) & 0x7fffffffffffffffu) >
+         0x7ff0000000000000u;
+}
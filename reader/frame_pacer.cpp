@@ -0,0 +1,114 @@
+/**
+ * @file frame_pacer.cpp
+ * @brief FramePacer: the wait loop, input callbacks and frame statistics.
+ */
+
+#include "frame_pacer.hpp"
+
+#include <GLFW/glfw3.h>
+#include <algorithm>
+#include <spdlog/spdlog.h>
+#include <time.h>
+
+namespace {
+
+constexpr int SETTLE_FRAMES = 3; // Hover and click states after an event
+
+double thread_cpu_seconds() {
+  timespec ts{};
+  clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+  return static_cast<double>(ts.tv_sec) + ts.tv_nsec * 1e-9;
+}
+
+} // namespace
+
+void FramePacer::on_input(GLFWwindow *window) {
+  if (auto *pacer =
+          static_cast<FramePacer *>(glfwGetWindowUserPointer(window)))
+    pacer->input_.store(true, std::memory_order_relaxed);
+}
+
+void FramePacer::attach(GLFWwindow *window) {
+  window_ = window;
+  glfwSetWindowUserPointer(window, this);
+  glfwSetCursorPosCallback(window,
+                           [](GLFWwindow *w, double, double) { on_input(w); });
+  glfwSetMouseButtonCallback(
+      window, [](GLFWwindow *w, int, int, int) { on_input(w); });
+  glfwSetScrollCallback(window,
+                        [](GLFWwindow *w, double, double) { on_input(w); });
+  glfwSetKeyCallback(window,
+                     [](GLFWwindow *w, int, int, int, int) { on_input(w); });
+  glfwSetCharCallback(window, [](GLFWwindow *w, unsigned) { on_input(w); });
+  glfwSetWindowSizeCallback(window,
+                            [](GLFWwindow *w, int, int) { on_input(w); });
+  glfwSetWindowFocusCallback(window, [](GLFWwindow *w, int) { on_input(w); });
+  glfwSetWindowRefreshCallback(window, [](GLFWwindow *w) { on_input(w); });
+  glfwSetCursorEnterCallback(window, [](GLFWwindow *w, int) { on_input(w); });
+  start_time_ = glfwGetTime();
+  start_cpu_ = thread_cpu_seconds();
+}
+
+void FramePacer::wait_for_frame(const std::atomic<uint64_t> &generation) {
+  const double min_interval = 1.0 / std::max(config_.max_fps, 1.0);
+  if (config_.continuous) {
+    glfwPollEvents();
+  } else {
+    for (;;) {
+      if (input_.exchange(false, std::memory_order_relaxed))
+        settle_frames_ = SETTLE_FRAMES;
+      const double now = glfwGetTime();
+      const double since = now - last_frame_;
+      const uint64_t current = generation.load(std::memory_order_acquire);
+      const bool pending = requested_ || settle_frames_ > 0 ||
+                           current != seen_generation_ ||
+                           since >= config_.idle_seconds ||
+                           glfwWindowShouldClose(window_);
+      if (pending && since >= min_interval) {
+        seen_generation_ = current;
+        requested_ = false;
+        if (settle_frames_ > 0)
+          --settle_frames_;
+        break;
+      }
+      // Without anything pending, wake at the cap's rate to look at the
+      // generation counter; producers do not post GLFW events.
+      const double timeout =
+          pending ? min_interval - since
+                  : std::min(min_interval, config_.idle_seconds - since);
+      glfwWaitEventsTimeout(std::max(timeout, 0.0));
+    }
+  }
+  frame_start_ = glfwGetTime();
+  last_frame_ = frame_start_;
+}
+
+void FramePacer::end_frame() {
+  const double frame_s = glfwGetTime() - frame_start_;
+  ++frames_;
+  total_frame_s_ += frame_s;
+  max_frame_s_ = std::max(max_frame_s_, frame_s);
+}
+
+FramePacer::Stats FramePacer::stats() const {
+  Stats stats;
+  stats.frames = frames_;
+  stats.seconds = glfwGetTime() - start_time_;
+  stats.avg_frame_ms = frames_ ? total_frame_s_ / frames_ * 1e3 : 0.0;
+  stats.max_frame_ms = max_frame_s_ * 1e3;
+  stats.cpu_percent = stats.seconds > 0.0
+                          ? (thread_cpu_seconds() - start_cpu_) /
+                                stats.seconds * 100.0
+                          : 0.0;
+  return stats;
+}
+
+void FramePacer::log_stats(const char *name) const {
+  const Stats s = stats();
+  SPDLOG_INFO("{}: {} frames in {:.1f} s ({:.1f} fps{}), frame {:.2f} ms "
+              "avg, {:.2f} ms max, GUI thread CPU {:.1f}%.",
+              name, s.frames, s.seconds,
+              s.seconds > 0.0 ? s.frames / s.seconds : 0.0,
+              config_.continuous ? ", continuous" : "", s.avg_frame_ms,
+              s.max_frame_ms, s.cpu_percent);
+}
@@ -0,0 +1,85 @@
+/**
+ * @file frame_pacer.hpp
+ * @brief Event-driven frame pacing for the GLFW/ImGui GUIs of pm_measure
+ * and pm_monitor.
+ *
+ * Instead of redrawing as fast as the driver allows, the GUI thread sleeps
+ * in glfwWaitEventsTimeout() and draws a frame only when there is input,
+ * when a producer thread has bumped its data generation counter, when the
+ * GUI asks for animation, or once per idle interval (status text, clocks).
+ * New data renders at most max_fps times per second. A GUI that should not
+ * perturb the measurement it shows then costs almost nothing while
+ * nothing changes.
+ */
+
+#pragma once
+#include <atomic>
+#include <cstdint>
+
+struct GLFWwindow;
+
+class FramePacer {
+public:
+  struct Config {
+    double max_fps = 60.0;      ///< Cap for data and input frames
+    double idle_seconds = 1.0;  ///< Redraw at least this often
+    bool continuous = false;    ///< Draw every loop, as before (benchmarks)
+  };
+
+  struct Stats {
+    uint64_t frames = 0;
+    double seconds = 0.0;      ///< Since attach()
+    double avg_frame_ms = 0.0; ///< Build, render and swap of a frame
+    double max_frame_ms = 0.0;
+    double cpu_percent = 0.0; ///< GUI thread CPU time over the run
+  };
+
+  explicit FramePacer(const Config &config) : config_(config) {}
+
+  FramePacer(const FramePacer &) = delete;
+  FramePacer &operator=(const FramePacer &) = delete;
+
+  /**
+   * @brief Register input callbacks on @p window. Call before
+   * ImGui_ImplGlfw_InitForOpenGL(), which chains to them. Uses the window's
+   * user pointer.
+   */
+  void attach(GLFWwindow *window);
+
+  /**
+   * @brief Process events and block until the next frame is due: input,
+   * a change of @p generation, requested animation, the idle interval or
+   * a close request. Starts the frame timer.
+   */
+  void wait_for_frame(const std::atomic<uint64_t> &generation);
+
+  /** @brief After glfwSwapBuffers(): stop the frame timer. */
+  void end_frame();
+
+  /**
+   * @brief Also draw the next frame as soon as the cap allows, e.g. while
+   * a widget is active or a window is being dragged.
+   */
+  void request_frame() { requested_ = true; }
+
+  Stats stats() const;
+  void log_stats(const char *name) const;
+
+private:
+  static void on_input(GLFWwindow *window);
+
+  Config config_;
+  GLFWwindow *window_ = nullptr;
+  std::atomic<bool> input_{false};
+  bool requested_ = false;
+  int settle_frames_ = 0; // ImGui needs a few frames to settle after input
+  uint64_t seen_generation_ = ~uint64_t{0};
+  double start_time_ = 0.0;
+  double last_frame_ = -1e9;
+  double frame_start_ = 0.0;
+  double start_cpu_ = 0.0;
+
+  uint64_t frames_ = 0;
+  double total_frame_s_ = 0.0;
+  double max_frame_s_ = 0.0;
+};
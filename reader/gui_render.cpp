@@ -1,19 +1,294 @@
 // This file contains the UI rendering logic, now decoupled from any data
 // processing.
 
+#include "gui_render.hpp"
+#include "column_list.hpp"
 #include "imgui.h"
+#include "eye_snapshot.hpp"
+#include "flight_recorder.hpp"
 #include "implot.h"
 #include "shared_data_types.hpp"
-#include <algorithm> // For std::find
+#include <GLFW/glfw3.h>
+#include <algorithm>
+#include <array>
 #include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <numeric>
 #include <string>
 #include <vector>
 
+namespace {
+
+constexpr int GRID_COLUMNS = 16;
+constexpr float PLOT_HEIGHT = 80.0f;
+constexpr double RESORT_SECONDS = 1.0; // Activity changes as traces arrive
+
+// Relative swing of the trimmed mean over the eye window.
+float activity(const DisplayData &plot) {
+  if (plot.y_data_mean.empty())
+    return 0.0f;
+  const auto [lo, hi] = std::ranges::minmax(plot.y_data_mean);
+  return (hi - lo) / (std::max(std::abs(lo), std::abs(hi)) + 1e-6f);
+}
+
+// Step of the trimmed mean at the rising worker edge in units of the
+// pre-edge min..max spread: how strongly the sensor follows the worker.
+float edge_response(const DisplayData &plot) {
+  double before = 0.0, after = 0.0, spread = 0.0;
+  int n_before = 0, n_after = 0;
+  for (size_t i = 0; i < plot.x_data.size(); ++i) {
+    if (plot.x_data[i] < 0.0f) {
+      before += plot.y_data_mean[i];
+      spread += plot.y_data_max[i] - plot.y_data_min[i];
+      ++n_before;
+    } else {
+      after += plot.y_data_mean[i];
+      ++n_after;
+    }
+  }
+  if (n_before == 0 || n_after == 0)
+    return 0.0f;
+  return static_cast<float>(std::abs(after / n_after - before / n_before) /
+                            (spread / n_before + 1e-6));
+}
+
+void rebuild_order(
+    EyeGridState &grid,
+    const std::vector<std::atomic<DisplayData *>> &gui_display_pointers,
+    double now) {
+  std::vector<int> selected;
+  grid.filter_valid =
+      grid.filter[0] == '\0' ||
+      parse_column_list(grid.filter, grid.slot.size(), selected);
+  if (grid.filter[0] == '\0') {
+    selected.resize(grid.slot.size());
+    std::iota(selected.begin(), selected.end(), 0);
+  } else if (!grid.filter_valid) {
+    return; // Keep the last order while the list is being typed
+  }
+
+  grid.order.clear();
+  for (const int sensor : selected) {
+    if (!grid.interesting_only || grid.slot[sensor] >= 0)
+      grid.order.push_back(sensor);
+  }
+  grid.dirty = false;
+  grid.sorted_at = now;
+  if (grid.sort == EyeGridState::SORT_INDEX)
+    return;
+
+  // Keys once per sensor, not per comparison; constant sensors last.
+  std::vector<float> key(grid.slot.size(), -1.0f);
+  for (const int sensor : grid.order) {
+    if (grid.slot[sensor] < 0)
+      continue;
+    const DisplayData *plot = gui_display_pointers[grid.slot[sensor]].load(
+        std::memory_order_acquire);
+    if (plot)
+      key[sensor] = grid.sort == EyeGridState::SORT_ACTIVITY
+                        ? activity(*plot)
+                        : edge_response(*plot);
+  }
+  std::ranges::stable_sort(grid.order, [&key](int a, int b) {
+    return key[a] > key[b];
+  });
+}
+
+constexpr ImU32 PLOT_BACKGROUND = IM_COL32(30, 30, 34, 255);
+constexpr ImU32 MEAN_COLOR = IM_COL32(255, 255, 0, 204); // As before: yellow
+constexpr ImU32 BAND_COLOR = IM_COL32(61, 127, 217, 90);  // Min..max
+constexpr float MEAN_HALF_WIDTH = 0.6f;
+
+// Persistence colors for the density intensities: black through blue and
+// cyan to yellow and white, as RGBA bytes.
+const std::array<uint32_t, 256> &density_palette() {
+  static const std::array<uint32_t, 256> palette = [] {
+    constexpr float STOPS[5][3] = {
+        {0, 0, 0}, {0.1f, 0.2f, 0.8f}, {0, 0.9f, 1}, {1, 1, 0}, {1, 1, 1}};
+    std::array<uint32_t, 256> colors{};
+    for (int i = 0; i < 256; ++i) {
+      const float t = i / 255.0f * 4.0f;
+      const int k = std::min(static_cast<int>(t), 3);
+      const float f = t - k;
+      auto channel = [&](int c) {
+        return static_cast<uint32_t>(
+            (STOPS[k][c] + (STOPS[k + 1][c] - STOPS[k][c]) * f) * 255.0f +
+            0.5f);
+      };
+      const uint32_t alpha = i == 0 ? 0 : 255; // Empty cells show through
+      colors[i] = IM_COL32(channel(0), channel(1), channel(2), alpha);
+    }
+    return colors;
+  }();
+  return palette;
+}
+
+// The sensor's density as a texture, uploaded again only when the
+// processing thread has published a new version. 0 without a density.
+ImTextureID density_texture(EyeGridState &grid, int slot,
+                            const DisplayData &plot) {
+  if (plot.density.empty() || plot.density_height <= 0)
+    return ImTextureID{};
+  GLuint &texture = grid.textures[slot];
+  if (texture == 0) {
+    glGenTextures(1, &texture);
+    glBindTexture(GL_TEXTURE_2D, texture);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    grid.texture_versions[slot] = 0;
+  }
+  if (grid.texture_versions[slot] != plot.version) {
+    const auto &palette = density_palette();
+    grid.upload.resize(plot.density.size());
+    for (size_t i = 0; i < plot.density.size(); ++i)
+      grid.upload[i] = palette[plot.density[i]];
+    const int width =
+        static_cast<int>(plot.density.size()) / plot.density_height;
+    glBindTexture(GL_TEXTURE_2D, texture);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, plot.density_height, 0,
+                 GL_RGBA, GL_UNSIGNED_BYTE, grid.upload.data());
+    grid.texture_versions[slot] = plot.version;
+  }
+  return (ImTextureID)(intptr_t)texture;
+}
+
+// A cell's eye drawn straight into the window's draw list, in one batch of
+// vertices: the min..max band and the trimmed mean as quad strips, from the
+// processing thread's normalized data. Costs a few hundred vertices instead
+// of an ImPlot context. With a density texture, the band is replaced by one
+// textured quad of its post-edge part. Returns true when clicked.
+bool draw_mini_plot(const DisplayData &plot, ImTextureID density) {
+  const float cell_width = ImGui::GetContentRegionAvail().x;
+  const bool clicked = ImGui::InvisibleButton(
+      "##EyePlot", ImVec2(std::max(cell_width, 1.0f), PLOT_HEIGHT));
+  const ImVec2 p0 = ImGui::GetItemRectMin();
+  const ImVec2 p1 = ImGui::GetItemRectMax();
+  ImDrawList *draw_list = ImGui::GetWindowDrawList();
+  draw_list->AddRectFilled(p0, p1, PLOT_BACKGROUND);
+
+  const size_t n = plot.norm_x.size();
+  if (n < 2)
+    return clicked;
+  const float width = p1.x - p0.x, height = p1.y - p0.y;
+  auto point = [&](size_t i, float y) {
+    return ImVec2(p0.x + plot.norm_x[i] * width, p1.y - y * height);
+  };
+  const ImVec2 uv = ImGui::GetFontTexUvWhitePixel();
+  auto quad = [&](ImVec2 a, ImVec2 b, ImVec2 c, ImVec2 d, ImU32 color) {
+    const auto base = static_cast<ImDrawIdx>(draw_list->_VtxCurrentIdx);
+    draw_list->PrimWriteVtx(a, uv, color);
+    draw_list->PrimWriteVtx(b, uv, color);
+    draw_list->PrimWriteVtx(c, uv, color);
+    draw_list->PrimWriteVtx(d, uv, color);
+    draw_list->PrimWriteIdx(base);
+    draw_list->PrimWriteIdx(static_cast<ImDrawIdx>(base + 1));
+    draw_list->PrimWriteIdx(static_cast<ImDrawIdx>(base + 2));
+    draw_list->PrimWriteIdx(base);
+    draw_list->PrimWriteIdx(static_cast<ImDrawIdx>(base + 2));
+    draw_list->PrimWriteIdx(static_cast<ImDrawIdx>(base + 3));
+  };
+
+  const int segments = static_cast<int>(n - 1);
+  if (density) {
+    const float u0 = static_cast<float>(plot.window_before_ms) /
+                     (plot.window_before_ms + plot.window_after_ms);
+    draw_list->AddImage(density, p0, p1, ImVec2(u0, 0), ImVec2(1, 1));
+    draw_list->PrimReserve(segments * 6, segments * 4);
+  } else {
+    draw_list->PrimReserve(2 * segments * 6, 2 * segments * 4);
+    for (size_t i = 0; i + 1 < n; ++i) {
+      quad(point(i, plot.norm_max[i]), point(i + 1, plot.norm_max[i + 1]),
+           point(i + 1, plot.norm_min[i + 1]), point(i, plot.norm_min[i]),
+           BAND_COLOR);
+    }
+  }
+  for (size_t i = 0; i + 1 < n; ++i) {
+    const ImVec2 a = point(i, plot.norm_mean[i]);
+    const ImVec2 b = point(i + 1, plot.norm_mean[i + 1]);
+    const float dx = b.x - a.x, dy = b.y - a.y;
+    const float scale =
+        MEAN_HALF_WIDTH / std::max(std::sqrt(dx * dx + dy * dy), 1e-3f);
+    const float nx = -dy * scale, ny = dx * scale;
+    quad(ImVec2(a.x + nx, a.y + ny), ImVec2(b.x + nx, b.y + ny),
+         ImVec2(b.x - nx, b.y - ny), ImVec2(a.x - nx, a.y - ny), MEAN_COLOR);
+  }
+  return clicked;
+}
+
+// The full ImPlot view of one sensor, opened by clicking its cell.
+void render_zoom_window(
+    EyeGridState &grid,
+    const std::vector<std::atomic<DisplayData *>> &gui_display_pointers) {
+  if (grid.zoom_sensor < 0)
+    return;
+  bool open = true;
+  ImGui::SetNextWindowSize(ImVec2(640, 360), ImGuiCond_FirstUseEver);
+  const std::string title =
+      "Eye diagram: sensor " + std::to_string(grid.zoom_sensor) + "###EyeZoom";
+  if (ImGui::Begin(title.c_str(), &open)) {
+    const DisplayData *plot =
+        grid.slot[grid.zoom_sensor] >= 0
+            ? gui_display_pointers[grid.slot[grid.zoom_sensor]].load(
+                  std::memory_order_acquire)
+            : nullptr;
+    if (!plot || plot->x_data.empty()) {
+      ImGui::Text("No traces for this sensor.");
+    } else {
+      ImGui::Text("%d traces", plot->accumulation_count);
+      if (ImPlot::BeginPlot("##EyeZoom", ImVec2(-1, -1),
+                            ImPlotFlags_NoTitle)) {
+        ImPlot::SetupAxis(ImAxis_X1, "ms after the rising edge",
+                          ImPlotAxisFlags_AutoFit);
+        ImPlot::SetupAxis(ImAxis_Y1, nullptr, ImPlotAxisFlags_AutoFit);
+        const int count = static_cast<int>(plot->x_data.size());
+        const ImTextureID density =
+            grid.show_density
+                ? density_texture(grid, grid.slot[grid.zoom_sensor], *plot)
+                : ImTextureID{};
+        if (density) {
+          ImPlot::PlotImage(
+              "Density", density,
+              ImPlotPoint(-plot->window_before_ms, plot->density_lo),
+              ImPlotPoint(plot->window_after_ms, plot->density_hi));
+        } else {
+          ImPlot::PlotShaded("Min..max", plot->x_data.data(),
+                             plot->y_data_min.data(),
+                             plot->y_data_max.data(), count);
+        }
+        ImPlot::PushStyleColor(ImPlotCol_Line, ImVec4(1, 1, 0, 0.8f));
+        ImPlot::PlotLine("Trimmed mean", plot->x_data.data(),
+                         plot->y_data_mean.data(), count);
+        ImPlot::PopStyleColor();
+        ImPlot::EndPlot();
+      }
+    }
+  }
+  ImGui::End();
+  if (!open)
+    grid.zoom_sensor = -1;
+}
+
+} // namespace
+
+EyeGridState::EyeGridState(int n_total_sensors,
+                           const std::vector<int> &interesting_indices)
+    : slot(n_total_sensors, -1), textures(interesting_indices.size(), 0),
+      texture_versions(interesting_indices.size(), 0) {
+  for (size_t i = 0; i < interesting_indices.size(); ++i) {
+    if (interesting_indices[i] >= 0 && interesting_indices[i] < n_total_sensors)
+      slot[interesting_indices[i]] = static_cast<int>(i);
+  }
+}
+
 void render_gui(
     const std::vector<std::atomic<DisplayData *>> &gui_display_pointers,
-    int n_total_sensors, const std::vector<int> &interesting_indices,
-    const std::string &experiment_status, CommandQueue &command_queue,
-    std::atomic<bool> &manual_mode, std::atomic<int> &manual_core_to_test,
+    EyeGridState &grid, const std::string &experiment_status,
+    CommandQueue &command_queue, std::atomic<bool> &manual_mode,
+    std::atomic<int> &manual_core_to_test, std::atomic<int> &marker,
+    FlightRecorder *flight_recorder, const EyeSnapshotWriter *snapshot_writer,
     int num_hardware_threads) {
 
 #ifdef NDEBUG
@@ -55,66 +330,119 @@ void render_gui(
     command_queue.push(ChangeCoreCmd{core_to_test});
   }
   ImGui::EndDisabled();
+
+  // Markers split the energy report into phases (also: kill -USR1 <pid>).
+  if (ImGui::Button("Insert Marker")) {
+    marker.fetch_add(1, std::memory_order_relaxed);
+  }
+  ImGui::SameLine();
+  ImGui::Text("Marker: %d", marker.load(std::memory_order_relaxed));
+
+  if (flight_recorder) {
+    ImGui::SameLine();
+    if (ImGui::Button("Dump Flight Recorder")) {
+      flight_recorder->trigger("manual");
+    }
+    const auto fr = flight_recorder->stats();
+    ImGui::SameLine();
+    ImGui::Text("%s dumps: %llu, lost: %llu, last: %.0f ms, ratio %.1fx",
+                fr.dumping ? "[writing]" : "",
+                static_cast<unsigned long long>(fr.dumps),
+                static_cast<unsigned long long>(fr.lost_samples),
+                fr.last_latency_ms, fr.compression_ratio);
+  }
+
+  if (snapshot_writer) {
+    ImGui::SameLine();
+    if (ImGui::Button("Save Eye Snapshot")) {
+      command_queue.push(SaveSnapshotCmd{});
+    }
+    const auto es = snapshot_writer->stats();
+    ImGui::SameLine();
+    ImGui::Text("snapshots: %llu, skipped: %llu, last: %.0f ms",
+                static_cast<unsigned long long>(es.written),
+                static_cast<unsigned long long>(es.skipped),
+                es.last_write_ms);
+  }
   ImGui::Separator();
 
-  if (ImGui::BeginTable("EyeDiagramGrid", 16)) {
-    for (int i = 0; i < n_total_sensors; ++i) {
-      ImGui::TableNextColumn();
-      auto it = std::ranges::find(interesting_indices, i);
-      const bool is_interesting = it != interesting_indices.end();
-      ImGui::PushID(i);
-
-      if (is_interesting) {
-        const size_t interesting_idx =
-            std::distance(interesting_indices.begin(), it);
-        const DisplayData *plot = gui_display_pointers[interesting_idx].load(
-            std::memory_order_acquire);
-
-        if (plot && !plot->x_data.empty()) {
-          if (ImPlot::BeginPlot("##EyePlot", ImVec2(-1, 80),
-                                ImPlotFlags_NoTitle | ImPlotFlags_NoLegend)) {
-
-            ImPlot::SetupAxisLimits(ImAxis_X1, 0, // -plot->window_before_ms,
-                                    plot->window_after_ms, ImPlotCond_Always);
-            // hide X axis ticks/labels
-            ImPlot::SetupAxis(ImAxis_X1, nullptr,
-                              ImPlotAxisFlags_NoTickLabels |
-                                  ImPlotAxisFlags_NoTickMarks);
-
-            ImPlot::SetupAxis(ImAxis_Y1, nullptr, ImPlotAxisFlags_AutoFit);
-
-            ImPlot::PushStyleColor(ImPlotCol_Line,
-                                   ImVec4(1, 1, 0, 0.8f)); // Yellow for Mean
-            ImPlot::PlotLine("TrimmedMean", plot->x_data.data(),
-                             plot->y_data_mean.data(),
-                             static_cast<int>(plot->x_data.size()));
-
-            // ImPlot::PushStyleColor(ImPlotCol_Line,
-            //                        ImVec4(1, 0, 0, 0.5f)); // Red for Max
-            // ImPlot::PlotLine("Max", plot->x_data.data(),
-            //                  plot->y_data_max.data(),
-            //                  static_cast<int>(plot->x_data.size()));
-            //
-            // ImPlot::PushStyleColor(ImPlotCol_Line,
-            //                        ImVec4(0, 1, 1, 0.5f)); // Cyan for Min
-            // ImPlot::PlotLine("Min", plot->x_data.data(),
-            //                  plot->y_data_min.data(),
-            //                  static_cast<int>(plot->x_data.size()));
-            ImPlot::PopStyleColor(3);
-
-            ImPlot::EndPlot();
+  ImGui::SetNextItemWidth(160);
+  if (ImGui::InputText("Sensors", grid.filter, sizeof(grid.filter)))
+    grid.dirty = true;
+  if (!grid.filter_valid) {
+    ImGui::SameLine();
+    ImGui::TextColored(ImVec4(1, 0.4f, 0.4f, 1), "(e.g. 17,20-31)");
+  }
+  ImGui::SameLine();
+  if (ImGui::Checkbox("Changing only", &grid.interesting_only))
+    grid.dirty = true;
+  ImGui::SameLine();
+  ImGui::Checkbox("Density", &grid.show_density);
+  ImGui::SameLine();
+  ImGui::SetNextItemWidth(140);
+  if (ImGui::Combo("Sort", &grid.sort, "Index\0Activity\0Edge response\0"))
+    grid.dirty = true;
+  const double now = ImGui::GetTime();
+  if (grid.dirty || (grid.sort != EyeGridState::SORT_INDEX &&
+                     now - grid.sorted_at > RESORT_SECONDS))
+    rebuild_order(grid, gui_display_pointers, now);
+  ImGui::SameLine();
+  ImGui::Text("%zu of %zu sensors", grid.order.size(), grid.slot.size());
+
+  if (ImGui::BeginTable("EyeDiagramGrid", GRID_COLUMNS)) {
+    // Only the rows on screen are laid out and plotted.
+    const int rows = static_cast<int>(
+        (grid.order.size() + GRID_COLUMNS - 1) / GRID_COLUMNS);
+    ImGuiListClipper clipper;
+    clipper.Begin(rows, PLOT_HEIGHT + 2 * ImGui::GetStyle().CellPadding.y);
+    while (clipper.Step()) {
+      for (int row = clipper.DisplayStart; row < clipper.DisplayEnd; ++row) {
+        ImGui::TableNextRow(0, PLOT_HEIGHT);
+        for (int col = 0; col < GRID_COLUMNS; ++col) {
+          const size_t cell = static_cast<size_t>(row) * GRID_COLUMNS + col;
+          if (cell >= grid.order.size())
+            break;
+          ImGui::TableSetColumnIndex(col);
+          const int sensor = grid.order[cell];
+          ImGui::PushID(sensor);
+
+          const DisplayData *plot =
+              grid.slot[sensor] >= 0
+                  ? gui_display_pointers[grid.slot[sensor]].load(
+                        std::memory_order_acquire)
+                  : nullptr;
+          if (plot && !plot->norm_x.empty()) {
+            const ImTextureID density =
+                grid.show_density
+                    ? density_texture(grid, grid.slot[sensor], *plot)
+                    : ImTextureID{};
+            if (draw_mini_plot(*plot, density))
+              grid.zoom_sensor = sensor;
+            if (ImGui::IsItemHovered())
+              ImGui::SetTooltip("Sensor %d, %d traces\n%.4g .. %.4g\n"
+                                "Click to zoom",
+                                sensor, plot->accumulation_count, plot->y_lo,
+                                plot->y_hi);
+          } else {
+            ImGui::Dummy(ImVec2(-1, PLOT_HEIGHT)); // Placeholder
+            if (ImGui::IsItemHovered())
+              ImGui::SetTooltip("Sensor %d", sensor);
           }
-        } else {
-          ImGui::Dummy(ImVec2(-1, 80)); // Placeholder
+          ImGui::PopID();
         }
-      } else {
-        ImGui::Dummy(ImVec2(-1, 80)); // Placeholder
       }
-      if (ImGui::IsItemHovered())
-        ImGui::SetTooltip("Sensor %d", i);
-      ImGui::PopID();
     }
     ImGui::EndTable();
   }
   ImGui::End();
-}
\ No newline at end of file
+
+  render_zoom_window(grid, gui_display_pointers);
+}
+
+void release_eye_textures(EyeGridState &grid) {
+  for (auto &texture : grid.textures) {
+    if (texture != 0)
+      glDeleteTextures(1, &texture);
+    texture = 0;
+  }
+}
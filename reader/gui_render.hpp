@@ -2,12 +2,48 @@
 
 #include "shared_data_types.hpp"
 #include <atomic>
+#include <cstdint>
 #include <string>
 #include <vector>
 
+class EyeSnapshotWriter;
+class FlightRecorder;
+
+// The eye grid's state between frames. The sensor -> display slot table is
+// built once; the filtered and sorted cell order is rebuilt when the filter
+// or the sort changes, and for the data-dependent sorts at most once a
+// second, so a frame only touches the rows on screen.
+struct EyeGridState {
+  enum Sort : int { SORT_INDEX, SORT_ACTIVITY, SORT_EDGE_RESPONSE };
+
+  EyeGridState(int n_total_sensors,
+               const std::vector<int> &interesting_indices);
+
+  std::vector<int> slot;  // By sensor: display pointer index, -1 if constant
+  std::vector<int> order; // Sensors shown, in grid order
+  char filter[128] = {};  // Column list ("17,20-31"); empty = all
+  bool filter_valid = true;
+  bool interesting_only = false;
+  int sort = SORT_INDEX;
+  bool dirty = true;
+  double sorted_at = 0.0; // ImGui::GetTime() of the last rebuild
+  int zoom_sensor = -1;    // Shown in the full plot window, -1 = none
+
+  // Persistence view: the density textures by display slot, with the
+  // DisplayData::version they hold, uploaded for visible cells only.
+  bool show_density = true;
+  std::vector<unsigned> textures;
+  std::vector<uint64_t> texture_versions;
+  std::vector<uint32_t> upload; // RGBA staging for glTexImage2D
+};
+
+// Delete the density textures; call while the GL context is current.
+void release_eye_textures(EyeGridState &grid);
+
 void render_gui(
     const std::vector<std::atomic<DisplayData *>> &gui_display_pointers,
-    int n_total_sensors, const std::vector<int> &interesting_indices,
-    const std::string &experiment_status, CommandQueue &command_queue,
-    std::atomic<bool> &manual_mode, std::atomic<int> &manual_core_to_test,
-    int num_hardware_threads);
\ No newline at end of file
+    EyeGridState &grid, const std::string &experiment_status,
+    CommandQueue &command_queue, std::atomic<bool> &manual_mode,
+    std::atomic<int> &manual_core_to_test, std::atomic<int> &marker,
+    FlightRecorder *flight_recorder, const EyeSnapshotWriter *snapshot_writer,
+    int num_hardware_threads);
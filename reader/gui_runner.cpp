@@ -9,13 +9,29 @@
 
 #include <algorithm>
 #include <chrono>
+#include <cmath>
 #include <deque>
+#include <limits>
 #include <numeric>
+#include <optional>
 #include <span>
 #include <thread>
 
+#include "csv_log_writer.hpp"
+#include "eye_density.hpp"
+#include "eye_snapshot.hpp"
+#include "flight_recorder.hpp"
+#include "frame_pacer.hpp"
+#include "gui_render.hpp"
+#include "metrics_exporter.hpp"
+#include "pm_table_layout.hpp"
 #include "pm_table_reader.hpp"
+#include "sample_recording.hpp"
+#include "shm_ring.hpp"
 #include "stats_utils.hpp"
+#include "terminal_ui.hpp"
+#include "trace_export.hpp"
+#include "tui_render.hpp"
 
 // allow literals for time units
 using namespace std::chrono_literals;
@@ -23,37 +39,64 @@ using namespace std::chrono_literals;
 // Forward declarations from measure.cpp
 void measurement_thread_func(int core_id,
                              folly::ProducerConsumerQueue<RawSample> &queue,
-                             PmTableReader &pm_table_reader);
+                             PmTableReader &pm_table_reader,
+                             FlightRecorder *flight_recorder);
+void shm_measurement_thread_func(int core_id,
+                                 folly::ProducerConsumerQueue<RawSample> &queue,
+                                 ShmRingConsumer &shm,
+                                 FlightRecorder *flight_recorder);
 void worker_thread_func(int core_id, int period_ms, int duty_cycle_percent,
                         int num_cycles);
 
-// Forward declaration from gui_render.cpp
-void render_gui(
-    const std::vector<std::atomic<DisplayData *>> &gui_display_pointers,
-    int n_total_sensors, const std::vector<int> &interesting_indices,
-    const std::string &experiment_status, CommandQueue &command_queue,
-    std::atomic<bool> &manual_mode, std::atomic<int> &manual_core_to_test,
-    int num_hardware_threads);
-
 // Extern global flags from measure.cpp
 extern std::atomic<bool> g_run_measurement;
 extern std::atomic<int> g_worker_state;
+extern std::atomic<int> g_marker;
 
 GuiRunner::GuiRunner(int num_hardware_threads, int measurement_core, int period,
-                     int duty_cycle, int cycles, PmTableReader &pm_table_reader,
-                     size_t n_measurements,
-                     const std::vector<int> &interesting_index)
+                     int duty_cycle, int cycles, PmTableReader *pm_table_reader,
+                     ShmRingConsumer *shm, size_t n_measurements,
+                     const std::vector<int> &interesting_index,
+                     std::string energy_report_path,
+                     FlightRecorder *flight_recorder, CsvLogWriter *csv_writer,
+                     TraceExporter *trace_exporter,
+                     MetricsAggregator *metrics, SampleRecorder *recorder,
+                     SampleReplay *replay, const EyeConfig &eye,
+                     EyeSnapshotWriter *snapshot_writer,
+                     const EyeSnapshot *resume, ReportConfig report)
     : num_hardware_threads_(num_hardware_threads),
       measurement_core_(measurement_core),
       // The worker load period is now distinct from the capture window
       worker_period_ms_(period), duty_cycle_percent_(duty_cycle),
       num_cycles_(cycles), n_measurements_(n_measurements),
-      interesting_index_(interesting_index), pm_table_reader_(pm_table_reader),
+      interesting_index_(interesting_index),
+      window_before_ms_(eye.window_before_ms),
+      window_after_ms_(eye.window_after_ms), trim_percent_(eye.trim_percent),
+      report_(std::move(report)),
+      energy_report_path_(std::move(energy_report_path)),
+      flight_recorder_(flight_recorder), csv_writer_(csv_writer),
+      trace_exporter_(trace_exporter), metrics_(metrics), recorder_(recorder),
+      replay_(replay),
+      snapshot_writer_(snapshot_writer), resume_(resume),
+      pm_table_reader_(pm_table_reader), shm_(shm),
       spsc_queue_(600), // SPSC queue size, e.g., for ~2 seconds of data
       gui_display_pointers_(interesting_index_.size()) {
   SPDLOG_INFO("GUI mode enabled. Initializing data buffers...");
   const size_t num_interesting = interesting_index_.size();
 
+  if (!report_.prefix.empty()) {
+    // Live, the render shares the machine with the experiment: few threads,
+    // none on the measurement core.
+    ReportOptions options = report_.options;
+    if (live())
+      options.threads =
+          std::min(options.threads > 0 ? options.threads
+                                       : ReportConfig::LIVE_REPORT_THREADS,
+                   ReportConfig::LIVE_REPORT_THREADS);
+    report_writer_ = std::make_unique<ReportWriter>(
+        options, live() ? measurement_core_ : -1);
+  }
+
   for (size_t i = 0; i < num_interesting; ++i) {
     display_data_a_.push_back(std::make_unique<DisplayData>());
     display_data_b_.push_back(std::make_unique<DisplayData>());
@@ -64,6 +107,21 @@ GuiRunner::GuiRunner(int num_hardware_threads, int measurement_core, int period,
     // Initially, point the GUI to buffer A
     gui_display_pointers_[i].store(display_data_a_[i].get());
   }
+
+  pm_table_version_ = replay_            ? replay_->pm_table_version()
+                      : pm_table_reader_ ? pm_table_reader_->getPmTableVersion()
+                      : shm_             ? shm_->pm_table_version()
+                      : resume_          ? resume_->pm_table_version
+                                         : 0;
+  layout_ = find_pm_table_layout(pm_table_version_, n_measurements_);
+  // A snapshot view has no samples to account.
+  if (layout_ && (replay_ || live())) {
+    SPDLOG_INFO("Energy accounting uses the {} layout ({:#x}).",
+                layout_->codename, layout_->version);
+    energy_accountant_ = std::make_unique<EnergyAccountant>(*layout_);
+  } else if (!layout_) {
+    SPDLOG_WARN("Unknown pm_table layout, energy accounting disabled.");
+  }
 }
 
 GuiRunner::~GuiRunner() {
@@ -80,6 +138,52 @@ GuiRunner::~GuiRunner() {
   }
 }
 
+namespace {
+
+// The density's range is rebuilt from scratch every this many windows, so it
+// shrinks again after an outlier has left the accumulation.
+constexpr uint64_t DENSITY_RANGE_WINDOWS = 64;
+
+// Autoscale the visible part of the eye here rather than per frame in the
+// GUI: y spans the min..max envelope with 5% margin, or the density image's
+// range so the mean lies on it.
+void normalize_mini_plot(DisplayData &display) {
+  if (!display.density.empty()) {
+    display.y_lo = display.density_lo;
+    display.y_hi = display.density_hi;
+  } else {
+    float lo = std::numeric_limits<float>::max();
+    float hi = std::numeric_limits<float>::lowest();
+    for (size_t i = 0; i < display.x_data.size(); ++i) {
+      if (display.x_data[i] >= 0.0f) {
+        lo = std::min(lo, display.y_data_min[i]);
+        hi = std::max(hi, display.y_data_max[i]);
+      }
+    }
+    if (lo > hi)
+      return;
+    const float pad = hi > lo ? (hi - lo) * 0.05f
+                              : std::max(std::abs(lo) * 0.01f, 1e-6f);
+    display.y_lo = lo - pad;
+    display.y_hi = hi + pad;
+  }
+  const float x_scale = 1.0f / static_cast<float>(display.window_after_ms);
+  const float y_scale = 1.0f / (display.y_hi - display.y_lo);
+  for (size_t i = 0; i < display.x_data.size(); ++i) {
+    if (display.x_data[i] < 0.0f)
+      continue;
+    display.norm_x.push_back(display.x_data[i] * x_scale);
+    display.norm_mean.push_back((display.y_data_mean[i] - display.y_lo) *
+                                y_scale);
+    display.norm_min.push_back((display.y_data_min[i] - display.y_lo) *
+                               y_scale);
+    display.norm_max.push_back((display.y_data_max[i] - display.y_lo) *
+                               y_scale);
+  }
+}
+
+} // namespace
+
 void GuiRunner::run_processing_thread() {
   enum class State { IDLE, CAPTURING } state = State::IDLE;
   TimePoint last_rise_time;
@@ -96,6 +200,9 @@ void GuiRunner::run_processing_thread() {
   std::vector<std::vector<std::deque<float>>> accumulation_buffer(
       num_interesting, std::vector<std::deque<float>>(num_bins));
 
+  // Value histograms of the same traces, for the persistence view.
+  std::vector<EyeDensity> density(num_interesting, EyeDensity(num_bins));
+
   std::unordered_map<int, size_t> sensor_to_storage_idx;
   for (size_t i = 0; i < interesting_index_.size(); ++i) {
     sensor_to_storage_idx[interesting_index_[i]] = i;
@@ -104,34 +211,340 @@ void GuiRunner::run_processing_thread() {
   auto *write_buffer_ptr = &display_data_b_;
   int last_worker_state = 0;
 
+  // Phases: which core the worker runs on and whether it is busy, plus the
+  // current marker. Updated only on change so labels are not rebuilt per
+  // sample.
+  int worker_dim = -1, marker_dim = -1;
+  int phase_core = -1, phase_worker_state = -1, phase_marker = -1;
+
+  // Flight recorder triggers fire on rising edges only.
+  int trigger_marker = -1;
+  bool prochot_active = false, thermal_limit_active = false;
+
+  // Trace tracks for the experiment state; markers become instants.
+  int worker_track = -1, core_track = -1;
+  int trace_marker = -1;
+  if (trace_exporter_) {
+    worker_track = trace_exporter_->add_track("Worker busy");
+    core_track = trace_exporter_->add_track("Core under test");
+  }
+
+  if (energy_accountant_) {
+    worker_dim = energy_accountant_->add_dimension("worker");
+    marker_dim = energy_accountant_->add_dimension("marker");
+  }
+
+  // Replayed samples carry their core; a change restarts the accumulation
+  // as the GUI's core switch does.
+  int replay_core = -1;
+  uint64_t n_samples = 0, n_windows = 0;
+
+  auto reset_accumulation = [&] {
+    for (auto &sensor_bins : accumulation_buffer) {
+      for (auto &bin : sensor_bins)
+        bin.clear();
+    }
+    for (auto &sensor_density : density)
+      sensor_density.clear();
+    current_trace.clear();
+    sample_history.clear();
+    state = State::IDLE;
+  };
+
+  // Rebuild the plots from the accumulation and flip the display buffers.
+  auto publish_display = [&] {
+    const uint64_t version =
+        display_generation_.load(std::memory_order_relaxed) + 1;
+    const bool refresh_ranges = n_windows % DENSITY_RANGE_WINDOWS == 0;
+    for (size_t i = 0; i < num_interesting; ++i) {
+      auto &target_display = *(*write_buffer_ptr)[i];
+      target_display.clear();
+      target_display.version = version;
+      target_display.window_before_ms = window_before_ms_;
+      target_display.window_after_ms = window_after_ms_;
+      target_display.accumulation_count =
+          !accumulation_buffer[i].empty()
+              ? accumulation_buffer[i][window_before_ms_].size()
+              : 0;
+
+      for (int bin_idx = 0; bin_idx < num_bins; ++bin_idx) {
+        if (const auto &bin_deque = accumulation_buffer[i][bin_idx];
+            !bin_deque.empty()) {
+          target_display.x_data.push_back(
+              static_cast<float>(bin_idx - window_before_ms_));
+
+          std::vector<float> temp_vec(bin_deque.begin(), bin_deque.end());
+          target_display.y_data_mean.push_back(
+              calculate_trimmed_mean(temp_vec, trim_percent_));
+          target_display.y_data_min.push_back(
+              *std::ranges::min_element(bin_deque));
+          target_display.y_data_max.push_back(
+              *std::ranges::max_element(bin_deque));
+        }
+      }
+      if (refresh_ranges || density[i].needs_rebuild())
+        density[i].rebuild(accumulation_buffer[i]);
+      if (density[i].render(target_display.density,
+                            target_display.density_lo,
+                            target_display.density_hi))
+        target_display.density_height = EyeDensity::VALUE_BINS;
+      normalize_mini_plot(target_display);
+    }
+
+    for (size_t i = 0; i < num_interesting; ++i) {
+      gui_display_pointers_[i].store((*write_buffer_ptr)[i].get(),
+                                     std::memory_order_release);
+    }
+
+    write_buffer_ptr = (write_buffer_ptr == &display_data_a_)
+                           ? &display_data_b_
+                           : &display_data_a_;
+    display_generation_.fetch_add(1, std::memory_order_release);
+  };
+
+  // Sensor series of the current step, decimated to a fixed number of
+  // buckets so long steps cost no more memory than short ones.
+  std::optional<SeriesDecimator> series;
+  if (!report_.prefix.empty())
+    series.emplace(interesting_index_);
+
+  // Eyes (trimmed mean over min..max, p10..p90 and p25..p75) and series of
+  // the step that just ended. Only the plot data is built here; rendering
+  // and writing happen on report_writer_'s thread.
+  // A GUI core switch has already stored the new core; steps without a
+  // completed window (dragging the slider) write nothing.
+  int step_core = manual_core_to_test_.load();
+  uint64_t step_first_window = n_windows;
+  auto write_step_report = [&](int core) {
+    if (!series || !report_writer_)
+      return;
+    const uint64_t windows = n_windows - step_first_window;
+    step_first_window = n_windows;
+    if (windows == 0) {
+      series->clear();
+      return;
+    }
+    ReportSection eyes{fmt::format("Eye diagrams, {} windows", windows),
+                       "ms", {}};
+    ReportSection traces{"Sensor series", "s", {}};
+    for (size_t i = 0; i < num_interesting; ++i) {
+      ReportPlot plot;
+      plot.title = fmt::format("#{}", interesting_index_[i]);
+      plot.marker_x = 0.0f;
+      plot.bands.resize(3);
+      std::vector<float> sorted;
+      for (int bin_idx = 0; bin_idx < num_bins; ++bin_idx) {
+        const auto &bin_deque = accumulation_buffer[i][bin_idx];
+        if (bin_deque.empty())
+          continue;
+        sorted.assign(bin_deque.begin(), bin_deque.end());
+        std::ranges::sort(sorted);
+        auto quantile = [&](float q) {
+          return sorted[static_cast<size_t>(q * (sorted.size() - 1) + 0.5f)];
+        };
+        plot.x.push_back(static_cast<float>(bin_idx - window_before_ms_));
+        plot.mean.push_back(calculate_trimmed_mean(sorted, trim_percent_));
+        const float bands[3][2] = {{sorted.front(), sorted.back()},
+                                   {quantile(0.10f), quantile(0.90f)},
+                                   {quantile(0.25f), quantile(0.75f)}};
+        for (size_t b = 0; b < 3; ++b) {
+          plot.bands[b].lo.push_back(bands[b][0]);
+          plot.bands[b].hi.push_back(bands[b][1]);
+        }
+      }
+      eyes.plots.push_back(std::move(plot));
+      traces.plots.push_back(
+          series->plot(i, fmt::format("#{}", interesting_index_[i])));
+    }
+    report_writer_->submit(Report{fmt::format("pm_measure core {}", core),
+                                  {std::move(eyes), std::move(traces)},
+                                  {}},
+                           fmt::format("{}_core{}", report_.prefix, core));
+    series->clear();
+  };
+
+  // Copy the accumulation into the writer's staging snapshot; the file is
+  // written on the writer thread. Skipped while the previous write runs.
+  auto take_snapshot = [&](bool wait) {
+    EyeSnapshot *snapshot = snapshot_writer_->acquire(wait);
+    if (!snapshot)
+      return;
+    snapshot->n_floats = static_cast<uint32_t>(n_measurements_);
+    snapshot->pm_table_version = pm_table_version_;
+    snapshot->window_before_ms = window_before_ms_;
+    snapshot->window_after_ms = window_after_ms_;
+    snapshot->trim_percent = trim_percent_;
+    snapshot->max_accumulations = max_accumulations_.load();
+    snapshot->core = replay_core >= 0 ? replay_core
+                                      : manual_core_to_test_.load();
+    snapshot->n_samples = n_samples;
+    snapshot->n_windows = n_windows;
+    snapshot->interesting.assign(interesting_index_.begin(),
+                                 interesting_index_.end());
+    snapshot->counts.clear();
+    snapshot->values.clear();
+    for (const auto &sensor_bins : accumulation_buffer) {
+      for (const auto &bin : sensor_bins) {
+        snapshot->counts.push_back(static_cast<uint32_t>(bin.size()));
+        snapshot->values.insert(snapshot->values.end(), bin.begin(),
+                                bin.end());
+      }
+    }
+    snapshot_writer_->publish();
+  };
+
+  if (resume_) {
+    // measure.cpp resumes with the snapshot's sensors and eye window.
+    size_t next = 0;
+    for (size_t i = 0; i < num_interesting; ++i) {
+      for (int bin = 0; bin < num_bins; ++bin) {
+        const uint32_t count = resume_->counts[i * num_bins + bin];
+        accumulation_buffer[i][bin].assign(
+            resume_->values.begin() + static_cast<std::ptrdiff_t>(next),
+            resume_->values.begin() +
+                static_cast<std::ptrdiff_t>(next + count));
+        next += count;
+      }
+    }
+    n_samples = resume_->n_samples;
+    n_windows = resume_->n_windows;
+    max_accumulations_.store(resume_->max_accumulations);
+    if (resume_->core >= 0) {
+      manual_core_to_test_.store(resume_->core);
+      step_core = resume_->core;
+      if (replay_)
+        replay_core = resume_->core;
+    }
+    publish_display();
+    SPDLOG_INFO("Resumed eye accumulation: core {}, {} windows.",
+                resume_->core, n_windows);
+  }
+
   while (!terminate_threads_.load()) {
     if (GuiCommand cmd; command_queue_.try_pop(cmd)) {
       std::visit(
           [&](auto &&arg) {
             using T = std::decay_t<decltype(arg)>;
             if constexpr (std::is_same_v<T, ChangeCoreCmd>) {
+              if (!live() && !replay_)
+                return; // Snapshot view: keep what was loaded
               SPDLOG_INFO("Processing command: Change core to {}",
                           arg.new_core_id);
-              for (auto &sensor_bins : accumulation_buffer) {
-                for (auto &bin : sensor_bins)
-                  bin.clear();
-              }
-              current_trace.clear();
-              sample_history.clear();
-              state = State::IDLE;
+              write_step_report(step_core);
+              step_core = arg.new_core_id;
+              reset_accumulation();
             } else if constexpr (std::is_same_v<T, ChangeAccumulationsCmd>) {
               max_accumulations_.store(arg.new_count);
               SPDLOG_INFO("Processing command: Change accumulations to {}",
                           arg.new_count);
+            } else if constexpr (std::is_same_v<T, SaveSnapshotCmd>) {
+              if (snapshot_writer_)
+                take_snapshot(false);
             }
           },
           cmd);
     }
+    if (snapshot_writer_ && snapshot_writer_->due())
+      take_snapshot(false);
 
     RawSample sample;
     bool work_done = false;
     while (spsc_queue_.read(sample)) {
       work_done = true;
+      ++n_samples;
+
+      if (sample.core >= 0 && sample.core != replay_core) {
+        if (replay_core >= 0) {
+          write_step_report(replay_core);
+          reset_accumulation();
+        }
+        replay_core = sample.core;
+        manual_core_to_test_.store(sample.core); // Shown in the GUI status
+      }
+      const int core =
+          sample.core >= 0 ? sample.core : manual_core_to_test_.load();
+
+      if (recorder_)
+        recorder_->append(sample, core);
+
+      // The round column is the experiment marker (GUI button or SIGUSR1).
+      if (csv_writer_)
+        csv_writer_->append(
+            std::chrono::duration_cast<std::chrono::nanoseconds>(
+                sample.timestamp.time_since_epoch())
+                .count(),
+            sample.marker, core, sample.worker_state,
+            sample.measurements.data(), sample.num_measurements);
+
+      if (series)
+        series->add(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                        sample.timestamp.time_since_epoch())
+                        .count(),
+                    sample.measurements.data());
+
+      if (metrics_)
+        metrics_->add(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                          sample.timestamp.time_since_epoch())
+                          .count(),
+                      sample.measurements.data());
+
+      if (trace_exporter_) {
+        const auto timestamp_ns =
+            std::chrono::duration_cast<std::chrono::nanoseconds>(
+                sample.timestamp.time_since_epoch())
+                .count();
+        trace_exporter_->add_sample(timestamp_ns, sample.measurements.data(),
+                                    sample.num_measurements);
+        trace_exporter_->set_value(timestamp_ns, worker_track,
+                                   static_cast<float>(sample.worker_state));
+        trace_exporter_->set_value(
+            timestamp_ns, core_track, static_cast<float>(core));
+        if (sample.marker != trace_marker) {
+          if (trace_marker >= 0)
+            trace_exporter_->add_instant(
+                timestamp_ns, fmt::format("marker {}", sample.marker));
+          trace_marker = sample.marker;
+        }
+      }
+
+      if (flight_recorder_) {
+        if (trigger_marker >= 0 && sample.marker != trigger_marker)
+          flight_recorder_->trigger("marker");
+        trigger_marker = sample.marker;
+        if (layout_ && sample.num_measurements >= layout_->min_floats) {
+          const bool prochot = sample.measurements[layout_->prochot] > 0.5f;
+          const bool thermal_limit = sample.measurements[layout_->thm_value] >=
+                                     sample.measurements[layout_->thm_limit];
+          if (prochot && !prochot_active)
+            flight_recorder_->trigger("prochot");
+          if (thermal_limit && !thermal_limit_active)
+            flight_recorder_->trigger("thermal limit");
+          prochot_active = prochot;
+          thermal_limit_active = thermal_limit;
+        }
+      }
+
+      if (energy_accountant_) {
+        if (core != phase_core || sample.worker_state != phase_worker_state) {
+          phase_core = core;
+          phase_worker_state = sample.worker_state;
+          energy_accountant_->set_phase(
+              worker_dim, fmt::format("core{} {}", core,
+                                      sample.worker_state ? "busy" : "idle"));
+        }
+        if (sample.marker != phase_marker) {
+          phase_marker = sample.marker;
+          energy_accountant_->set_phase(marker_dim,
+                                        std::to_string(sample.marker));
+        }
+        energy_accountant_->add_sample(
+            std::chrono::duration_cast<std::chrono::nanoseconds>(
+                sample.timestamp.time_since_epoch())
+                .count(),
+            std::span<const float>(sample.measurements.data(),
+                                   sample.num_measurements),
+            sample.work_count);
+      }
 
       sample_history.push_back(sample);
       if (sample_history.size() > history_size) {
@@ -155,6 +568,7 @@ void GuiRunner::run_processing_thread() {
           current_trace.push_back(sample);
         } else if (time_delta_ms >= window_after_ms_) {
           state = State::IDLE;
+          ++n_windows;
 
           auto process_sample_collection = [&](const auto &collection) {
             for (const auto &s : collection) {
@@ -171,6 +585,8 @@ void GuiRunner::run_processing_thread() {
                       it != sensor_to_storage_idx.end()) {
                     accumulation_buffer[it->second][bin_idx].push_back(
                         s.measurements[sens_idx]);
+                    density[it->second].add(static_cast<int>(bin_idx),
+                                            s.measurements[sens_idx]);
                   }
                 }
               }
@@ -181,49 +597,17 @@ void GuiRunner::run_processing_thread() {
           process_sample_collection(current_trace);
 
           int max_acc = max_accumulations_.load();
-          for (auto &sensor_bins : accumulation_buffer) {
-            for (auto &bin_deque : sensor_bins) {
-              while (static_cast<int>(bin_deque.size()) > max_acc) {
-                bin_deque.pop_front();
-              }
-            }
-          }
-
           for (size_t i = 0; i < num_interesting; ++i) {
-            auto &target_display = *(*write_buffer_ptr)[i];
-            target_display.clear();
-            target_display.window_before_ms = window_before_ms_;
-            target_display.window_after_ms = window_after_ms_;
-            target_display.accumulation_count =
-                !accumulation_buffer[i].empty()
-                    ? accumulation_buffer[i][window_before_ms_].size()
-                    : 0;
-
             for (int bin_idx = 0; bin_idx < num_bins; ++bin_idx) {
-              if (const auto &bin_deque = accumulation_buffer[i][bin_idx];
-                  !bin_deque.empty()) {
-                target_display.x_data.push_back(
-                    static_cast<float>(bin_idx - window_before_ms_));
-
-                std::vector<float> temp_vec(bin_deque.begin(), bin_deque.end());
-                target_display.y_data_mean.push_back(
-                    calculate_trimmed_mean(temp_vec, 10.0f));
-                target_display.y_data_min.push_back(
-                    *std::ranges::min_element(bin_deque));
-                target_display.y_data_max.push_back(
-                    *std::ranges::max_element(bin_deque));
+              auto &bin_deque = accumulation_buffer[i][bin_idx];
+              while (static_cast<int>(bin_deque.size()) > max_acc) {
+                density[i].remove(bin_idx, bin_deque.front());
+                bin_deque.pop_front();
               }
             }
           }
 
-          for (size_t i = 0; i < num_interesting; ++i) {
-            gui_display_pointers_[i].store((*write_buffer_ptr)[i].get(),
-                                           std::memory_order_release);
-          }
-
-          write_buffer_ptr = (write_buffer_ptr == &display_data_a_)
-                                 ? &display_data_b_
-                                 : &display_data_a_;
+          publish_display();
         }
       }
     }
@@ -232,6 +616,11 @@ void GuiRunner::run_processing_thread() {
       std::this_thread::sleep_for(5ms);
     }
   }
+  if (snapshot_writer_)
+    take_snapshot(true);
+  write_step_report(replay_core >= 0 ? replay_core : step_core);
+  SPDLOG_INFO("Processing finished: {} samples, {} eye windows.", n_samples,
+              n_windows);
 }
 
 void GuiRunner::run_worker_thread() const {
@@ -247,7 +636,7 @@ void GuiRunner::run_worker_thread() const {
   }
 }
 
-int GuiRunner::run() {
+int GuiRunner::run(const FramePacer::Config &pacing) {
   if (!glfwInit()) {
     return -1;
   }
@@ -263,6 +652,10 @@ int GuiRunner::run() {
   }
   glfwMakeContextCurrent(window_);
 
+  // Before the ImGui backend, which chains to the pacer's input callbacks.
+  FramePacer pacer(pacing);
+  pacer.attach(window_);
+
   IMGUI_CHECKVERSION();
   ImGui::CreateContext();
   ImPlot::CreateContext();
@@ -270,24 +663,21 @@ int GuiRunner::run() {
   ImGui_ImplOpenGL3_Init("#version 330");
   ImGui::StyleColorsDark();
 
-  g_run_measurement.store(true);
-  std::thread measurement(measurement_thread_func, measurement_core_,
-                          std::ref(spsc_queue_), std::ref(pm_table_reader_));
-  std::thread processing(&GuiRunner::run_processing_thread, this);
-  std::thread worker(&GuiRunner::run_worker_thread, this);
+  start_threads();
 
+  EyeGridState eye_grid(static_cast<int>(n_measurements_), interesting_index_);
   while (!glfwWindowShouldClose(window_)) {
-    glfwPollEvents();
+    // Draws only on input, a new eye window or the idle interval.
+    pacer.wait_for_frame(display_generation_);
     ImGui_ImplOpenGL3_NewFrame();
     ImGui_ImplGlfw_NewFrame();
     ImGui::NewFrame();
 
-    std::string status = "Manual mode: testing core " +
-                         std::to_string(manual_core_to_test_.load());
-
-    render_gui(gui_display_pointers_, n_measurements_, interesting_index_,
-               status, command_queue_, manual_mode_, manual_core_to_test_,
-               num_hardware_threads_);
+    render_gui(gui_display_pointers_, eye_grid, status(), command_queue_,
+               manual_mode_, manual_core_to_test_, g_marker, flight_recorder_,
+               snapshot_writer_, num_hardware_threads_);
+    if (ImGui::IsAnyItemActive())
+      pacer.request_frame(); // Dragging a slider or a plot
 
     ImGui::Render();
     int display_w, display_h;
@@ -298,18 +688,130 @@ int GuiRunner::run() {
     ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
 
     glfwSwapBuffers(window_);
+    pacer.end_frame();
   }
+  pacer.log_stats("GUI");
+  release_eye_textures(eye_grid);
 
+  stop_threads();
+  write_energy_report();
+
+  SPDLOG_INFO("GUI mode finished.");
+  return 0;
+}
+
+int GuiRunner::run_tui(double refresh_hz) {
+  {
+    TerminalScreen screen;
+    if (!screen) {
+      SPDLOG_ERROR("--tui needs a terminal on stdout.");
+      return -1;
+    }
+    start_threads();
+
+    // Frames are paced by the key wait, so the UI thread sleeps between
+    // them; a key redraws at once.
+    const auto period = std::chrono::duration<double>(1.0 / refresh_hz);
+    auto next_frame = std::chrono::steady_clock::now();
+    int scroll = 0;
+    bool running = true;
+    while (running && !TerminalScreen::interrupted()) {
+      render_tui(screen, gui_display_pointers_, interesting_index_, status(),
+                 manual_mode_.load(), g_marker.load(std::memory_order_relaxed),
+                 flight_recorder_, snapshot_writer_, scroll);
+      next_frame += std::chrono::duration_cast<
+          std::chrono::steady_clock::duration>(period);
+      const auto now = std::chrono::steady_clock::now();
+      if (next_frame < now)
+        next_frame = now;
+      const int key = screen.read_key(static_cast<int>(
+          std::chrono::duration_cast<std::chrono::milliseconds>(next_frame -
+                                                                now)
+              .count()));
+      if (key != TerminalScreen::KEY_NONE) {
+        running = handle_tui_key(key, command_queue_, manual_mode_,
+                                 manual_core_to_test_, g_marker,
+                                 flight_recorder_, snapshot_writer_,
+                                 num_hardware_threads_, scroll);
+        next_frame = std::chrono::steady_clock::now();
+      }
+    }
+    stop_threads();
+    const auto stats = screen.stats();
+    SPDLOG_INFO("Terminal UI: {} frames, {} cells, {:.1f} KiB written.",
+                stats.frames, stats.cells_written,
+                stats.bytes_written / 1024.0);
+  }
+  // The screen is gone, so the report's log lines reach the terminal.
+  write_energy_report();
+  SPDLOG_INFO("Terminal UI finished.");
+  return 0;
+}
+
+void GuiRunner::start_threads() {
+  g_run_measurement.store(true);
+  if (replay_) {
+    measurement_thread_ = std::thread(&SampleReplay::run, replay_,
+                                      std::ref(spsc_queue_),
+                                      std::cref(terminate_threads_));
+  } else if (pm_table_reader_) {
+    measurement_thread_ =
+        std::thread(measurement_thread_func, measurement_core_,
+                    std::ref(spsc_queue_), std::ref(*pm_table_reader_),
+                    flight_recorder_);
+    worker_thread_ = std::thread(&GuiRunner::run_worker_thread, this);
+  } else if (shm_) {
+    measurement_thread_ =
+        std::thread(shm_measurement_thread_func, measurement_core_,
+                    std::ref(spsc_queue_), std::ref(*shm_), flight_recorder_);
+    worker_thread_ = std::thread(&GuiRunner::run_worker_thread, this);
+  }
+  processing_thread_ = std::thread(&GuiRunner::run_processing_thread, this);
+}
+
+void GuiRunner::stop_threads() {
   terminate_threads_.store(true);
   g_run_measurement.store(false);
 
-  if (measurement.joinable())
-    measurement.join();
-  if (processing.joinable())
-    processing.join();
-  if (worker.joinable())
-    worker.join();
+  if (measurement_thread_.joinable())
+    measurement_thread_.join();
+  if (processing_thread_.joinable())
+    processing_thread_.join();
+  if (worker_thread_.joinable())
+    worker_thread_.join();
+  if (report_writer_)
+    report_writer_->close(); // The final step's report
+}
 
-  SPDLOG_INFO("GUI mode finished.");
+std::string GuiRunner::status() const {
+  return (live() || replay_ ? "Manual mode: testing core "
+                            : "Snapshot view: core ") +
+         std::to_string(manual_core_to_test_.load());
+}
+
+int GuiRunner::run_headless() {
+  if (!replay_) {
+    SPDLOG_ERROR("Headless mode needs a recording to replay.");
+    return -1;
+  }
+  std::thread processing(&GuiRunner::run_processing_thread, this);
+  replay_->run(spsc_queue_, terminate_threads_);
+  // The queue is empty; the processing thread finishes the samples it has
+  // already taken before it sees the flag.
+  terminate_threads_.store(true);
+  processing.join();
+  if (report_writer_)
+    report_writer_->close();
+
+  write_energy_report();
   return 0;
+}
+
+void GuiRunner::write_energy_report() {
+  if (energy_accountant_) {
+    energy_accountant_->log_summary();
+    if (energy_accountant_->write_csv(energy_report_path_)) {
+      SPDLOG_INFO("Energy report written to {}.", energy_report_path_);
+    }
+  }
 }
\ No newline at end of file
@@ -1,30 +1,91 @@
 #pragma once
+#include "energy_accountant.hpp"
+#include "frame_pacer.hpp"
+#include "report_render.hpp"
 #include "shared_data_types.hpp"
 #include <atomic>
 #include <memory>
+#include <string>
+#include <thread>
 #include <vector>
 
 // Forward declarations
+class CsvLogWriter;
+class EyeSnapshotWriter;
+class FlightRecorder;
+class MetricsAggregator;
 class PmTableReader;
+class SampleRecorder;
+class SampleReplay;
+class ShmRingConsumer;
+class TraceExporter;
+struct EyeSnapshot;
+struct PmTableLayout;
 struct GLFWwindow;
 
+// Eye-diagram accumulation around each rising worker edge.
+struct EyeConfig {
+  int window_before_ms = 50;
+  int window_after_ms = 150;
+  float trim_percent = 10.0f; // Cut from each end for the trimmed mean
+};
+
+// PNG/SVG report of the eyes and sensor series per experiment step (core),
+// written as <prefix>_core<N>.png/.svg; off if the prefix is empty. During
+// live runs the render uses at most LIVE_REPORT_THREADS threads.
+struct ReportConfig {
+  static constexpr unsigned LIVE_REPORT_THREADS = 2;
+
+  std::string prefix;
+  ReportOptions options;
+};
+
 class GuiRunner {
 public:
+  // Live samples come from pm_table_reader, or from a pm_acqd ring (shm).
+  // With neither, they come from replay and no worker load is started;
+  // without a replay either, the GUI only shows the accumulation restored
+  // from resume (snapshot view).
   GuiRunner(int num_hardware_threads, int measurement_core, int period,
-            int duty_cycle, int cycles, PmTableReader &pm_table_reader,
-            size_t n_measurements, const std::vector<int> &interesting_index);
+            int duty_cycle, int cycles, PmTableReader *pm_table_reader,
+            ShmRingConsumer *shm, size_t n_measurements,
+            const std::vector<int> &interesting_index,
+            std::string energy_report_path, FlightRecorder *flight_recorder,
+            CsvLogWriter *csv_writer, TraceExporter *trace_exporter,
+            MetricsAggregator *metrics, SampleRecorder *recorder,
+            SampleReplay *replay,
+            const EyeConfig &eye, EyeSnapshotWriter *snapshot_writer,
+            const EyeSnapshot *resume, ReportConfig report = {});
 
   ~GuiRunner();
 
   GuiRunner(const GuiRunner &) = delete;
   GuiRunner &operator=(const GuiRunner &) = delete;
 
-  int run();
+  // The window, drawn on input, new data or once a second, at most
+  // pacing.max_fps times per second.
+  int run(const FramePacer::Config &pacing = {});
+
+  // Replay without a window: push the recording through the processing
+  // thread as fast as allowed and return when it has been consumed.
+  int run_headless();
+
+  // The eye diagrams in the terminal instead of a window (no X server),
+  // redrawn refresh_hz times per second.
+  int run_tui(double refresh_hz);
 
 private:
+  // Start the sample source, worker and processing threads; stop and join
+  // them.
+  void start_threads();
+  void stop_threads();
+  std::string status() const;
+
   // Thread Functions
   void run_processing_thread();
   void run_worker_thread() const;
+  void write_energy_report();
+  bool live() const { return pm_table_reader_ || shm_; }
 
   // Experiment parameters
   int num_hardware_threads_;
@@ -35,12 +96,52 @@ private:
   size_t n_measurements_;
   const std::vector<int> &interesting_index_;
 
-  // --- FIXED: Eye diagram window parameters ---
-  const int window_before_ms_{50};
-  const int window_after_ms_{150};
+  // Eye diagram window parameters
+  const int window_before_ms_;
+  const int window_after_ms_;
+  const float trim_percent_;
+
+  // Built by the processing thread when the core changes and on exit, and
+  // rendered by report_writer_ in the background (null if off).
+  ReportConfig report_;
+  std::unique_ptr<ReportWriter> report_writer_;
+
+  // Energy per phase (worker busy/idle per core, markers); owned by the
+  // processing thread until it has been joined. Null if the layout is unknown.
+  std::unique_ptr<EnergyAccountant> energy_accountant_;
+  std::string energy_report_path_;
+  uint32_t pm_table_version_ = 0;
+  const PmTableLayout *layout_ = nullptr;
+
+  // Optional; fed by the measurement thread, triggered by the processing
+  // thread (marker, PROCHOT, thermal limit) and the GUI.
+  FlightRecorder *flight_recorder_ = nullptr;
+
+  // Optional; every sample is queued by the processing thread (long-format
+  // CSV for python/plot_measure.py).
+  CsvLogWriter *csv_writer_ = nullptr;
+
+  // Optional; written by the processing thread (counter tracks, worker state
+  // and markers on CLOCK_MONOTONIC for ui.perfetto.dev).
+  TraceExporter *trace_exporter_ = nullptr;
+
+  // Optional; fed by the processing thread, scraped by a MetricsServer.
+  MetricsAggregator *metrics_ = nullptr;
+
+  // Optional; every sample with the core under test, for later replay.
+  SampleRecorder *recorder_ = nullptr;
+  // Replay source instead of the measurement thread.
+  SampleReplay *replay_ = nullptr;
+
+  // Optional; the processing thread hands it a copy of the accumulation
+  // periodically, on the GUI's request and on exit.
+  EyeSnapshotWriter *snapshot_writer_ = nullptr;
+  // Optional; accumulation restored before the first sample.
+  const EyeSnapshot *resume_ = nullptr;
 
   // System resources
-  PmTableReader &pm_table_reader_;
+  PmTableReader *pm_table_reader_;
+  ShmRingConsumer *shm_;
   GLFWwindow *window_ = nullptr;
 
   // Thread communication and data structures
@@ -51,6 +152,12 @@ private:
   std::vector<std::unique_ptr<DisplayData>> display_data_b_; // Write buffer B
   std::vector<std::atomic<DisplayData *>>
       gui_display_pointers_; // Pointers for GUI to read
+  // Bumped by publish_display(); the GUI redraws when it changes.
+  std::atomic<uint64_t> display_generation_{0};
+
+  std::thread measurement_thread_;
+  std::thread worker_thread_;
+  std::thread processing_thread_;
 
   // Thread control
   std::atomic<bool> manual_mode_{true};
@@ -6,15 +6,31 @@
 #include <cstdint>
 #include <fstream>
 #include <iostream>
+#include <memory>
 #include <stdexcept>
+#include <string>
 #include <thread>
 #include <unistd.h> // For geteuid
 #include <vector>
 
+#include "async_log_writer.hpp"
+#include "columnar_log.hpp"
+#include "mmap_ring_log.hpp"
+#include "pmz_log_writer.hpp"
+#include "popl.hpp"
+#include "segmented_log.hpp"
+#include "shm_ring.hpp"
+#include "synthetic_table.hpp"
+
 // --- Configuration ---
 const char *PM_TABLE_PATH = "/sys/kernel/ryzen_smu_drv/pm_table";
 const char *PM_TABLE_SIZE_PATH = "/sys/kernel/ryzen_smu_drv/pm_table_size";
+const char *PM_TABLE_VERSION_PATH =
+    "/sys/kernel/ryzen_smu_drv/pm_table_version";
 const char *OUTPUT_FILE_PATH = "pm_table_log.bin";
+const char *COMPRESSED_OUTPUT_FILE_PATH = "pm_table_log.pmz";
+const char *COLUMNAR_OUTPUT_FILE_PATH = "pm_table_log.pmcol";
+const char *RING_OUTPUT_FILE_PATH = "pm_table_log.pmr";
 // The target sampling period of 1 millisecond (1kHz)
 constexpr auto SAMPLING_PERIOD = std::chrono::milliseconds(1);
 
@@ -45,6 +61,18 @@ uint64_t read_sysfs_uint64(const std::string &path) {
   }
   return value;
 }
+
+/**
+ * @brief Reads the 32-bit pm_table version, 0 if the driver does not report it.
+ */
+uint32_t read_pm_table_version() {
+  std::ifstream file(PM_TABLE_VERSION_PATH, std::ios::binary);
+  uint32_t version = 0;
+  if (!file.read(reinterpret_cast<char *>(&version), sizeof(version)))
+    version = 0;
+  return version;
+}
+
 #define SPDLOG_ERROR
 #define SPDLOG_INFO
 #define SPDLOG_WARN
@@ -85,7 +113,82 @@ void setup() {
   // }
 }
 
-int main() {
+int main(int argc, char **argv) {
+  using namespace popl;
+
+  OptionParser op("Allowed options");
+  auto help_option = op.add<Switch>("h", "help", "produce help message");
+  auto compress_option = op.add<Switch>(
+      "z", "compress", "Write the compressed .pmz format instead of .bin");
+  auto columnar_option = op.add<Switch>(
+      "", "columnar",
+      "Write the column-major .pmcol format (numpy.memmap) instead of .bin");
+  auto ring_option = op.add<Value<double>>(
+      "r", "ring-minutes",
+      "Record into a crash-safe mmap ring (.pmr) holding this many minutes",
+      0.0);
+  auto output_option = op.add<Value<std::string>>(
+      "o", "output", "Output file (default pm_table_log.bin/.pmz/.pmcol/.pmr)");
+  auto encoder_core_option = op.add<Value<int>>(
+      "", "encoder-core",
+      "Pin the .pmz/.pmcol writer thread to this CPU (-1 = no pin)", -1);
+  auto soak_option = op.add<Switch>(
+      "", "soak",
+      "Unattended multi-day run: rotate the output into numbered segments "
+      "with an index, bound the writer memory and write checkpoints");
+  auto rotate_mb_option = op.add<Value<double>>(
+      "", "rotate-mb", "Soak: start a new segment after this many MiB", 1024);
+  auto rotate_minutes_option = op.add<Value<double>>(
+      "", "rotate-minutes", "Soak: start a new segment after this many minutes",
+      60);
+  auto memory_budget_option = op.add<Value<double>>(
+      "", "memory-budget-mb", "Soak: upper bound for the writer buffers", 256);
+  auto checkpoint_option = op.add<Value<double>>(
+      "", "checkpoint-minutes", "Soak: interval of the summary checkpoints",
+      10);
+  auto duration_option = op.add<Value<double>>(
+      "", "duration-hours", "Stop after this many hours (0 = until Ctrl+C)",
+      0);
+  auto synthetic_option = op.add<Value<uint64_t>>(
+      "", "synthetic",
+      "Record a generated table of this many bytes instead of the driver's "
+      "(for soak tests without ryzen_smu)",
+      0);
+  auto shm_option = op.add<Value<std::string>>(
+      "", "shm",
+      "Record from a running pm_acqd instead of reading the driver "
+      "(shared-memory name, e.g. pm_table)");
+  op.parse(argc, argv);
+  if (help_option->is_set()) {
+    std::cout << op << std::endl;
+    return EXIT_SUCCESS;
+  }
+  const bool compress = compress_option->is_set();
+  const bool columnar = columnar_option->is_set();
+  const bool ring = ring_option->value() > 0;
+  const bool soak = soak_option->is_set() || rotate_mb_option->is_set() ||
+                    rotate_minutes_option->is_set();
+  if (compress + columnar + ring > 1) {
+    std::cerr << "Error: --compress, --columnar and --ring-minutes are "
+                 "exclusive."
+              << std::endl;
+    return EXIT_FAILURE;
+  }
+  if (soak && ring) {
+    std::cerr << "Error: a ring log is already bounded; --soak does not apply."
+              << std::endl;
+    return EXIT_FAILURE;
+  }
+  std::string output_path = OUTPUT_FILE_PATH;
+  if (output_option->is_set())
+    output_path = output_option->value();
+  else if (compress)
+    output_path = COMPRESSED_OUTPUT_FILE_PATH;
+  else if (columnar)
+    output_path = COLUMNAR_OUTPUT_FILE_PATH;
+  else if (ring)
+    output_path = RING_OUTPUT_FILE_PATH;
+
   // Register signal handlers for SIGINT (Ctrl+C) and SIGTERM
   signal(SIGINT, signalHandler);
   signal(SIGTERM, signalHandler);
@@ -98,8 +201,26 @@ int main() {
   // }
 
   try {
+    // With --shm, pm_acqd owns the driver; size, version, pace and
+    // timestamps all come from its ring.
+    std::unique_ptr<ShmRingConsumer> shm;
+    if (shm_option->is_set()) {
+      shm = std::make_unique<ShmRingConsumer>(shm_option->value(), "pm_reader");
+      if (!*shm) {
+        std::cerr << "Error: No pm_acqd ring named " << shm_option->value()
+                  << "." << std::endl;
+        return EXIT_FAILURE;
+      }
+    }
+
     // First, determine the exact size of the pm_table
-    uint64_t pm_table_size = read_sysfs_uint64(PM_TABLE_SIZE_PATH);
+    const bool synthetic = synthetic_option->value() > 0;
+    uint64_t pm_table_size = shm         ? shm->sample_bytes()
+                             : synthetic ? synthetic_option->value()
+                                         : read_sysfs_uint64(PM_TABLE_SIZE_PATH);
+    const uint32_t pm_table_version = shm         ? shm->pm_table_version()
+                                      : synthetic ? 0
+                                                  : read_pm_table_version();
     if (pm_table_size == 0 || pm_table_size > 16384) { // Sanity check size
       std::cerr << "Error: Invalid pm_table size reported: " << pm_table_size
                 << " bytes." << std::endl;
@@ -109,8 +230,11 @@ int main() {
               << std::endl;
 
     // Open the pm_table file for reading
-    std::ifstream pm_table_stream(PM_TABLE_PATH, std::ios::binary);
-    if (!pm_table_stream) {
+    std::ifstream pm_table_stream;
+    const bool from_driver = !synthetic && !shm;
+    if (from_driver)
+      pm_table_stream.open(PM_TABLE_PATH, std::ios::binary);
+    if (from_driver && !pm_table_stream) {
       std::cerr << "Error: Failed to open " << PM_TABLE_PATH << "."
                 << std::endl;
       std::cerr << "Is the ryzen_smu kernel module loaded?" << std::endl;
@@ -118,26 +242,130 @@ int main() {
     }
     pm_table_stream.seekg(0); // Seek to the beginning for each read
 
-    // Open the output file for writing the logged data
-    std::ofstream output_stream(OUTPUT_FILE_PATH,
-                                std::ios::binary | std::ios::trunc);
-    if (!output_stream) {
-      std::cerr << "Error: Failed to open output file " << OUTPUT_FILE_PATH
+    // Open the output file for writing the logged data. The sampling loop
+    // only copies into the writer's preallocated ring; a separate thread does
+    // the file I/O (and the encoding/transposing for .pmz/.pmcol), so
+    // writeback stalls do not reach the 1 kHz loop.
+    std::unique_ptr<AsyncLogWriter> raw_stream;
+    std::unique_ptr<PmzLogWriter> pmz_stream;
+    std::unique_ptr<ColumnarLogWriter> columnar_stream;
+    std::unique_ptr<MmapRingLog> ring_stream;
+    std::unique_ptr<SegmentedLog> soak_stream;
+    bool opened = false;
+    if (soak) {
+      // Rotation, the segment index and the checkpoints run on a supervisor
+      // thread; the loop below only sees a pointer swap at each rotation.
+      SegmentedLog::Config config;
+      config.format = compress   ? SegmentedLog::Format::Pmz
+                      : columnar ? SegmentedLog::Format::Columnar
+                                 : SegmentedLog::Format::Raw;
+      config.max_segment_bytes =
+          static_cast<uint64_t>(rotate_mb_option->value() * 1048576.0);
+      config.max_segment_age = std::chrono::seconds(
+          static_cast<int64_t>(rotate_minutes_option->value() * 60.0));
+      config.memory_budget_bytes =
+          static_cast<size_t>(memory_budget_option->value() * 1048576.0);
+      config.checkpoint_interval = std::chrono::seconds(
+          static_cast<int64_t>(checkpoint_option->value() * 60.0));
+      config.writer_core = encoder_core_option->value();
+      soak_stream = std::make_unique<SegmentedLog>(
+          output_path, static_cast<uint32_t>(pm_table_size),
+          pm_table_version, config);
+      opened = static_cast<bool>(*soak_stream);
+    } else if (compress) {
+      PmzLogWriter::Config config;
+      config.encoder_core = encoder_core_option->value();
+      pmz_stream = std::make_unique<PmzLogWriter>(
+          output_path, static_cast<uint32_t>(pm_table_size),
+          pm_table_version, config);
+      opened = static_cast<bool>(*pmz_stream);
+    } else if (columnar) {
+      ColumnarLogWriter::Config config;
+      config.writer_core = encoder_core_option->value();
+      columnar_stream = std::make_unique<ColumnarLogWriter>(
+          output_path, static_cast<uint32_t>(pm_table_size),
+          pm_table_version, config);
+      opened = static_cast<bool>(*columnar_stream);
+    } else if (ring) {
+      // Each sample is a memcpy into a file-backed mapping; a flusher thread
+      // msyncs once a second, so even a kernel panic loses at most ~1 s.
+      MmapRingLog::Config config;
+      config.capacity = static_cast<uint64_t>(
+          ring_option->value() * 60.0 *
+          (std::chrono::seconds(1) / SAMPLING_PERIOD));
+      ring_stream = std::make_unique<MmapRingLog>(
+          output_path, static_cast<uint32_t>(pm_table_size),
+          pm_table_version, config);
+      opened = static_cast<bool>(*ring_stream);
+    } else {
+      raw_stream = std::make_unique<AsyncLogWriter>(output_path);
+      opened = static_cast<bool>(*raw_stream);
+    }
+    if (!opened) {
+      std::cerr << "Error: Failed to open output file " << output_path
                 << " for writing." << std::endl;
       return EXIT_FAILURE;
     }
 
-    std::cout << "Starting to read pm_table at 1kHz. Press Ctrl+C to stop."
-              << std::endl;
-    std::cout << "Writing data to " << OUTPUT_FILE_PATH << std::endl;
+    if (shm)
+      std::cout << "Recording samples published by pm_acqd. Press Ctrl+C to "
+                   "stop."
+                << std::endl;
+    else
+      std::cout << "Starting to read pm_table at 1kHz. Press Ctrl+C to stop."
+                << std::endl;
+    std::cout << "Writing data to " << output_path << std::endl;
 
     std::vector<char> buffer(pm_table_size);
     uint64_t samples_written = 0;
+    uint64_t samples_read = 0;
+
+    // A full writer ring drops the sample (counted) instead of blocking.
+    auto append = [&](uint64_t timestamp) {
+      if (soak_stream)
+        return soak_stream->append_record(timestamp, buffer.data(),
+                                          pm_table_size);
+      if (pmz_stream)
+        return pmz_stream->append_record(timestamp, buffer.data(),
+                                         pm_table_size);
+      if (columnar_stream)
+        return columnar_stream->append_record(timestamp, buffer.data(),
+                                              pm_table_size);
+      if (ring_stream)
+        return ring_stream->append_record(timestamp, buffer.data(),
+                                          pm_table_size);
+      return raw_stream->append_record(timestamp, buffer.data(),
+                                       pm_table_size);
+    };
 
     // --- The Main High-Precision Loop ---
     auto next_sample_time = std::chrono::steady_clock::now();
+    const auto deadline =
+        duration_option->value() > 0
+            ? next_sample_time +
+                  std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                      std::chrono::duration<double, std::ratio<3600>>(
+                          duration_option->value()))
+            : std::chrono::steady_clock::time_point::max();
+
+    while (running && next_sample_time < deadline) {
+      if (shm) {
+        // The daemon sets the pace: drain what it has published, then nap.
+        ShmRingConsumer::Sample sample;
+        if (!shm->next(sample, buffer.data())) {
+          if (!shm->alive()) {
+            std::cerr << "\nError: pm_acqd stopped publishing." << std::endl;
+            break;
+          }
+          std::this_thread::sleep_for(SAMPLING_PERIOD / 2);
+          next_sample_time = std::chrono::steady_clock::now();
+          continue;
+        }
+        if (append(sample.realtime_ns))
+          samples_written++;
+        continue;
+      }
 
-    while (running) {
       // Calculate the time for the next iteration to maintain a consistent 1kHz
       // rate
       next_sample_time += SAMPLING_PERIOD;
@@ -150,9 +378,12 @@ int main() {
       uint64_t timestamp_u64 = static_cast<uint64_t>(timestamp_ns);
 
       // 2. Read the binary pm_table data
-      pm_table_stream.read(buffer.data(), pm_table_size);
+      if (synthetic)
+        fill_synthetic_table(buffer, samples_read++);
+      else
+        pm_table_stream.read(buffer.data(), pm_table_size);
 
-      if (!pm_table_stream) {
+      if (!synthetic && !pm_table_stream) {
         std::cerr << "\nWarning: Failed to read from " << PM_TABLE_PATH
                   << " on sample " << samples_written << std::endl;
         // Don't write partial data; just wait for the next cycle
@@ -160,14 +391,9 @@ int main() {
         continue;
       }
 
-      // 3. Write the timestamp, data size, and data to the output file
-      output_stream.write(reinterpret_cast<const char *>(&timestamp_u64),
-                          sizeof(timestamp_u64));
-      output_stream.write(reinterpret_cast<const char *>(&pm_table_size),
-                          sizeof(pm_table_size));
-      output_stream.write(buffer.data(), pm_table_size);
-
-      samples_written++;
+      // 3. Queue the timestamp, data size, and data for the writer thread.
+      if (append(timestamp_u64))
+        samples_written++;
 
       pm_table_stream.seekg(0); // Seek to the beginning for each read
 
@@ -177,7 +403,69 @@ int main() {
 
     // --- Cleanup ---
     std::cout << "Stopped. Wrote " << samples_written << " samples to "
-              << OUTPUT_FILE_PATH << "." << std::endl;
+              << output_path << "." << std::endl;
+    if (shm) {
+      const auto stats = shm->stats();
+      std::cout << "pm_acqd ring: " << stats.lost << " samples lost in "
+                << stats.overruns << " overruns, max lag " << stats.max_lag
+                << " samples." << std::endl;
+    }
+    if (soak_stream) {
+      soak_stream->close();
+      const auto stats = soak_stream->stats();
+      std::cout << "Soak: " << stats.segments << " segments, "
+                << stats.records << " records, " << stats.dropped_records
+                << " dropped in " << stats.stalls << " stalls, "
+                << stats.file_bytes / 1048576 << " MiB, largest gap across a "
+                << "rotation " << stats.max_boundary_gap_ns / 1e6
+                << " ms. Index: " << output_path << ".segments.json"
+                << std::endl;
+      return EXIT_SUCCESS;
+    }
+    if (pmz_stream) {
+      pmz_stream->close();
+      const auto stats = pmz_stream->stats();
+      std::cout << "Writer: " << stats.dropped_records << " dropped in "
+                << stats.stalls << " stalls, " << stats.blocks
+                << " blocks, " << stats.file_bytes / 1024 << " KiB ("
+                << (stats.file_bytes
+                        ? static_cast<double>(stats.raw_bytes) /
+                              static_cast<double>(stats.file_bytes)
+                        : 0.0)
+                << "x smaller than .bin), longest block encode "
+                << stats.max_encode_ms << " ms." << std::endl;
+      return EXIT_SUCCESS;
+    }
+    if (columnar_stream) {
+      columnar_stream->close();
+      const auto stats = columnar_stream->stats();
+      std::cout << "Writer: " << stats.dropped_records << " dropped in "
+                << stats.stalls << " stalls, " << stats.file_bytes / 1024
+                << " KiB (sidecar " << output_path << ".json)." << std::endl;
+      return EXIT_SUCCESS;
+    }
+    if (ring_stream) {
+      ring_stream->close();
+      const auto stats = ring_stream->stats();
+      std::cout << "Ring: records " << stats.first_seq << ".."
+                << stats.first_seq + stats.records - 1
+                << " this run, longest msync " << stats.max_flush_ms
+                << " ms. Recover with pm_log_convert " << output_path
+                << " out.bin" << std::endl;
+      return EXIT_SUCCESS;
+    }
+    raw_stream->close();
+    const auto stats = raw_stream->stats();
+    std::cout << "Writer: " << stats.dropped_records << " dropped in "
+              << stats.stalls << " stalls, max backlog "
+              << stats.max_backlog_bytes / 1024 << " KiB, longest write "
+              << stats.max_write_ms << " ms, longest fdatasync "
+              << stats.max_sync_ms << " ms"
+              << (stats.direct_io ? " (O_DIRECT)." : ".") << std::endl;
+    if (stats.failed)
+      std::cerr << "Writer: stopped after a write error, "
+                << stats.lost_bytes / 1024 << " KiB not written."
+                << std::endl;
 
   } catch (const std::exception &e) {
     std::cerr << "A critical error occurred: " << e.what() << std::endl;
@@ -1,21 +1,35 @@
 
 #include <atomic>
 #include <chrono>
+#include <csignal>
 #include <ctime>
+#include <numeric>
+#include <sstream>
 #include <thread>
 #include <unistd.h>
 #include <vector>
 
 #include "popl.hpp"
 #include <folly/ProducerConsumerQueue.h>
-#include <folly/stats/StreamingStats.h>
 #include <spdlog/spdlog.h>
 
+#include "activity_scan.hpp"
+#include "column_list.hpp"
+#include "csv_log_writer.hpp"
+#include "eye_snapshot.hpp"
+#include "flight_recorder.hpp"
+#include "float_bits.hpp"
 #include "gui_runner.hpp"
 #include "measurement_types.hpp"
+#include "metrics_exporter.hpp"
+#include "pm_table_layout.hpp"
 #include "pm_table_reader.hpp"
 #include "realtime_guard.hpp"
+#include "sample_recording.hpp"
 #include "shared_data_types.hpp"
+#include "shm_ring.hpp"
+#include "startup_cache.hpp"
+#include "trace_export.hpp"
 #include "workloads.hpp"
 
 using namespace std::chrono_literals;
@@ -24,6 +38,13 @@ using namespace std::chrono_literals;
 // These are used by multiple threads to coordinate.
 std::atomic<bool> g_run_measurement = false;
 std::atomic<int> g_worker_state = 0; // 0 for idle, 1 for busy
+std::atomic<uint64_t> g_work_count = 0; // workload iterations, for J/work
+std::atomic<int> g_marker = 0; // experiment marker, see on_marker_signal
+
+// SIGUSR1 advances the marker so scripts can delimit experiment phases.
+static void on_marker_signal(int) {
+  g_marker.fetch_add(1, std::memory_order_relaxed);
+}
 
 // --- Helper for hybrid sleep/spin ---
 static inline void cpu_relax() { asm volatile("pause" ::: "memory"); }
@@ -49,6 +70,31 @@ static void wait_until(const Clock::time_point &deadline) {
   }
 }
 
+static int64_t steady_ns(Clock::time_point t) {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             t.time_since_epoch())
+      .count();
+}
+
+// Read the pm_table every ms until the scan is done; @p expected is an
+// optional prior that lets it end early (ActivityScan::expect).
+static ActivityScan scan_live(PmTableReader &reader, size_t n_floats,
+                              const ActivityScan::Config &config,
+                              const std::vector<int> *expected) {
+  ActivityScan scan(n_floats, config);
+  if (expected)
+    scan.expect(*expected);
+  std::vector<float> table(n_floats);
+  for (;;) {
+    reader.readi(reinterpret_cast<char *>(table.data()));
+    if (scan.add(table.data(), steady_ns(Clock::now())))
+      break;
+    std::this_thread::sleep_for(1ms);
+  }
+  scan.finish();
+  return scan;
+}
+
 // --- Thread Function Definitions ---
 
 /**
@@ -60,7 +106,8 @@ static void wait_until(const Clock::time_point &deadline) {
  */
 void measurement_thread_func(int core_id,
                              folly::ProducerConsumerQueue<RawSample> &queue,
-                             PmTableReader &pm_table_reader) {
+                             PmTableReader &pm_table_reader,
+                             FlightRecorder *flight_recorder) {
   RealtimeGuard thread_rt(core_id, /*priority=*/98);
 
   while (!g_run_measurement.load(std::memory_order_acquire)) {
@@ -70,6 +117,11 @@ void measurement_thread_func(int core_id,
   const auto sample_period = 1ms;
   auto next_sample_time = Clock::now();
 
+  // The flight recorder writes pm_reader logs, which carry wall-clock
+  // timestamps. Convert once instead of reading a second clock per sample.
+  const auto wall_offset = std::chrono::system_clock::now().time_since_epoch() -
+                           Clock::now().time_since_epoch();
+
   const size_t num_floats = pm_table_reader.getPmTableSize() / sizeof(float);
   if (num_floats > PM_TABLE_MAX_FLOATS) {
     SPDLOG_ERROR("PM Table size ({}) exceeds RawSample buffer size ({}).",
@@ -84,10 +136,19 @@ void measurement_thread_func(int core_id,
     RawSample sample;
     sample.timestamp = Clock::now();
     sample.worker_state = g_worker_state.load(std::memory_order_relaxed);
+    sample.work_count = g_work_count.load(std::memory_order_relaxed);
+    sample.marker = g_marker.load(std::memory_order_relaxed);
 
     pm_table_reader.read(reinterpret_cast<char *>(sample.measurements.data()));
     sample.num_measurements = num_floats;
 
+    if (flight_recorder) {
+      const auto wall = sample.timestamp.time_since_epoch() + wall_offset;
+      flight_recorder->record(
+          std::chrono::duration_cast<std::chrono::nanoseconds>(wall).count(),
+          sample.measurements.data());
+    }
+
     while (!queue.write(sample)) {
       // This case means the processing thread is falling behind.
       // Spinning here is the correct behavior to not lose data, assuming
@@ -97,6 +158,78 @@ void measurement_thread_func(int core_id,
   }
 }
 
+/**
+ * @brief Measurement thread for --shm: pm_acqd reads the pm_table, this
+ * thread only forwards its samples.
+ *
+ * The daemon's CLOCK_MONOTONIC stamp (the clock behind steady_clock) becomes
+ * the sample time, so the eye diagram sees when the table was read rather
+ * than when it arrived. Between samples the thread sleeps until the next one
+ * is due and spins only for the last stretch, like measurement_thread_func,
+ * so the worker state it attaches is at most a few microseconds old.
+ */
+void shm_measurement_thread_func(int core_id,
+                                 folly::ProducerConsumerQueue<RawSample> &queue,
+                                 ShmRingConsumer &shm,
+                                 FlightRecorder *flight_recorder) {
+  RealtimeGuard thread_rt(core_id, /*priority=*/98);
+
+  while (!g_run_measurement.load(std::memory_order_acquire)) {
+    cpu_relax(); // Wait for the signal to start
+  }
+
+  const size_t num_floats = shm.sample_bytes() / sizeof(float);
+  if (num_floats > PM_TABLE_MAX_FLOATS) {
+    SPDLOG_ERROR("PM Table size ({}) exceeds RawSample buffer size ({}).",
+                 num_floats, PM_TABLE_MAX_FLOATS);
+    return;
+  }
+  const auto period = std::chrono::nanoseconds(shm.period_ns());
+
+  // Whatever was published before the start is stale.
+  ShmRingConsumer::Sample published;
+  while (shm.next(published)) {
+  }
+
+  auto next_due = Clock::now();
+  bool daemon_gone = false;
+  while (g_run_measurement.load(std::memory_order_acquire)) {
+    RawSample sample;
+    if (!shm.next(published, sample.measurements.data())) {
+      if (Clock::now() < next_due) {
+        wait_until(next_due);
+      } else if (!shm.alive()) {
+        if (!daemon_gone)
+          SPDLOG_ERROR("pm_acqd stopped publishing; waiting for it.");
+        daemon_gone = true;
+        std::this_thread::sleep_for(100ms);
+      } else {
+        cpu_relax();
+      }
+      continue;
+    }
+    if (daemon_gone)
+      SPDLOG_INFO("pm_acqd is publishing again.");
+    daemon_gone = false;
+
+    sample.timestamp = TimePoint(std::chrono::duration_cast<Clock::duration>(
+        std::chrono::nanoseconds(published.monotonic_ns)));
+    next_due = sample.timestamp + period;
+    sample.worker_state = g_worker_state.load(std::memory_order_relaxed);
+    sample.work_count = g_work_count.load(std::memory_order_relaxed);
+    sample.marker = g_marker.load(std::memory_order_relaxed);
+    sample.num_measurements = num_floats;
+
+    if (flight_recorder)
+      flight_recorder->record(published.realtime_ns,
+                              sample.measurements.data());
+
+    while (!queue.write(sample)) {
+      cpu_relax();
+    }
+  }
+}
+
 /**
  * @brief (FIX) Provides the implementation for the worker thread.
  *
@@ -123,6 +256,7 @@ void worker_thread_func(int core_id, int period_ms, int duty_cycle_percent,
     auto busy_start = Clock::now();
     while ((Clock::now() - busy_start) < busy_duration) {
       integer_alu_workload(1000);
+      g_work_count.fetch_add(1000, std::memory_order_relaxed);
     }
 
     g_worker_state.store(0, std::memory_order_relaxed);
@@ -131,6 +265,7 @@ void worker_thread_func(int core_id, int period_ms, int duty_cycle_percent,
   // Ensure state is idle when the burst is done
   g_worker_state.store(0, std::memory_order_relaxed);
 }
+
 // --- Main Program Logic ---
 
 int main(int argc, char **argv) {
@@ -150,6 +285,108 @@ int main(int argc, char **argv) {
                                            "Duty cycle in percent (10-90)", 50);
   auto cycles_opt =
       op.add<Value<int>>("c", "cycles", "Busy/wait cycles per run", 30);
+  auto energy_opt = op.add<Value<std::string>>(
+      "e", "energy-report", "Per-phase energy summary CSV written on exit",
+      "results/energy_report.csv");
+  auto flight_opt = op.add<Value<double>>(
+      "f", "flight-recorder",
+      "Seconds of raw history kept for trigger dumps (0 = off)", 0.0);
+  auto flight_delta_opt = op.add<Switch>(
+      "", "flight-delta", "Delta-compress the flight recorder ring");
+  auto csv_opt = op.add<Value<std::string>>(
+      "o", "csv",
+      "Long-format CSV of every sample for python/plot_measure.py "
+      "(empty = off), e.g. results/output.csv",
+      "");
+  auto csv_columns_opt = op.add<Value<std::string>>(
+      "", "csv-columns",
+      "pm_table indices in the CSV, e.g. 17,20-31, or 'all' (default: the "
+      "changing sensors)");
+  auto csv_split_opt = op.add<Value<double>>(
+      "", "csv-split-mb",
+      "Continue in output.001.csv, ... after this many MiB (0 = one file)", 0);
+  auto trace_opt = op.add<Value<std::string>>(
+      "", "trace",
+      "Counter-track trace for ui.perfetto.dev: .pftrace (Perfetto) or .json "
+      "(Chrome); empty = off",
+      "");
+  auto trace_cells_opt = op.add<Value<std::string>>(
+      "", "trace-cells",
+      "pm_table indices exported as tracks besides the derived channels, "
+      "e.g. 17,20-31 or 'all'");
+  auto record_opt = op.add<Value<std::string>>(
+      "", "record", "Record the raw sample stream (.pmrs) for --replay", "");
+  auto replay_opt = op.add<Value<std::string>>(
+      "", "replay",
+      "Feed a .pmrs recording through the processing pipeline instead of "
+      "the hardware");
+  auto replay_speed_opt = op.add<Value<double>>(
+      "", "replay-speed", "Multiple of real time (0 = as fast as possible)",
+      0.0);
+  auto shm_opt = op.add<Value<std::string>>(
+      "", "shm",
+      "Take live samples from a running pm_acqd (shared-memory name, e.g. "
+      "pm_table) instead of reading the driver");
+  auto metrics_opt = op.add<Value<std::string>>(
+      "", "metrics",
+      "Serve Prometheus metrics on a Unix socket path or localhost port");
+  auto metrics_window_opt = op.add<Value<double>>(
+      "", "metrics-window-seconds", "Window of the --metrics statistics",
+      10.0);
+  auto headless_opt = op.add<Switch>(
+      "", "headless",
+      "With --replay: no window, exit when the recording is consumed");
+  auto tui_opt = op.add<Switch>(
+      "", "tui",
+      "Draw the eye diagrams in this terminal instead of a window (no X "
+      "server needed)");
+  auto tui_hz_opt = op.add<Value<double>>(
+      "", "tui-hz", "Redraws per second of --tui", 4.0);
+  auto gui_fps_opt = op.add<Value<double>>(
+      "", "gui-fps",
+      "Most frames per second of the window; it only redraws on input, a "
+      "new eye window or once a second",
+      60.0);
+  auto gui_continuous_opt = op.add<Switch>(
+      "", "gui-continuous",
+      "Redraw the window continuously (for comparing GUI CPU use)");
+  auto eye_before_opt = op.add<Value<int>>(
+      "", "eye-before-ms", "Eye window before the rising worker edge", 50);
+  auto eye_after_opt = op.add<Value<int>>(
+      "", "eye-after-ms", "Eye window after the rising worker edge", 150);
+  auto trim_opt = op.add<Value<float>>(
+      "", "trim-percent", "Cut from each end for the eye's trimmed mean",
+      10.0f);
+  auto snapshot_opt = op.add<Value<std::string>>(
+      "", "eye-snapshot",
+      "Save the eye accumulation (.pmes) periodically, from the GUI and on "
+      "exit (empty = off)",
+      "");
+  auto snapshot_minutes_opt = op.add<Value<double>>(
+      "", "eye-snapshot-minutes",
+      "Interval of --eye-snapshot (0 = GUI button and exit only)", 5.0);
+  auto resume_opt = op.add<Value<std::string>>(
+      "", "eye-resume",
+      "Continue the accumulation of a .pmes snapshot (live or --replay)");
+  auto view_opt = op.add<Value<std::string>>(
+      "", "eye-view", "Show a .pmes snapshot without hardware");
+  auto report_opt = op.add<Value<std::string>>(
+      "", "report",
+      "Write <prefix>_core<N>.png/.svg (eyes with percentile bands, sensor "
+      "series) after each core and on exit (empty = off)",
+      "");
+  auto report_columns_opt = op.add<Value<int>>(
+      "", "report-columns", "Mini-plots per row of --report", 8);
+  auto startup_cache_opt = op.add<Value<std::string>>(
+      "", "startup-cache",
+      "Directory of the per-host cache of changing sensors; a scan that "
+      "reproduces it ends early, a change is logged and saved (empty = off)",
+      default_startup_cache_dir());
+  auto precheck_stable_opt = op.add<Value<int>>(
+      "", "precheck-stable",
+      "End the sensor scan after this many samples without a change in the "
+      "result (0 = always scan 1000)",
+      250);
 
   op.parse(argc, argv);
 
@@ -158,6 +395,8 @@ int main(int argc, char **argv) {
     return 0;
   }
 
+  std::signal(SIGUSR1, on_marker_signal);
+
   // --- Experiment Setup ---
   const int num_hardware_threads = std::thread::hardware_concurrency();
   constexpr int measurement_core = 0;
@@ -165,43 +404,336 @@ int main(int argc, char **argv) {
               "pinned to core {}.",
               num_hardware_threads, measurement_core);
 
-  PmTableReader pm_table_reader;
-  const size_t n_measurements =
-      pm_table_reader.getPmTableSize() / sizeof(float);
+  // A snapshot fixes the sensors and the eye window of the accumulation.
+  std::unique_ptr<EyeSnapshot> resume;
+  if (resume_opt->is_set() || view_opt->is_set()) {
+    if (resume_opt->is_set() && view_opt->is_set()) {
+      SPDLOG_ERROR("--eye-resume and --eye-view are mutually exclusive.");
+      return 1;
+    }
+    resume = std::make_unique<EyeSnapshot>();
+    if (!read_eye_snapshot(resume_opt->is_set() ? resume_opt->value()
+                                                : view_opt->value(),
+                           *resume))
+      return 1;
+    SPDLOG_INFO("Loaded eye snapshot: {} sensors, core {}, {} windows.",
+                resume->interesting.size(), resume->core, resume->n_windows);
+  }
+
+  if (tui_opt->is_set() && !(tui_hz_opt->value() > 0.0)) {
+    SPDLOG_ERROR("--tui-hz must be positive.");
+    return 1;
+  }
 
+  if (shm_opt->is_set() && (replay_opt->is_set() || view_opt->is_set())) {
+    SPDLOG_ERROR("--shm is a live source; it cannot be combined with "
+                 "--replay or --eye-view.");
+    return 1;
+  }
+
+  // Replay and snapshot view need neither the driver nor the hardware.
+  std::unique_ptr<SampleReplay> replay;
+  std::unique_ptr<PmTableReader> pm_table_reader;
+  std::unique_ptr<ShmRingConsumer> shm;
+  size_t n_measurements = 0;
+  uint32_t pm_table_version = 0;
+  if (view_opt->is_set()) {
+    if (replay_opt->is_set()) {
+      SPDLOG_ERROR("--eye-view cannot be combined with --replay; use "
+                   "--eye-resume to continue with a recording.");
+      return 1;
+    }
+    n_measurements = resume->n_floats;
+    pm_table_version = resume->pm_table_version;
+  } else if (replay_opt->is_set()) {
+    replay = std::make_unique<SampleReplay>(replay_opt->value(),
+                                            replay_speed_opt->value());
+    if (!*replay)
+      return 1;
+    n_measurements = replay->n_floats();
+    pm_table_version = replay->pm_table_version();
+  } else if (shm_opt->is_set()) {
+    shm = std::make_unique<ShmRingConsumer>(shm_opt->value(), "pm_measure");
+    if (!*shm)
+      return 1;
+    n_measurements = shm->sample_bytes() / sizeof(float);
+    pm_table_version = shm->pm_table_version();
+  } else {
+    pm_table_reader = std::make_unique<PmTableReader>();
+    n_measurements = pm_table_reader->getPmTableSize() / sizeof(float);
+    pm_table_version = pm_table_reader->getPmTableVersion();
+  }
+
+  if (resume && resume->n_floats != n_measurements) {
+    SPDLOG_ERROR("The snapshot has {} floats, the pm_table {}.",
+                 resume->n_floats, n_measurements);
+    return 1;
+  }
+
+  // Sensors that change: from the snapshot, all with -a, or a scan of the
+  // source's first samples. Live, the scan runs before the worker starts and
+  // is checked against the startup cache.
+  ActivityScan::Config precheck;
+  precheck.stable_samples =
+      static_cast<size_t>(std::max(0, precheck_stable_opt->value()));
   std::vector<int> interesting_index;
-  if (all_option->is_set()) {
+  if (resume) {
+    interesting_index = resume->interesting;
+  } else if (all_option->is_set()) {
     interesting_index.resize(n_measurements);
     std::iota(interesting_index.begin(), interesting_index.end(), 0);
-  } else {
-    // Find which sensors are actively changing
-    RealtimeGuard precheck_rt(measurement_core, 98);
+  } else if (replay) {
+    // Same rule over the start of the recording.
+    ActivityScan scan(n_measurements, precheck);
+    auto sample = std::make_unique<RawSample>();
+    for (uint64_t r = 0; r < replay->records(); ++r) {
+      replay->read(r, *sample);
+      if (scan.add(sample->measurements.data(),
+                   steady_ns(sample->timestamp)))
+        break;
+    }
+    scan.finish();
+    interesting_index = scan.active();
+    SPDLOG_INFO("Found {} changing sensors out of {} in {} samples.",
+                interesting_index.size(), n_measurements, scan.samples());
+  } else if (shm) {
+    // Same rule over what the daemon publishes next.
+    ActivityScan scan(n_measurements, precheck);
     std::vector<float> measurements(n_measurements);
-    std::vector<folly::StreamingStats<float, float>> stats(n_measurements);
-    constexpr int n_samples = 1000;
-    for (int count = 0; count < n_samples; count++) {
-      pm_table_reader.readi(reinterpret_cast<char *>(measurements.data()));
-      for (size_t i = 0; i < n_measurements; ++i) {
-        stats[i].add(measurements[i]);
+    ShmRingConsumer::Sample sample;
+    while (shm->alive()) {
+      if (!shm->next(sample, measurements.data())) {
+        std::this_thread::sleep_for(1ms);
+        continue;
       }
-      std::this_thread::sleep_for(1ms);
+      if (scan.add(measurements.data(),
+                   static_cast<int64_t>(sample.monotonic_ns)))
+        break;
+    }
+    scan.finish();
+    interesting_index = scan.active();
+    SPDLOG_INFO("Found {} changing sensors out of {} in {} samples.",
+                interesting_index.size(), n_measurements, scan.samples());
+  } else {
+    const StartupCacheKey key{pm_table_version,
+                              static_cast<uint32_t>(n_measurements),
+                              cpu_model_name()};
+    const std::string cache_path =
+        startup_cache_opt->value().empty()
+            ? std::string()
+            : startup_cache_path(startup_cache_opt->value(), key);
+    StartupCache cache;
+    const bool cached =
+        !cache_path.empty() && read_startup_cache(cache_path, key, cache);
+    // On the measurement core with the worker idle, as when the cached set
+    // was found, so the two are comparable. The cached set is a prior: the
+    // scan ends at the first block that reproduces it, and only a different
+    // result runs the full scan and rewrites the file.
+    const ActivityScan scan = [&] {
+      RealtimeGuard precheck_rt(measurement_core, 98);
+      return scan_live(*pm_table_reader, n_measurements, precheck,
+                       cached ? &cache.interesting : nullptr);
+    }();
+    interesting_index = scan.active();
+    SPDLOG_INFO("Found {} changing sensors out of {} in {} samples (SMU "
+                "update every {:.2f} ms).",
+                interesting_index.size(), n_measurements, scan.samples(),
+                scan.update_period_ms());
+    if (cached && cache.interesting == interesting_index) {
+      SPDLOG_INFO("Startup cache {} confirmed after {} samples.", cache_path,
+                  scan.samples());
+    } else if (!cache_path.empty()) {
+      if (cached)
+        SPDLOG_WARN("{} changing sensors now, {} in the startup cache; "
+                    "updating it.",
+                    interesting_index.size(), cache.interesting.size());
+      if (write_startup_cache(
+              cache_path, key,
+              {interesting_index, static_cast<float>(scan.update_period_ms()),
+               scan.samples(), static_cast<uint64_t>(std::time(nullptr))}))
+        SPDLOG_INFO("Saved the startup cache {}.", cache_path);
+    }
+  }
+
+  std::unique_ptr<FlightRecorder> flight_recorder;
+  if (flight_opt->value() > 0 && (pm_table_reader || shm)) {
+    FlightRecorder::Config config;
+    config.sample_bytes = pm_table_reader ? pm_table_reader->getPmTableSize()
+                                          : shm->sample_bytes();
+    config.history_seconds = flight_opt->value();
+    config.post_seconds = std::min(2.0, config.history_seconds / 4);
+    // Leave some headroom so the oldest samples are not overwritten before
+    // the dump thread gets to them.
+    config.pre_seconds =
+        0.9 * (config.history_seconds - config.post_seconds);
+    config.delta = flight_delta_opt->is_set();
+    config.pm_table_version = pm_table_version;
+    flight_recorder = std::make_unique<FlightRecorder>(config);
+    if (!*flight_recorder)
+      flight_recorder.reset();
+  }
+
+  std::unique_ptr<CsvLogWriter> csv_writer;
+  if (!csv_opt->value().empty()) {
+    CsvLogWriter::Config config;
+    if (!csv_columns_opt->is_set()) {
+      config.columns = interesting_index;
+    } else if (!parse_column_list(csv_columns_opt->value(), n_measurements,
+                                  config.columns)) {
+      SPDLOG_ERROR("Invalid --csv-columns '{}'.", csv_columns_opt->value());
+      return 1;
     }
+    config.split_bytes =
+        static_cast<uint64_t>(csv_split_opt->value() * 1048576.0);
+    csv_writer = std::make_unique<CsvLogWriter>(csv_opt->value(), config);
+    if (!*csv_writer)
+      csv_writer.reset();
+  }
 
-    for (size_t i = 0; i < n_measurements; ++i) {
-      if (stats[i].sampleVariance() > 1e-9f) {
-        interesting_index.push_back(i);
+  std::unique_ptr<TraceExporter> trace_exporter;
+  if (!trace_opt->value().empty()) {
+    TraceExporter::Config config;
+    config.format = TraceExporter::format_for_path(trace_opt->value());
+    config.layout = find_pm_table_layout(pm_table_version, n_measurements);
+    if (trace_cells_opt->is_set()) {
+      if (!parse_column_list(trace_cells_opt->value(), n_measurements,
+                             config.cells)) {
+        SPDLOG_ERROR("Invalid --trace-cells '{}'.", trace_cells_opt->value());
+        return 1;
       }
+    } else if (!config.layout) {
+      // Nothing to derive; fall back to the changing sensors.
+      config.cells = interesting_index;
     }
-    SPDLOG_INFO("Found {} changing sensors out of {}.",
-                interesting_index.size(), n_measurements);
+    trace_exporter =
+        std::make_unique<TraceExporter>(trace_opt->value(), config);
+    if (!*trace_exporter)
+      trace_exporter.reset();
+  }
+
+  std::unique_ptr<SampleRecorder> recorder;
+  if (!record_opt->value().empty()) {
+    recorder = std::make_unique<SampleRecorder>(
+        record_opt->value(), static_cast<uint32_t>(n_measurements),
+        pm_table_version, SampleRecorder::Config{});
+    if (!*recorder)
+      recorder.reset();
+  }
+
+  EyeConfig eye;
+  eye.window_before_ms = eye_before_opt->value();
+  eye.window_after_ms = eye_after_opt->value();
+  eye.trim_percent = trim_opt->value();
+  if (resume) {
+    eye.window_before_ms = resume->window_before_ms;
+    eye.window_after_ms = resume->window_after_ms;
+    eye.trim_percent = trim_opt->is_set() ? trim_opt->value()
+                                          : resume->trim_percent;
+    if (eye_before_opt->is_set() || eye_after_opt->is_set())
+      SPDLOG_WARN("Using the snapshot's eye window ({} / {} ms).",
+                  eye.window_before_ms, eye.window_after_ms);
+  }
+  if (eye.window_before_ms < 0 || eye.window_after_ms <= 0 ||
+      eye.trim_percent < 0.0f || eye.trim_percent >= 50.0f) {
+    SPDLOG_ERROR("Invalid eye window or trim percentage.");
+    return 1;
+  }
+
+  std::unique_ptr<EyeSnapshotWriter> snapshot_writer;
+  if (!snapshot_opt->value().empty()) {
+    snapshot_writer = std::make_unique<EyeSnapshotWriter>(
+        snapshot_opt->value(), snapshot_minutes_opt->value() * 60.0);
+  }
+
+  // The processing thread aggregates; the server thread only renders the
+  // last completed window.
+  std::unique_ptr<MetricsAggregator> metrics;
+  std::unique_ptr<MetricsServer> metrics_server;
+  if (metrics_opt->is_set() && !view_opt->is_set()) {
+    MetricsAggregator::Config config;
+    config.window_seconds = metrics_window_opt->value();
+    metrics = std::make_unique<MetricsAggregator>(
+        find_pm_table_layout(pm_table_version, n_measurements),
+        n_measurements, config);
+    metrics_server = std::make_unique<MetricsServer>(metrics_opt->value(),
+                                                     *metrics, "pm_measure");
+    if (!*metrics_server)
+      return 1;
+  }
+
+  ReportConfig report;
+  report.prefix = report_opt->value();
+  report.options.panels_per_row = report_columns_opt->value();
+  // is_finite() rejects NaN even under -ffast-math, where !(fps > 0) may not.
+  if (!is_finite(gui_fps_opt->value()) || gui_fps_opt->value() <= 0.0) {
+    SPDLOG_ERROR("--gui-fps must be positive.");
+    return 1;
+  }
+  if (report.options.panels_per_row <= 0) {
+    SPDLOG_ERROR("--report-columns must be positive.");
+    return 1;
   }
 
   // --- Launch the GUI ---
   GuiRunner runner(num_hardware_threads, measurement_core, period_opt->value(),
                    duty_cycle_opt->value(), cycles_opt->value(),
-                   pm_table_reader, n_measurements, interesting_index);
-
-  int result = runner.run();
+                   pm_table_reader.get(), shm.get(), n_measurements,
+                   interesting_index, energy_opt->value(),
+                   flight_recorder.get(), csv_writer.get(),
+                   trace_exporter.get(), metrics.get(), recorder.get(),
+                   replay.get(), eye, snapshot_writer.get(), resume.get(),
+                   std::move(report));
+
+  FramePacer::Config pacing;
+  pacing.max_fps = gui_fps_opt->value();
+  pacing.continuous = gui_continuous_opt->is_set();
+  int result = replay && headless_opt->is_set() ? runner.run_headless()
+               : tui_opt->is_set() ? runner.run_tui(tui_hz_opt->value())
+                                   : runner.run(pacing);
+  if (metrics_server) {
+    const auto stats = metrics_server->stats();
+    SPDLOG_INFO("Metrics: {} scrapes ({} errors), slowest render {:.2f} ms.",
+                stats.scrapes, stats.errors, stats.max_render_ms);
+    metrics_server.reset();
+  }
+  if (snapshot_writer) {
+    snapshot_writer->close();
+    const auto stats = snapshot_writer->stats();
+    SPDLOG_INFO("Eye snapshots: {} written ({} skipped, {} failed) to {}.",
+                stats.written, stats.skipped, stats.failed,
+                snapshot_writer->path());
+  }
+  if (recorder) {
+    recorder->close();
+    const auto stats = recorder->stats();
+    SPDLOG_INFO("Recording: {} samples ({} dropped), {:.1f} MiB.",
+                stats.records, stats.dropped_records,
+                stats.bytes / 1048576.0);
+    if (stats.failed)
+      SPDLOG_ERROR("Recording: {} samples lost after a write error.",
+                   stats.lost_records);
+  }
+  if (csv_writer) {
+    csv_writer->close();
+    const auto stats = csv_writer->stats();
+    SPDLOG_INFO("CSV: {} rows ({} dropped) in {} file(s), {:.1f} MiB, "
+                "longest block {:.1f} ms.",
+                stats.records, stats.dropped_records, stats.files,
+                stats.bytes / 1048576.0, stats.max_block_ms);
+    if (stats.failed)
+      SPDLOG_ERROR("CSV: {} rows lost after a write error.",
+                   stats.lost_records);
+  }
+  if (trace_exporter) {
+    const bool ok = trace_exporter->close();
+    const auto stats = trace_exporter->stats();
+    SPDLOG_INFO("Trace: {} samples, {} counter and {} instant events, "
+                "{:.1f} MiB.",
+                stats.samples, stats.counter_events, stats.instant_events,
+                stats.bytes / 1048576.0);
+    if (!ok)
+      SPDLOG_ERROR("Trace: truncated after a write error.");
+  }
 
   spdlog::shutdown();
   return result;
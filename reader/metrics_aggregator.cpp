@@ -0,0 +1,197 @@
+/**
+ * @file metrics_aggregator.cpp
+ * @brief MetricsAggregator.
+ */
+
+#include "metrics_aggregator.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#include "pm_table_layout.hpp"
+
+namespace {
+
+/// A power or current reading within 1% of its limit counts as a hit; the
+/// SMU regulates to just below the limit rather than onto it.
+constexpr float LIMIT_FRACTION = 0.99f;
+constexpr uint64_t INTERVAL_BIN_NS = 1000;
+
+} // namespace
+
+MetricsAggregator::MetricsAggregator(const PmTableLayout *layout,
+                                     size_t n_floats, Config config)
+    : n_floats_{n_floats},
+      window_ns_{static_cast<uint64_t>(config.window_seconds * 1e9)},
+      bin_ns_{INTERVAL_BIN_NS} {
+  if (layout && n_floats >= layout->min_floats && layout->n_cores > 0) {
+    n_cores_ = layout->n_cores;
+    using Kind = Sensor::Kind;
+    auto add = [this](std::string name, std::string unit, size_t cell,
+                      Kind kind = Kind::Cell, int core = -1) {
+      sensors_.push_back({std::move(name), std::move(unit), core, kind, cell});
+    };
+    add("socket_power", "W", layout->socket_power);
+    add("vddcr_cpu_power", "W", layout->vddcr_cpu_power);
+    add("vddcr_soc_power", "W", layout->vddcr_soc_power);
+    add("core_power_sum", "W", layout->core_power, Kind::CoreSum);
+    add("core_temperature_max", "degC", layout->core_temp, Kind::CoreMax);
+    add("soc_temperature", "degC", layout->soc_temp);
+    add("stapm", "W", layout->stapm_value);
+    add("ppt", "W", layout->ppt_value);
+    add("tdc", "A", layout->tdc_value);
+    add("edc", "A", layout->edc_value);
+    add("thermal", "degC", layout->thm_value);
+    for (size_t c = 0; c < layout->n_cores; ++c) {
+      const int core = static_cast<int>(c);
+      add("core_power", "W", layout->core_power + c, Kind::Cell, core);
+      add("core_temperature", "degC", layout->core_temp + c, Kind::Cell, core);
+      add("core_frequency", "MHz", layout->core_freq + c, Kind::Cell, core);
+      add("core_voltage", "V", layout->core_voltage + c, Kind::Cell, core);
+      add("core_c0", "%", layout->core_c0 + c, Kind::Cell, core);
+    }
+    limits_ = {{"stapm", layout->stapm_value, layout->stapm_limit},
+               {"ppt", layout->ppt_value, layout->ppt_limit},
+               {"tdc", layout->tdc_value, layout->tdc_limit},
+               {"edc", layout->edc_value, layout->edc_limit},
+               {"thermal", layout->thm_value, layout->thm_limit},
+               {"prochot", layout->prochot, SIZE_MAX}};
+  }
+
+  // Intervals up to 8 periods at 1 us resolution; longer ones only move
+  // the maximum.
+  intervals_.resize(std::clamp<uint64_t>(8 * config.period_ns / bin_ns_, 64,
+                                         1 << 16) +
+                    1);
+  previous_.resize(n_floats);
+  limit_active_.resize(limits_.size());
+
+  // Every buffer gets its final size now, so publishing only copies.
+  for (auto *snapshot : {&totals_, &buffers_[0], &buffers_[1], &buffers_[2]}) {
+    snapshot->sensors.resize(sensors_.size());
+    snapshot->limit_samples.resize(limits_.size());
+    snapshot->limit_events.resize(limits_.size());
+  }
+}
+
+float MetricsAggregator::sensor_value(const Sensor &sensor,
+                                      const float *table) const noexcept {
+  switch (sensor.kind) {
+  case Sensor::Kind::Cell:
+    break;
+  case Sensor::Kind::CoreSum: {
+    float sum = 0.0f;
+    for (size_t c = 0; c < n_cores_; ++c)
+      sum += table[sensor.cell + c];
+    return sum;
+  }
+  case Sensor::Kind::CoreMax:
+    return *std::max_element(table + sensor.cell,
+                             table + sensor.cell + n_cores_);
+  }
+  return table[sensor.cell];
+}
+
+uint32_t MetricsAggregator::add(uint64_t monotonic_ns,
+                                const float *table) noexcept {
+  if (last_ns_ != 0 && monotonic_ns > last_ns_) {
+    const uint64_t interval = monotonic_ns - last_ns_;
+    ++intervals_[std::min<uint64_t>(interval / bin_ns_,
+                                    intervals_.size() - 1)];
+    interval_max_ns_ = std::max(interval_max_ns_, interval);
+  }
+  if (window_start_ns_ == 0)
+    window_start_ns_ = monotonic_ns;
+
+  if (last_ns_ != 0 &&
+      std::memcmp(previous_.data(), table, n_floats_ * sizeof(float)) == 0)
+    ++totals_.duplicates;
+  else
+    std::memcpy(previous_.data(), table, n_floats_ * sizeof(float));
+  last_ns_ = monotonic_ns;
+  ++totals_.samples;
+  ++totals_.window_samples;
+
+  for (size_t i = 0; i < sensors_.size(); ++i) {
+    const float value = sensor_value(sensors_[i], table);
+    auto &window = totals_.sensors[i];
+    if (window.count++ == 0) {
+      window.min = window.max = value;
+    } else {
+      window.min = std::min(window.min, value);
+      window.max = std::max(window.max, value);
+    }
+    window.sum += value;
+    window.last = value;
+  }
+
+  uint32_t reached = 0;
+  for (size_t i = 0; i < limits_.size(); ++i) {
+    const auto &limit = limits_[i];
+    const bool hit =
+        limit.limit == SIZE_MAX
+            ? table[limit.value] > 0.5f
+            : table[limit.limit] > 0.0f &&
+                  table[limit.value] >= LIMIT_FRACTION * table[limit.limit];
+    if (hit) {
+      ++totals_.limit_samples[i];
+      if (!limit_active_[i]) {
+        ++totals_.limit_events[i];
+        reached |= 1u << i;
+      }
+    }
+    limit_active_[i] = hit;
+  }
+
+  if (monotonic_ns - window_start_ns_ >= window_ns_)
+    close_window(monotonic_ns);
+  return reached;
+}
+
+void MetricsAggregator::close_window(uint64_t now_ns) noexcept {
+  auto &out = buffers_[back_];
+  out.window_end_ns = now_ns;
+  out.window_seconds = static_cast<double>(now_ns - window_start_ns_) / 1e9;
+  out.window_samples = totals_.window_samples;
+  out.sensors = totals_.sensors; // Same size: no allocation
+  out.samples = totals_.samples;
+  out.dropped = totals_.dropped;
+  out.duplicates = totals_.duplicates;
+  out.limit_samples = totals_.limit_samples;
+  out.limit_events = totals_.limit_events;
+
+  uint64_t n_intervals = 0;
+  for (const uint32_t count : intervals_)
+    n_intervals += count;
+  size_t bin = 0;
+  uint64_t seen = 0;
+  for (size_t q = 0; q < MetricsSnapshot::QUANTILES.size(); ++q) {
+    const auto rank = static_cast<uint64_t>(
+        std::ceil(MetricsSnapshot::QUANTILES[q] * static_cast<double>(n_intervals)));
+    while (bin < intervals_.size() && seen + intervals_[bin] < rank)
+      seen += intervals_[bin++];
+    out.interval_quantiles_s[q] =
+        n_intervals == 0 ? 0.0
+        : bin >= intervals_.size() - 1
+            ? static_cast<double>(interval_max_ns_) / 1e9
+            : (static_cast<double>(bin) + 0.5) *
+                  static_cast<double>(bin_ns_) / 1e9;
+  }
+  out.interval_max_s = static_cast<double>(interval_max_ns_) / 1e9;
+
+  back_ = middle_.exchange(back_ | FRESH, std::memory_order_acq_rel) & 3;
+
+  for (auto &window : totals_.sensors)
+    window = {};
+  std::fill(intervals_.begin(), intervals_.end(), 0);
+  interval_max_ns_ = 0;
+  totals_.window_samples = 0;
+  window_start_ns_ = now_ns;
+}
+
+const MetricsSnapshot &MetricsAggregator::acquire() noexcept {
+  if (middle_.load(std::memory_order_relaxed) & FRESH)
+    front_ = middle_.exchange(front_, std::memory_order_acq_rel) & 3;
+  return buffers_[front_];
+}
@@ -0,0 +1,132 @@
+/**
+ * @file metrics_aggregator.hpp
+ * @brief Windowed statistics of the named pm_table sensors, limit hits and
+ * sampling health, handed from the sampling thread to a reader without
+ * locks.
+ *
+ * The producer feeds every table into a MetricsAggregator, which keeps
+ * per-window min/mean/max of the named sensors (pm_table_layout.hpp), limit
+ * counters and a histogram of sample intervals. At the end of each window it
+ * copies the aggregates into a snapshot and hands that over through a
+ * triple buffer. Used by MetricsServer (metrics_exporter.hpp) and the
+ * pm_telemetry library; it does not log.
+ */
+
+#pragma once
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+struct PmTableLayout;
+
+/** @brief Aggregates of one completed window, plus running totals. */
+struct MetricsSnapshot {
+  struct SensorWindow {
+    float min = 0.0f;
+    float max = 0.0f;
+    float last = 0.0f;
+    double sum = 0.0;
+    uint64_t count = 0;
+  };
+
+  static constexpr std::array<double, 4> QUANTILES = {0.5, 0.9, 0.99, 0.999};
+
+  uint64_t window_end_ns = 0; ///< Monotonic; 0 before the first window
+  double window_seconds = 0.0;
+  uint64_t window_samples = 0;
+  std::vector<SensorWindow> sensors;
+  std::array<double, QUANTILES.size()> interval_quantiles_s{};
+  double interval_max_s = 0.0;
+
+  // Totals since start.
+  uint64_t samples = 0;
+  uint64_t dropped = 0;    ///< Failed reads or samples lost in transport
+  uint64_t duplicates = 0; ///< Table identical to the previous one
+  std::vector<uint64_t> limit_samples; ///< Samples at the limit, per limit
+  std::vector<uint64_t> limit_events;  ///< Rising edges, per limit
+};
+
+/**
+ * @class MetricsAggregator
+ * @brief Single-producer aggregation; add() does no allocation and no
+ * syscalls.
+ */
+class MetricsAggregator {
+public:
+  /** @brief An exported sensor: a cell, or the sum/max over all cores. */
+  struct Sensor {
+    enum class Kind { Cell, CoreSum, CoreMax };
+    std::string name; ///< Label value, e.g. "core_power"
+    std::string unit;
+    int core = -1; ///< Per-core sensors carry a core label
+    Kind kind = Kind::Cell;
+    size_t cell = 0; ///< The cell, or the first core's cell
+  };
+
+  struct Limit {
+    std::string name;
+    size_t value;
+    size_t limit; ///< SIZE_MAX: value is a flag (PROCHOT)
+  };
+
+  struct Config {
+    double window_seconds = 10.0;
+    uint64_t period_ns = 1'000'000; ///< Expected sample interval
+  };
+
+  /** @param layout Null exports only the sampling health. */
+  MetricsAggregator(const PmTableLayout *layout, size_t n_floats,
+                    Config config);
+
+  MetricsAggregator(const MetricsAggregator &) = delete;
+  MetricsAggregator &operator=(const MetricsAggregator &) = delete;
+
+  /**
+   * @brief Account one table. Producer thread only.
+   * @return Bit i set if limits()[i] was reached with this table.
+   */
+  uint32_t add(uint64_t monotonic_ns, const float *table) noexcept;
+
+  /** @brief Account samples that never arrived. Producer thread only. */
+  void count_dropped(uint64_t n = 1) noexcept { totals_.dropped += n; }
+
+  /**
+   * @brief Newest published snapshot. Consumer thread only; it stays
+   * unchanged until the next call.
+   */
+  const MetricsSnapshot &acquire() noexcept;
+
+  const std::vector<Sensor> &sensors() const { return sensors_; }
+  const std::vector<Limit> &limits() const { return limits_; }
+
+private:
+  void close_window(uint64_t now_ns) noexcept;
+  float sensor_value(const Sensor &sensor, const float *table) const noexcept;
+
+  std::vector<Sensor> sensors_;
+  std::vector<Limit> limits_;
+  size_t n_floats_;
+  size_t n_cores_ = 0;
+  uint64_t window_ns_;
+  uint64_t bin_ns_;
+
+  // Producer state.
+  MetricsSnapshot totals_;              ///< Window and totals being built
+  std::vector<uint32_t> intervals_;     ///< Interval histogram, last = overflow
+  uint64_t interval_max_ns_ = 0;
+  std::vector<float> previous_;         ///< For duplicate detection
+  std::vector<uint8_t> limit_active_;
+  uint64_t window_start_ns_ = 0;
+  uint64_t last_ns_ = 0;
+
+  // Triple buffer: the producer fills back_, swaps it into middle_, the
+  // consumer swaps middle_ into front_. FRESH marks an unread middle.
+  static constexpr uint8_t FRESH = 4;
+  std::array<MetricsSnapshot, 3> buffers_;
+  std::atomic<uint8_t> middle_{1};
+  uint8_t back_ = 0;
+  uint8_t front_ = 2;
+};
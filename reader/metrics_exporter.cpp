@@ -0,0 +1,395 @@
+/**
+ * @file metrics_exporter.cpp
+ * @brief MetricsServer: HTTP exposition of a MetricsAggregator.
+ */
+
+#include "metrics_exporter.hpp"
+#include "float_bits.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <charconv>
+#include <chrono>
+#include <cstring>
+#include <ctime>
+#include <netinet/in.h>
+#include <poll.h>
+#include <spdlog/spdlog.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace {
+
+constexpr size_t MAX_REQUEST_BYTES = 4096;
+/// Budget for receiving a request, and again for sending its response.
+constexpr auto CLIENT_TIMEOUT = std::chrono::seconds(1);
+
+/**
+ * @brief Wait until @p fd is ready for @p events or @p deadline passes.
+ * @return false on timeout, error or hangup.
+ */
+bool wait_until(int fd, short events,
+                std::chrono::steady_clock::time_point deadline) {
+  for (;;) {
+    const auto left = std::chrono::ceil<std::chrono::milliseconds>(
+        deadline - std::chrono::steady_clock::now());
+    if (left.count() <= 0)
+      return false;
+    pollfd pfd{fd, events, 0};
+    const int n = ::poll(&pfd, 1, static_cast<int>(left.count()));
+    if (n < 0 && errno == EINTR)
+      continue;
+    return n > 0 && (pfd.revents & events) != 0;
+  }
+}
+
+uint64_t monotonic_ns() {
+  timespec ts{};
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return static_cast<uint64_t>(ts.tv_sec) * 1'000'000'000 +
+         static_cast<uint64_t>(ts.tv_nsec);
+}
+
+void append_number(std::string &out, double value) {
+  if (is_nan(value)) {
+    out += "NaN";
+    return;
+  }
+  if (!is_finite(value)) {
+    out += value > 0 ? "+Inf" : "-Inf";
+    return;
+  }
+  char digits[32];
+  out.append(digits, std::to_chars(digits, digits + sizeof(digits), value).ptr);
+}
+
+/// Floats print with their own shortest representation, not a double's.
+void append_number(std::string &out, float value) {
+  if (!is_finite(value)) {
+    append_number(out, static_cast<double>(value));
+    return;
+  }
+  char digits[32];
+  out.append(digits, std::to_chars(digits, digits + sizeof(digits), value).ptr);
+}
+
+void append_number(std::string &out, uint64_t value) {
+  char digits[24];
+  out.append(digits, std::to_chars(digits, digits + sizeof(digits), value).ptr);
+}
+
+} // namespace
+
+MetricsServer::MetricsServer(const std::string &endpoint,
+                             MetricsAggregator &aggregator, std::string prefix)
+    : aggregator_{aggregator}, prefix_{std::move(prefix)} {
+  const bool is_unix = endpoint.starts_with('/') ||
+                       endpoint.starts_with("./") || endpoint.starts_with('@');
+  if (is_unix) {
+    sockaddr_un addr{};
+    addr.sun_family = AF_UNIX;
+    if (endpoint.size() >= sizeof(addr.sun_path)) {
+      SPDLOG_ERROR("Metrics socket path {} is too long.", endpoint);
+      return;
+    }
+    std::memcpy(addr.sun_path, endpoint.data(), endpoint.size());
+    socklen_t len = offsetof(sockaddr_un, sun_path) + endpoint.size();
+    if (endpoint.starts_with('@')) {
+      addr.sun_path[0] = '\0'; // Abstract namespace
+    } else {
+      ++len;
+      // Replace a socket left behind by a previous run.
+      if (struct stat st{}; ::stat(endpoint.c_str(), &st) == 0 &&
+                            S_ISSOCK(st.st_mode))
+        ::unlink(endpoint.c_str());
+      unix_path_ = endpoint;
+    }
+    listen_fd_ = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (listen_fd_ >= 0 &&
+        ::bind(listen_fd_, reinterpret_cast<sockaddr *>(&addr), len) != 0) {
+      SPDLOG_ERROR("Failed to bind metrics socket {}: {}", endpoint,
+                   std::strerror(errno));
+      ::close(listen_fd_);
+      listen_fd_ = -1;
+      unix_path_.clear();
+    }
+  } else {
+    // Loopback only: "9464", "127.0.0.1:9464" or "localhost:9464".
+    std::string port = endpoint;
+    if (const auto colon = endpoint.rfind(':'); colon != std::string::npos) {
+      const std::string host = endpoint.substr(0, colon);
+      if (host != "127.0.0.1" && host != "localhost") {
+        SPDLOG_ERROR("Metrics are served on localhost only, not {}.", host);
+        return;
+      }
+      port = endpoint.substr(colon + 1);
+    }
+    unsigned port_number = 0;
+    const auto [end, ec] = std::from_chars(
+        port.data(), port.data() + port.size(), port_number);
+    if (ec != std::errc{} || end != port.data() + port.size() ||
+        port_number == 0 || port_number > 65535) {
+      SPDLOG_ERROR("Invalid metrics endpoint '{}'.", endpoint);
+      return;
+    }
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(static_cast<uint16_t>(port_number));
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    listen_fd_ = ::socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    const int one = 1;
+    if (listen_fd_ >= 0) {
+      ::setsockopt(listen_fd_, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+      if (::bind(listen_fd_, reinterpret_cast<sockaddr *>(&addr),
+                 sizeof(addr)) != 0) {
+        SPDLOG_ERROR("Failed to bind metrics port {}: {}", port_number,
+                     std::strerror(errno));
+        ::close(listen_fd_);
+        listen_fd_ = -1;
+      }
+    }
+  }
+  if (listen_fd_ < 0)
+    return;
+  if (::listen(listen_fd_, 8) != 0) {
+    SPDLOG_ERROR("listen() on {} failed: {}", endpoint, std::strerror(errno));
+    ::close(listen_fd_);
+    listen_fd_ = -1;
+    return;
+  }
+  body_.reserve(64 * 1024);
+  response_.reserve(64 * 1024);
+  thread_ = std::thread(&MetricsServer::run, this);
+  SPDLOG_INFO("Serving metrics on {}.", endpoint);
+}
+
+MetricsServer::~MetricsServer() {
+  stop_.store(true, std::memory_order_relaxed);
+  if (thread_.joinable())
+    thread_.join();
+  if (listen_fd_ >= 0)
+    ::close(listen_fd_);
+  if (!unix_path_.empty())
+    ::unlink(unix_path_.c_str());
+}
+
+MetricsServer::Stats MetricsServer::stats() const {
+  Stats s;
+  s.scrapes = scrapes_.load(std::memory_order_relaxed);
+  s.errors = errors_.load(std::memory_order_relaxed);
+  s.max_render_ms = max_render_ms_.load(std::memory_order_relaxed);
+  return s;
+}
+
+void MetricsServer::run() {
+  pollfd pfd{listen_fd_, POLLIN, 0};
+  while (!stop_.load(std::memory_order_relaxed)) {
+    if (::poll(&pfd, 1, 250) <= 0)
+      continue;
+    const int fd = ::accept4(listen_fd_, nullptr, nullptr, SOCK_CLOEXEC);
+    if (fd < 0)
+      continue;
+    serve(fd);
+    ::close(fd);
+  }
+}
+
+/**
+ * @brief Answer one request; a client that does not send its request
+ * within a second is dropped so it cannot hold up the next scrape. The
+ * second is a total, so trickling a byte at a time does not extend it;
+ * reading the response gets the same budget.
+ */
+void MetricsServer::serve(int fd) {
+  char request[MAX_REQUEST_BYTES];
+  size_t received = 0;
+  const auto request_deadline =
+      std::chrono::steady_clock::now() + CLIENT_TIMEOUT;
+  while (received < sizeof(request)) {
+    if (!wait_until(fd, POLLIN, request_deadline)) {
+      errors_.fetch_add(1, std::memory_order_relaxed);
+      return;
+    }
+    const ssize_t n = ::recv(fd, request + received,
+                             sizeof(request) - received, MSG_DONTWAIT);
+    if (n < 0 && (errno == EINTR || errno == EAGAIN))
+      continue;
+    if (n <= 0)
+      break;
+    received += static_cast<size_t>(n);
+    if (std::string_view(request, received).find("\r\n\r\n") !=
+        std::string_view::npos)
+      break;
+  }
+  const std::string_view line(request, received);
+  const bool is_get = line.starts_with("GET ");
+  const bool is_metrics =
+      line.starts_with("GET /metrics ") || line.starts_with("GET / ");
+
+  response_.clear();
+  if (!is_get || !is_metrics) {
+    response_ += is_get ? "HTTP/1.0 404 Not Found\r\n"
+                        : "HTTP/1.0 405 Method Not Allowed\r\n";
+    response_ += "Content-Length: 0\r\nConnection: close\r\n\r\n";
+    errors_.fetch_add(1, std::memory_order_relaxed);
+  } else {
+    const auto start = std::chrono::steady_clock::now();
+    render(aggregator_.acquire());
+    const double ms = std::chrono::duration<double, std::milli>(
+                          std::chrono::steady_clock::now() - start)
+                          .count();
+    if (ms > max_render_ms_.load(std::memory_order_relaxed))
+      max_render_ms_.store(ms, std::memory_order_relaxed);
+    scrapes_.fetch_add(1, std::memory_order_relaxed);
+    response_ += "HTTP/1.0 200 OK\r\n"
+                 "Content-Type: text/plain; version=0.0.4; charset=utf-8\r\n"
+                 "Connection: close\r\nContent-Length: ";
+    append_number(response_, uint64_t{body_.size()});
+    response_ += "\r\n\r\n";
+    response_ += body_;
+  }
+
+  size_t sent = 0;
+  const auto response_deadline =
+      std::chrono::steady_clock::now() + CLIENT_TIMEOUT;
+  while (sent < response_.size()) {
+    if (!wait_until(fd, POLLOUT, response_deadline)) {
+      errors_.fetch_add(1, std::memory_order_relaxed);
+      return;
+    }
+    const ssize_t n =
+        ::send(fd, response_.data() + sent, response_.size() - sent,
+               MSG_NOSIGNAL | MSG_DONTWAIT);
+    if (n < 0 && (errno == EINTR || errno == EAGAIN))
+      continue;
+    if (n <= 0) {
+      errors_.fetch_add(1, std::memory_order_relaxed);
+      return;
+    }
+    sent += static_cast<size_t>(n);
+  }
+}
+
+void MetricsServer::render(const MetricsSnapshot &snapshot) {
+  std::string &out = body_;
+  out.clear();
+  auto family = [&](std::string_view name, std::string_view type,
+                    std::string_view help) {
+    out += "# HELP ";
+    out += prefix_;
+    out += name;
+    out += ' ';
+    out += help;
+    out += "\n# TYPE ";
+    out += prefix_;
+    out += name;
+    out += ' ';
+    out += type;
+    out += '\n';
+  };
+  auto sample = [&](std::string_view name, auto value) {
+    out += prefix_;
+    out += name;
+    out += ' ';
+    append_number(out, value);
+    out += '\n';
+  };
+
+  family("_samples_total", "counter", "Tables sampled.");
+  sample("_samples_total", snapshot.samples);
+  family("_dropped_samples_total", "counter",
+         "Failed reads and samples lost before they were aggregated.");
+  sample("_dropped_samples_total", snapshot.dropped);
+  family("_duplicate_samples_total", "counter",
+         "Tables identical to the previous one (SMU not refreshed).");
+  sample("_duplicate_samples_total", snapshot.duplicates);
+  family("_scrapes_total", "counter", "Metrics requests served.");
+  sample("_scrapes_total", scrapes_.load(std::memory_order_relaxed) + 1);
+
+  family("_window_seconds", "gauge",
+         "Length of the window the statistics below cover.");
+  sample("_window_seconds", snapshot.window_seconds);
+  family("_window_samples", "gauge", "Tables in the window.");
+  sample("_window_samples", snapshot.window_samples);
+  family("_window_age_seconds", "gauge", "Time since the window closed.");
+  sample("_window_age_seconds",
+         snapshot.window_end_ns
+             ? static_cast<double>(monotonic_ns() - snapshot.window_end_ns) /
+                   1e9
+             : 0.0);
+
+  family("_sample_interval_seconds", "gauge",
+         "Quantiles of the interval between tables in the window.");
+  for (size_t q = 0; q < MetricsSnapshot::QUANTILES.size(); ++q) {
+    out += prefix_;
+    out += "_sample_interval_seconds{quantile=\"";
+    append_number(out, MetricsSnapshot::QUANTILES[q]);
+    out += "\"} ";
+    append_number(out, snapshot.interval_quantiles_s[q]);
+    out += '\n';
+  }
+  family("_sample_interval_max_seconds", "gauge",
+         "Longest interval between tables in the window.");
+  sample("_sample_interval_max_seconds", snapshot.interval_max_s);
+
+  const auto &limits = aggregator_.limits();
+  auto limit_family = [&](std::string_view name, std::string_view help,
+                          const std::vector<uint64_t> &values) {
+    family(name, "counter", help);
+    for (size_t i = 0; i < limits.size(); ++i) {
+      out += prefix_;
+      out += name;
+      out += "{limit=\"";
+      out += limits[i].name;
+      out += "\"} ";
+      append_number(out, values[i]);
+      out += '\n';
+    }
+  };
+  if (!limits.empty()) {
+    limit_family("_limit_samples_total",
+                 "Tables with the value at (99% of) its limit.",
+                 snapshot.limit_samples);
+    limit_family("_limit_events_total", "Times the value reached its limit.",
+                 snapshot.limit_events);
+  }
+
+  const auto &sensors = aggregator_.sensors();
+  if (sensors.empty() || snapshot.window_end_ns == 0)
+    return;
+  auto sensor_family = [&](std::string_view stat, std::string_view help,
+                           auto value) {
+    const std::string name = std::string("_sensor_").append(stat);
+    family(name, "gauge", help);
+    for (size_t i = 0; i < sensors.size(); ++i) {
+      const auto &window = snapshot.sensors[i];
+      if (window.count == 0)
+        continue;
+      out += prefix_;
+      out += name;
+      out += "{sensor=\"";
+      out += sensors[i].name;
+      out += "\",unit=\"";
+      out += sensors[i].unit;
+      if (sensors[i].core >= 0) {
+        out += "\",core=\"";
+        append_number(out, static_cast<uint64_t>(sensors[i].core));
+      }
+      out += "\"} ";
+      append_number(out, value(window));
+      out += '\n';
+    }
+  };
+  using Window = MetricsSnapshot::SensorWindow;
+  sensor_family("min", "Minimum over the window.",
+                [](const Window &w) { return w.min; });
+  sensor_family("mean", "Mean over the window.", [](const Window &w) {
+    return w.sum / static_cast<double>(w.count);
+  });
+  sensor_family("max", "Maximum over the window.",
+                [](const Window &w) { return w.max; });
+  sensor_family("last", "Last value of the window.",
+                [](const Window &w) { return w.last; });
+}
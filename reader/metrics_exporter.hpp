@@ -0,0 +1,64 @@
+/**
+ * @file metrics_exporter.hpp
+ * @brief Prometheus text exposition of windowed sensor statistics, limit
+ * hits and sampling health, served on a Unix socket or localhost.
+ *
+ * The sampling side feeds every table into a MetricsAggregator
+ * (metrics_aggregator.hpp). MetricsServer's thread takes the aggregator's
+ * newest snapshot and renders it into a reused buffer on each scrape;
+ * neither side ever waits for the other.
+ */
+
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <thread>
+
+#include "metrics_aggregator.hpp"
+
+/**
+ * @class MetricsServer
+ * @brief Minimal HTTP/1.0 server for GET /metrics.
+ *
+ * The endpoint is a Unix socket path ("/run/pm_acqd.sock", or "@name" for
+ * the abstract namespace) or a TCP port bound to 127.0.0.1 ("9464" or
+ * "127.0.0.1:9464"). Requests are served one at a time on the server's own
+ * thread.
+ */
+class MetricsServer {
+public:
+  struct Stats {
+    uint64_t scrapes = 0;
+    uint64_t errors = 0;
+    double max_render_ms = 0.0;
+  };
+
+  /** @param prefix Metric name prefix, e.g. "pm_acqd". */
+  MetricsServer(const std::string &endpoint, MetricsAggregator &aggregator,
+                std::string prefix);
+  ~MetricsServer();
+
+  MetricsServer(const MetricsServer &) = delete;
+  MetricsServer &operator=(const MetricsServer &) = delete;
+
+  explicit operator bool() const noexcept { return listen_fd_ >= 0; }
+
+  Stats stats() const;
+
+private:
+  void run();
+  void serve(int fd);
+  void render(const MetricsSnapshot &snapshot);
+
+  MetricsAggregator &aggregator_;
+  std::string prefix_;
+  std::string unix_path_; ///< Unlinked on exit; empty for TCP and abstract
+  int listen_fd_ = -1;
+  std::string body_;     ///< Reused exposition buffer
+  std::string response_; ///< Reused response buffer
+  std::atomic<bool> stop_{false};
+  std::atomic<uint64_t> scrapes_{0}, errors_{0};
+  std::atomic<double> max_render_ms_{0.0};
+  std::thread thread_;
+};
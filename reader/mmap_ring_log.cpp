@@ -0,0 +1,373 @@
+/**
+ * @file mmap_ring_log.cpp
+ * @brief MmapRingLog (writer, flusher thread) and MmapRingReader (recovery).
+ */
+
+#include "mmap_ring_log.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <cstddef>
+#include <cstring>
+#include <fcntl.h>
+#include <spdlog/spdlog.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#if defined(__SSE4_2__)
+#include <nmmintrin.h>
+#endif
+
+using namespace std::chrono_literals;
+
+namespace {
+
+constexpr size_t PAGE_BYTES = 4096;
+constexpr size_t SLOT_ALIGNMENT = 64;
+constexpr auto STOP_POLL = 20ms;
+/// Recovery keeps probing this many records past a torn one, since pages
+/// written back out of order can leave holes just before the crash point.
+constexpr uint64_t MAX_PROBE_GAP = 4096;
+
+#if !defined(__SSE4_2__)
+constexpr std::array<uint32_t, 256> make_crc32c_table() {
+  std::array<uint32_t, 256> table{};
+  for (uint32_t i = 0; i < 256; ++i) {
+    uint32_t c = i;
+    for (int k = 0; k < 8; ++k)
+      c = (c & 1) ? (c >> 1) ^ 0x82F63B78u : c >> 1;
+    table[i] = c;
+  }
+  return table;
+}
+constexpr auto CRC32C_TABLE = make_crc32c_table();
+#endif
+
+uint64_t slot_offset(const RingFileHeader &header, uint64_t seq) {
+  return header.header_bytes + ((seq - 1) % header.capacity) * header.slot_bytes;
+}
+
+uint32_t record_crc(const RingRecordHeader &record, const void *payload) {
+  return crc32c(crc32c(0, &record, offsetof(RingRecordHeader, crc)), payload,
+                record.size);
+}
+
+/** @brief The record for seq if it is present and intact, else nullptr. */
+const RingRecordHeader *valid_record(const char *base,
+                                     const RingFileHeader &header,
+                                     uint64_t seq) {
+  if (seq == 0)
+    return nullptr;
+  const char *slot = base + slot_offset(header, seq);
+  const auto *record = reinterpret_cast<const RingRecordHeader *>(slot);
+  if (record->seq != seq || record->size != header.sample_bytes ||
+      record_crc(*record, slot + sizeof(RingRecordHeader)) != record->crc)
+    return nullptr;
+  return record;
+}
+
+bool header_matches(const RingFileHeader &header, uint32_t sample_bytes,
+                    uint32_t slot_bytes, uint64_t capacity) {
+  return std::memcmp(header.magic, RING_FILE_MAGIC, 4) == 0 &&
+         header.header_bytes == RING_HEADER_BYTES &&
+         header.sample_bytes == sample_bytes &&
+         header.slot_bytes == slot_bytes && header.capacity == capacity;
+}
+
+double elapsed_ms(std::chrono::steady_clock::time_point since) {
+  return std::chrono::duration<double, std::milli>(
+             std::chrono::steady_clock::now() - since)
+      .count();
+}
+
+} // namespace
+
+uint32_t crc32c(uint32_t crc, const void *data, size_t length) noexcept {
+  const auto *p = static_cast<const unsigned char *>(data);
+  crc = ~crc;
+#if defined(__SSE4_2__)
+  uint64_t c = crc;
+  for (; length >= 8; p += 8, length -= 8) {
+    uint64_t word;
+    std::memcpy(&word, p, 8);
+    c = _mm_crc32_u64(c, word);
+  }
+  crc = static_cast<uint32_t>(c);
+  for (; length > 0; --length)
+    crc = _mm_crc32_u8(crc, *p++);
+#else
+  for (; length > 0; --length)
+    crc = CRC32C_TABLE[(crc ^ *p++) & 0xff] ^ (crc >> 8);
+#endif
+  return ~crc;
+}
+
+/**
+ * @brief Map the ring, creating (and fully allocating) the file if needed.
+ *
+ * The file is allocated with posix_fallocate so a full disk is reported
+ * here instead of as a SIGBUS on a store into the mapping.
+ */
+MmapRingLog::MmapRingLog(const std::string &path, uint32_t sample_bytes,
+                         uint32_t pm_table_version, Config config)
+    : config_{config}, path_{path}, sample_bytes_{sample_bytes} {
+  config_.capacity = std::max<uint64_t>(config_.capacity, 2);
+  slot_bytes_ = static_cast<uint32_t>(
+      (sizeof(RingRecordHeader) + sample_bytes + SLOT_ALIGNMENT - 1) /
+      SLOT_ALIGNMENT * SLOT_ALIGNMENT);
+  map_bytes_ = RING_HEADER_BYTES + config_.capacity * slot_bytes_;
+
+  fd_ = ::open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+  if (fd_ < 0) {
+    SPDLOG_ERROR("Failed to open ring log {}: {}", path, std::strerror(errno));
+    return;
+  }
+
+  RingFileHeader existing{};
+  struct stat st{};
+  const bool reuse =
+      ::fstat(fd_, &st) == 0 && static_cast<size_t>(st.st_size) == map_bytes_ &&
+      ::pread(fd_, &existing, sizeof(existing), 0) ==
+          static_cast<ssize_t>(sizeof(existing)) &&
+      header_matches(existing, sample_bytes, slot_bytes_, config_.capacity);
+  if (!reuse) {
+    int err = ::ftruncate(fd_, 0) == 0 ? 0 : errno;
+    if (err == 0)
+      err = ::posix_fallocate(fd_, 0, static_cast<off_t>(map_bytes_));
+    if (err != 0) {
+      SPDLOG_ERROR("Failed to allocate {} MiB for ring log {}: {}",
+                   map_bytes_ >> 20, path, std::strerror(err));
+      ::close(fd_);
+      fd_ = -1;
+      return;
+    }
+  }
+
+  void *map = ::mmap(nullptr, map_bytes_, PROT_READ | PROT_WRITE, MAP_SHARED,
+                     fd_, 0);
+  if (map == MAP_FAILED) {
+    SPDLOG_ERROR("Failed to map ring log {}: {}", path, std::strerror(errno));
+    ::close(fd_);
+    fd_ = -1;
+    return;
+  }
+  base_ = static_cast<char *>(map);
+
+  if (reuse) {
+    const uint64_t last =
+        MmapRingReader::find_last_seq(base_, *header());
+    next_seq_ = last + 1;
+    SPDLOG_INFO("Continuing ring log {} after record {}.", path, last);
+  } else {
+    RingFileHeader h{};
+    std::memcpy(h.magic, RING_FILE_MAGIC, 4);
+    h.header_bytes = RING_HEADER_BYTES;
+    h.sample_bytes = sample_bytes;
+    h.slot_bytes = slot_bytes_;
+    h.capacity = config_.capacity;
+    h.pm_table_version = pm_table_version;
+    std::memcpy(base_, &h, sizeof(h));
+    ::msync(base_, PAGE_BYTES, MS_SYNC);
+  }
+  first_seq_ = next_seq_;
+  committed_.store(next_seq_ - 1, std::memory_order_relaxed);
+
+  SPDLOG_INFO("Recording into ring log {} ({} records, {} MiB).", path,
+              config_.capacity, map_bytes_ >> 20);
+  flusher_ = std::thread(&MmapRingLog::run_flusher, this);
+}
+
+MmapRingLog::~MmapRingLog() { close(); }
+
+/**
+ * @brief Copy one record into its slot; the header (with sequence number
+ * and checksum) is stored last.
+ */
+bool MmapRingLog::append_record(uint64_t timestamp_ns, const void *blob,
+                                uint64_t size) noexcept {
+  if (closed_ || !base_ || size != sample_bytes_)
+    return false;
+  char *slot = base_ + slot_offset(*header(), next_seq_);
+  RingRecordHeader record{next_seq_, timestamp_ns,
+                          static_cast<uint32_t>(size), 0};
+  std::memcpy(slot + sizeof(record), blob, size);
+  record.crc = record_crc(record, blob);
+  std::memcpy(slot, &record, sizeof(record));
+  committed_.store(next_seq_, std::memory_order_release);
+  ++next_seq_;
+  return true;
+}
+
+/**
+ * @brief msync the slots of records (from_seq, to_seq], wrap aware.
+ */
+void MmapRingLog::flush_range(uint64_t from_seq, uint64_t to_seq) {
+  if (to_seq <= from_seq)
+    return;
+  const RingFileHeader &h = *header();
+  const uint64_t count = std::min(to_seq - from_seq, h.capacity);
+  const uint64_t first_slot = (to_seq - count) % h.capacity;
+  const uint64_t first_count = std::min(count, h.capacity - first_slot);
+
+  auto sync_slots = [&](uint64_t slot, uint64_t n) {
+    const uint64_t begin = h.header_bytes + slot * h.slot_bytes;
+    const uint64_t end = begin + n * h.slot_bytes;
+    const uint64_t aligned = begin / PAGE_BYTES * PAGE_BYTES;
+    ::msync(base_ + aligned, end - aligned, MS_SYNC);
+  };
+  sync_slots(first_slot, first_count);
+  if (count > first_count)
+    sync_slots(0, count - first_count);
+}
+
+/**
+ * @brief Periodically make the new records durable, then advance the head
+ * hint in the header, and prefault the slots ahead of the writer.
+ */
+void MmapRingLog::run_flusher() {
+  const RingFileHeader &h = *header();
+  uint64_t flushed = committed_.load(std::memory_order_acquire);
+  uint64_t prefaulted = flushed;
+  const uint64_t prefault_records =
+      std::min<uint64_t>(config_.prefault_bytes / slot_bytes_, h.capacity);
+  auto last_flush = std::chrono::steady_clock::now();
+
+  while (true) {
+    const bool stopping = stop_.load(std::memory_order_acquire);
+    const uint64_t committed = committed_.load(std::memory_order_acquire);
+
+    // Populate page tables ahead of the head so stores hit mapped pages.
+    if (committed + prefault_records > prefaulted) {
+      const uint64_t target = committed + prefault_records;
+      for (uint64_t seq = std::max(prefaulted, committed) + 1; seq <= target;) {
+        const uint64_t slot = (seq - 1) % h.capacity;
+        const uint64_t n = std::min(target - seq + 1, h.capacity - slot);
+        const uint64_t begin = h.header_bytes + slot * h.slot_bytes;
+        const uint64_t aligned = begin / PAGE_BYTES * PAGE_BYTES;
+#ifdef MADV_POPULATE_WRITE
+        ::madvise(base_ + aligned, begin + n * h.slot_bytes - aligned,
+                  MADV_POPULATE_WRITE);
+#else
+        ::madvise(base_ + aligned, begin + n * h.slot_bytes - aligned,
+                  MADV_WILLNEED);
+#endif
+        seq += n;
+      }
+      prefaulted = target;
+    }
+
+    if (stopping || (committed > flushed && std::chrono::steady_clock::now() -
+                                                    last_flush >=
+                                                config_.flush_interval)) {
+      const auto start = std::chrono::steady_clock::now();
+      flush_range(flushed, committed);
+      header()->committed_seq = committed;
+      ::msync(base_, PAGE_BYTES, MS_SYNC);
+      const double ms = elapsed_ms(start);
+      if (ms > max_flush_ms_.load(std::memory_order_relaxed))
+        max_flush_ms_.store(ms, std::memory_order_relaxed);
+      flushed = committed;
+      last_flush = std::chrono::steady_clock::now();
+    }
+    if (stopping)
+      break;
+    std::this_thread::sleep_for(STOP_POLL);
+  }
+}
+
+void MmapRingLog::close() {
+  if (closed_)
+    return;
+  closed_ = true;
+  stop_.store(true, std::memory_order_release);
+  if (flusher_.joinable())
+    flusher_.join();
+  if (base_) {
+    ::munmap(base_, map_bytes_);
+    base_ = nullptr;
+  }
+  if (fd_ >= 0) {
+    ::close(fd_);
+    fd_ = -1;
+  }
+}
+
+MmapRingLog::Stats MmapRingLog::stats() const {
+  Stats s;
+  s.first_seq = first_seq_;
+  s.records = committed_.load(std::memory_order_relaxed) + 1 - first_seq_;
+  s.max_flush_ms = max_flush_ms_.load(std::memory_order_relaxed);
+  return s;
+}
+
+MmapRingReader::MmapRingReader(const std::string &path) {
+  fd_ = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  struct stat st{};
+  if (fd_ < 0 || ::fstat(fd_, &st) != 0 ||
+      ::pread(fd_, &header_, sizeof(header_), 0) !=
+          static_cast<ssize_t>(sizeof(header_)) ||
+      std::memcmp(header_.magic, RING_FILE_MAGIC, 4) != 0 ||
+      header_.capacity == 0 ||
+      static_cast<uint64_t>(st.st_size) <
+          header_.header_bytes + header_.capacity * header_.slot_bytes) {
+    SPDLOG_ERROR("{} is not a complete ring log.", path);
+    return;
+  }
+  map_bytes_ = static_cast<size_t>(st.st_size);
+  void *map = ::mmap(nullptr, map_bytes_, PROT_READ, MAP_SHARED, fd_, 0);
+  if (map == MAP_FAILED) {
+    SPDLOG_ERROR("Failed to map {}: {}", path, std::strerror(errno));
+    return;
+  }
+  base_ = static_cast<const char *>(map);
+  ::madvise(const_cast<char *>(base_), map_bytes_, MADV_SEQUENTIAL);
+
+  last_seq_ = find_last_seq(base_, header_);
+  first_seq_ = last_seq_ == 0 ? 0
+               : last_seq_ > header_.capacity ? last_seq_ - header_.capacity + 1
+                                              : 1;
+}
+
+MmapRingReader::~MmapRingReader() {
+  if (base_)
+    ::munmap(const_cast<char *>(base_), map_bytes_);
+  if (fd_ >= 0)
+    ::close(fd_);
+}
+
+const void *MmapRingReader::record(uint64_t seq, uint64_t &timestamp_ns) const {
+  const RingRecordHeader *record = valid_record(base_, header_, seq);
+  if (!record)
+    return nullptr;
+  timestamp_ns = record->timestamp_ns;
+  return record + 1;
+}
+
+/**
+ * @brief Follow the chain forward from the header hint, tolerating holes of
+ * up to MAX_PROBE_GAP records; if the hint itself is not intact, scan every
+ * slot for the highest valid sequence number.
+ */
+uint64_t MmapRingReader::find_last_seq(const char *base,
+                                       const RingFileHeader &header) {
+  uint64_t last = header.committed_seq;
+  if (last != 0 && valid_record(base, header, last)) {
+    for (uint64_t probe = last + 1; probe <= last + MAX_PROBE_GAP; ++probe) {
+      if (valid_record(base, header, probe))
+        last = probe;
+    }
+    return last;
+  }
+
+  last = 0;
+  for (uint64_t slot = 0; slot < header.capacity; ++slot) {
+    const auto *record = reinterpret_cast<const RingRecordHeader *>(
+        base + header.header_bytes + slot * header.slot_bytes);
+    if (record->seq > last && (record->seq - 1) % header.capacity == slot &&
+        valid_record(base, header, record->seq))
+      last = record->seq;
+  }
+  return last;
+}
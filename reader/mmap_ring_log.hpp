@@ -0,0 +1,153 @@
+/**
+ * @file mmap_ring_log.hpp
+ * @brief Crash-safe, file-backed mmap ring of pm_table samples (.pmr).
+ *
+ * The file is a 4 KiB header followed by `capacity` fixed-size slots. Every
+ * record carries a sequence number and a CRC32C over sequence, timestamp,
+ * size and payload, and record `seq` always lives in slot (seq - 1) %
+ * capacity. The header holds the last committed sequence number as a hint.
+ *
+ * Appending is a memcpy into the shared mapping plus the checksum; a flusher
+ * thread msyncs the dirty range once per flush interval, so a kernel panic
+ * or hang loses at most that much. After a crash (of the process or the
+ * machine) MmapRingReader finds the newest valid record from the header hint
+ * and returns the surviving window in order, skipping torn records.
+ */
+
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <thread>
+
+inline constexpr char RING_FILE_MAGIC[4] = {'P', 'M', 'R', '1'};
+inline constexpr uint32_t RING_HEADER_BYTES = 4096;
+
+struct RingFileHeader {
+  char magic[4];
+  uint32_t header_bytes;
+  uint32_t sample_bytes;
+  uint32_t slot_bytes;
+  uint64_t capacity;          ///< Number of slots
+  uint32_t pm_table_version;
+  uint32_t reserved;
+  uint64_t committed_seq;     ///< Last appended sequence number (hint only)
+};
+
+struct RingRecordHeader {
+  uint64_t seq; ///< 1-based; 0 marks a slot never written
+  uint64_t timestamp_ns;
+  uint32_t size;
+  uint32_t crc;
+};
+
+/// CRC32C (Castagnoli); uses the SSE4.2 instruction when compiled for it.
+uint32_t crc32c(uint32_t crc, const void *data, size_t length) noexcept;
+
+/**
+ * @class MmapRingLog
+ * @brief Writer side. append_record() is producer-only and never blocks.
+ *
+ * Opening an existing ring with the same geometry continues after its newest
+ * valid record instead of overwriting the history.
+ */
+class MmapRingLog {
+public:
+  struct Config {
+    uint64_t capacity = 10 * 60 * 1000; ///< Records; 10 min at 1 kHz
+    std::chrono::milliseconds flush_interval{1000};
+    size_t prefault_bytes = 64u << 20;  ///< Touched ahead of the write head
+  };
+
+  struct Stats {
+    uint64_t records = 0;
+    uint64_t first_seq = 0; ///< Sequence number of the first record this run
+    double max_flush_ms = 0.0;
+  };
+
+  MmapRingLog(const std::string &path, uint32_t sample_bytes,
+              uint32_t pm_table_version, Config config);
+  ~MmapRingLog();
+
+  MmapRingLog(const MmapRingLog &) = delete;
+  MmapRingLog &operator=(const MmapRingLog &) = delete;
+
+  explicit operator bool() const noexcept { return base_ != nullptr; }
+
+  bool append_record(uint64_t timestamp_ns, const void *blob,
+                     uint64_t size) noexcept;
+
+  /** @brief Stop the flusher, msync everything and unmap. */
+  void close();
+
+  Stats stats() const;
+
+private:
+  RingFileHeader *header() const {
+    return reinterpret_cast<RingFileHeader *>(base_);
+  }
+  void run_flusher();
+  void flush_range(uint64_t from_seq, uint64_t to_seq);
+
+  Config config_;
+  std::string path_;
+  int fd_ = -1;
+  char *base_ = nullptr;
+  size_t map_bytes_ = 0;
+  uint32_t sample_bytes_ = 0;
+  uint32_t slot_bytes_ = 0;
+
+  uint64_t next_seq_ = 1;               ///< Producer-owned
+  uint64_t first_seq_ = 1;
+  std::atomic<uint64_t> committed_{0};  ///< Last appended seq
+  std::atomic<double> max_flush_ms_{0.0};
+  std::atomic<bool> stop_{false};
+  bool closed_ = false;
+  std::thread flusher_;
+};
+
+/**
+ * @class MmapRingReader
+ * @brief Recovery side: read the surviving records of a .pmr file in order.
+ */
+class MmapRingReader {
+public:
+  explicit MmapRingReader(const std::string &path);
+  ~MmapRingReader();
+
+  MmapRingReader(const MmapRingReader &) = delete;
+  MmapRingReader &operator=(const MmapRingReader &) = delete;
+
+  explicit operator bool() const noexcept { return base_ != nullptr; }
+
+  uint32_t sample_bytes() const { return header_.sample_bytes; }
+  uint32_t pm_table_version() const { return header_.pm_table_version; }
+  uint64_t capacity() const { return header_.capacity; }
+  uint64_t first_seq() const { return first_seq_; }
+  uint64_t last_seq() const { return last_seq_; }
+
+  /**
+   * @brief Record seq if it survived intact.
+   * @return Pointer to the payload (sample_bytes long) or nullptr.
+   */
+  const void *record(uint64_t seq, uint64_t &timestamp_ns) const;
+
+  /**
+   * @brief Newest intact sequence number (0 if none), searched forward from
+   * the header's committed_seq.
+   *
+   * Shared with the writer, which resumes after it.
+   */
+  static uint64_t find_last_seq(const char *base,
+                                const RingFileHeader &header);
+
+private:
+  int fd_ = -1;
+  const char *base_ = nullptr;
+  size_t map_bytes_ = 0;
+  RingFileHeader header_{};
+  uint64_t first_seq_ = 0;
+  uint64_t last_seq_ = 0;
+};
@@ -0,0 +1,32 @@
+/**
+ * @file parallel_for.hpp
+ * @brief Run fn(i) for i in [0, n) on up to @p threads threads.
+ *
+ * For short batch jobs (report panels, PNG bands) where a thread pool would
+ * outlive its use: the calling thread works too, and items are handed out
+ * one at a time through an atomic counter, so uneven items balance.
+ */
+
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <thread>
+#include <vector>
+
+template <typename Fn>
+void parallel_for(size_t n, unsigned threads, const Fn &fn) {
+  const size_t n_threads =
+      std::min<size_t>(n, std::max(1u, threads)); // Including this one
+  std::atomic<size_t> next{0};
+  auto work = [&] {
+    for (size_t i; (i = next.fetch_add(1, std::memory_order_relaxed)) < n;)
+      fn(i);
+  };
+  std::vector<std::thread> helpers;
+  for (size_t t = 1; t < n_threads; ++t)
+    helpers.emplace_back(work);
+  work();
+  for (auto &helper : helpers)
+    helper.join();
+}
@@ -0,0 +1,249 @@
+/**
+ * @file pm_acqd.cpp
+ * @brief Acquisition daemon: the only process that reads the pm_table.
+ *
+ * Reads the driver at a fixed period on a pinned, realtime thread and
+ * publishes every sample, with CLOCK_REALTIME and CLOCK_MONOTONIC stamps, to
+ * a shared-memory ring (shm_ring.hpp). pm_reader, pm_measure, pm_monitor and
+ * the Python tools attach with --shm instead of each polling sysfs, so they
+ * see identical samples and do not disturb each other's timing.
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <charconv>
+#include <chrono>
+#include <condition_variable>
+#include <csignal>
+#include <cstring>
+#include <ctime>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <spdlog/spdlog.h>
+#include <stop_token>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "metrics_exporter.hpp"
+#include "pm_table_layout.hpp"
+#include "pm_table_reader.hpp"
+#include "popl.hpp"
+#include "realtime_guard.hpp"
+#include "shm_ring.hpp"
+#include "synthetic_table.hpp"
+
+namespace {
+
+std::atomic<bool> running = true;
+
+void on_signal(int) { running.store(false, std::memory_order_relaxed); }
+
+uint64_t clock_ns(clockid_t clock) {
+  timespec ts{};
+  clock_gettime(clock, &ts);
+  return static_cast<uint64_t>(ts.tv_sec) * 1'000'000'000 +
+         static_cast<uint64_t>(ts.tv_nsec);
+}
+
+timespec to_timespec(uint64_t ns) {
+  return {static_cast<time_t>(ns / 1'000'000'000),
+          static_cast<long>(ns % 1'000'000'000)};
+}
+
+void log_status(ShmRingPublisher &ring, uint64_t max_late_ns) {
+  SPDLOG_INFO("{} samples published, {} read errors, latest wakeup {:.3f} ms "
+              "late.",
+              ring.published(), ring.read_errors(), max_late_ns / 1e6);
+  for (const auto &consumer : ring.consumers()) {
+    SPDLOG_INFO("  {} (pid {}): lag {} samples (max {}), {} lost in {} "
+                "overruns.",
+                consumer.name.empty() ? "?" : consumer.name, consumer.pid,
+                consumer.lag, consumer.max_lag, consumer.lost,
+                consumer.overruns);
+  }
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  using namespace popl;
+
+  OptionParser op("Usage: pm_acqd [options]\n"
+                  "Publishes pm_table samples to /dev/shm/<name> for "
+                  "pm_reader, pm_measure and pm_monitor (--shm <name>).");
+  auto help_option = op.add<Switch>("h", "help", "produce help message");
+  auto name_option = op.add<Value<std::string>>(
+      "n", "name", "Shared-memory object name", SHM_RING_DEFAULT_NAME);
+  auto period_option =
+      op.add<Value<unsigned>>("p", "period-us", "Sampling period", 1000);
+  auto history_option = op.add<Value<double>>(
+      "", "history-seconds",
+      "Ring length; a consumer may fall this far behind without losses", 8.0);
+  auto core_option =
+      op.add<Value<int>>("c", "core", "Pin the sampling thread to this CPU", 0);
+  auto priority_option = op.add<Value<int>>(
+      "", "priority", "SCHED_FIFO priority of the sampling thread", 90);
+  auto mode_option = op.add<Value<std::string>>(
+      "", "mode",
+      "Permissions of the ring (octal); 0666 lets non-root consumers register",
+      "0644");
+  auto status_option = op.add<Value<double>>(
+      "", "status-seconds", "Interval of the consumer lag report (0 = off)",
+      10.0);
+  auto metrics_option = op.add<Value<std::string>>(
+      "", "metrics",
+      "Serve Prometheus metrics on a Unix socket path or localhost port");
+  auto metrics_window_option = op.add<Value<double>>(
+      "", "metrics-window-seconds", "Window of the --metrics statistics",
+      10.0);
+  auto synthetic_option = op.add<Value<uint32_t>>(
+      "", "synthetic",
+      "Publish a generated table of this many bytes instead of the driver's",
+      0);
+  op.parse(argc, argv);
+
+  if (help_option->is_set()) {
+    std::cout << op << std::endl;
+    return 0;
+  }
+  if (period_option->value() < 100) {
+    SPDLOG_ERROR("--period-us must be at least 100.");
+    return 1;
+  }
+
+  std::unique_ptr<PmTableReader> pm_table_reader;
+  uint32_t sample_bytes = synthetic_option->value();
+  uint32_t pm_table_version = 0;
+  if (sample_bytes == 0) {
+    try {
+      pm_table_reader = std::make_unique<PmTableReader>();
+    } catch (const std::exception &e) {
+      SPDLOG_ERROR("{} Is the ryzen_smu kernel module loaded?", e.what());
+      return 1;
+    }
+    sample_bytes = static_cast<uint32_t>(pm_table_reader->getPmTableSize());
+    pm_table_version = pm_table_reader->getPmTableVersion();
+  }
+
+  ShmRingPublisher::Config config;
+  config.name = name_option->value();
+  config.period_ns = uint64_t{period_option->value()} * 1000;
+  config.capacity = std::max<uint64_t>(
+      64, static_cast<uint64_t>(history_option->value() * 1e9 /
+                                static_cast<double>(config.period_ns)));
+  const std::string &mode = mode_option->value();
+  const auto [mode_end, mode_ec] = std::from_chars(
+      mode.data(), mode.data() + mode.size(), config.mode, 8);
+  if (mode_ec != std::errc{} || mode_end != mode.data() + mode.size() ||
+      config.mode > 0777) {
+    SPDLOG_ERROR("Invalid --mode '{}'; expected octal permissions such as "
+                 "0644.",
+                 mode);
+    return 1;
+  }
+  ShmRingPublisher ring(sample_bytes, pm_table_version, config);
+  if (!ring)
+    return 1;
+
+  // Aggregated on the sampling thread (no locks, no syscalls); the server
+  // thread renders the last completed window.
+  std::unique_ptr<MetricsAggregator> metrics;
+  std::unique_ptr<MetricsServer> metrics_server;
+  if (metrics_option->is_set()) {
+    MetricsAggregator::Config metrics_config;
+    metrics_config.window_seconds = metrics_window_option->value();
+    metrics_config.period_ns = config.period_ns;
+    metrics = std::make_unique<MetricsAggregator>(
+        find_pm_table_layout(pm_table_version, sample_bytes / sizeof(float)),
+        sample_bytes / sizeof(float), metrics_config);
+    metrics_server = std::make_unique<MetricsServer>(metrics_option->value(),
+                                                     *metrics, "pm_acqd");
+    if (!*metrics_server)
+      return 1;
+  }
+
+  std::signal(SIGINT, on_signal);
+  std::signal(SIGTERM, on_signal);
+
+  // The lag report walks the consumer slots (a kill() each) and logs, so it
+  // runs on its own thread. Started before the realtime guard, so it keeps
+  // the normal policy and affinity; it only reads the ring header and the
+  // latest-wakeup maximum.
+  std::atomic<uint64_t> max_late_ns = 0;
+  const auto status_period = std::chrono::duration<double>(
+      std::max(0.0, status_option->value()));
+  std::jthread status_thread;
+  if (status_period.count() > 0) {
+    status_thread = std::jthread([&](std::stop_token stop) {
+      std::mutex mutex;
+      std::condition_variable_any wake;
+      std::unique_lock lock(mutex);
+      while (!wake.wait_for(lock, stop, status_period,
+                            [&] { return stop.stop_requested(); }))
+        log_status(ring, max_late_ns.exchange(0, std::memory_order_relaxed));
+    });
+  }
+
+  RealtimeGuard rt(core_option->value(), priority_option->value(),
+                   /*lock_memory=*/true);
+  if (!rt.active())
+    SPDLOG_WARN("Running without realtime priority; expect jitter. Grant "
+                "CAP_SYS_NICE or run as root.");
+
+  std::vector<char> buffer(sample_bytes);
+
+  // Absolute deadlines, so the period does not drift with the read time.
+  uint64_t deadline_ns = clock_ns(CLOCK_MONOTONIC);
+  while (running.load(std::memory_order_relaxed)) {
+    deadline_ns += config.period_ns;
+    const timespec deadline = to_timespec(deadline_ns);
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline,
+                           nullptr) == EINTR &&
+           running.load(std::memory_order_relaxed)) {
+    }
+
+    const uint64_t monotonic_ns = clock_ns(CLOCK_MONOTONIC);
+    const uint64_t realtime_ns = clock_ns(CLOCK_REALTIME);
+    if (monotonic_ns > deadline_ns) {
+      const uint64_t late_ns = monotonic_ns - deadline_ns;
+      uint64_t seen_ns = max_late_ns.load(std::memory_order_relaxed);
+      while (late_ns > seen_ns &&
+             !max_late_ns.compare_exchange_weak(seen_ns, late_ns,
+                                                std::memory_order_relaxed)) {
+      }
+      if (monotonic_ns - deadline_ns > config.period_ns) {
+        // Skip the missed periods instead of publishing a burst.
+        if (metrics)
+          metrics->count_dropped((monotonic_ns - deadline_ns) /
+                                 config.period_ns);
+        deadline_ns = monotonic_ns;
+      }
+    }
+
+    if (pm_table_reader) {
+      if (!pm_table_reader->read(buffer.data())) {
+        ring.count_read_error();
+        if (metrics)
+          metrics->count_dropped();
+        continue;
+      }
+    } else {
+      fill_synthetic_table(buffer, ring.published());
+    }
+    ring.publish(realtime_ns, monotonic_ns, buffer.data());
+    if (metrics)
+      metrics->add(monotonic_ns,
+                   reinterpret_cast<const float *>(buffer.data()));
+  }
+
+  SPDLOG_INFO("Stopping.");
+  if (status_thread.joinable()) {
+    status_thread.request_stop();
+    status_thread.join();
+  }
+  log_status(ring, max_late_ns.load(std::memory_order_relaxed));
+  return 0;
+}
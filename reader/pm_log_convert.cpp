@@ -0,0 +1,345 @@
+/**
+ * @file pm_log_convert.cpp
+ * @brief Convert pm_reader logs between .bin, .pmz and .pmcol; recover .pmr;
+ * export Perfetto / Chrome traces.
+ *
+ *   pm_log_convert pm_table_log.bin pm_table_log.pmz     # compress
+ *   pm_log_convert pm_table_log.pmz pm_table_log.bin     # decompress
+ *   pm_log_convert pm_table_log.bin pm_table_log.pmcol   # numpy.memmap
+ *                                                        # + zoom levels
+ *   pm_log_convert pm_table_log.pmr recovered.bin        # ring recovery
+ *   pm_log_convert pm_table_log.pmz trace.pftrace        # ui.perfetto.dev
+ *   pm_log_convert pm_table_log.bin trace.json           # chrome://tracing
+ *
+ * The input format follows from its magic, the output format from the
+ * output file extension (anything else is written as .bin).
+ */
+
+#include "column_list.hpp"
+#include "columnar_log.hpp"
+#include "mmap_ring_log.hpp"
+#include "pmz_codec.hpp"
+#include "popl.hpp"
+#include "pm_table_layout.hpp"
+#include "time_pyramid.hpp"
+#include "trace_export.hpp"
+
+#include <chrono>
+#include <cstring>
+#include <ctime>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <spdlog/spdlog.h>
+#include <string>
+#include <vector>
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+/// Receives n row-major samples; false aborts the conversion.
+using BlockSink =
+    std::function<bool(const uint64_t *, const uint32_t *, size_t)>;
+
+constexpr size_t BIN_BATCH = 1000;
+
+/**
+ * @brief Stream a pm_reader .bin log to sink in batches.
+ * @return Number of samples read.
+ */
+uint64_t read_bin(std::ifstream &in, uint64_t sample_bytes,
+                  const BlockSink &sink) {
+  std::vector<uint64_t> timestamps;
+  std::vector<uint32_t> words;
+  timestamps.reserve(BIN_BATCH);
+  words.reserve(BIN_BATCH * sample_bytes / 4);
+  std::vector<uint32_t> row(sample_bytes / 4);
+  uint64_t samples = 0;
+  uint64_t header[2];
+  while (in.read(reinterpret_cast<char *>(header), sizeof(header))) {
+    if (header[1] != sample_bytes) {
+      SPDLOG_ERROR("Sample {} has size {}, expected {}; stopping.", samples,
+                   header[1], sample_bytes);
+      break;
+    }
+    if (!in.read(reinterpret_cast<char *>(row.data()),
+                 static_cast<std::streamsize>(sample_bytes))) {
+      SPDLOG_WARN("Truncated last sample dropped.");
+      break;
+    }
+    timestamps.push_back(header[0]);
+    words.insert(words.end(), row.begin(), row.end());
+    if (timestamps.size() == BIN_BATCH) {
+      if (!sink(timestamps.data(), words.data(), timestamps.size()))
+        return samples;
+      samples += timestamps.size();
+      timestamps.clear();
+      words.clear();
+    }
+  }
+  if (!timestamps.empty() &&
+      sink(timestamps.data(), words.data(), timestamps.size()))
+    samples += timestamps.size();
+  return samples;
+}
+
+uint64_t read_pmz(PmzReader &reader, const BlockSink &sink) {
+  std::vector<uint64_t> timestamps;
+  std::vector<uint32_t> words;
+  uint64_t samples = 0;
+  for (size_t b = 0; b < reader.blocks().size(); ++b) {
+    if (!reader.read_block(b, timestamps, words)) {
+      SPDLOG_ERROR("Block {} is corrupt; stopping.", b);
+      break;
+    }
+    if (!sink(timestamps.data(), words.data(), timestamps.size()))
+      break;
+    samples += timestamps.size();
+  }
+  return samples;
+}
+
+/**
+ * @brief Stream the surviving records of a ring log, oldest first.
+ *
+ * Torn or missing records (a crash mid-write, or slots never written) are
+ * skipped and counted.
+ */
+uint64_t read_ring(const MmapRingReader &reader, const BlockSink &sink) {
+  const size_t n_words = reader.sample_bytes() / 4;
+  std::vector<uint64_t> timestamps;
+  std::vector<uint32_t> words;
+  timestamps.reserve(BIN_BATCH);
+  words.reserve(BIN_BATCH * n_words);
+  uint64_t samples = 0, skipped = 0;
+  for (uint64_t seq = reader.first_seq();
+       seq != 0 && seq <= reader.last_seq(); ++seq) {
+    uint64_t timestamp_ns = 0;
+    const auto *payload =
+        static_cast<const uint32_t *>(reader.record(seq, timestamp_ns));
+    if (!payload) {
+      ++skipped;
+      continue;
+    }
+    timestamps.push_back(timestamp_ns);
+    words.insert(words.end(), payload, payload + n_words);
+    if (timestamps.size() == BIN_BATCH) {
+      if (!sink(timestamps.data(), words.data(), timestamps.size()))
+        return samples;
+      samples += timestamps.size();
+      timestamps.clear();
+      words.clear();
+    }
+  }
+  if (!timestamps.empty() &&
+      sink(timestamps.data(), words.data(), timestamps.size()))
+    samples += timestamps.size();
+  SPDLOG_INFO("Ring records {}..{}: {} recovered, {} torn or missing.",
+              reader.first_seq(), reader.last_seq(), samples, skipped);
+  return samples;
+}
+
+bool ends_with(const std::string &s, const std::string &suffix) {
+  return s.size() >= suffix.size() &&
+         s.compare(s.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+/**
+ * @brief CLOCK_MONOTONIC - CLOCK_REALTIME of the running system.
+ *
+ * Recordings carry wall-clock timestamps; adding this puts them on the
+ * monotonic clock of the current boot, which is what perf and ftrace traces
+ * of that boot use.
+ */
+int64_t monotonic_minus_realtime_ns() {
+  timespec mono{}, real{};
+  clock_gettime(CLOCK_MONOTONIC, &mono);
+  clock_gettime(CLOCK_REALTIME, &real);
+  return (static_cast<int64_t>(mono.tv_sec) - real.tv_sec) * 1'000'000'000 +
+         (mono.tv_nsec - real.tv_nsec);
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  using namespace popl;
+
+  OptionParser op("Usage: pm_log_convert [options] <input> <output>");
+  auto help_option = op.add<Switch>("h", "help", "produce help message");
+  auto version_option = op.add<Value<uint32_t>>(
+      "v", "pm-table-version",
+      "pm_table version stored in the output header (for .bin input)", 0);
+  auto block_option = op.add<Value<uint32_t>>(
+      "b", "block-samples",
+      "Samples per .pmz block / .pmcol chunk (0 = format default)", 0);
+  auto no_pyramid_option = op.add<Switch>(
+      "", "no-pyramid",
+      "Do not write the min/max/mean zoom levels next to a .pmcol output");
+  auto trace_cells_option = op.add<Value<std::string>>(
+      "", "trace-cells",
+      "pm_table indices exported as counter tracks to a .pftrace/.json "
+      "output, e.g. 17,20-31 or 'all' (default: derived channels only)");
+  auto offset_option = op.add<Value<int64_t>>(
+      "", "monotonic-offset-ns",
+      "Added to the wall-clock timestamps of a .pftrace/.json output "
+      "(default: CLOCK_MONOTONIC - CLOCK_REALTIME now, i.e. a recording of "
+      "the current boot)");
+  op.parse(argc, argv);
+
+  const auto &args = op.non_option_args();
+  if (help_option->is_set() || args.size() != 2) {
+    std::cout << op << std::endl;
+    return help_option->is_set() ? 0 : 1;
+  }
+  const std::string &in_path = args[0];
+  const std::string &out_path = args[1];
+
+  // --- Input ---
+  std::ifstream bin_in;
+  std::unique_ptr<PmzReader> pmz_in;
+  std::unique_ptr<MmapRingReader> ring_in;
+  uint64_t sample_bytes = 0;
+  uint32_t version = version_option->value();
+  char magic[4] = {};
+  std::ifstream(in_path, std::ios::binary).read(magic, sizeof(magic));
+  if (std::memcmp(magic, PMZ_FILE_MAGIC, 4) == 0) {
+    pmz_in = std::make_unique<PmzReader>(in_path);
+    if (!*pmz_in)
+      return 1;
+    sample_bytes = pmz_in->sample_bytes();
+    if (!version_option->is_set())
+      version = pmz_in->pm_table_version();
+  } else if (std::memcmp(magic, RING_FILE_MAGIC, 4) == 0) {
+    ring_in = std::make_unique<MmapRingReader>(in_path);
+    if (!*ring_in)
+      return 1;
+    sample_bytes = ring_in->sample_bytes();
+    if (!version_option->is_set())
+      version = ring_in->pm_table_version();
+  } else {
+    bin_in.open(in_path, std::ios::binary);
+    uint64_t header[2] = {};
+    bin_in.read(reinterpret_cast<char *>(header), sizeof(header));
+    sample_bytes = header[1];
+    bin_in.seekg(0);
+  }
+  if (sample_bytes == 0 || sample_bytes > 16384 || sample_bytes % 4 != 0) {
+    SPDLOG_ERROR("{} is empty, unreadable or has an unexpected sample size "
+                 "({}).",
+                 in_path, sample_bytes);
+    return 1;
+  }
+  const auto n_words = static_cast<size_t>(sample_bytes / 4);
+  const auto table_bytes = static_cast<uint32_t>(sample_bytes);
+  const uint32_t block = block_option->value();
+
+  // --- Output ---
+  std::unique_ptr<PmzFileWriter> pmz_out;
+  std::unique_ptr<ColumnarFileWriter> columnar_out;
+  std::unique_ptr<PyramidWriter> pyramid_out;
+  std::unique_ptr<TraceExporter> trace_out;
+  std::ofstream bin_out;
+  BlockSink sink;
+  if (ends_with(out_path, ".pftrace") || ends_with(out_path, ".json") ||
+      ends_with(out_path, ".perfetto-trace")) {
+    TraceExporter::Config config;
+    config.format = TraceExporter::format_for_path(out_path);
+    config.layout = find_pm_table_layout(version, n_words);
+    if (trace_cells_option->is_set() &&
+        !parse_column_list(trace_cells_option->value(), n_words,
+                           config.cells)) {
+      SPDLOG_ERROR("Invalid --trace-cells '{}'.", trace_cells_option->value());
+      return 1;
+    }
+    if (!config.layout && config.cells.empty()) {
+      SPDLOG_ERROR("Unknown pm_table layout (version {:#x}); select cells "
+                   "with --trace-cells.",
+                   version);
+      return 1;
+    }
+    const int64_t offset = offset_option->is_set()
+                               ? offset_option->value()
+                               : monotonic_minus_realtime_ns();
+    SPDLOG_INFO("Trace timestamps: wall clock {:+} ns.", offset);
+    trace_out = std::make_unique<TraceExporter>(out_path, config);
+    sink = [&, offset](const uint64_t *ts, const uint32_t *rows, size_t n) {
+      for (size_t i = 0; i < n; ++i)
+        trace_out->add_sample(
+            static_cast<uint64_t>(static_cast<int64_t>(ts[i]) + offset),
+            reinterpret_cast<const float *>(rows + i * n_words), n_words);
+      return static_cast<bool>(*trace_out);
+    };
+  } else if (ends_with(out_path, ".pmz")) {
+    pmz_out = std::make_unique<PmzFileWriter>(out_path, table_bytes, version,
+                                              block ? block : 1000);
+    sink = [&](const uint64_t *ts, const uint32_t *rows, size_t n) {
+      return pmz_out->add_block(ts, rows, n);
+    };
+  } else if (ends_with(out_path, ".pmcol")) {
+    columnar_out = std::make_unique<ColumnarFileWriter>(
+        out_path, table_bytes, version, block ? block : 4096);
+    if (!no_pyramid_option->is_set())
+      pyramid_out =
+          std::make_unique<PyramidWriter>(out_path, table_bytes, version);
+    sink = [&](const uint64_t *ts, const uint32_t *rows, size_t n) {
+      return columnar_out->add_rows(ts, rows, n) &&
+             (!pyramid_out || pyramid_out->add_rows(ts, rows, n));
+    };
+  } else {
+    bin_out.open(out_path, std::ios::binary);
+    sink = [&](const uint64_t *ts, const uint32_t *rows, size_t n) {
+      for (size_t i = 0; i < n; ++i) {
+        const uint64_t header[2] = {ts[i], sample_bytes};
+        bin_out.write(reinterpret_cast<const char *>(header), sizeof(header));
+        bin_out.write(reinterpret_cast<const char *>(rows + i * n_words),
+                      static_cast<std::streamsize>(sample_bytes));
+      }
+      return static_cast<bool>(bin_out);
+    };
+  }
+  if ((pmz_out && !*pmz_out) || (columnar_out && !*columnar_out) ||
+      (pyramid_out && !*pyramid_out) || (trace_out && !*trace_out) ||
+      (!pmz_out && !columnar_out && !trace_out && !bin_out)) {
+    SPDLOG_ERROR("Failed to open {} for writing.", out_path);
+    return 1;
+  }
+
+  // --- Convert ---
+  const auto start = Clock::now();
+  uint64_t samples = 0;
+  if (pmz_in)
+    samples = read_pmz(*pmz_in, sink);
+  else if (ring_in)
+    samples = read_ring(*ring_in, sink);
+  else
+    samples = read_bin(bin_in, sample_bytes, sink);
+  bool ok = true;
+  if (pmz_out)
+    ok = pmz_out->close();
+  else if (columnar_out)
+    ok = columnar_out->close() && (!pyramid_out || pyramid_out->close());
+  else if (trace_out)
+    ok = trace_out->close();
+  else {
+    // close() flushes; a failed write or flush leaves the stream failed.
+    bin_out.close();
+    ok = static_cast<bool>(bin_out);
+    if (!ok)
+      SPDLOG_ERROR("Write to {} failed.", out_path);
+  }
+  const double seconds =
+      std::chrono::duration<double>(Clock::now() - start).count();
+
+  const auto in_bytes = std::filesystem::file_size(in_path);
+  const auto out_bytes = std::filesystem::file_size(out_path);
+  const double raw_mib = samples * (16.0 + sample_bytes) / 1048576.0;
+  SPDLOG_INFO("Converted {} samples in {:.2f} s: {:.1f} MiB -> {:.1f} MiB "
+              "(.bin equivalent {:.1f} MiB, {:.2f}x), {:.0f} MiB/s, "
+              "{:.0f} samples/s.",
+              samples, seconds, in_bytes / 1048576.0, out_bytes / 1048576.0,
+              raw_mib, out_bytes ? raw_mib * 1048576.0 / out_bytes : 0.0,
+              seconds > 0 ? raw_mib / seconds : 0.0,
+              seconds > 0 ? samples / seconds : 0.0);
+  return ok ? 0 : 1;
+}
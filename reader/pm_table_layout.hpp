@@ -0,0 +1,106 @@
+/**
+ * @file pm_table_layout.hpp
+ * @brief Float offsets of well-known metrics inside a pm_table, per table
+ * version.
+ *
+ * The pm_table is an array of 32-bit floats whose layout depends on the SMU
+ * table version (see ryzen_monitor's pm_tables.c). Only the cells needed for
+ * derived quantities (power, limits, temperatures) are described here; the
+ * rest of the table is treated as anonymous cells.
+ */
+
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * @struct PmTableLayout
+ * @brief Cell indices (not byte offsets) of named metrics for one table
+ * version.
+ */
+struct PmTableLayout {
+  uint32_t version;
+  const char *codename;
+  size_t min_floats; ///< Tables shorter than this cannot be this version.
+
+  size_t n_cores;
+  size_t core_power;   ///< First of n_cores consecutive cells, W.
+  size_t core_voltage; ///< First of n_cores consecutive cells, V.
+  size_t core_temp;    ///< First of n_cores consecutive cells, degC.
+  size_t core_freq;    ///< First of n_cores consecutive cells, MHz.
+  size_t core_c0;      ///< First of n_cores consecutive cells, %.
+
+  size_t stapm_limit;
+  size_t stapm_value;
+  size_t ppt_limit;
+  size_t ppt_value;
+  size_t tdc_limit;
+  size_t tdc_value;
+  size_t edc_limit;
+  size_t edc_value;
+  size_t thm_limit;
+  size_t thm_value;
+  size_t vddcr_cpu_power; ///< W
+  size_t vddcr_soc_power; ///< W
+  size_t socket_power;    ///< W
+  size_t soc_temp;        ///< degC
+  size_t prochot;
+};
+
+/// Cezanne / Barcelo (e.g. Ryzen 5 5625U), offsets from pm_tables.c.
+inline constexpr PmTableLayout PM_TABLE_LAYOUT_0x400005{
+    .version = 0x400005,
+    .codename = "Cezanne",
+    .min_floats = 580,
+    .n_cores = 8,
+    .core_power = 200,
+    .core_voltage = 208,
+    .core_temp = 216,
+    .core_freq = 240,
+    .core_c0 = 256,
+    .stapm_limit = 0,
+    .stapm_value = 1,
+    .ppt_limit = 4,
+    .ppt_value = 5,
+    .tdc_limit = 8,
+    .tdc_value = 9,
+    .edc_limit = 12,
+    .edc_value = 13,
+    .thm_limit = 16,
+    .thm_value = 17,
+    .vddcr_cpu_power = 34,
+    .vddcr_soc_power = 35,
+    .socket_power = 38,
+    .soc_temp = 400,
+    .prochot = 578,
+};
+
+inline constexpr const PmTableLayout *PM_TABLE_LAYOUTS[] = {
+    &PM_TABLE_LAYOUT_0x400005,
+};
+
+/**
+ * @brief Look up the layout for a table version.
+ *
+ * If the version is unknown (0 when the driver does not report it) the first
+ * layout whose minimum size fits the table is used, so tools keep working on
+ * the development machine without pm_table_version.
+ *
+ * @param version Value of /sys/kernel/ryzen_smu_drv/pm_table_version or 0.
+ * @param n_floats Table size in floats.
+ * @return Layout or nullptr if no known layout fits.
+ */
+inline const PmTableLayout *find_pm_table_layout(uint32_t version,
+                                                 size_t n_floats) {
+  for (const auto *layout : PM_TABLE_LAYOUTS) {
+    if (layout->version == version && n_floats >= layout->min_floats)
+      return layout;
+  }
+  if (version == 0) {
+    for (const auto *layout : PM_TABLE_LAYOUTS) {
+      if (n_floats >= layout->min_floats)
+        return layout;
+    }
+  }
+  return nullptr;
+}
@@ -19,6 +19,16 @@ PmTableReader::PmTableReader()
     SPDLOG_ERROR("Failed to open /sys/kernel/ryzen_smu_drv/pm_table.");
   }
   pm_table_stream.seekg(0);
+
+  // The version is optional: older driver builds do not export it.
+  std::ifstream version_file("/sys/kernel/ryzen_smu_drv/pm_table_version",
+                             std::ios::binary);
+  if (version_file.read(reinterpret_cast<char *>(&pm_table_version),
+                        sizeof(pm_table_version))) {
+    SPDLOG_TRACE("Detected pm_table version: {:#x}.", pm_table_version);
+  } else {
+    pm_table_version = 0;
+  }
 }
 
 /**
@@ -26,14 +36,23 @@ PmTableReader::PmTableReader()
  */
 uint64_t PmTableReader::getPmTableSize() const { return pm_table_size; }
 
+/**
+ * @brief Return the pm_table version read from sysfs (0 if unavailable).
+ */
+uint32_t PmTableReader::getPmTableVersion() const { return pm_table_version; }
+
 /**
  * @brief Read the pm_table blob into a caller-supplied buffer.
  *
  * This method reads pm_table_size bytes and rewinds the stream to the start.
  */
-void PmTableReader::read(char *buffer) {
-  pm_table_stream.read(buffer, getPmTableSize());
+bool PmTableReader::read(char *buffer) {
+  const bool ok =
+      static_cast<bool>(pm_table_stream.read(buffer, getPmTableSize()));
+  if (!ok)
+    pm_table_stream.clear();
   pm_table_stream.seekg(0);
+  return ok;
 }
 
 /**
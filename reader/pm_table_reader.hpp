@@ -24,14 +24,22 @@ public:
    */
   uint64_t getPmTableSize() const;
 
+  /**
+   * @brief Get the SMU table version (e.g. 0x400005 for Cezanne).
+   * @return Version from /sys/kernel/ryzen_smu_drv/pm_table_version, or 0 if
+   * the driver does not expose it.
+   */
+  uint32_t getPmTableVersion() const;
+
   /**
    * @brief Read pm_table_size bytes into the provided buffer.
    *
    * The buffer must be at least getPmTableSize() bytes long.
    *
    * @param buffer Destination buffer.
+   * @return false if the read came up short; the next read retries.
    */
-  void read(char *buffer); // reads pm_table_size bytes into buffer
+  bool read(char *buffer); // reads pm_table_size bytes into buffer
   /**
    * @brief Read the pm_table blob into a caller-supplied buffer.
    *
@@ -45,5 +53,6 @@ public:
 private:
   uint64_t read_sysfs_uint64(const std::string &path);
   uint64_t pm_table_size;
+  uint32_t pm_table_version{0};
   std::ifstream pm_table_stream;
 };
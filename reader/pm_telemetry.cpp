@@ -0,0 +1,587 @@
+/**
+ * @file pm_telemetry.cpp
+ * @brief libpm_telemetry: the C API of pm_telemetry.h.
+ *
+ * The sampler thread owns the source, the latest slot's write side, the
+ * MetricsAggregator's producer side and the event queue's write side; it
+ * takes no locks. API calls read the latest slot through its seqlock and
+ * the aggregator's snapshots under window_mutex (the triple buffer has a
+ * single consumer). The dispatcher drains the event queue and runs the
+ * callbacks under subscriber_mutex, which the sampler never touches.
+ */
+
+#include "pm_telemetry.h"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <ctime>
+#include <fcntl.h>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <pthread.h>
+#include <sched.h>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+#include "metrics_aggregator.hpp"
+#include "pm_table_layout.hpp"
+#include "synthetic_table.hpp"
+
+namespace {
+
+constexpr const char *DEFAULT_SYSFS_DIR = "/sys/kernel/ryzen_smu_drv";
+constexpr size_t MAX_TABLE_BYTES = 16384;
+constexpr size_t MAX_SUBSCRIBERS = 16;
+constexpr uint32_t EVENT_QUEUE_SIZE = 256; // Power of two
+constexpr uint64_t DISPATCH_PERIOD_NS = 5'000'000;
+
+uint64_t clock_ns(clockid_t clock) {
+  timespec ts{};
+  clock_gettime(clock, &ts);
+  return static_cast<uint64_t>(ts.tv_sec) * 1'000'000'000 +
+         static_cast<uint64_t>(ts.tv_nsec);
+}
+
+timespec to_timespec(uint64_t ns) {
+  return {static_cast<time_t>(ns / 1'000'000'000),
+          static_cast<long>(ns % 1'000'000'000)};
+}
+
+void sleep_until(uint64_t monotonic_ns) {
+  const timespec deadline = to_timespec(monotonic_ns);
+  while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline,
+                         nullptr) == EINTR) {
+  }
+}
+
+/// Reads a whole small binary sysfs attribute; false if it is missing.
+bool read_sysfs(const std::string &path, void *value, size_t size) {
+  const int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0)
+    return false;
+  const bool ok = ::pread(fd, value, size, 0) == static_cast<ssize_t>(size);
+  ::close(fd);
+  return ok;
+}
+
+/// Pins the calling thread and raises it to SCHED_FIFO; true if both (as
+/// requested) took effect.
+bool make_realtime(int cpu, int priority) {
+  bool ok = true;
+  if (cpu >= 0) {
+    cpu_set_t cpuset;
+    CPU_ZERO(&cpuset);
+    CPU_SET(cpu, &cpuset);
+    ok &= pthread_setaffinity_np(pthread_self(), sizeof(cpuset), &cpuset) ==
+          0;
+  }
+  if (priority > 0) {
+    sched_param param{};
+    param.sched_priority = priority;
+    ok &= pthread_setschedparam(pthread_self(), SCHED_FIFO, &param) == 0;
+  }
+  return ok && (cpu >= 0 || priority > 0);
+}
+
+struct Subscriber {
+  uint32_t id;
+  uint32_t mask;
+  pmt_event_fn callback;
+  void *user;
+};
+
+} // namespace
+
+struct pmt_handle {
+  // Source.
+  int fd = -1; ///< pm_table; -1 for synthetic tables
+  size_t table_bytes = 0;
+  uint32_t version = 0;
+  const PmTableLayout *layout = nullptr;
+
+  // Enumeration, fixed at open. The aggregator built on each start lists
+  // the same sensors and limits in the same order.
+  std::vector<MetricsAggregator::Sensor> sensors;
+  std::vector<MetricsAggregator::Limit> limits;
+
+  // Latest sample: a seqlock, written only by the sampler. seq 0 while a
+  // write is in progress.
+  std::atomic<uint64_t> latest_seq{0};
+  uint64_t latest_monotonic_ns = 0;
+  uint64_t latest_realtime_ns = 0;
+  std::vector<char> latest;
+
+  // Sampler.
+  std::mutex control_mutex; ///< Serializes start/stop
+  std::thread sampler;
+  std::thread dispatcher;
+  std::atomic<bool> running{false};     ///< Sampler keeps sampling
+  std::atomic<bool> dispatching{false}; ///< Dispatcher keeps polling
+  pmt_sampler_options options{};
+  std::atomic<uint64_t> samples{0}, read_errors{0}, missed_periods{0},
+      max_late_ns{0}, events{0}, events_dropped{0};
+  std::atomic<uint64_t> sampler_cpu_ns{0}; ///< Final value after a stop
+  uint64_t start_ns = 0, stop_ns = 0;
+  clockid_t sampler_clock{};
+  std::atomic<bool> realtime{false};
+
+  std::mutex window_mutex; ///< Guards aggregator and its consumer side
+  std::unique_ptr<MetricsAggregator> aggregator;
+
+  // Event queue, sampler to dispatcher.
+  std::array<pmt_event, EVENT_QUEUE_SIZE> event_queue{};
+  std::atomic<uint32_t> event_head{0}, event_tail{0};
+
+  std::mutex subscriber_mutex; ///< Held while callbacks run
+  std::vector<Subscriber> subscribers;
+  uint32_t next_subscriber_id = 1;
+
+  ~pmt_handle() {
+    if (fd >= 0)
+      ::close(fd);
+  }
+
+  bool read(std::vector<char> &buffer, uint64_t seq) {
+    if (fd < 0) {
+      fill_synthetic_table(buffer, seq);
+      return true;
+    }
+    return ::pread(fd, buffer.data(), table_bytes, 0) ==
+           static_cast<ssize_t>(table_bytes);
+  }
+
+  void publish_latest(const char *table, uint64_t seq, uint64_t monotonic_ns,
+                      uint64_t realtime_ns) {
+    latest_seq.store(0, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    latest_monotonic_ns = monotonic_ns;
+    latest_realtime_ns = realtime_ns;
+    std::memcpy(latest.data(), table, table_bytes);
+    latest_seq.store(seq, std::memory_order_release);
+  }
+
+  void push_events(uint32_t reached, uint64_t seq, uint64_t monotonic_ns,
+                   const float *table) {
+    for (uint32_t i = 0; i < limits.size(); ++i) {
+      if (!(reached & (1u << i)))
+        continue;
+      events.fetch_add(1, std::memory_order_relaxed);
+      const uint32_t head = event_head.load(std::memory_order_relaxed);
+      if (head - event_tail.load(std::memory_order_acquire) >=
+          EVENT_QUEUE_SIZE) {
+        events_dropped.fetch_add(1, std::memory_order_relaxed);
+        continue;
+      }
+      const auto &limit = limits[i];
+      event_queue[head % EVENT_QUEUE_SIZE] = {
+          i, seq, monotonic_ns, table[limit.value],
+          limit.limit == SIZE_MAX ? 0.0f : table[limit.limit]};
+      event_head.store(head + 1, std::memory_order_release);
+    }
+  }
+
+  void run_sampler(MetricsAggregator &metrics);
+  void run_dispatcher();
+};
+
+void pmt_handle::run_sampler(MetricsAggregator &metrics) {
+  realtime.store(make_realtime(options.cpu, options.rt_priority),
+                 std::memory_order_relaxed);
+
+  const auto period_ns = static_cast<uint64_t>(1e9 / options.rate_hz);
+  std::vector<char> buffer(table_bytes);
+  const auto *table = reinterpret_cast<const float *>(buffer.data());
+  uint64_t seq = 0;
+
+  // Absolute deadlines, so the period does not drift with the read time.
+  uint64_t deadline_ns = clock_ns(CLOCK_MONOTONIC);
+  while (running.load(std::memory_order_relaxed)) {
+    deadline_ns += period_ns;
+    sleep_until(deadline_ns);
+
+    const uint64_t monotonic_ns = clock_ns(CLOCK_MONOTONIC);
+    const uint64_t realtime_ns = clock_ns(CLOCK_REALTIME);
+    if (monotonic_ns > deadline_ns) {
+      const uint64_t late = monotonic_ns - deadline_ns;
+      if (late > max_late_ns.load(std::memory_order_relaxed))
+        max_late_ns.store(late, std::memory_order_relaxed);
+      if (late > period_ns) {
+        // Skip the missed periods instead of sampling a burst.
+        missed_periods.fetch_add(late / period_ns, std::memory_order_relaxed);
+        metrics.count_dropped(late / period_ns);
+        deadline_ns = monotonic_ns;
+      }
+    }
+
+    if (!read(buffer, seq)) {
+      read_errors.fetch_add(1, std::memory_order_relaxed);
+      metrics.count_dropped();
+      continue;
+    }
+    ++seq;
+    publish_latest(buffer.data(), seq, monotonic_ns, realtime_ns);
+    samples.store(seq, std::memory_order_relaxed);
+    if (const uint32_t reached = metrics.add(monotonic_ns, table))
+      push_events(reached, seq, monotonic_ns, table);
+  }
+}
+
+void pmt_handle::run_dispatcher() {
+  uint64_t wakeup_ns = clock_ns(CLOCK_MONOTONIC);
+  for (;;) {
+    const bool last_round = !dispatching.load(std::memory_order_acquire);
+    uint32_t tail = event_tail.load(std::memory_order_relaxed);
+    const uint32_t head = event_head.load(std::memory_order_acquire);
+    if (tail != head) {
+      std::lock_guard lock(subscriber_mutex);
+      for (; tail != head; ++tail) {
+        const pmt_event &event = event_queue[tail % EVENT_QUEUE_SIZE];
+        for (const auto &subscriber : subscribers) {
+          if (subscriber.mask & (1u << event.limit))
+            subscriber.callback(&event, subscriber.user);
+        }
+      }
+      event_tail.store(tail, std::memory_order_release);
+    }
+    // pmt_stop() clears dispatching after joining the sampler, so this
+    // round delivered everything it queued.
+    if (last_round)
+      return;
+    wakeup_ns += DISPATCH_PERIOD_NS;
+    sleep_until(wakeup_ns);
+  }
+}
+
+extern "C" {
+
+const char *pmt_strerror(int status) {
+  switch (status) {
+  case PMT_OK:
+    return "success";
+  case PMT_ERR_INVALID:
+    return "invalid argument";
+  case PMT_ERR_NO_DEVICE:
+    return "pm_table not available (is the ryzen_smu module loaded?)";
+  case PMT_ERR_IO:
+    return "pm_table read failed";
+  case PMT_ERR_STATE:
+    return "sampler already running";
+  case PMT_ERR_NO_DATA:
+    return "no data yet";
+  case PMT_ERR_RESOURCE:
+    return "out of resources";
+  }
+  return "unknown error";
+}
+
+int pmt_open(const pmt_open_options *options, pmt_handle **handle) {
+  if (!handle)
+    return PMT_ERR_INVALID;
+  *handle = nullptr;
+  const pmt_open_options defaults{};
+  if (!options)
+    options = &defaults;
+
+  auto h = std::unique_ptr<pmt_handle>(new (std::nothrow) pmt_handle);
+  if (!h)
+    return PMT_ERR_RESOURCE;
+  try {
+    if (options->synthetic_bytes > 0) {
+      if (options->synthetic_bytes > MAX_TABLE_BYTES ||
+          options->synthetic_bytes % sizeof(float) != 0)
+        return PMT_ERR_INVALID;
+      h->table_bytes = options->synthetic_bytes;
+      h->version = options->synthetic_version;
+    } else {
+      const std::string dir =
+          options->sysfs_dir ? options->sysfs_dir : DEFAULT_SYSFS_DIR;
+      uint64_t size = 0;
+      if (!read_sysfs(dir + "/pm_table_size", &size, sizeof(size)))
+        return PMT_ERR_NO_DEVICE;
+      if (size == 0 || size > MAX_TABLE_BYTES || size % sizeof(float) != 0)
+        return PMT_ERR_IO;
+      // The version is optional: older driver builds do not export it.
+      if (!read_sysfs(dir + "/pm_table_version", &h->version,
+                      sizeof(h->version)))
+        h->version = 0;
+      h->fd = ::open((dir + "/pm_table").c_str(), O_RDONLY | O_CLOEXEC);
+      if (h->fd < 0)
+        return errno == ENOENT ? PMT_ERR_NO_DEVICE : PMT_ERR_IO;
+      h->table_bytes = size;
+    }
+    h->latest.resize(h->table_bytes);
+
+    const size_t n_floats = h->table_bytes / sizeof(float);
+    h->layout = find_pm_table_layout(h->version, n_floats);
+    const MetricsAggregator catalog(h->layout, n_floats, {});
+    h->sensors = catalog.sensors();
+    h->limits = catalog.limits();
+    h->subscribers.reserve(MAX_SUBSCRIBERS);
+  } catch (const std::bad_alloc &) {
+    return PMT_ERR_RESOURCE;
+  }
+
+  // One read up front, so a broken driver fails here and not in the sampler.
+  if (!h->read(h->latest, 0))
+    return PMT_ERR_IO;
+  *handle = h.release();
+  return PMT_OK;
+}
+
+void pmt_close(pmt_handle *handle) {
+  if (!handle)
+    return;
+  pmt_stop(handle);
+  delete handle;
+}
+
+size_t pmt_table_cells(const pmt_handle *handle) {
+  return handle ? handle->table_bytes / sizeof(float) : 0;
+}
+
+uint32_t pmt_table_version(const pmt_handle *handle) {
+  return handle ? handle->version : 0;
+}
+
+const char *pmt_layout_name(const pmt_handle *handle) {
+  return handle && handle->layout ? handle->layout->codename : nullptr;
+}
+
+void pmt_sampler_options_init(pmt_sampler_options *options) {
+  if (!options)
+    return;
+  options->rate_hz = 1000.0;
+  options->window_seconds = 1.0;
+  options->cpu = -1;
+  options->rt_priority = 0;
+}
+
+int pmt_start(pmt_handle *handle, const pmt_sampler_options *options) {
+  if (!handle)
+    return PMT_ERR_INVALID;
+  pmt_sampler_options config;
+  pmt_sampler_options_init(&config);
+  if (options)
+    config = *options;
+  if (!(config.rate_hz >= 1.0 && config.rate_hz <= 10000.0) ||
+      !(config.window_seconds > 0.0) || config.rt_priority < 0 ||
+      config.rt_priority > 99)
+    return PMT_ERR_INVALID;
+
+  std::lock_guard control(handle->control_mutex);
+  if (handle->running.load(std::memory_order_relaxed))
+    return PMT_ERR_STATE;
+
+  MetricsAggregator *metrics = nullptr;
+  try {
+    MetricsAggregator::Config metrics_config;
+    metrics_config.window_seconds = config.window_seconds;
+    metrics_config.period_ns = static_cast<uint64_t>(1e9 / config.rate_hz);
+    auto aggregator = std::make_unique<MetricsAggregator>(
+        handle->layout, handle->table_bytes / sizeof(float), metrics_config);
+    metrics = aggregator.get();
+    std::lock_guard lock(handle->window_mutex);
+    handle->aggregator = std::move(aggregator);
+  } catch (const std::bad_alloc &) {
+    return PMT_ERR_RESOURCE;
+  }
+
+  handle->options = config;
+  handle->latest_seq.store(0, std::memory_order_relaxed);
+  for (auto *counter : {&handle->samples, &handle->read_errors,
+                        &handle->missed_periods, &handle->max_late_ns,
+                        &handle->events, &handle->events_dropped,
+                        &handle->sampler_cpu_ns})
+    counter->store(0, std::memory_order_relaxed);
+  handle->event_tail.store(handle->event_head.load());
+  handle->start_ns = clock_ns(CLOCK_MONOTONIC);
+  handle->stop_ns = 0;
+
+  handle->running.store(true, std::memory_order_release);
+  handle->dispatching.store(true, std::memory_order_release);
+  try {
+    handle->sampler =
+        std::thread([handle, metrics] { handle->run_sampler(*metrics); });
+    if (pthread_getcpuclockid(handle->sampler.native_handle(),
+                              &handle->sampler_clock) != 0)
+      handle->sampler_clock = CLOCK_THREAD_CPUTIME_ID;
+    handle->dispatcher = std::thread([handle] { handle->run_dispatcher(); });
+  } catch (const std::system_error &) {
+    handle->running.store(false, std::memory_order_release);
+    handle->dispatching.store(false, std::memory_order_release);
+    if (handle->sampler.joinable())
+      handle->sampler.join();
+    return PMT_ERR_RESOURCE;
+  }
+  return PMT_OK;
+}
+
+int pmt_stop(pmt_handle *handle) {
+  if (!handle)
+    return PMT_ERR_INVALID;
+  std::lock_guard control(handle->control_mutex);
+  if (!handle->sampler.joinable())
+    return PMT_OK;
+  timespec cpu{};
+  clock_gettime(handle->sampler_clock, &cpu);
+  handle->running.store(false, std::memory_order_release);
+  handle->sampler.join();
+  handle->dispatching.store(false, std::memory_order_release);
+  if (handle->dispatcher.joinable())
+    handle->dispatcher.join();
+  handle->sampler_cpu_ns.store(static_cast<uint64_t>(cpu.tv_sec) *
+                                   1'000'000'000 +
+                               static_cast<uint64_t>(cpu.tv_nsec));
+  handle->stop_ns = clock_ns(CLOCK_MONOTONIC);
+  return PMT_OK;
+}
+
+int pmt_latest(pmt_handle *handle, pmt_sample *sample, float *cells,
+               size_t n_cells) {
+  if (!handle || (!cells && n_cells > 0))
+    return PMT_ERR_INVALID;
+  const size_t bytes =
+      std::min(n_cells, handle->table_bytes / sizeof(float)) * sizeof(float);
+  for (unsigned attempt = 0;; ++attempt) {
+    const uint64_t seq = handle->latest_seq.load(std::memory_order_acquire);
+    if (seq == 0) {
+      if (handle->samples.load(std::memory_order_relaxed) == 0)
+        return PMT_ERR_NO_DATA;
+    } else {
+      const uint64_t monotonic_ns = handle->latest_monotonic_ns;
+      const uint64_t realtime_ns = handle->latest_realtime_ns;
+      if (bytes > 0)
+        std::memcpy(cells, handle->latest.data(), bytes);
+      std::atomic_thread_fence(std::memory_order_acquire);
+      if (handle->latest_seq.load(std::memory_order_relaxed) == seq) {
+        if (sample)
+          *sample = {seq, monotonic_ns, realtime_ns};
+        return PMT_OK;
+      }
+    }
+    // The sampler writes for about a microsecond; only a preempted sampler
+    // keeps a reader here.
+    if (attempt >= 64)
+      sched_yield();
+  }
+}
+
+size_t pmt_sensor_count(const pmt_handle *handle) {
+  return handle ? handle->sensors.size() : 0;
+}
+
+int pmt_sensor(const pmt_handle *handle, size_t index,
+               pmt_sensor_info *info) {
+  if (!handle || !info || index >= handle->sensors.size())
+    return PMT_ERR_INVALID;
+  const auto &sensor = handle->sensors[index];
+  *info = {sensor.name.c_str(), sensor.unit.c_str(), sensor.core};
+  return PMT_OK;
+}
+
+size_t pmt_limit_count(const pmt_handle *handle) {
+  return handle ? handle->limits.size() : 0;
+}
+
+const char *pmt_limit_name(const pmt_handle *handle, size_t index) {
+  if (!handle || index >= handle->limits.size())
+    return nullptr;
+  return handle->limits[index].name.c_str();
+}
+
+int pmt_window(pmt_handle *handle, pmt_window_stats *stats,
+               pmt_sensor_window *sensors, size_t n_sensors,
+               pmt_limit_counts *limits, size_t n_limits) {
+  if (!handle || (!sensors && n_sensors > 0) || (!limits && n_limits > 0))
+    return PMT_ERR_INVALID;
+  std::lock_guard lock(handle->window_mutex);
+  if (!handle->aggregator)
+    return PMT_ERR_NO_DATA;
+  const MetricsSnapshot &snapshot = handle->aggregator->acquire();
+  if (snapshot.window_end_ns == 0)
+    return PMT_ERR_NO_DATA;
+
+  if (stats) {
+    const auto &q = snapshot.interval_quantiles_s;
+    *stats = {snapshot.window_end_ns, snapshot.window_seconds,
+              snapshot.window_samples, q[0], q[1], q[2], q[3],
+              snapshot.interval_max_s, snapshot.samples, snapshot.dropped,
+              snapshot.duplicates};
+  }
+  n_sensors = std::min(n_sensors, snapshot.sensors.size());
+  for (size_t i = 0; i < n_sensors; ++i) {
+    const auto &window = snapshot.sensors[i];
+    sensors[i] = {window.min,
+                  window.count ? static_cast<float>(window.sum /
+                                                    static_cast<double>(
+                                                        window.count))
+                               : 0.0f,
+                  window.max, window.last, window.count};
+  }
+  n_limits = std::min(n_limits, snapshot.limit_samples.size());
+  for (size_t i = 0; i < n_limits; ++i)
+    limits[i] = {snapshot.limit_samples[i], snapshot.limit_events[i]};
+  return PMT_OK;
+}
+
+int pmt_subscribe(pmt_handle *handle, uint32_t limit_mask,
+                  pmt_event_fn callback, void *user, uint32_t *id) {
+  if (!handle || !callback || limit_mask == 0)
+    return PMT_ERR_INVALID;
+  std::lock_guard lock(handle->subscriber_mutex);
+  if (handle->subscribers.size() >= MAX_SUBSCRIBERS)
+    return PMT_ERR_RESOURCE;
+  const uint32_t new_id = handle->next_subscriber_id++;
+  handle->subscribers.push_back({new_id, limit_mask, callback, user});
+  if (id)
+    *id = new_id;
+  return PMT_OK;
+}
+
+int pmt_unsubscribe(pmt_handle *handle, uint32_t id) {
+  if (!handle)
+    return PMT_ERR_INVALID;
+  std::lock_guard lock(handle->subscriber_mutex);
+  auto &subscribers = handle->subscribers;
+  const auto it =
+      std::find_if(subscribers.begin(), subscribers.end(),
+                   [id](const Subscriber &s) { return s.id == id; });
+  if (it == subscribers.end())
+    return PMT_ERR_INVALID;
+  subscribers.erase(it);
+  return PMT_OK;
+}
+
+int pmt_get_stats(pmt_handle *handle, pmt_stats *stats) {
+  if (!handle || !stats)
+    return PMT_ERR_INVALID;
+  std::lock_guard control(handle->control_mutex);
+  const bool running = handle->sampler.joinable();
+  uint64_t cpu_ns = handle->sampler_cpu_ns.load(std::memory_order_relaxed);
+  if (running) {
+    timespec cpu{};
+    clock_gettime(handle->sampler_clock, &cpu);
+    cpu_ns = static_cast<uint64_t>(cpu.tv_sec) * 1'000'000'000 +
+             static_cast<uint64_t>(cpu.tv_nsec);
+  }
+  const uint64_t end_ns = running ? clock_ns(CLOCK_MONOTONIC) : handle->stop_ns;
+  *stats = {handle->samples.load(std::memory_order_relaxed),
+            handle->read_errors.load(std::memory_order_relaxed),
+            handle->missed_periods.load(std::memory_order_relaxed),
+            handle->max_late_ns.load(std::memory_order_relaxed),
+            handle->events.load(std::memory_order_relaxed),
+            handle->events_dropped.load(std::memory_order_relaxed),
+            cpu_ns,
+            handle->start_ns ? end_ns - handle->start_ns : 0,
+            handle->realtime.load(std::memory_order_relaxed) ? 1 : 0};
+  return PMT_OK;
+}
+
+} // extern "C"
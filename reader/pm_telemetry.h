@@ -0,0 +1,235 @@
+/**
+ * @file pm_telemetry.h
+ * @brief C API of libpm_telemetry: pm_table acquisition for embedding in
+ * other programs.
+ *
+ * The library bundles the acquisition core of pm_acqd: the sysfs read,
+ * absolute-deadline pacing, layout decoding (pm_table_layout.hpp), windowed
+ * statistics and limit detection (metrics_aggregator.hpp). It has no GUI,
+ * logging or C++ runtime types at its boundary, so any C, C++, Rust or
+ * Python (ctypes) program can link it.
+ *
+ *     pmt_handle *h;
+ *     pmt_open(NULL, &h);
+ *     pmt_sampler_options options;
+ *     pmt_sampler_options_init(&options);
+ *     options.rate_hz = 100;
+ *     pmt_start(h, &options);
+ *     ...
+ *     pmt_latest(h, &sample, cells, n_cells);   // newest table
+ *     pmt_window(h, &window, sensors, n_sensors, limits, n_limits);
+ *     ...
+ *     pmt_close(h);
+ *
+ * Footprint of a running sampler:
+ * - Threads: the sampler (optionally pinned and SCHED_FIFO) and an event
+ *   dispatcher that wakes every 5 ms. Nothing runs before pmt_start().
+ * - Memory: a few table copies, four window snapshots of ~40 bytes per
+ *   sensor, a 256-entry event queue and an interval histogram covering 8
+ *   periods at 1 us (32 KiB at 1 kHz, at most 256 KiB). Nothing is
+ *   allocated while sampling.
+ * - CPU: one pread of the table, a memcpy into the latest slot and one
+ *   aggregator pass per sample, with no locks or syscalls besides the read
+ *   and the sleep. pm_telemetry_bench reports the measured figure
+ *   (pmt_stats.sampler_cpu_ns over the wall time).
+ *
+ * All functions are thread-safe except pmt_close(), which must not race
+ * any other call on the same handle. Errors are negative pmt_status values.
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#if defined(__GNUC__)
+#define PMT_API __attribute__((visibility("default")))
+#else
+#define PMT_API
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct pmt_handle pmt_handle;
+
+typedef enum pmt_status {
+  PMT_OK = 0,
+  PMT_ERR_INVALID = -1,   ///< Null handle or pointer, or bad option value
+  PMT_ERR_NO_DEVICE = -2, ///< The ryzen_smu sysfs files are missing
+  PMT_ERR_IO = -3,        ///< The table could not be read
+  PMT_ERR_STATE = -4,     ///< Sampler already running
+  PMT_ERR_NO_DATA = -5,   ///< No sample or window yet
+  PMT_ERR_RESOURCE = -6,  ///< Out of memory, threads or subscriber slots
+} pmt_status;
+
+/** @brief Static description of a pmt_status. */
+PMT_API const char *pmt_strerror(int status);
+
+typedef struct pmt_open_options {
+  /** Directory of the driver's files; NULL means /sys/kernel/ryzen_smu_drv. */
+  const char *sysfs_dir;
+  /** Non-zero: generate tables of this many bytes instead of reading sysfs. */
+  uint32_t synthetic_bytes;
+  /** pm_table version reported for synthetic tables (0 = any layout). */
+  uint32_t synthetic_version;
+} pmt_open_options;
+
+/**
+ * @brief Open the pm_table. @p options may be NULL.
+ * @return PMT_OK and *handle set, or PMT_ERR_NO_DEVICE / PMT_ERR_IO.
+ */
+PMT_API int pmt_open(const pmt_open_options *options, pmt_handle **handle);
+
+/** @brief Stop the sampler and free the handle. NULL is ignored. */
+PMT_API void pmt_close(pmt_handle *handle);
+
+/** @brief Table size in 32-bit cells. */
+PMT_API size_t pmt_table_cells(const pmt_handle *handle);
+
+/** @brief SMU table version, or 0 if the driver does not report it. */
+PMT_API uint32_t pmt_table_version(const pmt_handle *handle);
+
+/** @brief Codename of the decoded layout, or NULL if none fits the table. */
+PMT_API const char *pmt_layout_name(const pmt_handle *handle);
+
+typedef struct pmt_sampler_options {
+  double rate_hz;        ///< Samples per second, 1..10000 (default 1000)
+  double window_seconds; ///< Aggregation window (default 1)
+  int cpu;               ///< Pin the sampler to this CPU; -1 = no pinning
+  int rt_priority;       ///< SCHED_FIFO priority; 0 = normal scheduling
+} pmt_sampler_options;
+
+/** @brief Fill @p options with the defaults. */
+PMT_API void pmt_sampler_options_init(pmt_sampler_options *options);
+
+/**
+ * @brief Start the background sampler. @p options may be NULL.
+ *
+ * Statistics start afresh on every start. Failing to pin or to get
+ * SCHED_FIFO is not an error; see pmt_stats.realtime.
+ */
+PMT_API int pmt_start(pmt_handle *handle, const pmt_sampler_options *options);
+
+/** @brief Stop the sampler; the last sample and window stay readable. */
+PMT_API int pmt_stop(pmt_handle *handle);
+
+typedef struct pmt_sample {
+  uint64_t seq;          ///< 1 for the first sample after pmt_start()
+  uint64_t monotonic_ns; ///< CLOCK_MONOTONIC at the read
+  uint64_t realtime_ns;  ///< CLOCK_REALTIME at the read
+} pmt_sample;
+
+/**
+ * @brief Copy the newest table. Never blocks the sampler.
+ * @param cells Receives min(@p n_cells, pmt_table_cells()) cells; may be
+ * NULL with @p n_cells 0 to read only the stamps.
+ * @return PMT_ERR_NO_DATA before the first sample.
+ */
+PMT_API int pmt_latest(pmt_handle *handle, pmt_sample *sample, float *cells,
+                       size_t n_cells);
+
+typedef struct pmt_sensor_info {
+  const char *name; ///< e.g. "socket_power", "core_temperature"
+  const char *unit; ///< e.g. "W", "degC"
+  int core;         ///< Core of a per-core sensor, else -1
+} pmt_sensor_info;
+
+/** @brief Number of decoded sensors; 0 if no layout fits the table. */
+PMT_API size_t pmt_sensor_count(const pmt_handle *handle);
+
+/** @brief Describe sensor @p index; the strings live as long as the handle. */
+PMT_API int pmt_sensor(const pmt_handle *handle, size_t index,
+                       pmt_sensor_info *info);
+
+/** @brief Number of limits (STAPM, PPT, TDC, EDC, thermal, PROCHOT). */
+PMT_API size_t pmt_limit_count(const pmt_handle *handle);
+
+/** @brief Name of limit @p index (bit 1 << index in event masks), or NULL. */
+PMT_API const char *pmt_limit_name(const pmt_handle *handle, size_t index);
+
+typedef struct pmt_window_stats {
+  uint64_t window_end_ns; ///< CLOCK_MONOTONIC
+  double window_seconds;
+  uint64_t window_samples;
+  double interval_p50_s; ///< Sample interval quantiles within the window
+  double interval_p90_s;
+  double interval_p99_s;
+  double interval_p999_s;
+  double interval_max_s;
+  // Totals since pmt_start().
+  uint64_t samples;
+  uint64_t dropped;    ///< Failed reads and missed periods
+  uint64_t duplicates; ///< Table identical to the previous one
+} pmt_window_stats;
+
+typedef struct pmt_sensor_window {
+  float min;
+  float mean;
+  float max;
+  float last;
+  uint64_t count;
+} pmt_sensor_window;
+
+typedef struct pmt_limit_counts {
+  uint64_t samples; ///< Samples at the limit since pmt_start()
+  uint64_t events;  ///< Times the limit was reached since pmt_start()
+} pmt_limit_counts;
+
+/**
+ * @brief Aggregates of the last completed window, all from the same window.
+ * @param sensors Receives min(@p n_sensors, pmt_sensor_count()) entries;
+ * may be NULL.
+ * @param limits Receives min(@p n_limits, pmt_limit_count()) entries; may
+ * be NULL.
+ * @return PMT_ERR_NO_DATA before the first window closes.
+ */
+PMT_API int pmt_window(pmt_handle *handle, pmt_window_stats *stats,
+                       pmt_sensor_window *sensors, size_t n_sensors,
+                       pmt_limit_counts *limits, size_t n_limits);
+
+typedef struct pmt_event {
+  uint32_t limit;        ///< Index into the limits
+  uint64_t seq;          ///< Sample that reached the limit
+  uint64_t monotonic_ns; ///< Its timestamp
+  float value;           ///< Value at that sample
+  float limit_value;     ///< Limit at that sample; 0 for PROCHOT
+} pmt_event;
+
+/**
+ * @brief Called on the library's dispatcher thread, at most ~5 ms after the
+ * sample. It must not call pmt_subscribe, pmt_unsubscribe, pmt_stop or
+ * pmt_close.
+ */
+typedef void (*pmt_event_fn)(const pmt_event *event, void *user);
+
+/**
+ * @brief Receive an event each time a limit in @p limit_mask is reached
+ * (rising edge). Up to 16 subscriptions per handle.
+ * @param id Receives the subscription id for pmt_unsubscribe(); may be NULL.
+ */
+PMT_API int pmt_subscribe(pmt_handle *handle, uint32_t limit_mask,
+                          pmt_event_fn callback, void *user, uint32_t *id);
+
+/** @brief Once this returns, the callback is not running and never will. */
+PMT_API int pmt_unsubscribe(pmt_handle *handle, uint32_t id);
+
+typedef struct pmt_stats {
+  uint64_t samples;
+  uint64_t read_errors;
+  uint64_t missed_periods; ///< Wakeups more than a period late, skipped
+  uint64_t max_late_ns;    ///< Latest wakeup since pmt_start()
+  uint64_t events;
+  uint64_t events_dropped; ///< Event queue full; dispatcher too slow
+  uint64_t sampler_cpu_ns; ///< CPU time of the sampler thread
+  uint64_t sampler_wall_ns;
+  int realtime; ///< Non-zero if pinning and SCHED_FIFO took effect
+} pmt_stats;
+
+/** @brief Counters of the current or last sampler run. */
+PMT_API int pmt_get_stats(pmt_handle *handle, pmt_stats *stats);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,150 @@
+/**
+ * @file pm_telemetry_bench.cpp
+ * @brief Cost of the libpm_telemetry API calls and of its sampler.
+ *
+ * Runs the sampler on synthetic tables (or the driver with --sysfs), times
+ * each query call from the calling thread while the sampler runs, and
+ * reports the sampler's CPU share and the resident memory the handle added:
+ *
+ *     pm_telemetry_bench [--rate 1000] [--seconds 5] [--sysfs]
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "pm_telemetry.h"
+#include "popl.hpp"
+
+namespace {
+
+long resident_kib() {
+  std::ifstream status("/proc/self/status");
+  std::string line;
+  while (std::getline(status, line)) {
+    if (line.rfind("VmRSS:", 0) == 0)
+      return std::stol(line.substr(6));
+  }
+  return 0;
+}
+
+/// Median ns per call of fn over rounds of `calls` calls.
+template <typename Fn> double time_call(Fn &&fn, int calls = 10000) {
+  std::vector<double> rounds;
+  for (int round = 0; round < 9; ++round) {
+    const auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < calls; ++i)
+      fn();
+    const std::chrono::duration<double, std::nano> elapsed =
+        std::chrono::steady_clock::now() - start;
+    rounds.push_back(elapsed.count() / calls);
+  }
+  std::nth_element(rounds.begin(), rounds.begin() + 4, rounds.end());
+  return rounds[4];
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  using namespace popl;
+
+  OptionParser op("Usage: pm_telemetry_bench [options]");
+  auto help_option = op.add<Switch>("h", "help", "produce help message");
+  auto rate_option =
+      op.add<Value<double>>("r", "rate", "Sampler rate in Hz", 1000.0);
+  auto seconds_option =
+      op.add<Value<double>>("s", "seconds", "Sampler run time", 5.0);
+  auto sysfs_option = op.add<Switch>(
+      "", "sysfs", "Read the ryzen_smu driver instead of synthetic tables");
+  op.parse(argc, argv);
+  if (help_option->is_set()) {
+    std::cout << op << std::endl;
+    return 0;
+  }
+
+  const long rss_before = resident_kib();
+  pmt_open_options open_options{};
+  if (!sysfs_option->is_set())
+    open_options.synthetic_bytes = 2400;
+  pmt_handle *handle = nullptr;
+  if (const int status = pmt_open(&open_options, &handle); status != PMT_OK) {
+    std::cerr << "pmt_open: " << pmt_strerror(status) << std::endl;
+    return 1;
+  }
+
+  pmt_sampler_options options;
+  pmt_sampler_options_init(&options);
+  options.rate_hz = rate_option->value();
+  if (const int status = pmt_start(handle, &options); status != PMT_OK) {
+    std::cerr << "pmt_start: " << pmt_strerror(status) << std::endl;
+    pmt_close(handle);
+    return 1;
+  }
+  uint32_t subscription = 0;
+  uint64_t events = 0;
+  pmt_subscribe(
+      handle, ~0u,
+      [](const pmt_event *, void *user) { ++*static_cast<uint64_t *>(user); },
+      &events, &subscription);
+
+  // Let the first window close before timing the queries.
+  const auto deadline = std::chrono::steady_clock::now() +
+                        std::chrono::duration<double>(seconds_option->value());
+  pmt_window_stats window{};
+  while (pmt_window(handle, &window, nullptr, 0, nullptr, 0) != PMT_OK)
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  const long rss_running = resident_kib();
+
+  std::vector<float> cells(pmt_table_cells(handle));
+  std::vector<pmt_sensor_window> sensors(pmt_sensor_count(handle));
+  std::vector<pmt_limit_counts> limits(pmt_limit_count(handle));
+  pmt_sample sample{};
+  pmt_stats stats{};
+  std::printf("%-34s %10s\n", "call", "ns/call");
+  std::printf("%-34s %10.1f\n", "pmt_latest (stamps only)",
+              time_call([&] { pmt_latest(handle, &sample, nullptr, 0); }));
+  std::printf("%-34s %10.1f\n", "pmt_latest (full table)", time_call([&] {
+                pmt_latest(handle, &sample, cells.data(), cells.size());
+              }));
+  std::printf("%-34s %10.1f\n", "pmt_window (stats only)", time_call([&] {
+                pmt_window(handle, &window, nullptr, 0, nullptr, 0);
+              }));
+  std::printf("%-34s %10.1f\n", "pmt_window (all sensors, limits)",
+              time_call([&] {
+                pmt_window(handle, &window, sensors.data(), sensors.size(),
+                           limits.data(), limits.size());
+              }));
+  std::printf("%-34s %10.1f\n", "pmt_get_stats",
+              time_call([&] { pmt_get_stats(handle, &stats); }));
+
+  std::this_thread::sleep_until(deadline);
+  pmt_stop(handle);
+  pmt_get_stats(handle, &stats);
+  const double wall_s = static_cast<double>(stats.sampler_wall_ns) / 1e9;
+  std::printf("\nsampler: %llu samples in %.2f s (%.1f Hz), %llu missed "
+              "periods, latest wakeup %.3f ms late\n",
+              static_cast<unsigned long long>(stats.samples), wall_s,
+              static_cast<double>(stats.samples) / wall_s,
+              static_cast<unsigned long long>(stats.missed_periods),
+              static_cast<double>(stats.max_late_ns) / 1e6);
+  std::printf("sampler CPU: %.3f%% of one CPU, %.2f us per sample\n",
+              100.0 * static_cast<double>(stats.sampler_cpu_ns) /
+                  static_cast<double>(stats.sampler_wall_ns),
+              static_cast<double>(stats.sampler_cpu_ns) / 1e3 /
+                  static_cast<double>(std::max<uint64_t>(stats.samples, 1)));
+  std::printf("events: %llu raised, %llu delivered, %llu dropped\n",
+              static_cast<unsigned long long>(stats.events),
+              static_cast<unsigned long long>(events),
+              static_cast<unsigned long long>(stats.events_dropped));
+  std::printf("resident memory added by the running handle: %ld KiB\n",
+              rss_running - rss_before);
+  pmt_unsubscribe(handle, subscription);
+  pmt_close(handle);
+  return 0;
+}
@@ -0,0 +1,108 @@
+/**
+ * @file pm_telemetry_example.c
+ * @brief Minimal C consumer of libpm_telemetry.
+ *
+ * Samples at 1 kHz, prints socket power and the hottest core once per
+ * window and every limit event as it happens:
+ *
+ *     pm_telemetry_example [seconds] [--synthetic]
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "pm_telemetry.h"
+
+static void on_limit(const pmt_event *event, void *user) {
+  pmt_handle *handle = user;
+  printf("  limit %s reached at sample %llu: %.1f of %.1f\n",
+         pmt_limit_name(handle, event->limit), (unsigned long long)event->seq,
+         event->value, event->limit_value);
+}
+
+static long find_sensor(const pmt_handle *handle, const char *name) {
+  for (size_t i = 0; i < pmt_sensor_count(handle); ++i) {
+    pmt_sensor_info info;
+    if (pmt_sensor(handle, i, &info) == PMT_OK && strcmp(info.name, name) == 0)
+      return (long)i;
+  }
+  return -1;
+}
+
+int main(int argc, char **argv) {
+  int seconds = 5;
+  pmt_open_options open_options = {NULL, 0, 0};
+  for (int i = 1; i < argc; ++i) {
+    if (strcmp(argv[i], "--synthetic") == 0)
+      open_options.synthetic_bytes = 2400;
+    else
+      seconds = atoi(argv[i]);
+  }
+
+  pmt_handle *handle;
+  int status = pmt_open(&open_options, &handle);
+  if (status != PMT_OK) {
+    fprintf(stderr, "pmt_open: %s\n", pmt_strerror(status));
+    return 1;
+  }
+  const char *layout = pmt_layout_name(handle);
+  printf("%zu cells, version %#x, layout %s, %zu sensors\n",
+         pmt_table_cells(handle), pmt_table_version(handle),
+         layout ? layout : "unknown", pmt_sensor_count(handle));
+
+  const size_t n_sensors = pmt_sensor_count(handle);
+  pmt_sensor_window *sensors = calloc(n_sensors + 1, sizeof(*sensors));
+  const long socket_power = find_sensor(handle, "socket_power");
+  const long core_temp = find_sensor(handle, "core_temperature_max");
+
+  pmt_subscribe(handle, ~0u, on_limit, handle, NULL);
+  pmt_sampler_options options;
+  pmt_sampler_options_init(&options);
+  status = pmt_start(handle, &options);
+  if (status != PMT_OK) {
+    fprintf(stderr, "pmt_start: %s\n", pmt_strerror(status));
+    pmt_close(handle);
+    return 1;
+  }
+
+  uint64_t last_window = 0;
+  for (int tick = 0; tick < seconds * 10; ++tick) {
+    const struct timespec interval = {0, 100000000};
+    nanosleep(&interval, NULL);
+
+    pmt_window_stats window;
+    if (pmt_window(handle, &window, sensors, n_sensors, NULL, 0) != PMT_OK ||
+        window.window_end_ns == last_window)
+      continue;
+    last_window = window.window_end_ns;
+    printf("%llu samples, interval p99 %.3f ms",
+           (unsigned long long)window.window_samples,
+           window.interval_p99_s * 1e3);
+    if (socket_power >= 0)
+      printf(", socket %.1f W (max %.1f)", sensors[socket_power].mean,
+             sensors[socket_power].max);
+    if (core_temp >= 0)
+      printf(", hottest core %.1f degC", sensors[core_temp].max);
+    printf("\n");
+  }
+
+  pmt_stop(handle);
+  pmt_stats stats;
+  pmt_get_stats(handle, &stats);
+  const double cpu_share =
+      stats.sampler_wall_ns
+          ? (double)stats.sampler_cpu_ns / (double)stats.sampler_wall_ns
+          : 0.0;
+  printf("%llu samples, %llu read errors, %llu events; sampler used %.2f%% "
+         "of a CPU\n",
+         (unsigned long long)stats.samples,
+         (unsigned long long)stats.read_errors,
+         (unsigned long long)stats.events, 100.0 * cpu_share);
+  free(sensors);
+  pmt_close(handle);
+  return 0;
+}
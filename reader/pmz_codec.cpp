@@ -0,0 +1,484 @@
+/**
+ * @file pmz_codec.cpp
+ * @brief Bit packing, block codec and the .pmz file writer/reader.
+ */
+
+#include "pmz_codec.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <spdlog/spdlog.h>
+#include <unistd.h>
+
+namespace {
+
+/// MSB-first bit packer appending to a byte vector.
+class BitWriter {
+public:
+  explicit BitWriter(std::vector<uint8_t> &out) : out_{out} {}
+
+  /** @brief Append the low `bits` bits of value (bits <= 32). */
+  void put(uint64_t value, unsigned bits) {
+    acc_ = (acc_ << bits) | (value & mask(bits));
+    n_ += bits;
+    while (n_ >= 8) {
+      n_ -= 8;
+      out_.push_back(static_cast<uint8_t>(acc_ >> n_));
+    }
+  }
+
+  void flush() {
+    if (n_ > 0)
+      out_.push_back(static_cast<uint8_t>(acc_ << (8 - n_)));
+    n_ = 0;
+  }
+
+  static uint64_t mask(unsigned bits) {
+    return bits >= 64 ? ~0ull : (1ull << bits) - 1;
+  }
+
+private:
+  std::vector<uint8_t> &out_;
+  uint64_t acc_ = 0;
+  unsigned n_ = 0;
+};
+
+/// MSB-first bit reader; reading past the end yields zeros and sets overrun.
+class BitReader {
+public:
+  BitReader(const uint8_t *begin, const uint8_t *end)
+      : p_{begin}, end_{end} {}
+
+  uint64_t get(unsigned bits) {
+    while (n_ < bits) {
+      acc_ <<= 8;
+      if (p_ < end_)
+        acc_ |= *p_++;
+      else
+        overrun_ = true;
+      n_ += 8;
+    }
+    n_ -= bits;
+    return (acc_ >> n_) & BitWriter::mask(bits);
+  }
+
+  int64_t get_signed(unsigned bits) {
+    const uint64_t raw = get(bits);
+    const uint64_t sign = 1ull << (bits - 1);
+    return static_cast<int64_t>((raw ^ sign) - sign);
+  }
+
+  bool overrun() const { return overrun_; }
+
+private:
+  const uint8_t *p_;
+  const uint8_t *end_;
+  uint64_t acc_ = 0;
+  unsigned n_ = 0;
+  bool overrun_ = false;
+};
+
+void put_dod(BitWriter &bw, int64_t dod) {
+  if (dod == 0) {
+    bw.put(0b0, 1);
+  } else if (dod >= -2048 && dod < 2048) {
+    bw.put(0b10, 2);
+    bw.put(static_cast<uint64_t>(dod), 12);
+  } else if (dod >= -(1 << 19) && dod < (1 << 19)) {
+    bw.put(0b110, 3);
+    bw.put(static_cast<uint64_t>(dod), 20);
+  } else if (dod >= INT32_MIN && dod <= INT32_MAX) {
+    bw.put(0b1110, 4);
+    bw.put(static_cast<uint64_t>(dod), 32);
+  } else {
+    bw.put(0b1111, 4);
+    bw.put(static_cast<uint64_t>(dod) >> 32, 32);
+    bw.put(static_cast<uint64_t>(dod), 32);
+  }
+}
+
+int64_t get_dod(BitReader &br) {
+  if (br.get(1) == 0)
+    return 0;
+  if (br.get(1) == 0)
+    return br.get_signed(12);
+  if (br.get(1) == 0)
+    return br.get_signed(20);
+  if (br.get(1) == 0)
+    return br.get_signed(32);
+  const uint64_t hi = br.get(32);
+  return static_cast<int64_t>((hi << 32) | br.get(32));
+}
+
+size_t bitmap_bytes(size_t n_words) { return (n_words + 7) / 8; }
+
+bool write_all(int fd, const void *data, size_t length) {
+  const auto *p = static_cast<const char *>(data);
+  while (length > 0) {
+    const ssize_t n = ::write(fd, p, length);
+    if (n < 0) {
+      if (errno == EINTR)
+        continue;
+      return false;
+    }
+    p += n;
+    length -= static_cast<size_t>(n);
+  }
+  return true;
+}
+
+} // namespace
+
+/**
+ * Payload layout: constant-cell bitmap, first row (raw), then one bit
+ * stream with the timestamp delta-of-deltas followed by the XOR codes of
+ * every non-constant cell, column by column.
+ *
+ * XOR codes (per value after the first): '0' unchanged; '10' + bits within
+ * the previous leading/trailing-zero window; '11' + 5 bit leading zeros +
+ * 5 bit (length - 1) + meaningful bits.
+ */
+void pmz_encode_block(const uint64_t *timestamps, const uint32_t *words,
+                      size_t n, size_t n_words, std::vector<uint8_t> &out) {
+  const size_t start = out.size();
+  out.resize(start + sizeof(PmzBlockHeader));
+
+  const size_t bitmap_start = out.size();
+  out.resize(bitmap_start + bitmap_bytes(n_words), 0);
+  std::vector<uint8_t> constant(n_words, 1);
+  for (size_t i = 1; i < n; ++i) {
+    const uint32_t *row = words + i * n_words;
+    for (size_t j = 0; j < n_words; ++j)
+      constant[j] &= static_cast<uint8_t>(row[j] == words[j]);
+  }
+  for (size_t j = 0; j < n_words; ++j) {
+    if (constant[j])
+      out[bitmap_start + j / 8] |= static_cast<uint8_t>(1u << (j % 8));
+  }
+
+  const size_t row0_start = out.size();
+  out.resize(row0_start + n_words * 4);
+  if (n > 0)
+    std::memcpy(out.data() + row0_start, words, n_words * 4);
+
+  BitWriter bw(out);
+  int64_t previous_delta = 0;
+  for (size_t i = 1; i < n; ++i) {
+    const auto delta = static_cast<int64_t>(timestamps[i] - timestamps[i - 1]);
+    put_dod(bw, delta - previous_delta);
+    previous_delta = delta;
+  }
+
+  for (size_t j = 0; j < n_words; ++j) {
+    if (constant[j])
+      continue;
+    uint32_t previous = words[j];
+    int window_lz = -1, window_tz = 0;
+    for (size_t i = 1; i < n; ++i) {
+      const uint32_t value = words[i * n_words + j];
+      const uint32_t x = value ^ previous;
+      previous = value;
+      if (x == 0) {
+        bw.put(0b0, 1);
+        continue;
+      }
+      const int lz = std::countl_zero(x);
+      const int tz = std::countr_zero(x);
+      if (window_lz >= 0 && lz >= window_lz && tz >= window_tz) {
+        bw.put(0b10, 2);
+        bw.put(x >> window_tz, 32 - window_lz - window_tz);
+      } else {
+        const int length = 32 - lz - tz;
+        bw.put(0b11, 2);
+        bw.put(static_cast<uint64_t>(lz), 5);
+        bw.put(static_cast<uint64_t>(length - 1), 5);
+        bw.put(x >> tz, length);
+        window_lz = lz;
+        window_tz = tz;
+      }
+    }
+  }
+  bw.flush();
+
+  PmzBlockHeader header{};
+  std::memcpy(header.magic, PMZ_BLOCK_MAGIC, 4);
+  header.n_samples = static_cast<uint32_t>(n);
+  header.payload_bytes =
+      static_cast<uint32_t>(out.size() - start - sizeof(PmzBlockHeader));
+  header.n_words = static_cast<uint32_t>(n_words);
+  header.first_timestamp_ns = n ? timestamps[0] : 0;
+  header.last_timestamp_ns = n ? timestamps[n - 1] : 0;
+  std::memcpy(out.data() + start, &header, sizeof(header));
+}
+
+bool pmz_decode_block(const PmzBlockHeader &header, const uint8_t *payload,
+                      std::vector<uint64_t> &timestamps,
+                      std::vector<uint32_t> &words) {
+  const size_t n = header.n_samples;
+  const size_t n_words = header.n_words;
+  const size_t fixed = bitmap_bytes(n_words) + n_words * 4;
+  if (header.payload_bytes < fixed)
+    return false;
+  // Every timestamp after the first takes at least one bit, which bounds n
+  // before it sizes the output.
+  if (n > 1 && n - 1 > (header.payload_bytes - fixed) * size_t{8})
+    return false;
+  timestamps.resize(n);
+  words.resize(n * n_words);
+  if (n == 0)
+    return true;
+
+  const uint8_t *bitmap = payload;
+  std::memcpy(words.data(), payload + bitmap_bytes(n_words), n_words * 4);
+
+  BitReader br(payload + fixed, payload + header.payload_bytes);
+  timestamps[0] = header.first_timestamp_ns;
+  int64_t delta = 0;
+  for (size_t i = 1; i < n; ++i) {
+    delta += get_dod(br);
+    timestamps[i] = timestamps[i - 1] + static_cast<uint64_t>(delta);
+  }
+
+  for (size_t j = 0; j < n_words; ++j) {
+    uint32_t value = words[j];
+    if (bitmap[j / 8] & (1u << (j % 8))) {
+      for (size_t i = 1; i < n; ++i)
+        words[i * n_words + j] = value;
+      continue;
+    }
+    int window_lz = 0, window_tz = 0;
+    for (size_t i = 1; i < n; ++i) {
+      if (br.get(1) != 0) {
+        if (br.get(1) == 0) {
+          const int length = 32 - window_lz - window_tz;
+          value ^= static_cast<uint32_t>(br.get(length)) << window_tz;
+        } else {
+          window_lz = static_cast<int>(br.get(5));
+          const int length = static_cast<int>(br.get(5)) + 1;
+          window_tz = 32 - window_lz - length;
+          if (window_tz < 0)
+            return false;
+          value ^= static_cast<uint32_t>(br.get(length)) << window_tz;
+        }
+      }
+      words[i * n_words + j] = value;
+    }
+  }
+  return !br.overrun();
+}
+
+PmzFileWriter::PmzFileWriter(const std::string &path, uint32_t sample_bytes,
+                             uint32_t pm_table_version, uint32_t block_samples)
+    : path_{path}, sample_bytes_{sample_bytes},
+      block_samples_{std::max<uint32_t>(block_samples, 1)} {
+  if (sample_bytes_ == 0 || sample_bytes_ % 4 != 0) {
+    SPDLOG_ERROR("pmz needs a table size that is a multiple of 4, got {}.",
+                 sample_bytes_);
+    return;
+  }
+  fd_ = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  if (fd_ < 0) {
+    SPDLOG_ERROR("Failed to open {}: {}", path, std::strerror(errno));
+    return;
+  }
+  PmzFileHeader header{};
+  std::memcpy(header.magic, PMZ_FILE_MAGIC, 4);
+  header.header_bytes = sizeof(PmzFileHeader);
+  header.sample_bytes = sample_bytes_;
+  header.block_samples = block_samples_;
+  header.pm_table_version = pm_table_version;
+  write_bytes(&header, sizeof(header));
+
+  pending_timestamps_.reserve(block_samples_);
+  pending_words_.reserve(static_cast<size_t>(block_samples_) * sample_bytes_ /
+                         4);
+}
+
+PmzFileWriter::~PmzFileWriter() { close(); }
+
+bool PmzFileWriter::write_bytes(const void *data, size_t length) {
+  if (!write_all(fd_, data, length)) {
+    SPDLOG_ERROR("Write to {} failed: {}", path_, std::strerror(errno));
+    return false;
+  }
+  offset_ += length;
+  return true;
+}
+
+bool PmzFileWriter::add(uint64_t timestamp_ns, const void *blob) {
+  if (fd_ < 0)
+    return false;
+  const auto *words = static_cast<const uint32_t *>(blob);
+  pending_timestamps_.push_back(timestamp_ns);
+  pending_words_.insert(pending_words_.end(), words,
+                        words + sample_bytes_ / 4);
+  if (pending_timestamps_.size() >= block_samples_)
+    return flush_pending();
+  return true;
+}
+
+bool PmzFileWriter::flush_pending() {
+  if (pending_timestamps_.empty())
+    return true;
+  const std::vector<uint64_t> timestamps = std::move(pending_timestamps_);
+  const std::vector<uint32_t> words = std::move(pending_words_);
+  pending_timestamps_.clear();
+  pending_words_.clear();
+  return add_block(timestamps.data(), words.data(), timestamps.size());
+}
+
+bool PmzFileWriter::add_block(const uint64_t *timestamps, const void *rows,
+                              size_t n) {
+  if (fd_ < 0)
+    return false;
+  if (n == 0)
+    return true;
+  if (!pending_timestamps_.empty() && !flush_pending())
+    return false;
+
+  // Blocks hold at most block_samples samples, which readers check.
+  const size_t n_words = sample_bytes_ / 4;
+  const auto *words = static_cast<const uint32_t *>(rows);
+  for (size_t first = 0; first < n; first += block_samples_) {
+    const size_t count = std::min<size_t>(n - first, block_samples_);
+    encoded_.clear();
+    pmz_encode_block(timestamps + first, words + first * n_words, count,
+                     n_words, encoded_);
+    index_.push_back({offset_, timestamps[first],
+                      timestamps[first + count - 1],
+                      static_cast<uint32_t>(count), 0});
+    raw_bytes_ += count * (16 + static_cast<uint64_t>(sample_bytes_));
+    if (!write_bytes(encoded_.data(), encoded_.size()))
+      return false;
+  }
+  return true;
+}
+
+bool PmzFileWriter::sync() { return fd_ >= 0 && ::fdatasync(fd_) == 0; }
+
+bool PmzFileWriter::close() {
+  if (fd_ < 0)
+    return false;
+  bool ok = flush_pending();
+
+  PmzTrailer trailer{};
+  trailer.index_offset = offset_;
+  trailer.n_blocks = static_cast<uint32_t>(index_.size());
+  std::memcpy(trailer.magic, PMZ_END_MAGIC, 4);
+  ok = write_bytes(PMZ_INDEX_MAGIC, 4) && ok;
+  ok = write_bytes(index_.data(), index_.size() * sizeof(PmzIndexEntry)) && ok;
+  ok = write_bytes(&trailer, sizeof(trailer)) && ok;
+
+  ::fdatasync(fd_);
+  ::close(fd_);
+  fd_ = -1;
+  return ok;
+}
+
+PmzReader::PmzReader(const std::string &path)
+    : file_(path, std::ios::binary) {
+  if (!file_.read(reinterpret_cast<char *>(&header_), sizeof(header_)) ||
+      std::memcmp(header_.magic, PMZ_FILE_MAGIC, 4) != 0 ||
+      header_.header_bytes < sizeof(header_) || header_.sample_bytes == 0 ||
+      header_.sample_bytes % 4 != 0 || header_.block_samples == 0) {
+    SPDLOG_ERROR("{} is not a pmz file.", path);
+    return;
+  }
+  file_.seekg(0, std::ios::end);
+  file_size_ = static_cast<uint64_t>(file_.tellg());
+  if (!load_index(file_size_)) {
+    SPDLOG_WARN("{} has no block index (not closed cleanly), scanning.", path);
+    scan_blocks(file_size_);
+  }
+  ok_ = true;
+}
+
+uint64_t PmzReader::n_samples() const {
+  uint64_t n = 0;
+  for (const auto &entry : index_)
+    n += entry.n_samples;
+  return n;
+}
+
+size_t PmzReader::find_block(uint64_t timestamp_ns) const {
+  const auto it = std::ranges::lower_bound(
+      index_, timestamp_ns, {}, &PmzIndexEntry::last_timestamp_ns);
+  return static_cast<size_t>(it - index_.begin());
+}
+
+bool PmzReader::load_index(uint64_t file_size) {
+  PmzTrailer trailer{};
+  if (file_size < header_.header_bytes + sizeof(trailer))
+    return false;
+  file_.clear();
+  file_.seekg(static_cast<std::streamoff>(file_size - sizeof(trailer)));
+  if (!file_.read(reinterpret_cast<char *>(&trailer), sizeof(trailer)) ||
+      std::memcmp(trailer.magic, PMZ_END_MAGIC, 4) != 0)
+    return false;
+  const uint64_t entries_bytes =
+      static_cast<uint64_t>(trailer.n_blocks) * sizeof(PmzIndexEntry);
+  if (trailer.index_offset + 4 + entries_bytes + sizeof(trailer) != file_size)
+    return false;
+
+  char magic[4];
+  file_.seekg(static_cast<std::streamoff>(trailer.index_offset));
+  if (!file_.read(magic, 4) || std::memcmp(magic, PMZ_INDEX_MAGIC, 4) != 0)
+    return false;
+  index_.resize(trailer.n_blocks);
+  return static_cast<bool>(file_.read(reinterpret_cast<char *>(index_.data()),
+                                      static_cast<std::streamsize>(
+                                          entries_bytes)));
+}
+
+/**
+ * @brief Check a block header against the file header and the file size
+ * before anything is sized from it.
+ */
+bool PmzReader::valid_block(const PmzBlockHeader &block,
+                            uint64_t offset) const {
+  return std::memcmp(block.magic, PMZ_BLOCK_MAGIC, 4) == 0 &&
+         block.n_words == header_.sample_bytes / 4 && block.n_samples > 0 &&
+         block.n_samples <= header_.block_samples &&
+         offset + sizeof(block) + block.payload_bytes <= file_size_;
+}
+
+void PmzReader::scan_blocks(uint64_t file_size) {
+  index_.clear();
+  uint64_t offset = header_.header_bytes;
+  PmzBlockHeader block{};
+  while (offset + sizeof(block) <= file_size) {
+    file_.clear();
+    file_.seekg(static_cast<std::streamoff>(offset));
+    if (!file_.read(reinterpret_cast<char *>(&block), sizeof(block)) ||
+        !valid_block(block, offset))
+      break; // truncated by a crash, or not a block
+    const uint64_t end = offset + sizeof(block) + block.payload_bytes;
+    index_.push_back({offset, block.first_timestamp_ns,
+                      block.last_timestamp_ns, block.n_samples, 0});
+    offset = end;
+  }
+}
+
+bool PmzReader::read_block(size_t i, std::vector<uint64_t> &timestamps,
+                           std::vector<uint32_t> &words) {
+  if (i >= index_.size())
+    return false;
+  PmzBlockHeader block{};
+  file_.clear();
+  file_.seekg(static_cast<std::streamoff>(index_[i].offset));
+  if (!file_.read(reinterpret_cast<char *>(&block), sizeof(block)) ||
+      !valid_block(block, index_[i].offset) ||
+      block.n_samples != index_[i].n_samples) {
+    SPDLOG_ERROR("pmz block {} at offset {} is corrupt.", i,
+                 index_[i].offset);
+    return false;
+  }
+  payload_.resize(block.payload_bytes);
+  if (!file_.read(reinterpret_cast<char *>(payload_.data()),
+                  block.payload_bytes))
+    return false;
+  return pmz_decode_block(block, payload_.data(), timestamps, words);
+}
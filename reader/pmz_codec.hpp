@@ -0,0 +1,168 @@
+/**
+ * @file pmz_codec.hpp
+ * @brief Compressed pm_table log format (.pmz): block codec, writer, reader.
+ *
+ * A .pmz file is a header followed by independently decodable blocks of up
+ * to block_samples samples, and (if the writer was closed cleanly) a block
+ * index for random access. Within a block:
+ *  - timestamps are stored as the first value plus delta-of-delta codes,
+ *  - cells that do not change within the block are stored once,
+ *  - every other cell is a column of Gorilla-style XOR codes against its
+ *    previous value, bit packed.
+ * Every block starts from raw values, so each block is a keyframe.
+ *
+ * Multi-byte fields are little endian, as in pm_table_log.bin.
+ */
+
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+inline constexpr char PMZ_FILE_MAGIC[4] = {'P', 'M', 'Z', '1'};
+inline constexpr char PMZ_BLOCK_MAGIC[4] = {'P', 'M', 'Z', 'B'};
+inline constexpr char PMZ_INDEX_MAGIC[4] = {'P', 'M', 'Z', 'I'};
+inline constexpr char PMZ_END_MAGIC[4] = {'P', 'M', 'Z', 'E'};
+
+struct PmzFileHeader {
+  char magic[4];
+  uint32_t header_bytes;
+  uint32_t sample_bytes;
+  uint32_t block_samples;
+  uint32_t pm_table_version;
+  uint32_t flags;
+  uint64_t reserved;
+};
+
+struct PmzBlockHeader {
+  char magic[4];
+  uint32_t n_samples;
+  uint32_t payload_bytes;
+  uint32_t n_words;
+  uint64_t first_timestamp_ns;
+  uint64_t last_timestamp_ns;
+};
+
+/// One entry of the trailing block index.
+struct PmzIndexEntry {
+  uint64_t offset; ///< File offset of the block header
+  uint64_t first_timestamp_ns;
+  uint64_t last_timestamp_ns;
+  uint32_t n_samples;
+  uint32_t reserved;
+};
+
+/// Last bytes of a cleanly closed file.
+struct PmzTrailer {
+  uint64_t index_offset;
+  uint32_t n_blocks;
+  char magic[4];
+};
+
+/**
+ * @brief Encode one block.
+ *
+ * @param timestamps n timestamps.
+ * @param words n rows of n_words 32-bit cells, row-major.
+ * @param out Receives block header and payload (appended).
+ */
+void pmz_encode_block(const uint64_t *timestamps, const uint32_t *words,
+                      size_t n, size_t n_words, std::vector<uint8_t> &out);
+
+/**
+ * @brief Decode one block payload produced by pmz_encode_block().
+ * @return false if the payload is truncated or inconsistent.
+ */
+bool pmz_decode_block(const PmzBlockHeader &header, const uint8_t *payload,
+                      std::vector<uint64_t> &timestamps,
+                      std::vector<uint32_t> &words);
+
+/**
+ * @class PmzFileWriter
+ * @brief Synchronous .pmz writer; buffers one block and encodes it in add().
+ *
+ * Used directly by pm_log_convert, and from the encoder thread of
+ * PmzLogWriter for pm_reader. add_block() splits its rows into blocks of at
+ * most block_samples, which PmzReader checks.
+ */
+class PmzFileWriter {
+public:
+  PmzFileWriter(const std::string &path, uint32_t sample_bytes,
+                uint32_t pm_table_version, uint32_t block_samples = 1000);
+  ~PmzFileWriter();
+
+  PmzFileWriter(const PmzFileWriter &) = delete;
+  PmzFileWriter &operator=(const PmzFileWriter &) = delete;
+
+  explicit operator bool() const noexcept { return fd_ >= 0; }
+
+  /** @brief Append one sample (sample_bytes long). */
+  bool add(uint64_t timestamp_ns, const void *blob);
+
+  /** @brief Encode and write n complete rows at once. */
+  bool add_block(const uint64_t *timestamps, const void *rows, size_t n);
+
+  /** @brief fdatasync what has been written so far. */
+  bool sync();
+
+  /** @brief Write the pending block and the index, sync and close. */
+  bool close();
+
+  uint64_t raw_bytes() const { return raw_bytes_; }
+  uint64_t file_bytes() const { return offset_; }
+
+private:
+  bool write_bytes(const void *data, size_t length);
+  bool flush_pending();
+
+  int fd_ = -1;
+  std::string path_;
+  uint32_t sample_bytes_;
+  uint32_t block_samples_;
+  uint64_t offset_ = 0;
+  uint64_t raw_bytes_ = 0;
+  std::vector<uint64_t> pending_timestamps_;
+  std::vector<uint32_t> pending_words_;
+  std::vector<uint8_t> encoded_;
+  std::vector<PmzIndexEntry> index_;
+};
+
+/**
+ * @class PmzReader
+ * @brief Random-access .pmz reader.
+ *
+ * Uses the trailing index when present and otherwise scans the block headers
+ * (e.g. after a crash); a truncated last block is ignored.
+ */
+class PmzReader {
+public:
+  explicit PmzReader(const std::string &path);
+
+  explicit operator bool() const noexcept { return ok_; }
+
+  uint32_t sample_bytes() const { return header_.sample_bytes; }
+  uint32_t pm_table_version() const { return header_.pm_table_version; }
+  const std::vector<PmzIndexEntry> &blocks() const { return index_; }
+  uint64_t n_samples() const;
+
+  /** @brief Index of the first block whose last timestamp is >= t, or size. */
+  size_t find_block(uint64_t timestamp_ns) const;
+
+  /** @brief Decode block i into timestamps and row-major cells. */
+  bool read_block(size_t i, std::vector<uint64_t> &timestamps,
+                  std::vector<uint32_t> &words);
+
+private:
+  bool load_index(uint64_t file_size);
+  void scan_blocks(uint64_t file_size);
+  bool valid_block(const PmzBlockHeader &block, uint64_t offset) const;
+
+  std::ifstream file_;
+  PmzFileHeader header_{};
+  uint64_t file_size_ = 0;
+  std::vector<PmzIndexEntry> index_;
+  std::vector<uint8_t> payload_;
+  bool ok_ = false;
+};
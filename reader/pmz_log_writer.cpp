@@ -0,0 +1,95 @@
+/**
+ * @file pmz_log_writer.cpp
+ * @brief PmzLogWriter encoder thread.
+ */
+
+#include "pmz_log_writer.hpp"
+
+#include <pthread.h>
+#include <sched.h>
+#include <spdlog/spdlog.h>
+
+PmzLogWriter::PmzLogWriter(const std::string &path, uint32_t sample_bytes,
+                           uint32_t pm_table_version, Config config)
+    : config_{config},
+      ring_{sample_bytes, config.block_samples, config.n_slots} {
+  if (!ring_)
+    return;
+  file_ = std::make_unique<PmzFileWriter>(path, sample_bytes, pm_table_version,
+                                          ring_.block_samples());
+  if (!*file_)
+    return;
+
+  SPDLOG_INFO("Logging compressed to {} ({} slots of {} samples{}).", path,
+              ring_.n_blocks(), ring_.block_samples(),
+              ring_.locked() ? ", locked" : "");
+  encoder_ = std::thread(&PmzLogWriter::run_encoder, this);
+}
+
+PmzLogWriter::~PmzLogWriter() { close(); }
+
+bool PmzLogWriter::append_record(uint64_t timestamp_ns, const void *blob,
+                                 uint64_t size) noexcept {
+  if (closed_ || !*this || size != ring_.sample_bytes())
+    return false;
+  return ring_.push(timestamp_ns, blob);
+}
+
+void PmzLogWriter::close() {
+  if (closed_)
+    return;
+  closed_ = true;
+  ring_.seal();
+  stop_.store(true, std::memory_order_release);
+  if (encoder_.joinable())
+    encoder_.join();
+  if (file_ && *file_) {
+    file_->close();
+    file_bytes_.store(file_->file_bytes(), std::memory_order_relaxed);
+  }
+}
+
+PmzLogWriter::Stats PmzLogWriter::stats() const {
+  Stats s;
+  s.records = ring_.records();
+  s.dropped_records = ring_.dropped();
+  s.stalls = ring_.stalls();
+  s.blocks = blocks_.load(std::memory_order_relaxed);
+  s.raw_bytes = raw_bytes_.load(std::memory_order_relaxed);
+  s.file_bytes = file_bytes_.load(std::memory_order_relaxed);
+  s.max_encode_ms = max_encode_ms_.load(std::memory_order_relaxed);
+  return s;
+}
+
+/**
+ * @brief Encode full blocks in fill order and hand them back to the sampler.
+ */
+void PmzLogWriter::run_encoder() {
+  if (config_.encoder_core >= 0) {
+    cpu_set_t cpuset;
+    CPU_ZERO(&cpuset);
+    CPU_SET(config_.encoder_core, &cpuset);
+    if (pthread_setaffinity_np(pthread_self(), sizeof(cpuset), &cpuset) != 0)
+      SPDLOG_WARN("Failed to pin the pmz encoder to CPU {}.",
+                  config_.encoder_core);
+  }
+
+  auto last_sync = std::chrono::steady_clock::now();
+  ring_.drain(stop_, [&](const SampleBlockRing::Block &block) {
+    const auto start = std::chrono::steady_clock::now();
+    file_->add_block(block.timestamps, block.words, block.n);
+    const double ms = std::chrono::duration<double, std::milli>(
+                          std::chrono::steady_clock::now() - start)
+                          .count();
+    if (ms > max_encode_ms_.load(std::memory_order_relaxed))
+      max_encode_ms_.store(ms, std::memory_order_relaxed);
+    blocks_.fetch_add(1, std::memory_order_relaxed);
+    raw_bytes_.store(file_->raw_bytes(), std::memory_order_relaxed);
+    file_bytes_.store(file_->file_bytes(), std::memory_order_relaxed);
+
+    if (std::chrono::steady_clock::now() - last_sync >= config_.sync_interval) {
+      file_->sync();
+      last_sync = std::chrono::steady_clock::now();
+    }
+  });
+}
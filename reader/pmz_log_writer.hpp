@@ -0,0 +1,86 @@
+/**
+ * @file pmz_log_writer.hpp
+ * @brief Compressed (.pmz) pm_reader log with encoding off the sampling thread.
+ *
+ * The sampling thread copies each table into a SampleBlockRing; an encoder
+ * thread (pinnable to a background core) compresses every full block with
+ * pmz_encode_block() and appends it to the file.
+ */
+
+#pragma once
+#include "pmz_codec.hpp"
+#include "sample_block_ring.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <thread>
+
+/**
+ * @class PmzLogWriter
+ * @brief Drop-in for AsyncLogWriter::append_record() writing a .pmz file.
+ *
+ * append_record() never blocks and never allocates: if every slot is still
+ * waiting for the encoder the sample is dropped and counted.
+ */
+class PmzLogWriter {
+public:
+  struct Config {
+    uint32_t block_samples = 1000; ///< One block per second at 1 kHz
+    size_t n_slots = 8;
+    int encoder_core = -1;         ///< Pin the encoder thread; -1 = no pin
+    std::chrono::milliseconds sync_interval{1000};
+  };
+
+  struct Stats {
+    uint64_t records = 0;
+    uint64_t dropped_records = 0;
+    uint64_t stalls = 0;
+    uint64_t blocks = 0;
+    uint64_t raw_bytes = 0;  ///< Size the same samples take in .bin format
+    uint64_t file_bytes = 0;
+    double max_encode_ms = 0.0; ///< Longest encode + write of one block
+  };
+
+  PmzLogWriter(const std::string &path, uint32_t sample_bytes,
+               uint32_t pm_table_version, Config config);
+  PmzLogWriter(const std::string &path, uint32_t sample_bytes,
+               uint32_t pm_table_version)
+      : PmzLogWriter(path, sample_bytes, pm_table_version, Config{}) {}
+  ~PmzLogWriter();
+
+  PmzLogWriter(const PmzLogWriter &) = delete;
+  PmzLogWriter &operator=(const PmzLogWriter &) = delete;
+
+  explicit operator bool() const noexcept {
+    return file_ && static_cast<bool>(*file_) && ring_;
+  }
+
+  /** @brief Queue one sample; size must equal sample_bytes. Producer only. */
+  bool append_record(uint64_t timestamp_ns, const void *blob,
+                     uint64_t size) noexcept;
+
+  /** @brief Encode the partial block, write the index and close. */
+  void close();
+
+  Stats stats() const;
+
+private:
+  void run_encoder();
+
+  Config config_;
+  SampleBlockRing ring_;
+  std::unique_ptr<PmzFileWriter> file_;
+
+  std::atomic<uint64_t> blocks_{0};
+  std::atomic<uint64_t> raw_bytes_{0};
+  std::atomic<uint64_t> file_bytes_{0};
+  std::atomic<double> max_encode_ms_{0.0};
+
+  std::atomic<bool> stop_{false};
+  bool closed_ = false;
+  std::thread encoder_;
+};
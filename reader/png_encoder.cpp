@@ -0,0 +1,381 @@
+/**
+ * @file png_encoder.cpp
+ * @brief PNG filtering, fixed-Huffman deflate and the chunk container.
+ */
+
+#include "png_encoder.hpp"
+#include "parallel_for.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <spdlog/spdlog.h>
+
+namespace {
+
+constexpr int WINDOW_SIZE = 32768;
+constexpr int MIN_MATCH = 3;
+constexpr int MAX_MATCH = 258;
+constexpr int HASH_BITS = 15;
+constexpr int MAX_CHAIN = 8;
+// Longer matches are not entered into the hash chains (zlib's
+// max_insert_length); flat runs then cost one step per 258 bytes.
+constexpr int MAX_INSERT = 32;
+constexpr size_t BAND_BYTES = 1 << 20; // Filtered bytes per parallel band
+
+constexpr std::array<uint16_t, 29> LENGTH_BASE = {
+    3,  4,  5,  6,  7,  8,  9,  10, 11,  13,  15,  17,  19,  23, 27,
+    31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258};
+constexpr std::array<uint8_t, 29> LENGTH_EXTRA = {
+    0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2,
+    2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0};
+constexpr std::array<uint16_t, 30> DIST_BASE = {
+    1,    2,    3,    4,    5,    7,     9,     13,    17,  25,
+    33,   49,   65,   97,   129,  193,   257,   385,   513, 769,
+    1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577};
+constexpr std::array<uint8_t, 30> DIST_EXTRA = {
+    0, 0, 0, 0, 1, 1, 2, 2,  3,  3,  4,  4,  5,  5,  6,
+    6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13};
+
+uint32_t reverse_bits(uint32_t code, int length) {
+  uint32_t reversed = 0;
+  for (int i = 0; i < length; ++i) {
+    reversed = (reversed << 1) | (code & 1);
+    code >>= 1;
+  }
+  return reversed;
+}
+
+// The fixed literal/length code (RFC 1951, 3.2.6), bit-reversed for an
+// LSB-first writer.
+struct FixedCodes {
+  std::array<uint16_t, 288> lit_code{};
+  std::array<uint8_t, 288> lit_length{};
+  std::array<uint8_t, 30> dist_code{};
+
+  FixedCodes() {
+    for (int v = 0; v < 288; ++v) {
+      uint32_t code;
+      int length;
+      if (v < 144) {
+        code = 0x30 + v, length = 8;
+      } else if (v < 256) {
+        code = 0x190 + (v - 144), length = 9;
+      } else if (v < 280) {
+        code = v - 256, length = 7;
+      } else {
+        code = 0xC0 + (v - 280), length = 8;
+      }
+      lit_code[v] = static_cast<uint16_t>(reverse_bits(code, length));
+      lit_length[v] = static_cast<uint8_t>(length);
+    }
+    for (int d = 0; d < 30; ++d)
+      dist_code[d] = static_cast<uint8_t>(reverse_bits(d, 5));
+  }
+};
+
+const FixedCodes &fixed_codes() {
+  static const FixedCodes codes;
+  return codes;
+}
+
+class BitWriter {
+public:
+  explicit BitWriter(std::vector<uint8_t> &out) : out_(out) {}
+
+  void put(uint32_t bits, int count) {
+    acc_ |= static_cast<uint64_t>(bits) << n_;
+    n_ += count;
+    while (n_ >= 8) {
+      out_.push_back(static_cast<uint8_t>(acc_));
+      acc_ >>= 8;
+      n_ -= 8;
+    }
+  }
+
+  void align() {
+    if (n_ > 0)
+      put(0, 8 - n_);
+  }
+
+private:
+  std::vector<uint8_t> &out_;
+  uint64_t acc_ = 0;
+  int n_ = 0;
+};
+
+void put_literal(BitWriter &bits, int symbol) {
+  const auto &codes = fixed_codes();
+  bits.put(codes.lit_code[symbol], codes.lit_length[symbol]);
+}
+
+void put_match(BitWriter &bits, int length, int distance) {
+  const auto &codes = fixed_codes();
+  const int l = static_cast<int>(
+      std::upper_bound(LENGTH_BASE.begin(), LENGTH_BASE.end(), length) -
+      LENGTH_BASE.begin() - 1);
+  put_literal(bits, 257 + l);
+  bits.put(length - LENGTH_BASE[l], LENGTH_EXTRA[l]);
+  const int d = static_cast<int>(
+      std::upper_bound(DIST_BASE.begin(), DIST_BASE.end(), distance) -
+      DIST_BASE.begin() - 1);
+  bits.put(codes.dist_code[d], 5);
+  bits.put(distance - DIST_BASE[d], DIST_EXTRA[d]);
+}
+
+uint32_t hash3(const uint8_t *p) {
+  const uint32_t v = p[0] | p[1] << 8 | p[2] << 16;
+  return (v * 2654435761u) >> (32 - HASH_BITS);
+}
+
+// One non-final fixed-Huffman block holding [data, data + size), closed with
+// an empty stored block so the output ends on a byte boundary and the next
+// band's blocks can simply be appended.
+void deflate_band(const uint8_t *data, size_t size,
+                  std::vector<uint8_t> &out) {
+  BitWriter bits(out);
+  bits.put(0, 1); // BFINAL
+  bits.put(1, 2); // Fixed Huffman
+
+  std::vector<int32_t> head(size_t{1} << HASH_BITS, -1);
+  std::vector<int32_t> prev(size);
+  auto insert = [&](size_t pos) {
+    if (pos + MIN_MATCH > size)
+      return;
+    const uint32_t h = hash3(data + pos);
+    prev[pos] = head[h];
+    head[h] = static_cast<int32_t>(pos);
+  };
+
+  size_t pos = 0;
+  while (pos < size) {
+    int best_length = 0, best_distance = 0;
+    if (pos + MIN_MATCH <= size) {
+      const int max_length =
+          static_cast<int>(std::min<size_t>(MAX_MATCH, size - pos));
+      int32_t candidate = head[hash3(data + pos)];
+      for (int chain = 0; chain < MAX_CHAIN && candidate >= 0 &&
+                          pos - candidate <= WINDOW_SIZE;
+           ++chain, candidate = prev[candidate]) {
+        const uint8_t *a = data + pos;
+        const uint8_t *b = data + candidate;
+        if (b[best_length] != a[best_length])
+          continue;
+        int length = 0;
+        while (length < max_length && a[length] == b[length])
+          ++length;
+        if (length > best_length) {
+          best_length = length;
+          best_distance = static_cast<int>(pos - candidate);
+          if (length == max_length)
+            break;
+        }
+      }
+    }
+
+    if (best_length >= MIN_MATCH) {
+      put_match(bits, best_length, best_distance);
+      if (best_length <= MAX_INSERT) {
+        for (int i = 0; i < best_length; ++i)
+          insert(pos + i);
+      } else {
+        insert(pos);
+      }
+      pos += best_length;
+    } else {
+      put_literal(bits, data[pos]);
+      insert(pos);
+      ++pos;
+    }
+  }
+  put_literal(bits, 256); // End of block
+
+  bits.put(0, 1); // Empty stored block: BFINAL = 0, BTYPE = 00
+  bits.put(0, 2);
+  bits.align();
+  bits.put(0x0000, 16);
+  bits.put(0xFFFF, 16);
+}
+
+uint32_t adler32(const uint8_t *data, size_t size) {
+  constexpr uint32_t BASE = 65521;
+  uint32_t a = 1, b = 0;
+  while (size > 0) {
+    const size_t n = std::min<size_t>(size, 5552); // No overflow before %
+    for (size_t i = 0; i < n; ++i) {
+      a += data[i];
+      b += a;
+    }
+    a %= BASE;
+    b %= BASE;
+    data += n;
+    size -= n;
+  }
+  return b << 16 | a;
+}
+
+// zlib's adler32_combine(): the checksum of A followed by B from both.
+uint32_t adler32_combine(uint32_t adler1, uint32_t adler2, size_t len2) {
+  constexpr uint32_t BASE = 65521;
+  const uint32_t rem = static_cast<uint32_t>(len2 % BASE);
+  uint32_t sum1 = adler1 & 0xFFFF;
+  uint32_t sum2 = static_cast<uint32_t>(
+      (static_cast<uint64_t>(rem) * sum1) % BASE);
+  sum1 += (adler2 & 0xFFFF) + BASE - 1;
+  sum2 += ((adler1 >> 16) & 0xFFFF) + ((adler2 >> 16) & 0xFFFF) + BASE - rem;
+  if (sum1 >= BASE)
+    sum1 -= BASE;
+  if (sum1 >= BASE)
+    sum1 -= BASE;
+  if (sum2 >= (BASE << 1))
+    sum2 -= (BASE << 1);
+  if (sum2 >= BASE)
+    sum2 -= BASE;
+  return sum1 | (sum2 << 16);
+}
+
+// Filter one row with whichever of None, Sub and Up has the smallest sum of
+// absolute (signed) residuals, the usual PNG heuristic.
+void filter_row(const uint8_t *row, const uint8_t *above, size_t row_bytes,
+                uint8_t *out) {
+  constexpr size_t BPP = 3;
+  auto cost = [&](auto residual) {
+    uint64_t sum = 0;
+    for (size_t i = 0; i < row_bytes; ++i)
+      sum += std::abs(static_cast<int8_t>(residual(i)));
+    return sum;
+  };
+  auto none = [&](size_t i) -> uint8_t { return row[i]; };
+  auto sub = [&](size_t i) -> uint8_t {
+    return row[i] - (i >= BPP ? row[i - BPP] : 0);
+  };
+  auto up = [&](size_t i) -> uint8_t {
+    return row[i] - (above ? above[i] : 0);
+  };
+
+  const uint64_t costs[3] = {cost(none), cost(sub), above ? cost(up) : ~0ull};
+  const int filter =
+      static_cast<int>(std::min_element(costs, costs + 3) - costs);
+  out[0] = static_cast<uint8_t>(filter);
+  for (size_t i = 0; i < row_bytes; ++i)
+    out[1 + i] = filter == 0 ? none(i) : filter == 1 ? sub(i) : up(i);
+}
+
+void put_u32(std::vector<uint8_t> &out, uint32_t v) {
+  out.push_back(static_cast<uint8_t>(v >> 24));
+  out.push_back(static_cast<uint8_t>(v >> 16));
+  out.push_back(static_cast<uint8_t>(v >> 8));
+  out.push_back(static_cast<uint8_t>(v));
+}
+
+void put_chunk(std::vector<uint8_t> &png, const char type[4],
+               const uint8_t *data, size_t size) {
+  put_u32(png, static_cast<uint32_t>(size));
+  const size_t start = png.size();
+  png.insert(png.end(), type, type + 4);
+  png.insert(png.end(), data, data + size);
+  put_u32(png, crc32_ieee(0, png.data() + start, size + 4));
+}
+
+} // namespace
+
+uint32_t crc32_ieee(uint32_t crc, const void *data, size_t length) noexcept {
+  static const auto table = [] {
+    std::array<uint32_t, 256> t{};
+    for (uint32_t n = 0; n < 256; ++n) {
+      uint32_t c = n;
+      for (int k = 0; k < 8; ++k)
+        c = c & 1 ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+      t[n] = c;
+    }
+    return t;
+  }();
+  const auto *p = static_cast<const uint8_t *>(data);
+  crc = ~crc;
+  for (size_t i = 0; i < length; ++i)
+    crc = table[(crc ^ p[i]) & 0xFF] ^ (crc >> 8);
+  return ~crc;
+}
+
+std::vector<uint8_t> encode_png(const uint8_t *rgb, int width, int height,
+                                unsigned threads) {
+  const size_t row_bytes = static_cast<size_t>(width) * 3;
+  const size_t filtered_row = row_bytes + 1;
+  const size_t rows_per_band =
+      std::max<size_t>(1, BAND_BYTES / filtered_row);
+  const size_t n_bands =
+      (static_cast<size_t>(height) + rows_per_band - 1) / rows_per_band;
+
+  // Each band filters its rows (the row above is in the input) and
+  // compresses them independently.
+  struct Band {
+    std::vector<uint8_t> deflated;
+    uint32_t adler = 1;
+    size_t size = 0;
+  };
+  std::vector<Band> bands(n_bands);
+  parallel_for(n_bands, threads, [&](size_t b) {
+    const size_t first = b * rows_per_band;
+    const size_t last =
+        std::min<size_t>(first + rows_per_band, static_cast<size_t>(height));
+    std::vector<uint8_t> filtered((last - first) * filtered_row);
+    for (size_t y = first; y < last; ++y) {
+      const uint8_t *above = y > 0 ? rgb + (y - 1) * row_bytes : nullptr;
+      filter_row(rgb + y * row_bytes, above, row_bytes,
+                 filtered.data() + (y - first) * filtered_row);
+    }
+    bands[b].size = filtered.size();
+    bands[b].adler = adler32(filtered.data(), filtered.size());
+    bands[b].deflated.reserve(filtered.size() / 8);
+    deflate_band(filtered.data(), filtered.size(), bands[b].deflated);
+  });
+
+  std::vector<uint8_t> zlib = {0x78, 0x01};
+  uint32_t adler = 1;
+  for (const auto &band : bands) {
+    zlib.insert(zlib.end(), band.deflated.begin(), band.deflated.end());
+    adler = adler32_combine(adler, band.adler, band.size);
+  }
+  zlib.push_back(0x03); // Final empty fixed-Huffman block
+  zlib.push_back(0x00);
+  put_u32(zlib, adler);
+
+  std::vector<uint8_t> png = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n'};
+  std::vector<uint8_t> ihdr;
+  put_u32(ihdr, static_cast<uint32_t>(width));
+  put_u32(ihdr, static_cast<uint32_t>(height));
+  ihdr.insert(ihdr.end(), {8, 2, 0, 0, 0}); // 8-bit RGB, no interlace
+  put_chunk(png, "IHDR", ihdr.data(), ihdr.size());
+  constexpr size_t IDAT_BYTES = 1 << 20;
+  for (size_t offset = 0; offset < zlib.size(); offset += IDAT_BYTES) {
+    put_chunk(png, "IDAT", zlib.data() + offset,
+              std::min(IDAT_BYTES, zlib.size() - offset));
+  }
+  put_chunk(png, "IEND", nullptr, 0);
+  return png;
+}
+
+bool write_png(const std::string &path, const uint8_t *rgb, int width,
+               int height, unsigned threads) {
+  const auto png = encode_png(rgb, width, height, threads);
+  const std::string tmp_path = path + ".tmp";
+  {
+    std::ofstream out(tmp_path, std::ios::binary | std::ios::trunc);
+    out.write(reinterpret_cast<const char *>(png.data()),
+              static_cast<std::streamsize>(png.size()));
+    if (!out) {
+      SPDLOG_ERROR("Failed to write {}.", tmp_path);
+      return false;
+    }
+  }
+  if (std::rename(tmp_path.c_str(), path.c_str()) != 0) {
+    SPDLOG_ERROR("Failed to rename {} to {}: {}", tmp_path, path,
+                 std::strerror(errno));
+    return false;
+  }
+  return true;
+}
@@ -0,0 +1,31 @@
+/**
+ * @file png_encoder.hpp
+ * @brief A small self-contained PNG encoder (8-bit RGB), no zlib.
+ *
+ * The image is compressed with deflate using the fixed Huffman codes and a
+ * greedy LZ77 match search, which suits plots: large flat areas and repeated
+ * rows shrink to a few bits per run. Bands of rows are compressed on
+ * separate threads, each with its own window, and joined with byte-aligned
+ * empty stored blocks, as parallel gzip does; the result is one ordinary
+ * zlib stream.
+ */
+
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/** @brief CRC-32 (IEEE 802.3, as PNG and zlib's crc32()). */
+uint32_t crc32_ieee(uint32_t crc, const void *data, size_t length) noexcept;
+
+/**
+ * @brief Encode @p rgb (width * height * 3 bytes, rows top to bottom) as a
+ * PNG file in memory, compressing on up to @p threads threads.
+ */
+std::vector<uint8_t> encode_png(const uint8_t *rgb, int width, int height,
+                                unsigned threads = 1);
+
+/** @brief encode_png() to a temporary file renamed over @p path. */
+bool write_png(const std::string &path, const uint8_t *rgb, int width,
+               int height, unsigned threads = 1);
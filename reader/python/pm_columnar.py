@@ -0,0 +1,156 @@
+"""Zero-copy loader for column-major pm_table recordings (.pmcol).
+
+Written by `pm_reader --columnar` or `pm_log_convert in.bin out.pmcol`.
+The layout is described by the JSON sidecar (<file>.pmcol.json); each chunk
+holds a timestamp column followed by one float32 column per pm_table cell,
+so a cell's full-rate series is a strided view of a single numpy.memmap.
+
+    log = ColumnarLog("pm_table_log.pmcol")
+    t = log.timestamps()          # int64 ns, all samples
+    v = log.cell(17)              # float32, all samples of cell 17
+    t, v = log.window(17, t0, t1) # only the chunks overlapping [t0, t1]
+
+Zoom levels (<file>.10ms.pmcol ... <file>.10s.pmcol, see time_pyramid.hpp)
+hold min/max/mean per bucket; Pyramid picks the coarsest level that still
+gives one bucket per pixel:
+
+    pyr = Pyramid("pm_table_log.pmcol")
+    t, lo, hi, mean, bucket_ns = pyr.query(17, t0, t1, pixels=1200)
+"""
+
+import json
+from pathlib import Path
+
+import numpy as np
+
+
+class ColumnarLog:
+    def __init__(self, path):
+        self.path = Path(path)
+        sidecar = Path(str(self.path) + ".json")
+        self.meta = json.loads(sidecar.read_text())
+        if self.meta.get("format") != "pm_columnar":
+            raise ValueError(f"{sidecar} does not describe a pm_columnar file")
+
+        self.chunk_samples = self.meta["chunk_samples"]
+        self.n_cells = self.meta["n_cells"]
+        header_bytes = self.meta["header_bytes"]
+        chunk_bytes = self.meta["chunk_bytes"]
+
+        # The sidecar is rewritten after every chunk; after a crash the data
+        # may be behind it, so trust only chunks that are fully on disk.
+        on_disk = (self.path.stat().st_size - header_bytes) // chunk_bytes
+        self.n_chunks = min(self.meta["n_chunks"], max(on_disk, 0))
+        self.n_samples = min(self.meta["n_samples"],
+                             self.n_chunks * self.chunk_samples)
+
+        fields = {
+            field["name"]: (np.dtype(field["dtype"]), tuple(field["shape"]))
+            for field in self.meta["chunk_layout"]
+        }
+        self.chunk_dtype = np.dtype({
+            "names": list(fields),
+            "formats": [(dtype, shape) for dtype, shape in fields.values()],
+            "offsets": [f["offset"] for f in self.meta["chunk_layout"]],
+            "itemsize": chunk_bytes,
+        })
+        self.chunks = (
+            np.memmap(self.path, dtype=self.chunk_dtype, mode="r",
+                      offset=header_bytes, shape=(self.n_chunks,))
+            if self.n_chunks else np.empty(0, dtype=self.chunk_dtype)
+        )
+
+    def __len__(self):
+        return self.n_samples
+
+    def _flat(self, columns):
+        """(n_chunks, chunk_samples) view -> 1-D series of valid samples."""
+        return columns.reshape(-1)[: self.n_samples]
+
+    def timestamps(self):
+        """All timestamps in ns since the epoch (int64)."""
+        return self._flat(self.chunks["timestamp_ns"]).astype(np.int64)
+
+    def cell(self, index):
+        """Full-rate series of one pm_table cell (float32).
+
+        Only the pages of that cell's columns are read from disk.
+        """
+        return self._flat(self.chunks["cells"][:, index, :])
+
+    def cells(self, indices):
+        """Several cells as a (len(indices), n_samples) array."""
+        return np.stack([self.cell(i) for i in indices])
+
+    def chunk_range(self, t0_ns, t1_ns):
+        """Chunks [first, last) whose samples may lie in [t0_ns, t1_ns]."""
+        if not self.n_chunks:
+            return 0, 0
+        starts = self.chunks["timestamp_ns"][:, 0]
+        first = max(int(np.searchsorted(starts, t0_ns, side="right")) - 1, 0)
+        last = int(np.searchsorted(starts, t1_ns, side="right"))
+        return first, max(last, first)
+
+    def window(self, index, t0_ns, t1_ns):
+        """Timestamps and values of one cell within [t0_ns, t1_ns]."""
+        first, last = self.chunk_range(t0_ns, t1_ns)
+        valid = min(self.n_samples, last * self.chunk_samples) - \
+            first * self.chunk_samples
+        t = self.chunks["timestamp_ns"][first:last].reshape(-1)[:valid]
+        v = self.chunks["cells"][first:last, index, :].reshape(-1)[:valid]
+        mask = (t >= t0_ns) & (t <= t1_ns)
+        return t[mask].astype(np.int64), v[mask]
+
+
+PYRAMID_LEVELS = ("10ms", "100ms", "1s", "10s")
+
+
+class Pyramid:
+    def __init__(self, path):
+        self.raw = ColumnarLog(path)
+        stem = str(path)
+        if stem.endswith(".pmcol"):
+            stem = stem[: -len(".pmcol")]
+        self.levels = []  # (bucket_ns, ColumnarLog), finest first
+        for label in PYRAMID_LEVELS:
+            level_path = Path(f"{stem}.{label}.pmcol")
+            if not Path(str(level_path) + ".json").exists():
+                continue
+            level = ColumnarLog(level_path)
+            info = level.meta.get("pyramid")
+            if info and info["n_source_cells"] == self.raw.n_cells:
+                self.levels.append((info["bucket_ns"], level))
+
+    def choose_bucket_ns(self, t0_ns, t1_ns, pixels):
+        """Coarsest bucket with at least one bucket per pixel (0 = raw)."""
+        per_pixel = max(t1_ns - t0_ns, 0) // max(pixels, 1)
+        chosen = 0
+        for bucket_ns, _ in self.levels:
+            if bucket_ns <= per_pixel:
+                chosen = bucket_ns
+        return chosen
+
+    def query(self, index, t0_ns, t1_ns, pixels):
+        """Bucket starts, min, max, mean of one cell and the bucket width."""
+        bucket_ns = self.choose_bucket_ns(t0_ns, t1_ns, pixels)
+        if bucket_ns == 0:
+            t, v = self.raw.window(index, t0_ns, t1_ns)
+            return t, v, v, v, 0
+        level = dict(self.levels)[bucket_ns]
+        n = self.raw.n_cells
+        start = t0_ns - t0_ns % bucket_ns
+        t, lo = level.window(index, start, t1_ns)
+        _, hi = level.window(n + index, start, t1_ns)
+        _, mean = level.window(2 * n + index, start, t1_ns)
+        return t, lo, hi, mean, bucket_ns
+
+
+if __name__ == "__main__":
+    import sys
+
+    log = ColumnarLog(sys.argv[1])
+    t = log.timestamps()
+    print(f"{len(log)} samples x {log.n_cells} cells in {log.n_chunks} chunks")
+    if len(t):
+        print(f"{(t[-1] - t[0]) * 1e-9:.1f} s, "
+              f"median period {np.median(np.diff(t)) * 1e-6:.3f} ms")
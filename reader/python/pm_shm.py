@@ -0,0 +1,172 @@
+"""Read-only client of the pm_acqd shared-memory ring (/dev/shm/<name>).
+
+pm_acqd is the single process that reads the pm_table; it publishes every
+sample with CLOCK_REALTIME and CLOCK_MONOTONIC timestamps into a ring of
+seqlocked slots (layout in shm_ring.hpp). This client maps the ring
+read-only, so it never slows the daemon down; it does not register in the
+daemon's consumer table.
+
+    ring = ShmRing("pm_table")
+    while True:
+        s = ring.next()           # Sample(seq, realtime_ns, monotonic_ns, data)
+        if s is None:
+            time.sleep(0.001)
+            continue
+        print(s.data[17])
+    ring.latest()                 # newest sample only, e.g. for a 10 Hz plot
+
+Falling more than a ring behind loses samples; next() skips ahead and counts
+them in ring.lost / ring.overruns. Run as a script for a live rate report:
+
+    python pm_shm.py [name]
+"""
+
+import mmap
+import struct
+import sys
+import time
+from collections import namedtuple
+from pathlib import Path
+
+import numpy as np
+
+MAGIC = b"PMSH"
+FORMAT_VERSION = 1
+
+# magic, format_version, header_bytes, sample_bytes, slot_bytes,
+# pm_table_version, capacity, period_ns, daemon_pid
+_HEADER = struct.Struct("<4s5IQQi")
+_PUBLISHED_OFFSET = 64  # published, heartbeat_ns, read_errors (u64 each)
+_SLOT_HEADER_BYTES = 32
+
+Sample = namedtuple("Sample", "seq realtime_ns monotonic_ns data")
+
+
+class ShmRing:
+    def __init__(self, name="pm_table"):
+        self.path = Path("/dev/shm") / name
+        with open(self.path, "rb") as f:
+            self._map = mmap.mmap(f.fileno(), 0, prot=mmap.PROT_READ)
+        (magic, version, header_bytes, sample_bytes, slot_bytes,
+         self.pm_table_version, self.capacity, self.period_ns,
+         self.daemon_pid) = _HEADER.unpack_from(self._map)
+        if magic != MAGIC or version != FORMAT_VERSION:
+            raise ValueError(f"{self.path} is not a pm_acqd ring "
+                             f"(magic {magic!r}, version {version})")
+        self.n_floats = sample_bytes // 4
+
+        slot_dtype = np.dtype({
+            "names": ["seq", "realtime_ns", "monotonic_ns", "data"],
+            "formats": ["<u8", "<u8", "<u8", ("<f4", (self.n_floats,))],
+            "offsets": [0, 8, 16, _SLOT_HEADER_BYTES],
+            "itemsize": slot_bytes,
+        })
+        self._counters = np.frombuffer(self._map, dtype="<u8", count=3,
+                                       offset=_PUBLISHED_OFFSET)
+        self._latest = np.frombuffer(self._map, dtype=slot_dtype, count=1,
+                                     offset=header_bytes)
+        self._ring = np.frombuffer(self._map, dtype=slot_dtype,
+                                   count=self.capacity,
+                                   offset=header_bytes + slot_bytes)
+
+        # Samples published before attaching are history, not backlog.
+        self.next_seq = self.published + 1
+        self.received = 0
+        self.lost = 0
+        self.overruns = 0
+        self.max_lag = 0
+
+    @property
+    def published(self):
+        return int(self._counters[0])
+
+    @property
+    def read_errors(self):
+        return int(self._counters[2])
+
+    @staticmethod
+    def _read(slot, seq):
+        """Seqlock read: the slot holds seq before and after the copy."""
+        if slot["seq"] != seq:
+            return None
+        sample = Sample(seq, int(slot["realtime_ns"]),
+                        int(slot["monotonic_ns"]), slot["data"].copy())
+        return sample if slot["seq"] == seq else None
+
+    def _skip_lost(self, published):
+        resume = published - self.capacity // 4 + 1
+        self.lost += resume - self.next_seq
+        self.overruns += 1
+        self.next_seq = resume
+
+    def next(self):
+        """The next sample in sequence, or None if there is none yet."""
+        while True:
+            published = self.published
+            if self.next_seq > published:
+                return None
+            lag = published - self.next_seq + 1
+            self.max_lag = max(self.max_lag, lag)
+            if lag >= self.capacity:
+                self._skip_lost(published)
+                continue
+            sample = self._read(self._ring[(self.next_seq - 1) % self.capacity],
+                                self.next_seq)
+            if sample is None:
+                self._skip_lost(self.published)
+                continue
+            self.next_seq += 1
+            self.received += 1
+            return sample
+
+    def latest(self):
+        """The newest sample, skipping the ring; None before the first."""
+        slot = self._latest[0]
+        for _ in range(16):
+            seq = int(slot["seq"])
+            if seq == 0:
+                if self.published == 0:
+                    return None
+                continue
+            sample = self._read(slot, seq)
+            if sample is not None:
+                return sample
+        return None
+
+    def lag(self):
+        return max(self.published - self.next_seq + 1, 0)
+
+    def alive(self, timeout_s=1.0):
+        heartbeat = int(self._counters[1])
+        now = time.clock_gettime_ns(time.CLOCK_MONOTONIC)
+        return now < heartbeat or now - heartbeat < timeout_s * 1e9
+
+    def close(self):
+        # Drop the numpy views first; mmap refuses to close while exported.
+        del self._counters, self._latest, self._ring
+        self._map.close()
+
+
+def main():
+    ring = ShmRing(sys.argv[1] if len(sys.argv) > 1 else "pm_table")
+    print(f"{ring.path}: {ring.n_floats} floats every "
+          f"{ring.period_ns / 1e3:.0f} us from pid {ring.daemon_pid}, "
+          f"{ring.capacity} slots")
+    last_report = time.monotonic()
+    received = 0
+    while ring.alive():
+        if ring.next() is None:
+            time.sleep(ring.period_ns / 2e9)
+            continue
+        now = time.monotonic()
+        if now - last_report >= 1.0:
+            rate = (ring.received - received) / (now - last_report)
+            print(f"{rate:7.1f} samples/s, lag {ring.lag()}, "
+                  f"{ring.lost} lost in {ring.overruns} overruns, "
+                  f"{ring.read_errors} read errors")
+            received, last_report = ring.received, now
+    print("pm_acqd stopped publishing.")
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,836 @@
+/**
+ * @file report_render.cpp
+ * @brief Report layout, the software rasterizer, the SVG writer and
+ * SeriesDecimator.
+ */
+
+#include "report_render.hpp"
+#include "float_bits.hpp"
+#include "parallel_for.hpp"
+#include "png_encoder.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include <pthread.h>
+#include <sched.h>
+#include <spdlog/spdlog.h>
+#include <string_view>
+#include <thread>
+
+namespace {
+
+constexpr int MARGIN = 8;
+constexpr int TITLE_HEIGHT = 24;
+constexpr int HEADER_HEIGHT = 16; // Above each section and grid
+constexpr int PANEL_GAP = 2;      // Between neighbouring panels
+constexpr int PLOT_TOP = 11;      // Panel title row
+constexpr int PLOT_BOTTOM = 10;   // x labels
+constexpr int PLOT_SIDE = 3;
+constexpr int GRID_CELL_WIDTH = 56; // "{:8.2f}" at 6 px per glyph
+constexpr int GRID_CELL_HEIGHT = 12;
+constexpr int GRID_LABEL_WIDTH = 36;
+constexpr int GLYPH_WIDTH = 6; // 5 columns and one of spacing
+constexpr int GLYPH_HEIGHT = 8;
+
+// A dark theme like the GUI's.
+constexpr uint32_t PAGE_COLOR = 0x0F0F0F;
+constexpr uint32_t PANEL_COLOR = 0x1E1E22;
+constexpr uint32_t TEXT_COLOR = 0xE0E0E0;
+constexpr uint32_t DIM_COLOR = 0x909090;
+constexpr uint32_t MEAN_COLOR = 0xFFFF00; // As the GUI's eye plots
+constexpr uint32_t BAND_COLOR = 0x3D7FD9;
+constexpr uint32_t MARKER_COLOR = 0x707070;
+
+// 5x7 glyphs for ' ' .. '_' (lower case is drawn as upper case), rows top to
+// bottom, bit 4 = leftmost column.
+constexpr uint8_t FONT[64][7] = {
+    {0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00}, // ' '
+    {0x04, 0x04, 0x04, 0x04, 0x04, 0x00, 0x04}, // !
+    {0x0A, 0x0A, 0x0A, 0x00, 0x00, 0x00, 0x00}, // "
+    {0x0A, 0x0A, 0x1F, 0x0A, 0x1F, 0x0A, 0x0A}, // #
+    {0x04, 0x0F, 0x14, 0x0E, 0x05, 0x1E, 0x04}, // $
+    {0x18, 0x19, 0x02, 0x04, 0x08, 0x13, 0x03}, // %
+    {0x0C, 0x12, 0x14, 0x08, 0x15, 0x12, 0x0D}, // &
+    {0x0C, 0x04, 0x08, 0x00, 0x00, 0x00, 0x00}, // '
+    {0x02, 0x04, 0x08, 0x08, 0x08, 0x04, 0x02}, // (
+    {0x08, 0x04, 0x02, 0x02, 0x02, 0x04, 0x08}, // )
+    {0x00, 0x04, 0x15, 0x0E, 0x15, 0x04, 0x00}, // *
+    {0x00, 0x04, 0x04, 0x1F, 0x04, 0x04, 0x00}, // +
+    {0x00, 0x00, 0x00, 0x00, 0x0C, 0x04, 0x08}, // ,
+    {0x00, 0x00, 0x00, 0x1F, 0x00, 0x00, 0x00}, // -
+    {0x00, 0x00, 0x00, 0x00, 0x00, 0x0C, 0x0C}, // .
+    {0x00, 0x01, 0x02, 0x04, 0x08, 0x10, 0x00}, // /
+    {0x0E, 0x11, 0x13, 0x15, 0x19, 0x11, 0x0E}, // 0
+    {0x04, 0x0C, 0x04, 0x04, 0x04, 0x04, 0x0E}, // 1
+    {0x0E, 0x11, 0x01, 0x02, 0x04, 0x08, 0x1F}, // 2
+    {0x1F, 0x02, 0x04, 0x02, 0x01, 0x11, 0x0E}, // 3
+    {0x02, 0x06, 0x0A, 0x12, 0x1F, 0x02, 0x02}, // 4
+    {0x1F, 0x10, 0x1E, 0x01, 0x01, 0x11, 0x0E}, // 5
+    {0x06, 0x08, 0x10, 0x1E, 0x11, 0x11, 0x0E}, // 6
+    {0x1F, 0x01, 0x02, 0x04, 0x08, 0x08, 0x08}, // 7
+    {0x0E, 0x11, 0x11, 0x0E, 0x11, 0x11, 0x0E}, // 8
+    {0x0E, 0x11, 0x11, 0x0F, 0x01, 0x02, 0x0C}, // 9
+    {0x00, 0x0C, 0x0C, 0x00, 0x0C, 0x0C, 0x00}, // :
+    {0x00, 0x0C, 0x0C, 0x00, 0x0C, 0x04, 0x08}, // ;
+    {0x02, 0x04, 0x08, 0x10, 0x08, 0x04, 0x02}, // <
+    {0x00, 0x00, 0x1F, 0x00, 0x1F, 0x00, 0x00}, // =
+    {0x08, 0x04, 0x02, 0x01, 0x02, 0x04, 0x08}, // >
+    {0x0E, 0x11, 0x01, 0x02, 0x04, 0x00, 0x04}, // ?
+    {0x0E, 0x11, 0x01, 0x0D, 0x15, 0x15, 0x0E}, // @
+    {0x0E, 0x11, 0x11, 0x11, 0x1F, 0x11, 0x11}, // A
+    {0x1E, 0x11, 0x11, 0x1E, 0x11, 0x11, 0x1E}, // B
+    {0x0E, 0x11, 0x10, 0x10, 0x10, 0x11, 0x0E}, // C
+    {0x1C, 0x12, 0x11, 0x11, 0x11, 0x12, 0x1C}, // D
+    {0x1F, 0x10, 0x10, 0x1E, 0x10, 0x10, 0x1F}, // E
+    {0x1F, 0x10, 0x10, 0x1E, 0x10, 0x10, 0x10}, // F
+    {0x0E, 0x11, 0x10, 0x17, 0x11, 0x11, 0x0F}, // G
+    {0x11, 0x11, 0x11, 0x1F, 0x11, 0x11, 0x11}, // H
+    {0x0E, 0x04, 0x04, 0x04, 0x04, 0x04, 0x0E}, // I
+    {0x07, 0x02, 0x02, 0x02, 0x02, 0x12, 0x0C}, // J
+    {0x11, 0x12, 0x14, 0x18, 0x14, 0x12, 0x11}, // K
+    {0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x1F}, // L
+    {0x11, 0x1B, 0x15, 0x15, 0x11, 0x11, 0x11}, // M
+    {0x11, 0x11, 0x19, 0x15, 0x13, 0x11, 0x11}, // N
+    {0x0E, 0x11, 0x11, 0x11, 0x11, 0x11, 0x0E}, // O
+    {0x1E, 0x11, 0x11, 0x1E, 0x10, 0x10, 0x10}, // P
+    {0x0E, 0x11, 0x11, 0x11, 0x15, 0x12, 0x0D}, // Q
+    {0x1E, 0x11, 0x11, 0x1E, 0x14, 0x12, 0x11}, // R
+    {0x0F, 0x10, 0x10, 0x0E, 0x01, 0x01, 0x1E}, // S
+    {0x1F, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04}, // T
+    {0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x0E}, // U
+    {0x11, 0x11, 0x11, 0x11, 0x11, 0x0A, 0x04}, // V
+    {0x11, 0x11, 0x11, 0x15, 0x15, 0x15, 0x0A}, // W
+    {0x11, 0x11, 0x0A, 0x04, 0x0A, 0x11, 0x11}, // X
+    {0x11, 0x11, 0x11, 0x0A, 0x04, 0x04, 0x04}, // Y
+    {0x1F, 0x01, 0x02, 0x04, 0x08, 0x10, 0x1F}, // Z
+    {0x0E, 0x08, 0x08, 0x08, 0x08, 0x08, 0x0E}, // [
+    {0x00, 0x10, 0x08, 0x04, 0x02, 0x01, 0x00}, // backslash
+    {0x0E, 0x02, 0x02, 0x02, 0x02, 0x02, 0x0E}, // ]
+    {0x04, 0x0A, 0x11, 0x00, 0x00, 0x00, 0x00}, // ^
+    {0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x1F}, // _
+};
+
+const uint8_t *glyph_rows(char c) {
+  if (c >= 'a' && c <= 'z')
+    c = static_cast<char>(c - 'a' + 'A');
+  if (c < 0x20 || c > 0x5F)
+    c = '?';
+  return FONT[c - 0x20];
+}
+
+uint32_t mix(uint32_t a, uint32_t b, float t) {
+  auto channel = [&](int shift) {
+    const float ca = static_cast<float>((a >> shift) & 0xFF);
+    const float cb = static_cast<float>((b >> shift) & 0xFF);
+    return static_cast<uint32_t>(ca + (cb - ca) * t + 0.5f) << shift;
+  };
+  return channel(16) | channel(8) | channel(0);
+}
+
+uint32_t band_color(size_t band, size_t n_bands) {
+  const float t =
+      n_bands > 1 ? 0.35f + 0.45f * band / static_cast<float>(n_bands - 1)
+                  : 0.5f;
+  return mix(PANEL_COLOR, BAND_COLOR, t);
+}
+
+std::string number(float v) { return fmt::format("{:.4g}", v); }
+
+// --- Layout, shared by the PNG and SVG output ---
+
+struct PanelSlot {
+  const ReportPlot *plot;
+  const ReportSection *section;
+  int x, y, width, height;
+};
+
+struct Header {
+  std::string text;
+  int y;
+};
+
+struct GridSlot {
+  const ReportGrid *grid;
+  int x, y, rows;
+};
+
+struct Layout {
+  int width = 0, height = 0;
+  std::vector<Header> headers;
+  std::vector<PanelSlot> panels;
+  std::vector<GridSlot> grids;
+};
+
+Layout make_layout(const Report &report, const ReportOptions &options) {
+  Layout layout;
+  const int panels_per_row = std::max(1, options.panels_per_row);
+  int content_width = panels_per_row * options.panel_width;
+  for (const auto &grid : report.grids) {
+    content_width = std::max(content_width,
+                             GRID_LABEL_WIDTH +
+                                 std::max(1, grid.columns) * GRID_CELL_WIDTH);
+  }
+  layout.width = content_width + 2 * MARGIN;
+
+  int y = MARGIN + TITLE_HEIGHT;
+  for (const auto &section : report.sections) {
+    layout.headers.push_back(
+        {fmt::format("{} ({} plots)", section.title, section.plots.size()),
+         y});
+    y += HEADER_HEIGHT;
+    for (size_t i = 0; i < section.plots.size(); ++i) {
+      const int col = static_cast<int>(i % panels_per_row);
+      const int row = static_cast<int>(i / panels_per_row);
+      layout.panels.push_back({&section.plots[i], &section,
+                               MARGIN + col * options.panel_width,
+                               y + row * options.panel_height,
+                               options.panel_width - PANEL_GAP,
+                               options.panel_height - PANEL_GAP});
+    }
+    const int rows = static_cast<int>(
+        (section.plots.size() + panels_per_row - 1) / panels_per_row);
+    y += rows * options.panel_height + MARGIN;
+  }
+  for (const auto &grid : report.grids) {
+    layout.headers.push_back({grid.title, y});
+    y += HEADER_HEIGHT;
+    const int columns = std::max(1, grid.columns);
+    const int rows =
+        static_cast<int>((grid.values.size() + columns - 1) / columns);
+    layout.grids.push_back({&grid, MARGIN, y, rows});
+    y += (rows + 1) * GRID_CELL_HEIGHT + MARGIN; // Column letters
+  }
+  layout.height = y + MARGIN;
+  return layout;
+}
+
+// Data to pixel mapping of a panel's plot area.
+struct PlotGeometry {
+  int left, top, width, height;
+  float x_lo, x_hi, y_lo, y_hi;
+
+  float px(float x) const {
+    return left + (x - x_lo) / (x_hi - x_lo) * (width - 1);
+  }
+  float py(float y) const {
+    return top + (y_hi - y) / (y_hi - y_lo) * (height - 1);
+  }
+};
+
+PlotGeometry plot_geometry(const PanelSlot &slot) {
+  const ReportPlot &plot = *slot.plot;
+  PlotGeometry g{slot.x + PLOT_SIDE,
+                 slot.y + PLOT_TOP,
+                 std::max(2, slot.width - 2 * PLOT_SIDE),
+                 std::max(2, slot.height - PLOT_TOP - PLOT_BOTTOM),
+                 0.0f,
+                 1.0f,
+                 std::numeric_limits<float>::max(),
+                 std::numeric_limits<float>::lowest()};
+  if (!plot.x.empty()) {
+    g.x_lo = plot.x.front();
+    g.x_hi = plot.x.back();
+  }
+  auto extend = [&](const std::vector<float> &values) {
+    for (const float v : values) {
+      if (is_finite(v)) {
+        g.y_lo = std::min(g.y_lo, v);
+        g.y_hi = std::max(g.y_hi, v);
+      }
+    }
+  };
+  if (!plot.bands.empty()) {
+    extend(plot.bands.front().lo);
+    extend(plot.bands.front().hi);
+  }
+  extend(plot.mean);
+  if (g.y_lo > g.y_hi) {
+    g.y_lo = 0.0f;
+    g.y_hi = 1.0f;
+  }
+  const float pad = (g.y_hi - g.y_lo) * 0.05f;
+  g.y_lo -= pad;
+  g.y_hi += pad;
+  if (!(g.y_hi > g.y_lo)) { // Constant: centre it
+    const float half = std::max(std::abs(g.y_lo) * 0.01f, 1e-6f);
+    g.y_lo -= half;
+    g.y_hi += half;
+  }
+  if (!(g.x_hi > g.x_lo)) {
+    g.x_lo -= 0.5f;
+    g.x_hi += 0.5f;
+  }
+  return g;
+}
+
+// Interpolate values at x (ascending xs) while sweeping x upwards.
+class Sweep {
+public:
+  explicit Sweep(const std::vector<float> &xs) : xs_(xs) {}
+
+  // False outside the data; else the segment and the fraction within it.
+  bool at(float x, size_t &i, float &t) {
+    if (xs_.empty() || x < xs_.front() || x > xs_.back())
+      return false;
+    while (i_ + 1 < xs_.size() && xs_[i_ + 1] < x)
+      ++i_;
+    i = i_;
+    const float span = i_ + 1 < xs_.size() ? xs_[i_ + 1] - xs_[i_] : 0.0f;
+    t = span > 0.0f ? (x - xs_[i_]) / span : 0.0f;
+    return true;
+  }
+
+private:
+  const std::vector<float> &xs_;
+  size_t i_ = 0;
+};
+
+float lerp_at(const std::vector<float> &v, size_t i, float t) {
+  return i + 1 < v.size() ? v[i] + (v[i + 1] - v[i]) * t : v[i];
+}
+
+// --- Rasterizer ---
+
+// Drawing into a shared RGB image, clipped to one rectangle, so panels can be
+// drawn from several threads at once.
+class Canvas {
+public:
+  Canvas(uint8_t *rgb, int stride, int x0, int y0, int x1, int y1)
+      : rgb_(rgb), stride_(stride), x0_(x0), y0_(y0), x1_(x1), y1_(y1) {}
+
+  void pixel(int x, int y, uint32_t color) {
+    if (x < x0_ || y < y0_ || x >= x1_ || y >= y1_)
+      return;
+    uint8_t *p = rgb_ + (static_cast<size_t>(y) * stride_ + x) * 3;
+    p[0] = static_cast<uint8_t>(color >> 16);
+    p[1] = static_cast<uint8_t>(color >> 8);
+    p[2] = static_cast<uint8_t>(color);
+  }
+
+  void fill(int x, int y, int w, int h, uint32_t color) {
+    const int xa = std::max(x, x0_), xb = std::min(x + w, x1_);
+    const int ya = std::max(y, y0_), yb = std::min(y + h, y1_);
+    for (int yy = ya; yy < yb; ++yy) {
+      for (int xx = xa; xx < xb; ++xx)
+        pixel(xx, yy, color);
+    }
+  }
+
+  void line(float fx0, float fy0, float fx1, float fy1, uint32_t color) {
+    int x0 = static_cast<int>(std::lround(fx0));
+    int y0 = static_cast<int>(std::lround(fy0));
+    const int x1 = static_cast<int>(std::lround(fx1));
+    const int y1 = static_cast<int>(std::lround(fy1));
+    const int dx = std::abs(x1 - x0), sx = x0 < x1 ? 1 : -1;
+    const int dy = -std::abs(y1 - y0), sy = y0 < y1 ? 1 : -1;
+    for (int err = dx + dy;;) {
+      pixel(x0, y0, color);
+      if (x0 == x1 && y0 == y1)
+        break;
+      const int e2 = 2 * err;
+      if (e2 >= dy) {
+        err += dy;
+        x0 += sx;
+      }
+      if (e2 <= dx) {
+        err += dx;
+        y0 += sy;
+      }
+    }
+  }
+
+  // @return Width in pixels.
+  int text(int x, int y, std::string_view s, uint32_t color, int scale = 1) {
+    for (size_t i = 0; i < s.size(); ++i) {
+      const uint8_t *rows = glyph_rows(s[i]);
+      const int gx = x + static_cast<int>(i) * GLYPH_WIDTH * scale;
+      for (int r = 0; r < 7; ++r) {
+        for (int c = 0; c < 5; ++c) {
+          if (rows[r] & (0x10 >> c))
+            fill(gx + c * scale, y + r * scale, scale, scale, color);
+        }
+      }
+    }
+    return static_cast<int>(s.size()) * GLYPH_WIDTH * scale;
+  }
+
+private:
+  uint8_t *rgb_;
+  int stride_;
+  int x0_, y0_, x1_, y1_;
+};
+
+int text_width(std::string_view s) {
+  return static_cast<int>(s.size()) * GLYPH_WIDTH;
+}
+
+void draw_panel(Canvas &canvas, const PanelSlot &slot) {
+  const ReportPlot &plot = *slot.plot;
+  canvas.fill(slot.x, slot.y, slot.width, slot.height, PANEL_COLOR);
+  const PlotGeometry g = plot_geometry(slot);
+
+  canvas.text(slot.x + PLOT_SIDE, slot.y + 2, plot.title, TEXT_COLOR);
+  const std::string range =
+      number(g.y_lo) + ".." + number(g.y_hi); // Padded range of the plot
+  canvas.text(slot.x + slot.width - PLOT_SIDE - text_width(range), slot.y + 2,
+              range, DIM_COLOR);
+  const int label_y = slot.y + slot.height - GLYPH_HEIGHT;
+  canvas.text(slot.x + PLOT_SIDE, label_y, number(g.x_lo), DIM_COLOR);
+  const std::string x_hi = number(g.x_hi) + " " + slot.section->x_unit;
+  canvas.text(slot.x + slot.width - PLOT_SIDE - text_width(x_hi), label_y,
+              x_hi, DIM_COLOR);
+  if (plot.x.empty())
+    return;
+
+  if (is_finite(plot.marker_x) && plot.marker_x >= g.x_lo &&
+      plot.marker_x <= g.x_hi) {
+    const float mx = g.px(plot.marker_x);
+    canvas.line(mx, static_cast<float>(g.top), mx,
+                static_cast<float>(g.top + g.height - 1), MARKER_COLOR);
+  }
+
+  for (size_t b = 0; b < plot.bands.size(); ++b) {
+    const auto &band = plot.bands[b];
+    if (band.lo.size() != plot.x.size() || band.hi.size() != plot.x.size())
+      continue;
+    const uint32_t color = band_color(b, plot.bands.size());
+    Sweep sweep(plot.x);
+    for (int col = 0; col < g.width; ++col) {
+      const float x = g.x_lo + col * (g.x_hi - g.x_lo) / (g.width - 1);
+      size_t i;
+      float t;
+      if (!sweep.at(x, i, t))
+        continue;
+      const float hi = lerp_at(band.hi, i, t), lo = lerp_at(band.lo, i, t);
+      if (!is_finite(hi) || !is_finite(lo))
+        continue;
+      const int y0 = static_cast<int>(std::lround(g.py(hi)));
+      const int y1 = static_cast<int>(std::lround(g.py(lo)));
+      canvas.fill(g.left + col, y0, 1, y1 - y0 + 1, color);
+    }
+  }
+
+  if (plot.mean.size() == plot.x.size()) {
+    for (size_t i = 0; i < plot.x.size(); ++i) {
+      if (!is_finite(plot.mean[i]))
+        continue;
+      const float x = g.px(plot.x[i]), y = g.py(plot.mean[i]);
+      if (i > 0 && is_finite(plot.mean[i - 1]))
+        canvas.line(g.px(plot.x[i - 1]), g.py(plot.mean[i - 1]), x, y,
+                    MEAN_COLOR);
+      else
+        canvas.pixel(static_cast<int>(std::lround(x)),
+                     static_cast<int>(std::lround(y)), MEAN_COLOR);
+    }
+  }
+}
+
+void draw_grid(Canvas &canvas, const GridSlot &slot) {
+  const ReportGrid &grid = *slot.grid;
+  const int columns = std::max(1, grid.columns);
+  for (int col = 0; col < columns; ++col) {
+    const std::string letter(1, static_cast<char>('A' + col % 26));
+    canvas.text(slot.x + GRID_LABEL_WIDTH + col * GRID_CELL_WIDTH +
+                    GRID_CELL_WIDTH - GLYPH_WIDTH - 4,
+                slot.y + 2, letter, DIM_COLOR);
+  }
+  for (int row = 0; row < slot.rows; ++row) {
+    const int y = slot.y + (row + 1) * GRID_CELL_HEIGHT;
+    canvas.text(slot.x, y + 2, fmt::format("{:5}", row * columns), DIM_COLOR);
+    for (int col = 0; col < columns; ++col) {
+      const size_t i = static_cast<size_t>(row) * columns + col;
+      if (i >= grid.values.size())
+        break;
+      const int x = slot.x + GRID_LABEL_WIDTH + col * GRID_CELL_WIDTH;
+      canvas.fill(x, y, GRID_CELL_WIDTH - 1, GRID_CELL_HEIGHT - 1,
+                  i < grid.background.size() ? grid.background[i]
+                                             : PANEL_COLOR);
+      canvas.text(x + 2, y + 2, fmt::format("{:8.2f}", grid.values[i]),
+                  i < grid.foreground.size() ? grid.foreground[i]
+                                             : TEXT_COLOR);
+    }
+  }
+}
+
+// --- SVG ---
+
+std::string svg_color(uint32_t color) {
+  return fmt::format("#{:06x}", color & 0xFFFFFF);
+}
+
+void svg_escape(std::string &out, std::string_view s) {
+  for (const char c : s) {
+    switch (c) {
+    case '&':
+      out += "&amp;";
+      break;
+    case '<':
+      out += "&lt;";
+      break;
+    case '>':
+      out += "&gt;";
+      break;
+    default:
+      out += c;
+    }
+  }
+}
+
+void svg_text(std::string &out, int x, int y, std::string_view s,
+              uint32_t color, const char *anchor = "start") {
+  out += fmt::format("<text x=\"{}\" y=\"{}\" fill=\"{}\" text-anchor=\"{}\">",
+                     x, y + GLYPH_HEIGHT - 1, svg_color(color), anchor);
+  svg_escape(out, s);
+  out += "</text>\n";
+}
+
+std::string svg_panel(const PanelSlot &slot) {
+  const ReportPlot &plot = *slot.plot;
+  const PlotGeometry g = plot_geometry(slot);
+  std::string out;
+  out += fmt::format(
+      "<g><rect x=\"{}\" y=\"{}\" width=\"{}\" height=\"{}\" fill=\"{}\"/>\n",
+      slot.x, slot.y, slot.width, slot.height, svg_color(PANEL_COLOR));
+  svg_text(out, slot.x + PLOT_SIDE, slot.y + 2, plot.title, TEXT_COLOR);
+  svg_text(out, slot.x + slot.width - PLOT_SIDE, slot.y + 2,
+           number(g.y_lo) + ".." + number(g.y_hi), DIM_COLOR, "end");
+  const int label_y = slot.y + slot.height - GLYPH_HEIGHT;
+  svg_text(out, slot.x + PLOT_SIDE, label_y, number(g.x_lo), DIM_COLOR);
+  svg_text(out, slot.x + slot.width - PLOT_SIDE, label_y,
+           number(g.x_hi) + " " + slot.section->x_unit, DIM_COLOR, "end");
+
+  if (!plot.x.empty()) {
+    if (is_finite(plot.marker_x) && plot.marker_x >= g.x_lo &&
+        plot.marker_x <= g.x_hi) {
+      out += fmt::format("<line x1=\"{0:.1f}\" y1=\"{1}\" x2=\"{0:.1f}\" "
+                         "y2=\"{2}\" stroke=\"{3}\"/>\n",
+                         g.px(plot.marker_x), g.top, g.top + g.height - 1,
+                         svg_color(MARKER_COLOR));
+    }
+    for (size_t b = 0; b < plot.bands.size(); ++b) {
+      const auto &band = plot.bands[b];
+      if (band.lo.size() != plot.x.size() || band.hi.size() != plot.x.size())
+        continue;
+      // One closed subpath per run of finite points; a non-finite hi or lo
+      // leaves a gap, as in the PNG.
+      auto finite = [&](size_t i) {
+        return is_finite(band.hi[i]) && is_finite(band.lo[i]);
+      };
+      std::string d;
+      for (size_t first = 0; first < plot.x.size();) {
+        if (!finite(first)) {
+          ++first;
+          continue;
+        }
+        size_t end = first + 1;
+        while (end < plot.x.size() && finite(end))
+          ++end;
+        for (size_t i = first; i < end; ++i) {
+          d += fmt::format("{}{:.1f},{:.1f}", i == first ? 'M' : 'L',
+                           g.px(plot.x[i]), g.py(band.hi[i]));
+        }
+        for (size_t i = end; i-- > first;) {
+          d += fmt::format("L{:.1f},{:.1f}", g.px(plot.x[i]),
+                           g.py(band.lo[i]));
+        }
+        d += 'Z';
+        first = end;
+      }
+      if (!d.empty())
+        out += fmt::format("<path d=\"{}\" fill=\"{}\"/>\n", d,
+                           svg_color(band_color(b, plot.bands.size())));
+    }
+    if (plot.mean.size() == plot.x.size()) {
+      // Broken at non-finite points rather than bridged across them.
+      std::string d;
+      for (size_t i = 0; i < plot.x.size(); ++i) {
+        if (!is_finite(plot.mean[i]))
+          continue;
+        const bool joined = i > 0 && is_finite(plot.mean[i - 1]);
+        d += fmt::format("{}{:.1f},{:.1f}", joined ? 'L' : 'M',
+                         g.px(plot.x[i]), g.py(plot.mean[i]));
+      }
+      if (!d.empty())
+        out += fmt::format("<path d=\"{}\" fill=\"none\" stroke=\"{}\" "
+                           "stroke-width=\"1\"/>\n",
+                           d, svg_color(MEAN_COLOR));
+    }
+  }
+  out += "</g>\n";
+  return out;
+}
+
+void svg_grid(std::string &out, const GridSlot &slot) {
+  const ReportGrid &grid = *slot.grid;
+  const int columns = std::max(1, grid.columns);
+  for (int col = 0; col < columns; ++col) {
+    svg_text(out,
+             slot.x + GRID_LABEL_WIDTH + (col + 1) * GRID_CELL_WIDTH - 4,
+             slot.y + 2, std::string(1, static_cast<char>('A' + col % 26)),
+             DIM_COLOR, "end");
+  }
+  for (int row = 0; row < slot.rows; ++row) {
+    const int y = slot.y + (row + 1) * GRID_CELL_HEIGHT;
+    svg_text(out, slot.x, y + 2, fmt::format("{:5}", row * columns),
+             DIM_COLOR);
+    for (int col = 0; col < columns; ++col) {
+      const size_t i = static_cast<size_t>(row) * columns + col;
+      if (i >= grid.values.size())
+        break;
+      const int x = slot.x + GRID_LABEL_WIDTH + col * GRID_CELL_WIDTH;
+      out += fmt::format(
+          "<rect x=\"{}\" y=\"{}\" width=\"{}\" height=\"{}\" fill=\"{}\"/>\n",
+          x, y, GRID_CELL_WIDTH - 1, GRID_CELL_HEIGHT - 1,
+          svg_color(i < grid.background.size() ? grid.background[i]
+                                               : PANEL_COLOR));
+      svg_text(out, x + 2, y + 2, fmt::format("{:8.2f}", grid.values[i]),
+               i < grid.foreground.size() ? grid.foreground[i] : TEXT_COLOR);
+    }
+  }
+}
+
+unsigned thread_count(const ReportOptions &options) {
+  if (options.threads > 0)
+    return options.threads;
+  return std::max(1u, std::thread::hardware_concurrency());
+}
+
+bool write_text_file(const std::string &path, const std::string &text) {
+  const std::string tmp_path = path + ".tmp";
+  {
+    std::ofstream out(tmp_path, std::ios::trunc);
+    out << text;
+    if (!out) {
+      SPDLOG_ERROR("Failed to write {}.", tmp_path);
+      return false;
+    }
+  }
+  if (std::rename(tmp_path.c_str(), path.c_str()) != 0) {
+    SPDLOG_ERROR("Failed to rename {} to {}: {}", tmp_path, path,
+                 std::strerror(errno));
+    return false;
+  }
+  return true;
+}
+
+} // namespace
+
+bool write_report_png(const Report &report, const std::string &path,
+                      const ReportOptions &options) {
+  const Layout layout = make_layout(report, options);
+  std::vector<uint8_t> rgb(static_cast<size_t>(layout.width) * layout.height *
+                           3);
+  Canvas page(rgb.data(), layout.width, 0, 0, layout.width, layout.height);
+  page.fill(0, 0, layout.width, layout.height, PAGE_COLOR);
+  page.text(MARGIN, MARGIN, report.title, TEXT_COLOR, 2);
+  for (const auto &header : layout.headers)
+    page.text(MARGIN, header.y + 4, header.text, TEXT_COLOR);
+  for (const auto &grid : layout.grids)
+    draw_grid(page, grid);
+
+  // Panels own disjoint rectangles of the image.
+  parallel_for(layout.panels.size(), thread_count(options), [&](size_t i) {
+    const auto &slot = layout.panels[i];
+    Canvas canvas(rgb.data(), layout.width, slot.x, slot.y,
+                  slot.x + slot.width, slot.y + slot.height);
+    draw_panel(canvas, slot);
+  });
+  return write_png(path, rgb.data(), layout.width, layout.height,
+                   thread_count(options));
+}
+
+bool write_report_svg(const Report &report, const std::string &path,
+                      const ReportOptions &options) {
+  const Layout layout = make_layout(report, options);
+  std::vector<std::string> panels(layout.panels.size());
+  parallel_for(layout.panels.size(), thread_count(options),
+               [&](size_t i) { panels[i] = svg_panel(layout.panels[i]); });
+
+  std::string out = fmt::format(
+      "<svg xmlns=\"http://www.w3.org/2000/svg\" width=\"{0}\" "
+      "height=\"{1}\" viewBox=\"0 0 {0} {1}\">\n"
+      "<style>text {{ font: 9px monospace; white-space: pre; }}</style>\n"
+      "<rect width=\"100%\" height=\"100%\" fill=\"{2}\"/>\n",
+      layout.width, layout.height, svg_color(PAGE_COLOR));
+  out += fmt::format("<text x=\"{}\" y=\"{}\" fill=\"{}\" "
+                     "style=\"font-size: 16px\">",
+                     MARGIN, MARGIN + 14, svg_color(TEXT_COLOR));
+  svg_escape(out, report.title);
+  out += "</text>\n";
+  for (const auto &header : layout.headers)
+    svg_text(out, MARGIN, header.y + 4, header.text, TEXT_COLOR);
+  for (const auto &panel : panels)
+    out += panel;
+  for (const auto &grid : layout.grids)
+    svg_grid(out, grid);
+  out += "</svg>\n";
+  return write_text_file(path, out);
+}
+
+bool write_report(const Report &report, const std::string &prefix,
+                  const ReportOptions &options) {
+  const bool png = write_report_png(report, prefix + ".png", options);
+  const bool svg = write_report_svg(report, prefix + ".svg", options);
+  return png && svg;
+}
+
+// --- ReportWriter ---
+
+ReportWriter::ReportWriter(ReportOptions options, int avoid_cpu)
+    : options_(options), avoid_cpu_(avoid_cpu) {
+  writer_ = std::thread(&ReportWriter::run_writer, this);
+}
+
+ReportWriter::~ReportWriter() { close(); }
+
+void ReportWriter::submit(Report report, std::string prefix) {
+  {
+    std::lock_guard lock(mutex_);
+    if (stop_ || queue_.size() >= MAX_QUEUED) {
+      ++stats_.skipped;
+      SPDLOG_WARN("Report {} skipped: {} reports are still being written.",
+                  prefix, queue_.size());
+      return;
+    }
+    queue_.emplace_back(std::move(report), std::move(prefix));
+  }
+  wake_.notify_one();
+}
+
+void ReportWriter::close() {
+  {
+    std::lock_guard lock(mutex_);
+    stop_ = true;
+  }
+  wake_.notify_one();
+  if (writer_.joinable())
+    writer_.join();
+}
+
+ReportWriter::Stats ReportWriter::stats() const {
+  std::lock_guard lock(mutex_);
+  return stats_;
+}
+
+void ReportWriter::run_writer() {
+  // Idle priority and off the measurement core; the render threads started
+  // by parallel_for inherit both.
+  const sched_param param{};
+  if (pthread_setschedparam(pthread_self(), SCHED_IDLE, &param) != 0)
+    SPDLOG_DEBUG("The report writer could not switch to SCHED_IDLE.");
+  if (avoid_cpu_ >= 0) {
+    cpu_set_t cpuset;
+    if (pthread_getaffinity_np(pthread_self(), sizeof(cpuset), &cpuset) ==
+            0 &&
+        CPU_ISSET(avoid_cpu_, &cpuset) && CPU_COUNT(&cpuset) > 1) {
+      CPU_CLR(avoid_cpu_, &cpuset);
+      pthread_setaffinity_np(pthread_self(), sizeof(cpuset), &cpuset);
+    }
+  }
+
+  while (true) {
+    std::pair<Report, std::string> job;
+    {
+      std::unique_lock lock(mutex_);
+      wake_.wait(lock, [this] { return stop_ || !queue_.empty(); });
+      if (queue_.empty())
+        return; // Stopped and drained
+      job = std::move(queue_.front());
+      queue_.pop_front();
+    }
+    const auto start = std::chrono::steady_clock::now();
+    const bool ok = write_report(job.first, job.second, options_);
+    {
+      std::lock_guard lock(mutex_);
+      ++(ok ? stats_.written : stats_.failed);
+    }
+    if (ok)
+      SPDLOG_INFO("Report written to {}.png/.svg in {} ms.", job.second,
+                  std::chrono::duration_cast<std::chrono::milliseconds>(
+                      std::chrono::steady_clock::now() - start)
+                      .count());
+  }
+}
+
+// --- SeriesDecimator ---
+
+SeriesDecimator::SeriesDecimator(std::vector<int> cells, size_t max_buckets,
+                                 uint64_t initial_bucket_ns)
+    : cells_(std::move(cells)), max_buckets_(std::max<size_t>(2, max_buckets)),
+      initial_bucket_ns_(std::max<uint64_t>(1, initial_bucket_ns)),
+      bucket_ns_(initial_bucket_ns_) {
+  buckets_.reserve(max_buckets_ * cells_.size());
+}
+
+void SeriesDecimator::add(uint64_t t_ns, const float *table) {
+  if (n_buckets_ == 0)
+    t0_ns_ = t_ns;
+  const uint64_t dt = t_ns > t0_ns_ ? t_ns - t0_ns_ : 0;
+  while (dt / bucket_ns_ >= max_buckets_)
+    halve();
+  const size_t b = static_cast<size_t>(dt / bucket_ns_);
+  const size_t n = cells_.size();
+  if (b >= n_buckets_) {
+    n_buckets_ = b + 1;
+    buckets_.resize(n_buckets_ * n,
+                    {std::numeric_limits<float>::max(),
+                     std::numeric_limits<float>::lowest(), 0.0, 0});
+  }
+  Bucket *row = &buckets_[b * n];
+  for (size_t k = 0; k < n; ++k) {
+    const float v = table[cells_[k]];
+    row[k].min = std::min(row[k].min, v);
+    row[k].max = std::max(row[k].max, v);
+    row[k].sum += v;
+    ++row[k].count;
+  }
+}
+
+void SeriesDecimator::halve() {
+  const size_t n = cells_.size();
+  const size_t halved = (n_buckets_ + 1) / 2;
+  for (size_t b = 0; b < halved; ++b) {
+    for (size_t k = 0; k < n; ++k) {
+      Bucket merged = buckets_[2 * b * n + k];
+      if (2 * b + 1 < n_buckets_) {
+        const Bucket &next = buckets_[(2 * b + 1) * n + k];
+        merged.min = std::min(merged.min, next.min);
+        merged.max = std::max(merged.max, next.max);
+        merged.sum += next.sum;
+        merged.count += next.count;
+      }
+      buckets_[b * n + k] = merged;
+    }
+  }
+  n_buckets_ = halved;
+  buckets_.resize(n_buckets_ * n);
+  bucket_ns_ *= 2;
+}
+
+void SeriesDecimator::clear() {
+  buckets_.clear();
+  n_buckets_ = 0;
+  bucket_ns_ = initial_bucket_ns_;
+}
+
+ReportPlot SeriesDecimator::plot(size_t k, std::string title) const {
+  ReportPlot plot;
+  plot.title = std::move(title);
+  plot.bands.resize(1);
+  const size_t n = cells_.size();
+  for (size_t b = 0; b < n_buckets_; ++b) {
+    const Bucket &bucket = buckets_[b * n + k];
+    if (bucket.count == 0)
+      continue;
+    plot.x.push_back(static_cast<float>((b + 0.5) * bucket_ns_ / 1e9));
+    plot.mean.push_back(static_cast<float>(bucket.sum / bucket.count));
+    plot.bands[0].lo.push_back(bucket.min);
+    plot.bands[0].hi.push_back(bucket.max);
+  }
+  return plot;
+}
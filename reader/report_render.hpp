@@ -0,0 +1,171 @@
+/**
+ * @file report_render.hpp
+ * @brief Headless PNG and SVG reports: grids of mini-plots (eye diagrams,
+ * sensor time series) and colored cell grids (correlations), no OpenGL.
+ *
+ * A Report is plain data; write_report_png() rasterizes it in software
+ * (panels in parallel, PNG via png_encoder.hpp) and write_report_svg()
+ * emits the same layout as vector graphics. Labels use a built-in 5x7
+ * font, upper case only.
+ */
+
+#pragma once
+#include <cmath>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+/**
+ * @struct ReportPlot
+ * @brief One mini-plot: a mean line over shaded bands, e.g. min..max,
+ * p10..p90 and p25..p75 of an eye diagram.
+ */
+struct ReportPlot {
+  struct Band {
+    std::vector<float> lo, hi; ///< One value per x
+  };
+
+  std::string title;
+  std::vector<float> x; ///< Ascending
+  std::vector<float> mean;
+  std::vector<Band> bands; ///< Outermost first, inner bands brighter
+  float marker_x = NAN;    ///< Vertical line, e.g. the rising edge
+};
+
+/** @brief A titled grid of mini-plots sharing an x unit. */
+struct ReportSection {
+  std::string title;
+  std::string x_unit;
+  std::vector<ReportPlot> plots;
+};
+
+/**
+ * @struct ReportGrid
+ * @brief Values in fixed columns on per-cell colors, as pm_monitor's
+ * correlation grid (columns labelled A, B, ...; rows by first index).
+ */
+struct ReportGrid {
+  std::string title;
+  int columns = 16;
+  std::vector<float> values;
+  std::vector<uint32_t> background; ///< 0xRRGGBB per value
+  std::vector<uint32_t> foreground; ///< 0xRRGGBB per value
+};
+
+struct Report {
+  std::string title;
+  std::vector<ReportSection> sections;
+  std::vector<ReportGrid> grids; ///< Below the sections
+};
+
+struct ReportOptions {
+  int panel_width = 200; ///< Pixels per mini-plot
+  int panel_height = 120;
+  int panels_per_row = 8;
+  unsigned threads = 0; ///< 0 = all hardware threads
+};
+
+/** @brief Rasterize @p report to a PNG file. */
+bool write_report_png(const Report &report, const std::string &path,
+                      const ReportOptions &options = {});
+
+/** @brief The same layout as SVG. */
+bool write_report_svg(const Report &report, const std::string &path,
+                      const ReportOptions &options = {});
+
+/** @brief Both, as `<prefix>.png` and `<prefix>.svg`. */
+bool write_report(const Report &report, const std::string &prefix,
+                  const ReportOptions &options = {});
+
+/**
+ * @class ReportWriter
+ * @brief Writes reports on a background thread, so a live experiment is not
+ * disturbed by rendering.
+ *
+ * The thread runs at SCHED_IDLE and is kept off @p avoid_cpu (the
+ * measurement core); the render threads it starts inherit both. submit()
+ * never blocks: the report is queued, and if MAX_QUEUED are already
+ * waiting it is skipped and counted.
+ */
+class ReportWriter {
+public:
+  struct Stats {
+    uint64_t written = 0;
+    uint64_t skipped = 0; ///< Queue full
+    uint64_t failed = 0;
+  };
+
+  static constexpr size_t MAX_QUEUED = 4;
+
+  /** @param avoid_cpu CPU the render threads must not use, or -1. */
+  explicit ReportWriter(ReportOptions options, int avoid_cpu = -1);
+  ~ReportWriter();
+
+  ReportWriter(const ReportWriter &) = delete;
+  ReportWriter &operator=(const ReportWriter &) = delete;
+
+  /** @brief Queue @p report for `<prefix>.png` and `<prefix>.svg`. */
+  void submit(Report report, std::string prefix);
+
+  /** @brief Write everything queued and stop the thread. */
+  void close();
+
+  Stats stats() const;
+
+private:
+  void run_writer();
+
+  ReportOptions options_;
+  int avoid_cpu_;
+  mutable std::mutex mutex_;
+  std::condition_variable wake_;
+  std::deque<std::pair<Report, std::string>> queue_;
+  bool stop_ = false;
+  Stats stats_;
+  std::thread writer_;
+};
+
+/**
+ * @class SeriesDecimator
+ * @brief Min/mean/max time series of selected cells in at most
+ * @p max_buckets buckets per cell. When the buckets are full, neighbours
+ * are merged and the bucket width doubles, so a run of any length fits in
+ * constant memory.
+ */
+class SeriesDecimator {
+public:
+  SeriesDecimator(std::vector<int> cells, size_t max_buckets = 512,
+                  uint64_t initial_bucket_ns = 100'000'000);
+
+  /** @brief Add one table (all cells) sampled at @p t_ns. */
+  void add(uint64_t t_ns, const float *table);
+
+  void clear();
+
+  const std::vector<int> &cells() const noexcept { return cells_; }
+
+  /** @brief Series @p k as a plot, x in seconds since the first sample. */
+  ReportPlot plot(size_t k, std::string title) const;
+
+private:
+  struct Bucket {
+    float min, max;
+    double sum;
+    uint32_t count;
+  };
+
+  void halve();
+
+  std::vector<int> cells_;
+  size_t max_buckets_;
+  uint64_t initial_bucket_ns_;
+  uint64_t bucket_ns_;
+  uint64_t t0_ns_ = 0;
+  size_t n_buckets_ = 0;
+  std::vector<Bucket> buckets_; ///< [bucket][cell]
+};
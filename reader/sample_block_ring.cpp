@@ -0,0 +1,94 @@
+/**
+ * @file sample_block_ring.cpp
+ * @brief SampleBlockRing implementation.
+ */
+
+#include "sample_block_ring.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <spdlog/spdlog.h>
+
+namespace {
+
+size_t block_bytes(uint32_t block_samples, uint32_t sample_bytes) {
+  return static_cast<size_t>(block_samples) * (8 + sample_bytes);
+}
+
+} // namespace
+
+SampleBlockRing::SampleBlockRing(uint32_t sample_bytes, uint32_t block_samples,
+                                 size_t n_blocks)
+    : sample_bytes_{sample_bytes},
+      block_samples_{std::max<uint32_t>(block_samples, 1)},
+      n_blocks_{std::max<size_t>(n_blocks, 2)},
+      arena_{block_bytes(block_samples_, sample_bytes) * n_blocks_} {
+  if (!arena_) {
+    SPDLOG_ERROR("Failed to allocate {} sample blocks of {} samples.",
+                 n_blocks_, block_samples_);
+    return;
+  }
+  // Touch every page now so the sampling thread never takes a page fault.
+  std::memset(arena_.data(), 0, arena_.size());
+  slots_ = std::make_unique<Slot[]>(n_blocks_);
+  auto *base = static_cast<char *>(arena_.data());
+  const size_t per_block = block_bytes(block_samples_, sample_bytes);
+  for (size_t i = 0; i < n_blocks_; ++i) {
+    char *block = base + i * per_block;
+    slots_[i].timestamps = reinterpret_cast<uint64_t *>(block);
+    slots_[i].words = reinterpret_cast<uint32_t *>(
+        block + static_cast<size_t>(block_samples_) * 8);
+  }
+}
+
+bool SampleBlockRing::push(uint64_t timestamp_ns, const void *blob) noexcept {
+  if (!slots_)
+    return false;
+  Slot &slot = slots_[fill_];
+  if (slot.state.load(std::memory_order_acquire) != FREE) {
+    dropped_.fetch_add(1, std::memory_order_relaxed);
+    if (!in_stall_) {
+      stalls_.fetch_add(1, std::memory_order_relaxed);
+      in_stall_ = true;
+    }
+    return false;
+  }
+  in_stall_ = false;
+
+  slot.timestamps[slot.n] = timestamp_ns;
+  std::memcpy(slot.words + static_cast<size_t>(slot.n) * (sample_bytes_ / 4),
+              blob, sample_bytes_);
+  records_.fetch_add(1, std::memory_order_relaxed);
+  if (++slot.n == block_samples_) {
+    slot.state.store(READY, std::memory_order_release);
+    fill_ = (fill_ + 1) % n_blocks_;
+  }
+  return true;
+}
+
+void SampleBlockRing::seal() noexcept {
+  if (!slots_)
+    return;
+  Slot &slot = slots_[fill_];
+  if (slot.n > 0 && slot.state.load(std::memory_order_acquire) == FREE) {
+    slot.state.store(READY, std::memory_order_release);
+    fill_ = (fill_ + 1) % n_blocks_;
+  }
+}
+
+bool SampleBlockRing::front(Block &block) const noexcept {
+  if (!slots_)
+    return false;
+  const Slot &slot = slots_[drain_];
+  if (slot.state.load(std::memory_order_acquire) != READY)
+    return false;
+  block = {slot.timestamps, slot.words, slot.n};
+  return true;
+}
+
+void SampleBlockRing::pop() noexcept {
+  Slot &slot = slots_[drain_];
+  slot.n = 0;
+  slot.state.store(FREE, std::memory_order_release);
+  drain_ = (drain_ + 1) % n_blocks_;
+}
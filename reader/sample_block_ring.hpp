@@ -0,0 +1,118 @@
+/**
+ * @file sample_block_ring.hpp
+ * @brief Preallocated ring of fixed-size sample blocks between the sampling
+ * thread and a background encoder/writer thread.
+ */
+
+#pragma once
+#include "locked_buffer.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <thread>
+#include <utility>
+
+/**
+ * @class SampleBlockRing
+ * @brief Single-producer, single-consumer ring of row-major sample blocks.
+ *
+ * The producer copies each sample into the current block; a full block is
+ * handed to the consumer as a whole. push() never blocks, allocates or takes
+ * a page fault: when all blocks are still waiting for the consumer the
+ * sample is dropped and counted.
+ */
+class SampleBlockRing {
+public:
+  /** @brief A READY block as seen by the consumer. */
+  struct Block {
+    const uint64_t *timestamps;
+    const uint32_t *words; ///< n rows of sample_bytes / 4 words
+    uint32_t n;
+  };
+
+  SampleBlockRing(uint32_t sample_bytes, uint32_t block_samples,
+                  size_t n_blocks);
+
+  explicit operator bool() const noexcept { return static_cast<bool>(arena_); }
+  bool locked() const noexcept { return arena_.locked(); }
+  uint32_t sample_bytes() const { return sample_bytes_; }
+  uint32_t block_samples() const { return block_samples_; }
+  size_t n_blocks() const { return n_blocks_; }
+
+  /** @brief Producer: copy one sample in. False if dropped. */
+  bool push(uint64_t timestamp_ns, const void *blob) noexcept;
+
+  /** @brief Producer: hand over the partially filled block (at shutdown). */
+  void seal() noexcept;
+
+  /** @brief Consumer: the oldest READY block, or false if none. */
+  bool front(Block &block) const noexcept;
+
+  /** @brief Consumer: release the block returned by front(). */
+  void pop() noexcept;
+
+  /**
+   * @brief Consumer loop: process(block) and pop every READY block until
+   * @p stop is set and the ring is empty. When no block is ready, idle() is
+   * called and the thread sleeps for POLL_INTERVAL.
+   *
+   * The producer must seal() before it sets @p stop (with release order).
+   */
+  template <typename Process, typename Idle>
+  void drain(const std::atomic<bool> &stop, Process &&process, Idle &&idle) {
+    Block block{};
+    while (true) {
+      // Read stop before front(): the last block is sealed before stop is
+      // set, so a stop seen here guarantees that block is visible to front().
+      const bool stopping = stop.load(std::memory_order_acquire);
+      if (!front(block)) {
+        if (stopping)
+          return;
+        idle();
+        std::this_thread::sleep_for(POLL_INTERVAL);
+        continue;
+      }
+      process(block);
+      pop();
+    }
+  }
+
+  template <typename Process>
+  void drain(const std::atomic<bool> &stop, Process &&process) {
+    drain(stop, std::forward<Process>(process), [] {});
+  }
+
+  uint64_t records() const { return records_.load(std::memory_order_relaxed); }
+  uint64_t dropped() const { return dropped_.load(std::memory_order_relaxed); }
+  uint64_t stalls() const { return stalls_.load(std::memory_order_relaxed); }
+
+  /// drain()'s sleep when no block is ready.
+  static constexpr auto POLL_INTERVAL = std::chrono::milliseconds(5);
+
+private:
+  enum SlotState : uint32_t { FREE, READY };
+
+  struct Slot {
+    std::atomic<uint32_t> state{FREE};
+    uint32_t n = 0;
+    uint64_t *timestamps = nullptr;
+    uint32_t *words = nullptr;
+  };
+
+  uint32_t sample_bytes_;
+  uint32_t block_samples_;
+  size_t n_blocks_;
+  LockedBuffer arena_;
+  std::unique_ptr<Slot[]> slots_;
+
+  size_t fill_ = 0;  ///< Producer-owned
+  bool in_stall_ = false;
+  size_t drain_ = 0; ///< Consumer-owned
+
+  std::atomic<uint64_t> records_{0};
+  std::atomic<uint64_t> dropped_{0};
+  std::atomic<uint64_t> stalls_{0};
+};
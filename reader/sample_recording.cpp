@@ -0,0 +1,256 @@
+/**
+ * @file sample_recording.cpp
+ * @brief SampleRecorder writer thread and SampleReplay pacing.
+ */
+
+#include "sample_recording.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <fcntl.h>
+#include <spdlog/spdlog.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace std::chrono_literals;
+
+namespace {
+
+/// Replay paces in slices this long instead of sleeping per sample.
+constexpr auto PACE_SLICE = 2ms;
+
+} // namespace
+
+SampleRecorder::SampleRecorder(const std::string &path, uint32_t n_floats,
+                               uint32_t pm_table_version, Config config)
+    : path_{path}, n_floats_{n_floats},
+      ring_{static_cast<uint32_t>(4 * (HEADER_WORDS + n_floats)),
+            config.block_samples, config.n_blocks},
+      row_(HEADER_WORDS + n_floats) {
+  if (!ring_ || n_floats == 0 || n_floats > PM_TABLE_MAX_FLOATS)
+    return;
+  buffer_.resize(size_t{ring_.block_samples()} * (8 + ring_.sample_bytes()));
+  fd_ = ::open(path_.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  if (fd_ < 0) {
+    SPDLOG_ERROR("Failed to open {}: {}", path_, std::strerror(errno));
+    return;
+  }
+  SampleRecordingHeader header{};
+  std::memcpy(header.magic, SAMPLE_RECORDING_MAGIC, 4);
+  header.format_version = SAMPLE_RECORDING_FORMAT_VERSION;
+  header.n_floats = n_floats;
+  header.pm_table_version = pm_table_version;
+  header.record_bytes = 8 + ring_.sample_bytes();
+  if (!write_all(reinterpret_cast<const char *>(&header), sizeof(header))) {
+    ::close(fd_);
+    fd_ = -1;
+    return;
+  }
+  SPDLOG_INFO("Recording samples to {} ({} floats, {} slots of {} "
+              "samples{}).",
+              path_, n_floats, ring_.n_blocks(), ring_.block_samples(),
+              ring_.locked() ? ", locked" : "");
+  writer_ = std::thread(&SampleRecorder::run_writer, this);
+}
+
+SampleRecorder::~SampleRecorder() { close(); }
+
+bool SampleRecorder::append(const RawSample &sample, int core) noexcept {
+  if (closed_ || !*this)
+    return false;
+  row_[0] = std::bit_cast<uint32_t>(core);
+  row_[1] = std::bit_cast<uint32_t>(sample.worker_state);
+  row_[2] = std::bit_cast<uint32_t>(sample.marker);
+  row_[3] = static_cast<uint32_t>(sample.work_count);
+  row_[4] = static_cast<uint32_t>(sample.work_count >> 32);
+  const size_t n = std::min<size_t>(sample.num_measurements, n_floats_);
+  std::memcpy(row_.data() + HEADER_WORDS, sample.measurements.data(),
+              n * sizeof(float));
+  std::fill(row_.begin() + HEADER_WORDS + static_cast<std::ptrdiff_t>(n),
+            row_.end(), 0u);
+  return ring_.push(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                        sample.timestamp.time_since_epoch())
+                        .count(),
+                    row_.data());
+}
+
+void SampleRecorder::close() {
+  if (closed_)
+    return;
+  closed_ = true;
+  ring_.seal();
+  stop_.store(true, std::memory_order_release);
+  if (writer_.joinable())
+    writer_.join();
+  if (fd_ >= 0) {
+    ::close(fd_);
+    fd_ = -1;
+  }
+}
+
+SampleRecorder::Stats SampleRecorder::stats() const {
+  Stats s;
+  s.records = ring_.records();
+  s.dropped_records = ring_.dropped();
+  s.stalls = ring_.stalls();
+  s.bytes = bytes_.load(std::memory_order_relaxed);
+  s.lost_records = lost_.load(std::memory_order_relaxed);
+  s.failed = failed_.load(std::memory_order_relaxed);
+  return s;
+}
+
+bool SampleRecorder::write_all(const char *data, size_t size) {
+  size_t done = 0;
+  while (done < size) {
+    const ssize_t n = ::write(fd_, data + done, size - done);
+    if (n < 0) {
+      if (errno == EINTR)
+        continue;
+      SPDLOG_ERROR("Recording write to {} failed, no further samples are "
+                   "written: {}",
+                   path_, std::strerror(errno));
+      return false;
+    }
+    done += static_cast<size_t>(n);
+  }
+  bytes_.fetch_add(size, std::memory_order_relaxed);
+  return true;
+}
+
+/**
+ * @brief Interleave each block's timestamps with its rows and write it.
+ */
+void SampleRecorder::run_writer() {
+  const size_t row_bytes = ring_.sample_bytes();
+  ring_.drain(stop_, [&](const SampleBlockRing::Block &block) {
+    if (failed_.load(std::memory_order_relaxed)) {
+      lost_.fetch_add(block.n, std::memory_order_relaxed);
+      return;
+    }
+    char *out = buffer_.data();
+    for (uint32_t r = 0; r < block.n; ++r) {
+      std::memcpy(out, &block.timestamps[r], 8);
+      std::memcpy(out + 8, block.words + r * (row_bytes / 4), row_bytes);
+      out += 8 + row_bytes;
+    }
+    // A partly written block may end mid-record; count all of it as lost
+    // and stop, rather than continue after a gap. The ring is still
+    // drained so the rest of the run is counted too.
+    if (!write_all(buffer_.data(), static_cast<size_t>(out - buffer_.data()))) {
+      lost_.fetch_add(block.n, std::memory_order_relaxed);
+      failed_.store(true, std::memory_order_relaxed);
+    }
+  });
+}
+
+SampleReplay::SampleReplay(const std::string &path, double speed)
+    : path_{path}, speed_{speed} {
+  const int fd = ::open(path_.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    SPDLOG_ERROR("Failed to open {}: {}", path_, std::strerror(errno));
+    return;
+  }
+  struct stat st{};
+  if (::fstat(fd, &st) != 0 ||
+      static_cast<size_t>(st.st_size) < sizeof(header_) ||
+      ::pread(fd, &header_, sizeof(header_), 0) !=
+          static_cast<ssize_t>(sizeof(header_)) ||
+      std::memcmp(header_.magic, SAMPLE_RECORDING_MAGIC, 4) != 0 ||
+      header_.format_version != SAMPLE_RECORDING_FORMAT_VERSION ||
+      header_.n_floats == 0 || header_.n_floats > PM_TABLE_MAX_FLOATS ||
+      header_.record_bytes !=
+          8 + 4 * (SAMPLE_RECORD_HEADER_WORDS + header_.n_floats)) {
+    SPDLOG_ERROR("{} is not a pm_measure sample recording.", path_);
+    ::close(fd);
+    return;
+  }
+  map_bytes_ = static_cast<size_t>(st.st_size);
+  void *map = ::mmap(nullptr, map_bytes_, PROT_READ, MAP_PRIVATE, fd, 0);
+  ::close(fd);
+  if (map == MAP_FAILED) {
+    SPDLOG_ERROR("Failed to map {}: {}", path_, std::strerror(errno));
+    return;
+  }
+  base_ = static_cast<const char *>(map);
+  ::madvise(map, map_bytes_, MADV_SEQUENTIAL);
+  // A truncated last record (crash while recording) is ignored.
+  records_ = (map_bytes_ - sizeof(header_)) / header_.record_bytes;
+  SPDLOG_INFO("Replaying {}: {} samples of {} floats (version {:#x}), {}.",
+              path_, records_, header_.n_floats, header_.pm_table_version,
+              speed_ > 0 ? fmt::format("{}x real time", speed_)
+                         : std::string("as fast as possible"));
+}
+
+SampleReplay::~SampleReplay() {
+  if (base_)
+    ::munmap(const_cast<char *>(base_), map_bytes_);
+}
+
+bool SampleReplay::read(uint64_t i, RawSample &sample) const {
+  if (!base_ || i >= records_)
+    return false;
+  const char *record = base_ + sizeof(header_) + i * header_.record_bytes;
+  uint64_t timestamp_ns = 0;
+  uint32_t words[SAMPLE_RECORD_HEADER_WORDS];
+  std::memcpy(&timestamp_ns, record, 8);
+  std::memcpy(words, record + 8, sizeof(words));
+  sample.timestamp = TimePoint(std::chrono::nanoseconds(timestamp_ns));
+  sample.core = std::bit_cast<int32_t>(words[0]);
+  sample.worker_state = std::bit_cast<int32_t>(words[1]);
+  sample.marker = std::bit_cast<int32_t>(words[2]);
+  sample.work_count = words[3] | uint64_t{words[4]} << 32;
+  std::memcpy(sample.measurements.data(), record + 8 + sizeof(words),
+              header_.n_floats * sizeof(float));
+  sample.num_measurements = header_.n_floats;
+  return true;
+}
+
+/**
+ * @brief With a speed, sample i is released at start + (t_i - t_0) / speed;
+ * otherwise the only limit is the queue (the processing thread).
+ */
+void SampleReplay::run(folly::ProducerConsumerQueue<RawSample> &queue,
+                       const std::atomic<bool> &stop) {
+  RawSample sample;
+  const auto start = Clock::now();
+  uint64_t first_ns = 0, last_ns = 0;
+  uint64_t i = 0;
+  for (; i < records_ && !stop.load(std::memory_order_relaxed); ++i) {
+    read(i, sample);
+    const auto recorded = static_cast<uint64_t>(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(
+            sample.timestamp.time_since_epoch())
+            .count());
+    if (i == 0)
+      first_ns = recorded;
+    last_ns = recorded;
+    if (speed_ > 0) {
+      const auto due =
+          start + std::chrono::nanoseconds(static_cast<int64_t>(
+                      static_cast<double>(recorded - first_ns) / speed_));
+      if (due - Clock::now() > PACE_SLICE)
+        std::this_thread::sleep_until(due);
+    }
+    while (!queue.write(sample)) {
+      if (stop.load(std::memory_order_relaxed))
+        break;
+      std::this_thread::yield();
+    }
+  }
+  while (!queue.isEmpty() && !stop.load(std::memory_order_relaxed))
+    std::this_thread::yield();
+
+  stats_.samples = i;
+  stats_.seconds =
+      std::chrono::duration<double>(Clock::now() - start).count();
+  const double recorded_seconds = static_cast<double>(last_ns - first_ns) / 1e9;
+  SPDLOG_INFO("Replayed {} samples in {:.2f} s: {:.0f} samples/s ({:.1f}x "
+              "real time).",
+              stats_.samples, stats_.seconds,
+              stats_.seconds > 0 ? stats_.samples / stats_.seconds : 0.0,
+              stats_.seconds > 0 ? recorded_seconds / stats_.seconds : 0.0);
+}
@@ -0,0 +1,136 @@
+/**
+ * @file sample_recording.hpp
+ * @brief Record pm_measure's raw sample stream and replay it through the
+ * processing pipeline.
+ *
+ * A `.pmrs` file is a header followed by fixed-size records (see
+ * sample_recording_format.hpp). Every sample carries the worker state and
+ * the core under test, so worker transitions and core changes replay
+ * exactly. Recording runs on a writer thread behind a SampleBlockRing;
+ * replay maps the file and pushes RawSamples into the same SPSC queue the
+ * measurement thread feeds, either as fast as the processing thread takes
+ * them or at a multiple of real time.
+ */
+
+#pragma once
+#include "sample_block_ring.hpp"
+#include "sample_recording_format.hpp"
+#include "shared_data_types.hpp"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <thread>
+#include <vector>
+
+/**
+ * @class SampleRecorder
+ * @brief Single-producer .pmrs writer; append() never blocks.
+ */
+class SampleRecorder {
+public:
+  struct Config {
+    uint32_t block_samples = 250; ///< Ring block (hand-over granularity)
+    size_t n_blocks = 32;         ///< 8 s of backlog at 1 kHz
+  };
+
+  struct Stats {
+    uint64_t records = 0;
+    uint64_t dropped_records = 0;
+    uint64_t stalls = 0;
+    uint64_t bytes = 0;
+    /// Samples lost to a write error; after the first one nothing more is
+    /// written and the rest of the run counts here.
+    uint64_t lost_records = 0;
+    bool failed = false;
+  };
+
+  SampleRecorder(const std::string &path, uint32_t n_floats,
+                 uint32_t pm_table_version, Config config);
+  ~SampleRecorder();
+
+  SampleRecorder(const SampleRecorder &) = delete;
+  SampleRecorder &operator=(const SampleRecorder &) = delete;
+
+  explicit operator bool() const noexcept { return fd_ >= 0 && ring_; }
+
+  /**
+   * @brief Queue one sample. Producer thread only.
+   * @param core Core under test when the sample was taken.
+   */
+  bool append(const RawSample &sample, int core) noexcept;
+
+  /** @brief Write everything queued, then close. */
+  void close();
+
+  Stats stats() const;
+
+private:
+  static constexpr size_t HEADER_WORDS = SAMPLE_RECORD_HEADER_WORDS;
+
+  bool write_all(const char *data, size_t size);
+  void run_writer();
+
+  std::string path_;
+  uint32_t n_floats_;
+  SampleBlockRing ring_;
+  std::vector<uint32_t> row_; ///< Producer scratch: one ring row
+  std::vector<char> buffer_;  ///< Writer-owned: one block of records
+  int fd_ = -1;
+
+  std::atomic<uint64_t> bytes_{0};
+  std::atomic<uint64_t> lost_{0};
+  std::atomic<bool> failed_{false};
+  std::atomic<bool> stop_{false};
+  bool closed_ = false;
+  std::thread writer_;
+};
+
+/**
+ * @class SampleReplay
+ * @brief Read-only view of a .pmrs file that feeds the processing queue.
+ */
+class SampleReplay {
+public:
+  struct Stats {
+    uint64_t samples = 0;
+    double seconds = 0.0; ///< Until the processing thread took the last one
+  };
+
+  /**
+   * @param speed Multiple of real time; 0 replays as fast as possible.
+   */
+  SampleReplay(const std::string &path, double speed);
+  ~SampleReplay();
+
+  SampleReplay(const SampleReplay &) = delete;
+  SampleReplay &operator=(const SampleReplay &) = delete;
+
+  explicit operator bool() const noexcept { return base_ != nullptr; }
+
+  uint32_t n_floats() const { return header_.n_floats; }
+  uint32_t pm_table_version() const { return header_.pm_table_version; }
+  uint64_t records() const { return records_; }
+
+  /** @brief Decode record i (0-based) into sample. */
+  bool read(uint64_t i, RawSample &sample) const;
+
+  /**
+   * @brief Push every record into queue, oldest first; returns when the
+   * queue has been drained or stop is set. Logs the throughput.
+   */
+  void run(folly::ProducerConsumerQueue<RawSample> &queue,
+           const std::atomic<bool> &stop);
+
+  Stats stats() const { return stats_; }
+
+private:
+  std::string path_;
+  double speed_;
+  SampleRecordingHeader header_{};
+  const char *base_ = nullptr;
+  size_t map_bytes_ = 0;
+  uint64_t records_ = 0;
+  Stats stats_;
+};
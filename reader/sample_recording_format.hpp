@@ -0,0 +1,34 @@
+/**
+ * @file sample_recording_format.hpp
+ * @brief On-disk layout of pm_measure's .pmrs sample recordings, without
+ * the recorder's dependencies (for offline tools).
+ *
+ * A 64-byte SampleRecordingHeader is followed by record_bytes-sized records:
+ *
+ *   uint64 timestamp_ns (steady_clock), int32 core, int32 worker_state,
+ *   int32 marker, uint32 work_count_lo, uint32 work_count_hi,
+ *   float32 table[n_floats]
+ */
+
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+inline constexpr char SAMPLE_RECORDING_MAGIC[4] = {'P', 'M', 'R', 'S'};
+inline constexpr uint32_t SAMPLE_RECORDING_FORMAT_VERSION = 1;
+/// 32-bit words between the timestamp and the table.
+inline constexpr size_t SAMPLE_RECORD_HEADER_WORDS = 5;
+
+/**
+ * @struct SampleRecordingHeader
+ * @brief First 64 bytes of a .pmrs file.
+ */
+struct SampleRecordingHeader {
+  char magic[4];
+  uint32_t format_version;
+  uint32_t n_floats;
+  uint32_t pm_table_version;
+  uint32_t record_bytes;
+  uint32_t reserved[11];
+};
+static_assert(sizeof(SampleRecordingHeader) == 64);
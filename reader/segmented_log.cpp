@@ -0,0 +1,426 @@
+/**
+ * @file segmented_log.cpp
+ * @brief SegmentedLog: rotation, segment index, buffer budget, checkpoints.
+ */
+
+#include "segmented_log.hpp"
+#include "time_pyramid.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <filesystem>
+#include <pthread.h>
+#include <sched.h>
+#include <spdlog/spdlog.h>
+#include <utility>
+
+using namespace std::chrono_literals;
+
+namespace {
+
+constexpr auto SUPERVISOR_POLL = 100ms;
+constexpr auto HANDOFF_POLL = 1ms;
+/// Retry interval when the next segment cannot be opened (disk full, ...).
+constexpr auto OPEN_RETRY = 60s;
+
+/**
+ * @brief VmRSS and VmHWM of this process in KiB, 0 if unavailable.
+ */
+std::pair<uint64_t, uint64_t> resident_kib() {
+  std::ifstream status("/proc/self/status");
+  std::string line;
+  uint64_t rss = 0, peak = 0;
+  while (std::getline(status, line)) {
+    if (line.starts_with("VmRSS:"))
+      rss = std::strtoull(line.c_str() + 6, nullptr, 10);
+    else if (line.starts_with("VmHWM:"))
+      peak = std::strtoull(line.c_str() + 6, nullptr, 10);
+  }
+  return {rss, peak};
+}
+
+uint64_t unix_now_ns() {
+  return static_cast<uint64_t>(
+      std::chrono::duration_cast<std::chrono::nanoseconds>(
+          std::chrono::system_clock::now().time_since_epoch())
+          .count());
+}
+
+} // namespace
+
+SegmentedLog::SegmentedLog(const std::string &base_path,
+                           uint32_t sample_bytes, uint32_t pm_table_version,
+                           Config config)
+    : base_path_{base_path}, sample_bytes_{sample_bytes},
+      pm_table_version_{pm_table_version}, config_{config} {
+  const std::filesystem::path path(base_path);
+  extension_ = path.extension().string();
+  stem_ = base_path.substr(0, base_path.size() - extension_.size());
+  pmz_config_.encoder_core = config_.writer_core;
+  columnar_config_.writer_core = config_.writer_core;
+  if (!fit_budget())
+    return;
+
+  // Never overwrite the segments of an earlier run.
+  while (std::filesystem::exists(segment_path(first_number_)))
+    ++first_number_;
+  auto first = open_segment(first_number_);
+  if (!first)
+    return;
+  current_ = active_ = first.get();
+  segments_.push_back(std::move(first));
+  n_segments_.store(1, std::memory_order_relaxed);
+  write_index(false);
+
+  checkpoints_.open(base_path_ + ".checkpoints.jsonl", std::ios::app);
+  started_ = last_checkpoint_ = std::chrono::steady_clock::now();
+  SPDLOG_INFO("Soak mode: segments of {} MiB / {} min, writer buffers {} "
+              "MiB per segment, checkpoints every {} s.",
+              config_.max_segment_bytes >> 20,
+              config_.max_segment_age.count() / 60.0,
+              writer_memory_bytes_ >> 20,
+              config_.checkpoint_interval.count());
+  supervisor_ = std::thread(&SegmentedLog::run_supervisor, this);
+}
+
+SegmentedLog::~SegmentedLog() { close(); }
+
+std::string SegmentedLog::segment_path(uint64_t n) const {
+  char number[16];
+  std::snprintf(number, sizeof(number), ".%06llu",
+                static_cast<unsigned long long>(n));
+  return stem_ + number + extension_;
+}
+
+/**
+ * @brief Size the writers' buffers so two live segments fit the budget.
+ *
+ * Only the fixed, preallocated buffers count; they are the whole steady-state
+ * footprint of a segment, so staying inside them keeps memory flat however
+ * long the run is. The zoom levels go first, then the rings shrink to their
+ * minimum.
+ * @return false if the minimum still exceeds the budget.
+ */
+bool SegmentedLog::fit_budget() {
+  const size_t row = sample_bytes_ + 8;
+  const size_t per_segment = config_.memory_budget_bytes / 2;
+  switch (config_.format) {
+  case Format::Raw: {
+    if (per_segment)
+      raw_config_.n_blocks = std::clamp<size_t>(
+          per_segment / raw_config_.block_bytes, 4, raw_config_.n_blocks);
+    writer_memory_bytes_ = raw_config_.n_blocks * raw_config_.block_bytes;
+    break;
+  }
+  case Format::Pmz: {
+    const size_t slot = pmz_config_.block_samples * row;
+    // One extra slot for the encoder's block buffers.
+    if (per_segment)
+      pmz_config_.n_slots = std::clamp<size_t>(
+          per_segment / slot - std::min<size_t>(per_segment / slot, 1), 2,
+          pmz_config_.n_slots);
+    writer_memory_bytes_ = (pmz_config_.n_slots + 1) * slot;
+    break;
+  }
+  case Format::Columnar: {
+    const size_t block = columnar_config_.block_samples * row;
+    const size_t chunk = columnar_config_.chunk_samples * row;
+    const size_t pyramid = pyramid_chunk_bytes(sample_bytes_);
+    if (per_segment && chunk + pyramid + 2 * block > per_segment) {
+      SPDLOG_WARN("Memory budget too small for the zoom levels; recording "
+                  "without them.");
+      columnar_config_.pyramid = false;
+    }
+    const size_t fixed = chunk + (columnar_config_.pyramid ? pyramid : 0);
+    if (per_segment)
+      columnar_config_.n_blocks = std::clamp<size_t>(
+          (per_segment - std::min(per_segment, fixed)) / block, 2,
+          columnar_config_.n_blocks);
+    writer_memory_bytes_ = fixed + columnar_config_.n_blocks * block;
+    break;
+  }
+  }
+  if (config_.memory_budget_bytes &&
+      2 * writer_memory_bytes_ > config_.memory_budget_bytes) {
+    SPDLOG_ERROR("Writer buffers need at least {:.1f} MiB per segment, more "
+                 "than half of the {:.1f} MiB budget.",
+                 writer_memory_bytes_ / 1048576.0,
+                 config_.memory_budget_bytes / 1048576.0);
+    return false;
+  }
+  return true;
+}
+
+std::unique_ptr<SegmentedLog::Segment>
+SegmentedLog::open_segment(uint64_t number) const {
+  auto segment = std::make_unique<Segment>();
+  segment->number = number;
+  segment->path = segment_path(number);
+  segment->opened = std::chrono::steady_clock::now();
+  bool ok = false;
+  switch (config_.format) {
+  case Format::Raw:
+    segment->raw = std::make_unique<AsyncLogWriter>(segment->path, raw_config_);
+    ok = static_cast<bool>(*segment->raw);
+    break;
+  case Format::Pmz:
+    segment->pmz = std::make_unique<PmzLogWriter>(
+        segment->path, sample_bytes_, pm_table_version_, pmz_config_);
+    ok = static_cast<bool>(*segment->pmz);
+    break;
+  case Format::Columnar:
+    segment->columnar = std::make_unique<ColumnarLogWriter>(
+        segment->path, sample_bytes_, pm_table_version_, columnar_config_);
+    ok = static_cast<bool>(*segment->columnar);
+    break;
+  }
+  if (!ok) {
+    SPDLOG_ERROR("Failed to open segment {}.", segment->path);
+    return nullptr;
+  }
+  return segment;
+}
+
+bool SegmentedLog::append_record(uint64_t timestamp_ns, const void *blob,
+                                 uint64_t size) noexcept {
+  if (closed_ || !current_)
+    return false;
+  // A plain load on the hot path; the exchange only runs once per rotation.
+  if (handoff_.load(std::memory_order_relaxed) != nullptr)
+    current_ = handoff_.exchange(nullptr, std::memory_order_acq_rel);
+
+  Segment &segment = *current_;
+  if (segment.first_timestamp_ns.load(std::memory_order_relaxed) == 0)
+    segment.first_timestamp_ns.store(timestamp_ns, std::memory_order_relaxed);
+  segment.last_timestamp_ns.store(timestamp_ns, std::memory_order_relaxed);
+  if (segment.pmz)
+    return segment.pmz->append_record(timestamp_ns, blob, size);
+  if (segment.columnar)
+    return segment.columnar->append_record(timestamp_ns, blob, size);
+  return segment.raw->append_record(timestamp_ns, blob, size);
+}
+
+SegmentedLog::Stats SegmentedLog::segment_stats(const Segment &segment) {
+  Stats s;
+  if (segment.complete) {
+    s.records = segment.records;
+    s.dropped_records = segment.dropped_records;
+    s.stalls = segment.stalls;
+    s.file_bytes = segment.file_bytes;
+  } else if (segment.pmz) {
+    const auto w = segment.pmz->stats();
+    s.records = w.records;
+    s.dropped_records = w.dropped_records;
+    s.stalls = w.stalls;
+    s.file_bytes = w.file_bytes;
+  } else if (segment.columnar) {
+    const auto w = segment.columnar->stats();
+    s.records = w.records;
+    s.dropped_records = w.dropped_records;
+    s.stalls = w.stalls;
+    s.file_bytes = w.file_bytes;
+  } else if (segment.raw) {
+    const auto w = segment.raw->stats();
+    s.records = w.records;
+    s.dropped_records = w.dropped_records;
+    s.stalls = w.stalls;
+    s.file_bytes = w.written_bytes;
+  }
+  return s;
+}
+
+SegmentedLog::Stats SegmentedLog::totals(const Segment &live) const {
+  // Once retired, a segment's counters are part of the retired totals.
+  Stats s = live.complete ? Stats{} : segment_stats(live);
+  s.segments = n_segments_.load(std::memory_order_relaxed);
+  s.records += retired_records_.load(std::memory_order_relaxed);
+  s.dropped_records += retired_dropped_.load(std::memory_order_relaxed);
+  s.stalls += retired_stalls_.load(std::memory_order_relaxed);
+  s.file_bytes += retired_bytes_.load(std::memory_order_relaxed);
+  s.max_boundary_gap_ns = max_gap_ns_.load(std::memory_order_relaxed);
+  s.writer_memory_bytes = writer_memory_bytes_;
+  return s;
+}
+
+SegmentedLog::Stats SegmentedLog::stats() const {
+  return current_ ? totals(*current_) : Stats{};
+}
+
+/**
+ * @brief Drain and close a segment that the producer no longer writes to,
+ * keep its counters and release its buffers.
+ */
+void SegmentedLog::retire(Segment &segment) {
+  if (segment.complete)
+    return;
+  if (segment.pmz)
+    segment.pmz->close();
+  else if (segment.columnar)
+    segment.columnar->close();
+  else if (segment.raw)
+    segment.raw->close();
+  const Stats s = segment_stats(segment);
+  segment.records = s.records;
+  segment.dropped_records = s.dropped_records;
+  segment.stalls = s.stalls;
+  segment.file_bytes = s.file_bytes;
+  segment.complete = true;
+  segment.raw.reset();
+  segment.pmz.reset();
+  segment.columnar.reset();
+
+  retired_records_.fetch_add(s.records, std::memory_order_relaxed);
+  retired_dropped_.fetch_add(s.dropped_records, std::memory_order_relaxed);
+  retired_stalls_.fetch_add(s.stalls, std::memory_order_relaxed);
+  retired_bytes_.fetch_add(s.file_bytes, std::memory_order_relaxed);
+
+  // Gap between the previous segment's last sample and this one's first.
+  const size_t index = segment.number - first_number_;
+  if (index > 0) {
+    const Segment &previous = *segments_[index - 1];
+    const uint64_t last = previous.last_timestamp_ns.load();
+    const uint64_t first = segment.first_timestamp_ns.load();
+    if (last && first > last && first - last > max_gap_ns_.load())
+      max_gap_ns_.store(first - last, std::memory_order_relaxed);
+  }
+}
+
+bool SegmentedLog::rotation_due(const Segment &segment) const {
+  if (config_.max_segment_bytes &&
+      segment_stats(segment).file_bytes >= config_.max_segment_bytes)
+    return true;
+  return config_.max_segment_age.count() > 0 &&
+         std::chrono::steady_clock::now() - segment.opened >=
+             config_.max_segment_age;
+}
+
+void SegmentedLog::run_supervisor() {
+  // Opening a segment allocates and locks its buffers; keep that off the
+  // sampling core.
+  if (config_.writer_core >= 0) {
+    cpu_set_t cpuset;
+    CPU_ZERO(&cpuset);
+    CPU_SET(config_.writer_core, &cpuset);
+    if (pthread_setaffinity_np(pthread_self(), sizeof(cpuset), &cpuset) != 0)
+      SPDLOG_WARN("Failed to pin the soak supervisor to CPU {}.",
+                  config_.writer_core);
+  }
+
+  auto next_attempt = std::chrono::steady_clock::now();
+  while (!stop_.load(std::memory_order_acquire)) {
+    std::this_thread::sleep_for(SUPERVISOR_POLL);
+    const auto now = std::chrono::steady_clock::now();
+    if (now - last_checkpoint_ >= config_.checkpoint_interval)
+      write_checkpoint();
+    if (now < next_attempt || !rotation_due(*active_))
+      continue;
+
+    // Opening happens here, while the producer keeps writing the old segment.
+    auto next = open_segment(active_->number + 1);
+    if (!next) {
+      next_attempt = now + OPEN_RETRY;
+      continue;
+    }
+    Segment *next_segment = next.get();
+    segments_.push_back(std::move(next));
+    n_segments_.fetch_add(1, std::memory_order_relaxed);
+    handoff_.store(next_segment, std::memory_order_release);
+    while (handoff_.load(std::memory_order_acquire) != nullptr &&
+           !stop_.load(std::memory_order_acquire))
+      std::this_thread::sleep_for(HANDOFF_POLL);
+    if (handoff_.load(std::memory_order_acquire) != nullptr)
+      break; // Shutting down before the producer switched; close() takes over
+
+    Segment *previous = std::exchange(active_, next_segment);
+    retire(*previous);
+    write_index(false);
+    SPDLOG_INFO("Rotated {} ({} records, {} dropped) -> {}.", previous->path,
+                previous->records, previous->dropped_records,
+                next_segment->path);
+  }
+}
+
+void SegmentedLog::close() {
+  if (closed_ || !current_)
+    return;
+  closed_ = true;
+  stop_.store(true, std::memory_order_release);
+  if (supervisor_.joinable())
+    supervisor_.join();
+  if (Segment *next = handoff_.exchange(nullptr, std::memory_order_acq_rel))
+    current_ = next;
+  for (auto &segment : segments_)
+    retire(*segment);
+  active_ = current_;
+  write_checkpoint();
+  write_index(true);
+}
+
+void SegmentedLog::write_index(bool complete) const {
+  const std::string index = base_path_ + ".segments.json";
+  const std::string tmp = index + ".tmp";
+  {
+    std::ofstream out(tmp);
+    out << "{\n"
+        << "  \"format\": \"pm_segments\",\n"
+        << "  \"format_version\": 1,\n"
+        << "  \"complete\": " << (complete ? "true" : "false") << ",\n"
+        << "  \"pm_table_version\": " << pm_table_version_ << ",\n"
+        << "  \"sample_bytes\": " << sample_bytes_ << ",\n"
+        << "  \"segments\": [";
+    for (size_t i = 0; i < segments_.size(); ++i) {
+      const Segment &segment = *segments_[i];
+      const Stats s = segment_stats(segment);
+      out << (i ? ",\n" : "\n") << "    {\"file\": \""
+          << std::filesystem::path(segment.path).filename().string()
+          << "\", \"complete\": " << (segment.complete ? "true" : "false")
+          << ", \"first_timestamp_ns\": " << segment.first_timestamp_ns.load()
+          << ", \"last_timestamp_ns\": " << segment.last_timestamp_ns.load()
+          << ", \"records\": " << s.records
+          << ", \"dropped_records\": " << s.dropped_records
+          << ", \"file_bytes\": " << s.file_bytes << "}";
+    }
+    out << "\n  ]\n"
+        << "}\n";
+    if (!out)
+      return;
+  }
+  std::rename(tmp.c_str(), index.c_str());
+}
+
+/**
+ * @brief Append one summary line. Resident memory includes more than the
+ * writers, so exceeding the budget is only reported.
+ */
+void SegmentedLog::write_checkpoint() {
+  const auto now = std::chrono::steady_clock::now();
+  const Stats s = totals(*active_);
+  const auto [rss_kib, peak_kib] = resident_kib();
+  const double interval_s =
+      std::chrono::duration<double>(now - last_checkpoint_).count();
+  const double rate =
+      interval_s > 0 ? (s.records - checkpoint_records_) / interval_s : 0.0;
+  checkpoints_ << "{\"timestamp_ns\": " << unix_now_ns()
+               << ", \"uptime_s\": "
+               << std::chrono::duration<double>(now - started_).count()
+               << ", \"segment\": \""
+               << std::filesystem::path(active_->path).filename().string()
+               << "\", \"segments\": " << s.segments
+               << ", \"records\": " << s.records
+               << ", \"records_per_s\": " << rate
+               << ", \"dropped_records\": " << s.dropped_records
+               << ", \"stalls\": " << s.stalls
+               << ", \"file_bytes\": " << s.file_bytes
+               << ", \"max_boundary_gap_ms\": " << s.max_boundary_gap_ns / 1e6
+               << ", \"rss_kib\": " << rss_kib
+               << ", \"rss_peak_kib\": " << peak_kib
+               << ", \"writer_memory_kib\": " << (s.writer_memory_bytes >> 10)
+               << ", \"memory_budget_kib\": "
+               << (config_.memory_budget_bytes >> 10) << "}" << std::endl;
+  if (config_.memory_budget_bytes &&
+      rss_kib * 1024 > config_.memory_budget_bytes)
+    SPDLOG_WARN("Resident memory {} MiB exceeds the {} MiB budget.",
+                rss_kib >> 10, config_.memory_budget_bytes >> 20);
+  last_checkpoint_ = now;
+  checkpoint_records_ = s.records;
+}
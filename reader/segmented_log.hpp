@@ -0,0 +1,147 @@
+/**
+ * @file segmented_log.hpp
+ * @brief Soak-mode recording: rotated output segments, a segment index, a
+ * writer buffer budget and periodic summary checkpoints.
+ *
+ * A base path `pm_table_log.pmz` produces `pm_table_log.000001.pmz`,
+ * `pm_table_log.000002.pmz`, ... plus
+ *  - `pm_table_log.pmz.segments.json`: every segment with its time range,
+ *    record and drop counts (rewritten via rename on each rotation),
+ *  - `pm_table_log.pmz.checkpoints.jsonl`: one summary line per checkpoint
+ *    interval (throughput, drops, resident memory).
+ *
+ * Rotation never blocks the sampling thread: a supervisor thread opens the
+ * next segment while the current one keeps recording, then hands it over
+ * through an atomic pointer that append_record() picks up with a single
+ * exchange. The retired segment is drained and closed on the supervisor.
+ */
+
+#pragma once
+#include "async_log_writer.hpp"
+#include "columnar_log.hpp"
+#include "pmz_log_writer.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+/**
+ * @class SegmentedLog
+ * @brief Drop-in for the pm_reader writers that rotates by size or age.
+ */
+class SegmentedLog {
+public:
+  enum class Format { Raw, Pmz, Columnar };
+
+  struct Config {
+    Format format = Format::Raw;
+    uint64_t max_segment_bytes = 1ull << 30; ///< 0 = no size limit
+    std::chrono::seconds max_segment_age{3600}; ///< 0 = no age limit
+    /// Upper bound for the writers' buffers. Two segments are alive during a
+    /// rotation, so each gets half; the log does not open if even the
+    /// smallest rings exceed that. Resident memory is only compared against
+    /// it in the checkpoints. 0 keeps the writer defaults.
+    size_t memory_budget_bytes = 256u << 20;
+    std::chrono::seconds checkpoint_interval{600};
+    int writer_core = -1; ///< Pin the .pmz/.pmcol writer threads
+  };
+
+  struct Stats {
+    uint64_t segments = 0;
+    uint64_t records = 0;
+    uint64_t dropped_records = 0;
+    uint64_t stalls = 0;
+    uint64_t file_bytes = 0;
+    uint64_t max_boundary_gap_ns = 0; ///< Largest gap across a rotation
+    size_t writer_memory_bytes = 0;   ///< Buffers of one segment
+  };
+
+  SegmentedLog(const std::string &base_path, uint32_t sample_bytes,
+               uint32_t pm_table_version, Config config);
+  ~SegmentedLog();
+
+  SegmentedLog(const SegmentedLog &) = delete;
+  SegmentedLog &operator=(const SegmentedLog &) = delete;
+
+  explicit operator bool() const noexcept { return current_ != nullptr; }
+
+  /** @brief Queue one sample into the current segment. Producer only. */
+  bool append_record(uint64_t timestamp_ns, const void *blob,
+                     uint64_t size) noexcept;
+
+  /** @brief Close the open segment(s), finish the index and checkpoints. */
+  void close();
+
+  Stats stats() const;
+
+  /** @brief Path of segment number n (1-based). */
+  std::string segment_path(uint64_t n) const;
+
+private:
+  /// One output file and its writer; exactly one pointer is set.
+  struct Segment {
+    uint64_t number = 0;
+    std::string path;
+    std::unique_ptr<AsyncLogWriter> raw;
+    std::unique_ptr<PmzLogWriter> pmz;
+    std::unique_ptr<ColumnarLogWriter> columnar;
+    std::chrono::steady_clock::time_point opened;
+    // Written by the producer while the segment is current.
+    std::atomic<uint64_t> first_timestamp_ns{0};
+    std::atomic<uint64_t> last_timestamp_ns{0};
+    // Filled in when the segment is retired.
+    bool complete = false;
+    uint64_t records = 0;
+    uint64_t dropped_records = 0;
+    uint64_t stalls = 0;
+    uint64_t file_bytes = 0;
+  };
+
+  std::unique_ptr<Segment> open_segment(uint64_t number) const;
+  static Stats segment_stats(const Segment &segment);
+  Stats totals(const Segment &live) const;
+  void retire(Segment &segment);
+  bool rotation_due(const Segment &segment) const;
+  bool fit_budget();
+  void run_supervisor();
+  void write_index(bool complete) const;
+  void write_checkpoint();
+
+  std::string base_path_;
+  std::string stem_, extension_;
+  uint32_t sample_bytes_;
+  uint32_t pm_table_version_;
+  Config config_;
+  AsyncLogWriter::Config raw_config_;
+  PmzLogWriter::Config pmz_config_;
+  ColumnarLogWriter::Config columnar_config_;
+  size_t writer_memory_bytes_ = 0;
+
+  /// Producer-owned pointer to the segment being recorded.
+  Segment *current_ = nullptr;
+  /// Next segment published by the supervisor, taken by the producer.
+  std::atomic<Segment *> handoff_{nullptr};
+
+  // Supervisor-owned state; the list keeps retired segments' metadata (not
+  // their writers) for the index.
+  std::vector<std::unique_ptr<Segment>> segments_;
+  Segment *active_ = nullptr; ///< Supervisor's view of current_
+  uint64_t first_number_ = 1;
+  std::atomic<uint64_t> n_segments_{0};
+  std::atomic<uint64_t> retired_records_{0}, retired_dropped_{0},
+      retired_stalls_{0}, retired_bytes_{0};
+  std::atomic<uint64_t> max_gap_ns_{0};
+  std::ofstream checkpoints_;
+  std::chrono::steady_clock::time_point started_, last_checkpoint_;
+  uint64_t checkpoint_records_ = 0;
+
+  std::atomic<bool> stop_{false};
+  bool closed_ = false;
+  std::thread supervisor_;
+};
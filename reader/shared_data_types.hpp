@@ -7,6 +7,7 @@
 
 #include <array>
 #include <atomic>
+#include <cstdint>
 #include <mutex>
 #include <queue>
 #include <variant>
@@ -23,6 +24,9 @@ constexpr size_t PM_TABLE_MAX_FLOATS = 2048;
 struct RawSample {
   TimePoint timestamp{};
   int worker_state{};
+  uint64_t work_count{}; ///< Workload iterations completed so far
+  int marker{};          ///< Experiment marker, bumped from GUI or SIGUSR1
+  int core{-1};          ///< Core under test when replayed; -1 live (GUI)
   std::array<float, PM_TABLE_MAX_FLOATS> measurements;
   size_t num_measurements{};
 };
@@ -38,6 +42,26 @@ struct DisplayData {
   std::vector<float> y_data_max;  // Max envelope
   std::vector<float> y_data_min;  // Min envelope
 
+  // The grid's mini-plot, scaled by the processing thread: the part after
+  // the edge (0 .. window_after_ms) with x and y in [0, 1], y from y_lo to
+  // y_hi, so the GUI only maps it onto the cell.
+  float y_lo = 0.0f;
+  float y_hi = 0.0f;
+  std::vector<float> norm_x;
+  std::vector<float> norm_mean;
+  std::vector<float> norm_min;
+  std::vector<float> norm_max;
+
+  // Persistence-style eye over the whole window: EyeDensity's intensities,
+  // density_height rows (highest values first) of window_before_ms +
+  // window_after_ms columns, values density_lo .. density_hi. version
+  // changes with every publish, for the GUI's texture cache.
+  std::vector<uint8_t> density;
+  int density_height = 0;
+  float density_lo = 0.0f;
+  float density_hi = 0.0f;
+  uint64_t version = 0;
+
   // Metadata
   int original_sensor_index = -1;
   int accumulation_count = 0; // How many traces were used for this data
@@ -49,6 +73,13 @@ struct DisplayData {
     y_data_mean.clear();
     y_data_max.clear();
     y_data_min.clear();
+    norm_x.clear();
+    norm_mean.clear();
+    norm_min.clear();
+    norm_max.clear();
+    density.clear();
+    density_height = 0;
+    y_lo = y_hi = 0.0f;
     accumulation_count = 0;
   }
 };
@@ -61,8 +92,10 @@ struct ChangeCoreCmd {
 struct ChangeAccumulationsCmd {
   int new_count;
 };
+struct SaveSnapshotCmd {};
 
-using GuiCommand = std::variant<ChangeCoreCmd, ChangeAccumulationsCmd>;
+using GuiCommand =
+    std::variant<ChangeCoreCmd, ChangeAccumulationsCmd, SaveSnapshotCmd>;
 
 class CommandQueue {
 public:
@@ -0,0 +1,388 @@
+/**
+ * @file shm_ring.cpp
+ * @brief ShmRingPublisher and ShmRingConsumer.
+ */
+
+#include "shm_ring.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+#include <ctime>
+#include <fcntl.h>
+#include <spdlog/spdlog.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+uint64_t monotonic_ns() {
+  timespec ts{};
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return static_cast<uint64_t>(ts.tv_sec) * 1'000'000'000 +
+         static_cast<uint64_t>(ts.tv_nsec);
+}
+
+std::string shm_path(const std::string &name) { return "/" + name; }
+
+/// kill(pid, 0) fails with ESRCH only if there is no such process.
+bool process_alive(int pid) {
+  return pid > 0 && (::kill(pid, 0) == 0 || errno != ESRCH);
+}
+
+size_t ring_bytes(uint32_t slot_bytes, uint64_t capacity) {
+  return SHM_RING_HEADER_BYTES + size_t{slot_bytes} * (capacity + 1);
+}
+
+/// Seqlock write: invalidate, fill, publish.
+void write_slot(char *slot_base, uint64_t seq, uint64_t realtime_ns,
+                uint64_t monotonic_ns, const void *data, uint32_t size) {
+  auto *slot = reinterpret_cast<ShmSlotHeader *>(slot_base);
+  slot->seq.store(0, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+  slot->realtime_ns = realtime_ns;
+  slot->monotonic_ns = monotonic_ns;
+  slot->size = size;
+  std::memcpy(slot_base + sizeof(ShmSlotHeader), data, size);
+  slot->seq.store(seq, std::memory_order_release);
+}
+
+} // namespace
+
+ShmRingPublisher::ShmRingPublisher(uint32_t sample_bytes,
+                                   uint32_t pm_table_version, Config config)
+    : config_{std::move(config)}, path_{shm_path(config_.name)},
+      sample_bytes_{sample_bytes} {
+  if (sample_bytes == 0 || sample_bytes > 16384 || config_.capacity < 16) {
+    SPDLOG_ERROR("Invalid shared-memory ring geometry ({} bytes x {}).",
+                 sample_bytes, config_.capacity);
+    return;
+  }
+  const auto slot_bytes = static_cast<uint32_t>(
+      (sizeof(ShmSlotHeader) + sample_bytes + 63) / 64 * 64);
+  map_bytes_ = ring_bytes(slot_bytes, config_.capacity);
+
+  int fd = ::shm_open(path_.c_str(), O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC,
+                      config_.mode);
+  if (fd < 0 && errno == EEXIST) {
+    // Left over from a daemon that died, or a live one.
+    if (const int old = ::shm_open(path_.c_str(), O_RDONLY | O_CLOEXEC, 0);
+        old >= 0) {
+      ShmRingHeader existing{};
+      const bool readable =
+          ::pread(old, &existing, offsetof(ShmRingHeader, published), 0) ==
+          static_cast<ssize_t>(offsetof(ShmRingHeader, published));
+      ::close(old);
+      if (readable &&
+          std::memcmp(existing.magic, SHM_RING_MAGIC, 4) == 0 &&
+          existing.daemon_pid != ::getpid() &&
+          process_alive(existing.daemon_pid)) {
+        SPDLOG_ERROR("/dev/shm{} belongs to a running daemon (pid {}).", path_,
+                     existing.daemon_pid);
+        return;
+      }
+    }
+    ::shm_unlink(path_.c_str());
+    fd = ::shm_open(path_.c_str(), O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC,
+                    config_.mode);
+  }
+  if (fd < 0) {
+    SPDLOG_ERROR("shm_open({}) failed: {}", path_, std::strerror(errno));
+    return;
+  }
+  ::fchmod(fd, config_.mode); // Not narrowed by the umask
+  if (::ftruncate(fd, static_cast<off_t>(map_bytes_)) != 0) {
+    SPDLOG_ERROR("Failed to size {}: {}", path_, std::strerror(errno));
+    ::close(fd);
+    ::shm_unlink(path_.c_str());
+    return;
+  }
+  void *map = ::mmap(nullptr, map_bytes_, PROT_READ | PROT_WRITE,
+                     MAP_SHARED | MAP_POPULATE, fd, 0);
+  ::close(fd);
+  if (map == MAP_FAILED) {
+    SPDLOG_ERROR("Failed to map {}: {}", path_, std::strerror(errno));
+    ::shm_unlink(path_.c_str());
+    return;
+  }
+  base_ = static_cast<char *>(map);
+  auto *header = reinterpret_cast<ShmRingHeader *>(base_);
+  header->format_version = SHM_RING_FORMAT_VERSION;
+  header->header_bytes = SHM_RING_HEADER_BYTES;
+  header->sample_bytes = sample_bytes;
+  header->slot_bytes = slot_bytes;
+  header->pm_table_version = pm_table_version;
+  header->capacity = config_.capacity;
+  header->period_ns = config_.period_ns;
+  header->daemon_pid = ::getpid();
+  timespec now{};
+  clock_gettime(CLOCK_REALTIME, &now);
+  header->start_realtime_ns = static_cast<uint64_t>(now.tv_sec) *
+                                  1'000'000'000 +
+                              static_cast<uint64_t>(now.tv_nsec);
+  std::atomic_thread_fence(std::memory_order_release);
+  std::memcpy(header->magic, SHM_RING_MAGIC, 4);
+  header_ = header;
+  SPDLOG_INFO("Publishing {} byte samples to /dev/shm{} ({} slots, {:.1f} "
+              "MiB).",
+              sample_bytes, path_, config_.capacity, map_bytes_ / 1048576.0);
+}
+
+ShmRingPublisher::~ShmRingPublisher() {
+  if (base_) {
+    ::munmap(base_, map_bytes_);
+    // Attached consumers keep their mapping; they notice the missing
+    // heartbeat.
+    ::shm_unlink(path_.c_str());
+  }
+}
+
+void ShmRingPublisher::publish(uint64_t realtime_ns, uint64_t monotonic_ns,
+                               const void *data) noexcept {
+  if (!header_)
+    return;
+  const uint64_t seq = next_seq_++;
+  const size_t slot_bytes = header_->slot_bytes;
+  char *ring = base_ + SHM_RING_HEADER_BYTES + slot_bytes;
+  write_slot(ring + (seq - 1) % config_.capacity * slot_bytes, seq,
+             realtime_ns, monotonic_ns, data, sample_bytes_);
+  write_slot(base_ + SHM_RING_HEADER_BYTES, seq, realtime_ns, monotonic_ns,
+             data, sample_bytes_);
+  header_->published.store(seq, std::memory_order_release);
+  header_->heartbeat_ns.store(monotonic_ns, std::memory_order_relaxed);
+}
+
+void ShmRingPublisher::count_read_error() noexcept {
+  if (header_)
+    header_->read_errors.fetch_add(1, std::memory_order_relaxed);
+}
+
+std::vector<ShmRingPublisher::ConsumerInfo> ShmRingPublisher::consumers() {
+  std::vector<ConsumerInfo> result;
+  if (!header_)
+    return result;
+  const uint64_t published = header_->published.load(std::memory_order_relaxed);
+  for (auto &entry : header_->consumers) {
+    int pid = entry.pid.load(std::memory_order_acquire);
+    if (pid == 0)
+      continue;
+    if (!process_alive(pid)) {
+      entry.pid.compare_exchange_strong(pid, 0, std::memory_order_acq_rel);
+      continue;
+    }
+    ConsumerInfo info;
+    info.pid = pid;
+    info.name.assign(entry.name, strnlen(entry.name, sizeof(entry.name)));
+    const uint64_t position = entry.position.load(std::memory_order_relaxed);
+    info.lag = published > position ? published - position : 0;
+    info.lost = entry.lost.load(std::memory_order_relaxed);
+    info.overruns = entry.overruns.load(std::memory_order_relaxed);
+    info.max_lag = entry.max_lag.load(std::memory_order_relaxed);
+    result.push_back(std::move(info));
+  }
+  return result;
+}
+
+ShmRingConsumer::ShmRingConsumer(const std::string &name,
+                                 const std::string &client) {
+  const std::string path = shm_path(name);
+  bool writable = true;
+  int fd = ::shm_open(path.c_str(), O_RDWR | O_CLOEXEC, 0);
+  if (fd < 0 && errno == EACCES) {
+    writable = false;
+    fd = ::shm_open(path.c_str(), O_RDONLY | O_CLOEXEC, 0);
+  }
+  if (fd < 0) {
+    SPDLOG_ERROR("No acquisition daemon on /dev/shm{} ({}); start pm_acqd.",
+                 path, std::strerror(errno));
+    return;
+  }
+  struct stat st{};
+  if (::fstat(fd, &st) != 0 ||
+      static_cast<size_t>(st.st_size) < SHM_RING_HEADER_BYTES) {
+    ::close(fd);
+    SPDLOG_ERROR("/dev/shm{} is not a pm_table ring.", path);
+    return;
+  }
+  map_bytes_ = static_cast<size_t>(st.st_size);
+  void *map = ::mmap(nullptr, map_bytes_,
+                     writable ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED,
+                     fd, 0);
+  ::close(fd);
+  if (map == MAP_FAILED) {
+    SPDLOG_ERROR("Failed to map /dev/shm{}: {}", path, std::strerror(errno));
+    return;
+  }
+  base_ = static_cast<const char *>(map);
+  const auto *header = reinterpret_cast<const ShmRingHeader *>(base_);
+  // Everything next() indexes with comes from the header; check it before
+  // the first read (capacity is bounded first so ring_bytes cannot wrap).
+  if (std::memcmp(header->magic, SHM_RING_MAGIC, 4) != 0 ||
+      header->format_version != SHM_RING_FORMAT_VERSION ||
+      header->capacity == 0 ||
+      uint64_t{header->sample_bytes} + sizeof(ShmSlotHeader) >
+          header->slot_bytes ||
+      header->slot_bytes % alignof(ShmSlotHeader) != 0 ||
+      header->capacity >= map_bytes_ / header->slot_bytes ||
+      ring_bytes(header->slot_bytes, header->capacity) > map_bytes_) {
+    SPDLOG_ERROR("/dev/shm{} has an unsupported layout.", path);
+    ::munmap(const_cast<char *>(base_), map_bytes_);
+    base_ = nullptr;
+    return;
+  }
+  header_ = header;
+  // Start with the next sample; what was published before attaching is
+  // history, not backlog.
+  next_seq_ = header_->published.load(std::memory_order_acquire) + 1;
+
+  if (writable) {
+    auto *mutable_header = const_cast<ShmRingHeader *>(header_);
+    const int pid = ::getpid();
+    for (auto &entry : mutable_header->consumers) {
+      int expected = entry.pid.load(std::memory_order_relaxed);
+      if ((expected == 0 || !process_alive(expected)) &&
+          entry.pid.compare_exchange_strong(expected, pid,
+                                            std::memory_order_acq_rel)) {
+        entry.position.store(next_seq_ - 1, std::memory_order_relaxed);
+        entry.lost.store(0, std::memory_order_relaxed);
+        entry.overruns.store(0, std::memory_order_relaxed);
+        entry.max_lag.store(0, std::memory_order_relaxed);
+        std::memset(entry.name, 0, sizeof(entry.name));
+        std::memcpy(entry.name, client.data(),
+                    std::min(client.size(), sizeof(entry.name) - 1));
+        entry_ = &entry;
+        break;
+      }
+    }
+  }
+  SPDLOG_INFO("Attached to /dev/shm{}: {} byte samples every {} us from pid "
+              "{}{}.",
+              path, header_->sample_bytes, header_->period_ns / 1000,
+              header_->daemon_pid,
+              entry_ ? "" : " (read-only, not registered)");
+}
+
+ShmRingConsumer::~ShmRingConsumer() {
+  if (entry_)
+    entry_->pid.store(0, std::memory_order_release);
+  if (base_)
+    ::munmap(const_cast<char *>(base_), map_bytes_);
+}
+
+const ShmSlotHeader *ShmRingConsumer::slot(uint64_t seq) const {
+  const size_t slot_bytes = header_->slot_bytes;
+  return reinterpret_cast<const ShmSlotHeader *>(
+      base_ + SHM_RING_HEADER_BYTES + slot_bytes +
+      (seq - 1) % header_->capacity * slot_bytes);
+}
+
+/**
+ * @brief Seqlock read of one slot; false if it does not hold seq (anymore).
+ */
+bool ShmRingConsumer::read_slot(const ShmSlotHeader *slot, uint64_t seq,
+                                Sample &sample, void *dest) const {
+  if (slot->seq.load(std::memory_order_acquire) != seq)
+    return false;
+  sample.seq = seq;
+  sample.realtime_ns = slot->realtime_ns;
+  sample.monotonic_ns = slot->monotonic_ns;
+  const char *payload = reinterpret_cast<const char *>(slot + 1);
+  if (dest) {
+    std::memcpy(dest, payload, header_->sample_bytes);
+    sample.data = static_cast<const char *>(dest);
+  } else {
+    sample.data = payload;
+  }
+  std::atomic_thread_fence(std::memory_order_acquire);
+  return slot->seq.load(std::memory_order_relaxed) == seq;
+}
+
+/**
+ * @brief Fallen behind by (almost) a ring: skip to a quarter ring behind
+ * the daemon, so the next reads are not overwritten right away.
+ */
+void ShmRingConsumer::skip_lost(uint64_t published) {
+  const uint64_t resume = published - header_->capacity / 4 + 1;
+  stats_.lost += resume - next_seq_;
+  ++stats_.overruns;
+  next_seq_ = resume;
+}
+
+bool ShmRingConsumer::next(Sample &sample, void *dest) {
+  if (!header_)
+    return false;
+  while (true) {
+    const uint64_t published =
+        header_->published.load(std::memory_order_acquire);
+    if (next_seq_ > published)
+      return false;
+    const uint64_t lag = published - next_seq_ + 1;
+    stats_.max_lag = std::max(stats_.max_lag, lag);
+    // One slot of margin: the daemon may already be writing seq published+1.
+    if (lag >= header_->capacity) {
+      skip_lost(published);
+      continue;
+    }
+    if (!read_slot(slot(next_seq_), next_seq_, sample, dest)) {
+      // Overwritten between the check above and the copy.
+      skip_lost(header_->published.load(std::memory_order_acquire));
+      continue;
+    }
+    ++next_seq_;
+    ++stats_.received;
+    update_entry();
+    return true;
+  }
+}
+
+bool ShmRingConsumer::still_valid(const Sample &sample) const {
+  std::atomic_thread_fence(std::memory_order_acquire);
+  return header_ &&
+         slot(sample.seq)->seq.load(std::memory_order_relaxed) == sample.seq;
+}
+
+bool ShmRingConsumer::latest(Sample &sample, void *dest) const {
+  if (!header_ || !dest)
+    return false;
+  const auto *latest_slot =
+      reinterpret_cast<const ShmSlotHeader *>(base_ + SHM_RING_HEADER_BYTES);
+  for (int attempt = 0; attempt < 16; ++attempt) {
+    const uint64_t seq = latest_slot->seq.load(std::memory_order_acquire);
+    if (seq == 0) {
+      if (header_->published.load(std::memory_order_relaxed) == 0)
+        return false; // Nothing published yet
+      continue;       // Being written
+    }
+    if (read_slot(latest_slot, seq, sample, dest))
+      return true;
+  }
+  return false;
+}
+
+uint64_t ShmRingConsumer::lag() const {
+  if (!header_)
+    return 0;
+  const uint64_t published = header_->published.load(std::memory_order_acquire);
+  return published >= next_seq_ ? published - next_seq_ + 1 : 0;
+}
+
+bool ShmRingConsumer::alive(uint64_t timeout_ns) const {
+  if (!header_)
+    return false;
+  // Load the heartbeat first: it may be newer than a clock read taken before.
+  const uint64_t heartbeat =
+      header_->heartbeat_ns.load(std::memory_order_relaxed);
+  const uint64_t now = monotonic_ns();
+  return now < heartbeat || now - heartbeat < timeout_ns;
+}
+
+void ShmRingConsumer::update_entry() {
+  if (!entry_)
+    return;
+  entry_->position.store(next_seq_ - 1, std::memory_order_relaxed);
+  entry_->lost.store(stats_.lost, std::memory_order_relaxed);
+  entry_->overruns.store(stats_.overruns, std::memory_order_relaxed);
+  entry_->max_lag.store(stats_.max_lag, std::memory_order_relaxed);
+}
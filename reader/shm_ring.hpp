@@ -0,0 +1,225 @@
+/**
+ * @file shm_ring.hpp
+ * @brief Shared-memory ring through which one acquisition daemon (pm_acqd)
+ * publishes pm_table samples to any number of consumers.
+ *
+ * The POSIX shared-memory object (/dev/shm/<name>) is a 4 KiB header, one
+ * "latest" slot, and `capacity` ring slots. Sample `seq` (1-based) lives in
+ * ring slot (seq - 1) % capacity. Every slot is a seqlock: its sequence
+ * number is 0 while the daemon writes it and `seq` afterwards, so a reader
+ * validates a copy by reading the same number before and after it. Readers
+ * never write to the ring and never block the daemon. A reader that falls
+ * more than a ring behind loses samples; it detects that, counts them, and
+ * skips ahead.
+ *
+ * Every slot carries CLOCK_REALTIME and CLOCK_MONOTONIC timestamps taken once
+ * by the daemon, so all consumers agree on when a sample was read. Consumers
+ * that can open the object read-write register themselves in the header's
+ * consumer table, so the daemon can report their lag and losses.
+ *
+ * Offsets are fixed (static_asserts below) because python/pm_shm.py reads the
+ * same layout.
+ */
+
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+inline constexpr char SHM_RING_MAGIC[4] = {'P', 'M', 'S', 'H'};
+inline constexpr uint32_t SHM_RING_FORMAT_VERSION = 1;
+inline constexpr uint32_t SHM_RING_HEADER_BYTES = 4096;
+inline constexpr uint32_t SHM_RING_MAX_CONSUMERS = 32;
+inline constexpr const char *SHM_RING_DEFAULT_NAME = "pm_table";
+
+/** @brief A registered consumer's progress, written by the consumer. */
+struct ShmConsumerEntry {
+  std::atomic<int32_t> pid; ///< 0 = free
+  uint32_t reserved;
+  std::atomic<uint64_t> position; ///< Last sequence number consumed
+  std::atomic<uint64_t> lost;     ///< Samples overwritten before being read
+  std::atomic<uint64_t> overruns; ///< Times it fell behind by a full ring
+  std::atomic<uint64_t> max_lag;  ///< Largest backlog seen, in samples
+  char name[24];                  ///< Tool name, for the daemon's log
+};
+static_assert(sizeof(ShmConsumerEntry) == 64);
+
+struct ShmRingHeader {
+  char magic[4]; ///< Written last, so a consumer never sees a half-built ring
+  uint32_t format_version;
+  uint32_t header_bytes;
+  uint32_t sample_bytes;
+  uint32_t slot_bytes;
+  uint32_t pm_table_version;
+  uint64_t capacity; ///< Ring slots
+  uint64_t period_ns;
+  int32_t daemon_pid;
+  uint32_t reserved0;
+  uint64_t start_realtime_ns;
+  uint64_t reserved1;
+  std::atomic<uint64_t> published;    ///< Sequence number of the newest sample
+  std::atomic<uint64_t> heartbeat_ns; ///< CLOCK_MONOTONIC of the newest publish
+  std::atomic<uint64_t> read_errors;  ///< Failed pm_table reads (not published)
+  uint64_t reserved2[5];
+  ShmConsumerEntry consumers[SHM_RING_MAX_CONSUMERS];
+};
+static_assert(offsetof(ShmRingHeader, published) == 64);
+static_assert(offsetof(ShmRingHeader, consumers) == 128);
+static_assert(sizeof(ShmRingHeader) <= SHM_RING_HEADER_BYTES);
+
+struct ShmSlotHeader {
+  std::atomic<uint64_t> seq; ///< 0 while being written
+  uint64_t realtime_ns;
+  uint64_t monotonic_ns;
+  uint32_t size;
+  uint32_t reserved;
+};
+static_assert(sizeof(ShmSlotHeader) == 32);
+
+/**
+ * @class ShmRingPublisher
+ * @brief Daemon side: creates the object and publishes samples.
+ *
+ * publish() is two memcpys plus a few atomic stores (no syscalls). A second
+ * daemon on the same name is refused while the first one is alive; the
+ * object of a dead daemon is replaced.
+ */
+class ShmRingPublisher {
+public:
+  struct Config {
+    std::string name = SHM_RING_DEFAULT_NAME;
+    uint64_t capacity = 8192; ///< Ring slots; 8 s at 1 kHz
+    uint64_t period_ns = 1'000'000;
+    unsigned mode = 0644; ///< 0666 lets non-root consumers register
+  };
+
+  /** @brief A consumer table entry, for the daemon's log. */
+  struct ConsumerInfo {
+    int pid = 0;
+    std::string name;
+    uint64_t lag = 0;
+    uint64_t lost = 0;
+    uint64_t overruns = 0;
+    uint64_t max_lag = 0;
+  };
+
+  ShmRingPublisher(uint32_t sample_bytes, uint32_t pm_table_version,
+                   Config config);
+  ~ShmRingPublisher();
+
+  ShmRingPublisher(const ShmRingPublisher &) = delete;
+  ShmRingPublisher &operator=(const ShmRingPublisher &) = delete;
+
+  explicit operator bool() const noexcept { return header_ != nullptr; }
+
+  /** @brief Publish one sample of sample_bytes. Producer thread only. */
+  void publish(uint64_t realtime_ns, uint64_t monotonic_ns,
+               const void *data) noexcept;
+
+  /** @brief Count a failed read; consumers see it in the header. */
+  void count_read_error() noexcept;
+
+  /** @brief From the header, so any thread may call it. */
+  uint64_t published() const noexcept {
+    return header_ ? header_->published.load(std::memory_order_relaxed) : 0;
+  }
+  uint64_t read_errors() const noexcept {
+    return header_ ? header_->read_errors.load(std::memory_order_relaxed) : 0;
+  }
+
+  /**
+   * @brief Live consumers; entries of dead processes are freed. One kill()
+   * per registered slot, so keep it off the sampling thread.
+   */
+  std::vector<ConsumerInfo> consumers();
+
+  const std::string &path() const { return path_; }
+
+private:
+  Config config_;
+  std::string path_;
+  ShmRingHeader *header_ = nullptr;
+  char *base_ = nullptr;
+  size_t map_bytes_ = 0;
+  uint32_t sample_bytes_;
+  uint64_t next_seq_ = 1;
+};
+
+/**
+ * @class ShmRingConsumer
+ * @brief Reader side: attaches to a running daemon's ring.
+ */
+class ShmRingConsumer {
+public:
+  /** @brief One sample; data points into the ring or to the caller's copy. */
+  struct Sample {
+    uint64_t seq = 0;
+    uint64_t realtime_ns = 0;
+    uint64_t monotonic_ns = 0;
+    const char *data = nullptr;
+  };
+
+  struct Stats {
+    uint64_t received = 0;
+    uint64_t lost = 0;
+    uint64_t overruns = 0;
+    uint64_t max_lag = 0;
+  };
+
+  /**
+   * @param name Shared-memory object name (without the leading slash).
+   * @param client Shown in the daemon's consumer list.
+   */
+  explicit ShmRingConsumer(const std::string &name = SHM_RING_DEFAULT_NAME,
+                           const std::string &client = "");
+  ~ShmRingConsumer();
+
+  ShmRingConsumer(const ShmRingConsumer &) = delete;
+  ShmRingConsumer &operator=(const ShmRingConsumer &) = delete;
+
+  explicit operator bool() const noexcept { return header_ != nullptr; }
+
+  uint32_t sample_bytes() const { return header_->sample_bytes; }
+  uint32_t pm_table_version() const { return header_->pm_table_version; }
+  uint64_t period_ns() const { return header_->period_ns; }
+  uint64_t capacity() const { return header_->capacity; }
+
+  /**
+   * @brief Take the next sample in sequence; false if there is none yet.
+   *
+   * With dest (sample_bytes() long) the payload is copied and validated,
+   * and sample.data points to dest. Without it, sample.data points into the
+   * ring (zero copy); check still_valid() after using it.
+   */
+  bool next(Sample &sample, void *dest = nullptr);
+
+  /** @brief The zero-copy sample was not overwritten while it was used. */
+  bool still_valid(const Sample &sample) const;
+
+  /** @brief Copy the newest sample, skipping the ring (e.g. a 10 Hz GUI). */
+  bool latest(Sample &sample, void *dest) const;
+
+  /** @brief Samples published but not consumed yet. */
+  uint64_t lag() const;
+
+  /** @brief The daemon published within timeout_ns. */
+  bool alive(uint64_t timeout_ns = 1'000'000'000) const;
+
+  Stats stats() const { return stats_; }
+
+private:
+  const ShmSlotHeader *slot(uint64_t seq) const;
+  bool read_slot(const ShmSlotHeader *slot, uint64_t seq, Sample &sample,
+                 void *dest) const;
+  void skip_lost(uint64_t published);
+  void update_entry();
+
+  const ShmRingHeader *header_ = nullptr;
+  ShmConsumerEntry *entry_ = nullptr; ///< Null if not registered
+  const char *base_ = nullptr;
+  size_t map_bytes_ = 0;
+  uint64_t next_seq_ = 1;
+  Stats stats_;
+};
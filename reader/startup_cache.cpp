@@ -0,0 +1,138 @@
+/**
+ * @file startup_cache.cpp
+ * @brief .pmsc serialization and the cache key's host facts.
+ */
+
+#include "startup_cache.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <spdlog/spdlog.h>
+
+namespace {
+
+/// The key's model string as stored: truncated, so a long name still hits.
+std::string stored_model(const std::string &model) {
+  return model.substr(0, sizeof(StartupCacheHeader::cpu_model) - 1);
+}
+
+} // namespace
+
+std::string cpu_model_name() {
+  std::ifstream in("/proc/cpuinfo");
+  std::string line;
+  while (std::getline(in, line)) {
+    if (line.rfind("model name", 0) != 0)
+      continue;
+    const size_t colon = line.find(':');
+    if (colon == std::string::npos)
+      break;
+    const size_t begin = line.find_first_not_of(" \t", colon + 1);
+    return begin == std::string::npos ? "" : line.substr(begin);
+  }
+  return "";
+}
+
+std::string default_startup_cache_dir() {
+  if (const char *xdg = std::getenv("XDG_CACHE_HOME"); xdg && *xdg)
+    return std::string(xdg) + "/pm_measure";
+  if (const char *home = std::getenv("HOME"); home && *home)
+    return std::string(home) + "/.cache/pm_measure";
+  return ".";
+}
+
+std::string startup_cache_path(const std::string &dir,
+                               const StartupCacheKey &key) {
+  char name[64];
+  std::snprintf(name, sizeof(name), "startup_%x_%u.pmsc",
+                key.pm_table_version, key.n_floats);
+  return dir + "/" + name;
+}
+
+bool read_startup_cache(const std::string &path, const StartupCacheKey &key,
+                        StartupCache &cache) {
+  std::ifstream in(path, std::ios::binary);
+  if (!in) {
+    SPDLOG_DEBUG("No startup cache at {}.", path);
+    return false;
+  }
+  StartupCacheHeader header{};
+  in.read(reinterpret_cast<char *>(&header), sizeof(header));
+  if (!in || std::memcmp(header.magic, STARTUP_CACHE_MAGIC, 4) != 0 ||
+      header.format_version != STARTUP_CACHE_FORMAT_VERSION) {
+    SPDLOG_INFO("Ignoring startup cache {}: not a format {} cache.", path,
+                STARTUP_CACHE_FORMAT_VERSION);
+    return false;
+  }
+  const std::string model(
+      header.cpu_model,
+      strnlen(header.cpu_model, sizeof(header.cpu_model)));
+  if (header.pm_table_version != key.pm_table_version ||
+      header.n_floats != key.n_floats || model != stored_model(key.cpu_model) ||
+      header.n_interesting > header.n_floats) {
+    SPDLOG_INFO("Ignoring startup cache {}: made for another table or CPU "
+                "({}).",
+                path, model);
+    return false;
+  }
+
+  cache.interesting.resize(header.n_interesting);
+  in.read(reinterpret_cast<char *>(cache.interesting.data()),
+          static_cast<std::streamsize>(cache.interesting.size() *
+                                       sizeof(int32_t)));
+  if (!in || std::any_of(cache.interesting.begin(), cache.interesting.end(),
+                         [&](int i) {
+                           return i < 0 ||
+                                  static_cast<uint32_t>(i) >= header.n_floats;
+                         })) {
+    SPDLOG_INFO("Ignoring startup cache {}: truncated or corrupt.", path);
+    return false;
+  }
+  cache.update_period_ms = header.update_period_ms;
+  cache.scan_samples = header.scan_samples;
+  cache.created_unix_s = header.created_unix_s;
+  return true;
+}
+
+bool write_startup_cache(const std::string &path, const StartupCacheKey &key,
+                         const StartupCache &cache) {
+  std::error_code ec;
+  std::filesystem::create_directories(
+      std::filesystem::path(path).parent_path(), ec);
+
+  StartupCacheHeader header{};
+  std::memcpy(header.magic, STARTUP_CACHE_MAGIC, 4);
+  header.format_version = STARTUP_CACHE_FORMAT_VERSION;
+  header.pm_table_version = key.pm_table_version;
+  header.n_floats = key.n_floats;
+  const std::string model = stored_model(key.cpu_model);
+  std::memcpy(header.cpu_model, model.data(), model.size());
+  header.n_interesting = static_cast<uint32_t>(cache.interesting.size());
+  header.update_period_ms = cache.update_period_ms;
+  header.scan_samples = cache.scan_samples;
+  header.created_unix_s = cache.created_unix_s;
+
+  const std::string tmp_path = path + ".tmp";
+  {
+    std::ofstream out(tmp_path, std::ios::binary | std::ios::trunc);
+    out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    out.write(reinterpret_cast<const char *>(cache.interesting.data()),
+              static_cast<std::streamsize>(cache.interesting.size() *
+                                           sizeof(int32_t)));
+    if (!out) {
+      SPDLOG_WARN("Failed to write startup cache {}.", tmp_path);
+      return false;
+    }
+  }
+  if (std::rename(tmp_path.c_str(), path.c_str()) != 0) {
+    SPDLOG_WARN("Failed to rename {} to {}: {}", tmp_path, path,
+                std::strerror(errno));
+    return false;
+  }
+  return true;
+}
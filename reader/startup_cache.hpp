@@ -0,0 +1,70 @@
+/**
+ * @file startup_cache.hpp
+ * @brief Per-host cache of pm_measure's startup discovery.
+ *
+ * The set of changing cells depends on the SMU firmware and the CPU, not on
+ * the run, so pm_measure stores it after a scan and uses it as the prior
+ * of the next start's scan, which ends as soon as it reproduces the set; a
+ * different set is logged and replaces the entry. A cache file is keyed by
+ * pm_table version, table size and CPU model; any mismatch is a miss.
+ *
+ * Layout (little endian): a 128-byte StartupCacheHeader, then
+ * int32 interesting[n_interesting].
+ */
+
+#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+
+inline constexpr char STARTUP_CACHE_MAGIC[4] = {'P', 'M', 'S', 'C'};
+inline constexpr uint32_t STARTUP_CACHE_FORMAT_VERSION = 1;
+
+struct StartupCacheHeader {
+  char magic[4];
+  uint32_t format_version;
+  uint32_t pm_table_version;
+  uint32_t n_floats;
+  char cpu_model[80]; ///< NUL-padded, truncated
+  uint32_t n_interesting;
+  float update_period_ms; ///< SMU refresh estimate, 0 if unknown
+  uint64_t scan_samples;
+  uint64_t created_unix_s;
+  uint64_t reserved;
+};
+static_assert(sizeof(StartupCacheHeader) == 128);
+
+struct StartupCacheKey {
+  uint32_t pm_table_version = 0;
+  uint32_t n_floats = 0;
+  std::string cpu_model;
+};
+
+struct StartupCache {
+  std::vector<int> interesting;
+  float update_period_ms = 0.0f;
+  uint64_t scan_samples = 0;
+  uint64_t created_unix_s = 0;
+};
+
+/** @brief "model name" from /proc/cpuinfo, or "" if unavailable. */
+std::string cpu_model_name();
+
+/** @brief $XDG_CACHE_HOME/pm_measure, else $HOME/.cache/pm_measure. */
+std::string default_startup_cache_dir();
+
+/** @brief `<dir>/startup_<version>_<n_floats>.pmsc`. */
+std::string startup_cache_path(const std::string &dir,
+                               const StartupCacheKey &key);
+
+/**
+ * @brief Read the entry for @p key.
+ * @return false if missing, unreadable or for another key (logged at debug
+ * or info level; a miss is not an error).
+ */
+bool read_startup_cache(const std::string &path, const StartupCacheKey &key,
+                        StartupCache &cache);
+
+/** @brief Write via a temporary file and rename; creates the directory. */
+bool write_startup_cache(const std::string &path, const StartupCacheKey &key,
+                         const StartupCache &cache);
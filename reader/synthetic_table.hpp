@@ -0,0 +1,21 @@
+/**
+ * @file synthetic_table.hpp
+ * @brief Deterministic stand-in for a pm_table read (--synthetic).
+ */
+
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/**
+ * @brief Slowly varying float cells, so soak runs exercise the writers,
+ * codecs and the shared-memory ring without the ryzen_smu driver.
+ */
+inline void fill_synthetic_table(std::vector<char> &buffer, uint64_t sample) {
+  auto *cells = reinterpret_cast<float *>(buffer.data());
+  const size_t n_cells = buffer.size() / sizeof(float);
+  const float phase = static_cast<float>(sample % 4000) / 4000.0f;
+  for (size_t i = 0; i < n_cells; ++i)
+    cells[i] = static_cast<float>(i % 97) + phase * static_cast<float>(i % 5);
+}
@@ -0,0 +1,456 @@
+/**
+ * @file terminal_ui.cpp
+ * @brief TerminalScreen and BrailleCanvas.
+ */
+
+#include "terminal_ui.hpp"
+#include "float_bits.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <charconv>
+#include <cmath>
+#include <csignal>
+#include <cstdio>
+#include <limits>
+#include <poll.h>
+#include <spdlog/sinks/ringbuffer_sink.h>
+#include <spdlog/spdlog.h>
+#include <sys/ioctl.h>
+#include <termios.h>
+#include <unistd.h>
+
+namespace {
+
+std::atomic<bool> g_interrupted{false};
+
+void on_interrupt(int) { g_interrupted.store(true, std::memory_order_relaxed); }
+
+void append_utf8(std::string &out, char32_t ch) {
+  if (ch < 0x80) {
+    out += static_cast<char>(ch);
+  } else if (ch < 0x800) {
+    out += static_cast<char>(0xC0 | (ch >> 6));
+    out += static_cast<char>(0x80 | (ch & 0x3F));
+  } else if (ch < 0x10000) {
+    out += static_cast<char>(0xE0 | (ch >> 12));
+    out += static_cast<char>(0x80 | ((ch >> 6) & 0x3F));
+    out += static_cast<char>(0x80 | (ch & 0x3F));
+  } else {
+    out += static_cast<char>(0xF0 | (ch >> 18));
+    out += static_cast<char>(0x80 | ((ch >> 12) & 0x3F));
+    out += static_cast<char>(0x80 | ((ch >> 6) & 0x3F));
+    out += static_cast<char>(0x80 | (ch & 0x3F));
+  }
+}
+
+/// Decodes one code point and advances @p i; malformed bytes become '?'.
+char32_t next_utf8(std::string_view s, size_t &i) {
+  const auto byte = [&](size_t k) { return static_cast<uint8_t>(s[k]); };
+  const uint8_t lead = byte(i);
+  const int extra = lead < 0x80           ? 0
+                    : (lead >> 5) == 0x6  ? 1
+                    : (lead >> 4) == 0xE  ? 2
+                    : (lead >> 3) == 0x1E ? 3
+                                          : -1;
+  if (extra < 0 || s.size() - i <= static_cast<size_t>(extra)) {
+    ++i;
+    return U'?';
+  }
+  char32_t ch = extra == 0 ? lead : lead & (0x3F >> extra);
+  for (int k = 1; k <= extra; ++k) {
+    if ((byte(i + k) & 0xC0) != 0x80) {
+      ++i;
+      return U'?';
+    }
+    ch = ch << 6 | (byte(i + k) & 0x3F);
+  }
+  i += extra + 1;
+  return ch;
+}
+
+void append_number(std::string &out, unsigned value) {
+  char digits[12];
+  const auto end = std::to_chars(digits, digits + sizeof(digits), value).ptr;
+  out.append(digits, end);
+}
+
+void append_color(std::string &out, bool foreground, TerminalColor color) {
+  if (color == TERMINAL_DEFAULT_COLOR) {
+    out += foreground ? "\x1b[39m" : "\x1b[49m";
+    return;
+  }
+  out += foreground ? "\x1b[38;2;" : "\x1b[48;2;";
+  append_number(out, color >> 16 & 0xFF);
+  out += ';';
+  append_number(out, color >> 8 & 0xFF);
+  out += ';';
+  append_number(out, color & 0xFF);
+  out += 'm';
+}
+
+void write_all(const std::string &out) {
+  size_t done = 0;
+  while (done < out.size()) {
+    const ssize_t n = ::write(STDOUT_FILENO, out.data() + done,
+                              out.size() - done);
+    if (n <= 0)
+      return;
+    done += static_cast<size_t>(n);
+  }
+}
+
+} // namespace
+
+TerminalColor terminal_hsv(float h, float s, float v) {
+  h = std::fmod(h, 1.0f) * 6.0f;
+  const int sector = static_cast<int>(h);
+  const float f = h - static_cast<float>(sector);
+  const float p = v * (1.0f - s);
+  const float q = v * (1.0f - s * f);
+  const float t = v * (1.0f - s * (1.0f - f));
+  switch (sector) {
+  case 0:
+    return terminal_rgb(v, t, p);
+  case 1:
+    return terminal_rgb(q, v, p);
+  case 2:
+    return terminal_rgb(p, v, t);
+  case 3:
+    return terminal_rgb(p, q, v);
+  case 4:
+    return terminal_rgb(t, p, v);
+  default:
+    return terminal_rgb(v, p, q);
+  }
+}
+
+struct TerminalScreen::Saved {
+  termios attributes{};
+  struct sigaction sigint {};
+  struct sigaction sigterm {};
+};
+
+struct TerminalScreen::LogCapture {
+  std::shared_ptr<spdlog::logger> previous;
+  std::shared_ptr<spdlog::sinks::ringbuffer_sink_mt> sink;
+};
+
+TerminalScreen::TerminalScreen() {
+  if (!isatty(STDOUT_FILENO))
+    return;
+  active_ = true;
+  saved_ = std::make_unique<Saved>();
+
+  if (isatty(STDIN_FILENO) &&
+      tcgetattr(STDIN_FILENO, &saved_->attributes) == 0) {
+    // Keys arrive unechoed and one at a time; Ctrl-C still raises SIGINT.
+    termios raw = saved_->attributes;
+    raw.c_lflag &= ~static_cast<tcflag_t>(ICANON | ECHO);
+    raw.c_cc[VMIN] = 0;
+    raw.c_cc[VTIME] = 0;
+    tcsetattr(STDIN_FILENO, TCSANOW, &raw);
+  }
+
+  struct sigaction action {};
+  action.sa_handler = on_interrupt;
+  sigemptyset(&action.sa_mask);
+  sigaction(SIGINT, &action, &saved_->sigint);
+  sigaction(SIGTERM, &action, &saved_->sigterm);
+  g_interrupted.store(false, std::memory_order_relaxed);
+
+  // Log lines would scroll the screen; keep them in a ring instead. The
+  // previous logger stays alive, so threads that are logging through it
+  // right now are unaffected.
+  if (isatty(STDERR_FILENO)) {
+    log_ = std::make_unique<LogCapture>();
+    log_->previous = spdlog::default_logger();
+    log_->sink = std::make_shared<spdlog::sinks::ringbuffer_sink_mt>(64);
+    log_->sink->set_pattern("%H:%M:%S %L %v");
+    auto logger = std::make_shared<spdlog::logger>(log_->previous->name(),
+                                                   log_->sink);
+    logger->set_level(log_->previous->level());
+    spdlog::set_default_logger(std::move(logger));
+  }
+
+  write_all("\x1b[?1049h\x1b[?25l\x1b[2J");
+  clear();
+}
+
+TerminalScreen::~TerminalScreen() {
+  if (!active_)
+    return;
+  write_all("\x1b[0m\x1b[?25h\x1b[?1049l");
+  if (isatty(STDIN_FILENO))
+    tcsetattr(STDIN_FILENO, TCSANOW, &saved_->attributes);
+  sigaction(SIGINT, &saved_->sigint, nullptr);
+  sigaction(SIGTERM, &saved_->sigterm, nullptr);
+
+  if (log_) {
+    spdlog::set_default_logger(log_->previous);
+    for (const auto &line : log_->sink->last_formatted())
+      std::fputs(line.c_str(), stderr);
+  }
+}
+
+void TerminalScreen::clear() {
+  if (!active_)
+    return;
+  winsize size{};
+  if (ioctl(STDOUT_FILENO, TIOCGWINSZ, &size) == 0 && size.ws_col > 0 &&
+      (size.ws_col != width_ || size.ws_row != height_)) {
+    width_ = size.ws_col;
+    height_ = size.ws_row;
+    front_.assign(static_cast<size_t>(width_) * height_, Cell{});
+    full_redraw_ = true;
+  }
+  back_.assign(static_cast<size_t>(width_) * height_, Cell{});
+}
+
+int TerminalScreen::text(int x, int y, std::string_view utf8,
+                         TerminalColor fg, TerminalColor bg) {
+  int drawn = 0;
+  for (size_t i = 0; i < utf8.size();) {
+    const char32_t ch = next_utf8(utf8, i);
+    if (Cell *c = cell(x + drawn, y))
+      *c = {ch, fg, bg};
+    else if (x + drawn >= width_)
+      break;
+    ++drawn;
+  }
+  return drawn;
+}
+
+void TerminalScreen::glyph(int x, int y, char32_t ch, TerminalColor fg,
+                           TerminalColor bg) {
+  if (Cell *c = cell(x, y))
+    *c = {ch, fg, bg};
+}
+
+void TerminalScreen::fill(int x, int y, int w, TerminalColor bg) {
+  for (int i = 0; i < w; ++i) {
+    if (Cell *c = cell(x + i, y))
+      c->bg = bg;
+  }
+}
+
+void TerminalScreen::sparkline(int x, int y, int w,
+                               std::span<const float> values,
+                               TerminalColor fg, TerminalColor bg) {
+  if (w <= 0 || values.empty())
+    return;
+  const auto shown =
+      values.last(std::min(values.size(), static_cast<size_t>(w)));
+  // Non-finite values (a missing or broken reading) leave a gap.
+  float lo = std::numeric_limits<float>::infinity();
+  float hi = -std::numeric_limits<float>::infinity();
+  for (const float v : shown) {
+    if (is_finite(v)) {
+      lo = std::min(lo, v);
+      hi = std::max(hi, v);
+    }
+  }
+  const float range = hi - lo;
+  for (size_t i = 0; i < shown.size(); ++i) {
+    if (!is_finite(shown[i])) {
+      glyph(x + static_cast<int>(i), y, U' ', fg, bg);
+      continue;
+    }
+    const int level =
+        is_finite(range) && range > 0.0f
+            ? static_cast<int>((shown[i] - lo) / range * 7.0f + 0.5f)
+            : 3;
+    glyph(x + static_cast<int>(i), y, U'▁' + level, fg, bg);
+  }
+}
+
+void TerminalScreen::present() {
+  if (!active_)
+    return;
+  out_.clear();
+  if (full_redraw_) {
+    out_ += "\x1b[0m\x1b[2J";
+    // Differ from every cell so all of them are sent.
+    std::ranges::fill(front_, Cell{0, 0, 0});
+    full_redraw_ = false;
+  }
+
+  TerminalColor fg = 0xFFFFFFFF, bg = 0xFFFFFFFF; // Unknown
+  int cursor_x = -1, cursor_y = -1;
+  for (int y = 0; y < height_; ++y) {
+    for (int x = 0; x < width_; ++x) {
+      const size_t i = static_cast<size_t>(y) * width_ + x;
+      const Cell &c = back_[i];
+      if (c == front_[i])
+        continue;
+      if (x != cursor_x || y != cursor_y) {
+        out_ += "\x1b[";
+        append_number(out_, static_cast<unsigned>(y + 1));
+        out_ += ';';
+        append_number(out_, static_cast<unsigned>(x + 1));
+        out_ += 'H';
+      }
+      if (c.fg != fg)
+        append_color(out_, true, fg = c.fg);
+      if (c.bg != bg)
+        append_color(out_, false, bg = c.bg);
+      append_utf8(out_, c.ch);
+      front_[i] = c;
+      cursor_x = x + 1;
+      cursor_y = y;
+      ++stats_.cells_written;
+    }
+  }
+  ++stats_.frames;
+  if (out_.empty())
+    return;
+  write_all(out_);
+  stats_.bytes_written += out_.size();
+}
+
+int TerminalScreen::read_key(int timeout_ms) {
+  pollfd fd{STDIN_FILENO, POLLIN, 0};
+  if (::poll(&fd, 1, std::max(timeout_ms, 0)) <= 0 || !(fd.revents & POLLIN))
+    return KEY_NONE;
+  char buffer[16];
+  const ssize_t n = ::read(STDIN_FILENO, buffer, sizeof(buffer));
+  if (n <= 0)
+    return KEY_NONE;
+  if (buffer[0] != '\x1b' || n < 3 || buffer[1] != '[')
+    return static_cast<unsigned char>(buffer[0]);
+  switch (buffer[2]) {
+  case 'A':
+    return KEY_UP;
+  case 'B':
+    return KEY_DOWN;
+  case 'C':
+    return KEY_RIGHT;
+  case 'D':
+    return KEY_LEFT;
+  case 'H':
+    return KEY_HOME;
+  case 'F':
+    return KEY_END;
+  case '5':
+    return KEY_PAGE_UP;
+  case '6':
+    return KEY_PAGE_DOWN;
+  }
+  return KEY_NONE;
+}
+
+bool TerminalScreen::interrupted() noexcept {
+  return g_interrupted.load(std::memory_order_relaxed);
+}
+
+std::vector<std::string> TerminalScreen::recent_log(size_t n) const {
+  if (!log_)
+    return {};
+  auto lines = log_->sink->last_formatted(n);
+  for (auto &line : lines) {
+    while (!line.empty() && (line.back() == '\n' || line.back() == '\r'))
+      line.pop_back();
+  }
+  return lines;
+}
+
+BrailleCanvas::BrailleCanvas(int cols, int rows)
+    : cols_{std::max(cols, 1)}, rows_{std::max(rows, 1)},
+      bits_(static_cast<size_t>(cols_) * rows_) {}
+
+void BrailleCanvas::clear() { std::ranges::fill(bits_, 0); }
+
+void BrailleCanvas::set(int x, int y) {
+  if (x < 0 || y < 0 || x >= dots_x() || y >= dots_y())
+    return;
+  // Dots 1-3 and 7 run down the left column, 4-6 and 8 down the right.
+  static constexpr uint8_t DOT[2][4] = {{0x01, 0x02, 0x04, 0x40},
+                                        {0x08, 0x10, 0x20, 0x80}};
+  bits_[static_cast<size_t>(y / 4) * cols_ + x / 2] |= DOT[x % 2][y % 4];
+}
+
+void BrailleCanvas::line(int x0, int y0, int x1, int y1) {
+  // Bresenham.
+  const int dx = std::abs(x1 - x0), sx = x0 < x1 ? 1 : -1;
+  const int dy = -std::abs(y1 - y0), sy = y0 < y1 ? 1 : -1;
+  int err = dx + dy;
+  for (;;) {
+    set(x0, y0);
+    if (x0 == x1 && y0 == y1)
+      return;
+    const int e2 = 2 * err;
+    if (e2 >= dy) {
+      err += dy;
+      x0 += sx;
+    }
+    if (e2 <= dx) {
+      err += dx;
+      y0 += sy;
+    }
+  }
+}
+
+void BrailleCanvas::plot(std::span<const float> xs, std::span<const float> ys,
+                         float x_lo, float x_hi, float y_lo, float y_hi) {
+  const size_t n = std::min(xs.size(), ys.size());
+  if (n == 0 || !is_finite(x_lo) || !is_finite(x_hi) || !(x_hi > x_lo))
+    return;
+  // Points with a non-finite coordinate are skipped and break the line.
+  auto finite = [&](size_t i) { return is_finite(xs[i]) && is_finite(ys[i]); };
+  if (!is_finite(y_lo) || !is_finite(y_hi) || !(y_hi > y_lo)) {
+    float lo = std::numeric_limits<float>::infinity();
+    float hi = -std::numeric_limits<float>::infinity();
+    for (size_t i = 0; i < n; ++i) {
+      if (finite(i)) {
+        lo = std::min(lo, ys[i]);
+        hi = std::max(hi, ys[i]);
+      }
+    }
+    if (lo > hi)
+      return;
+    const float margin = hi > lo ? 0.0f : std::max(std::abs(lo) * 0.01f, 0.5f);
+    y_lo = lo - margin;
+    y_hi = hi + margin;
+  }
+  const float sx = static_cast<float>(dots_x() - 1) / (x_hi - x_lo);
+  const float sy = static_cast<float>(dots_y() - 1) / (y_hi - y_lo);
+  // Far-off points only set the slope of the edge segment; clamping keeps
+  // lround in range and line() short.
+  const float limit = 4.0f * static_cast<float>(dots_x() + dots_y());
+  auto dot = [&](float v) {
+    return static_cast<int>(std::lround(std::clamp(v, -limit, limit)));
+  };
+  auto to_dot = [&](size_t i) {
+    return std::pair{dot((xs[i] - x_lo) * sx),
+                     dots_y() - 1 - dot((ys[i] - y_lo) * sy)};
+  };
+  bool connected = false;
+  int px = 0, py = 0;
+  for (size_t i = 0; i < n; ++i) {
+    if (!finite(i)) {
+      connected = false;
+      continue;
+    }
+    const auto [x, y] = to_dot(i);
+    if (connected)
+      line(px, py, x, y);
+    else
+      set(x, y);
+    px = x;
+    py = y;
+    connected = true;
+  }
+}
+
+void BrailleCanvas::draw(TerminalScreen &screen, int x, int y,
+                         TerminalColor fg, TerminalColor bg) const {
+  for (int row = 0; row < rows_; ++row) {
+    for (int col = 0; col < cols_; ++col) {
+      const uint8_t bits = bits_[static_cast<size_t>(row) * cols_ + col];
+      if (bits)
+        screen.glyph(x + col, y + row, U'⠀' + bits, fg, bg);
+      else if (bg != TERMINAL_DEFAULT_COLOR)
+        screen.fill(x + col, y + row, 1, bg);
+    }
+  }
+}
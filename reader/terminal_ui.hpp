@@ -0,0 +1,191 @@
+/**
+ * @file terminal_ui.hpp
+ * @brief ANSI terminal output for the --tui modes of pm_measure and
+ * pm_monitor, for hosts without an X server. No curses.
+ *
+ * A frame is drawn into a cell buffer; present() compares it with what the
+ * terminal already shows and writes only the changed cells, with one
+ * write(2) per frame. A frame that changes nothing costs no output at all.
+ * Colors are 24-bit; plots use block sparklines and braille dots (2x4 per
+ * cell).
+ */
+
+#pragma once
+#include <cstdint>
+#include <memory>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/** @brief 0xRRGGBB, or TERMINAL_DEFAULT_COLOR for the terminal's own. */
+using TerminalColor = uint32_t;
+constexpr TerminalColor TERMINAL_DEFAULT_COLOR = 0xFF000000;
+
+constexpr TerminalColor terminal_rgb(float r, float g, float b) {
+  auto channel = [](float v) {
+    return static_cast<uint32_t>((v < 0.0f ? 0.0f : v > 1.0f ? 1.0f : v) *
+                                     255.0f +
+                                 0.5f);
+  };
+  return channel(r) << 16 | channel(g) << 8 | channel(b);
+}
+
+/** @brief Hue, saturation and value in [0, 1], as ImGui's HSV helpers. */
+TerminalColor terminal_hsv(float h, float s, float v);
+
+/**
+ * @class TerminalScreen
+ * @brief Owns the terminal while alive: alternate screen, hidden cursor,
+ * unbuffered keys; restores everything on destruction.
+ *
+ * While the screen is up, spdlog's default logger is redirected into a ring
+ * (shown with recent_log()) if stderr is the terminal, and the messages are
+ * printed to stderr on exit. SIGINT and SIGTERM set interrupted() instead of
+ * killing the process with the terminal in raw mode. Single-threaded: draw,
+ * present and read keys from one UI thread.
+ */
+class TerminalScreen {
+public:
+  enum Key : int {
+    KEY_NONE = -1,
+    KEY_UP = 0x100,
+    KEY_DOWN,
+    KEY_LEFT,
+    KEY_RIGHT,
+    KEY_PAGE_UP,
+    KEY_PAGE_DOWN,
+    KEY_HOME,
+    KEY_END,
+  };
+
+  struct Stats {
+    uint64_t frames = 0;
+    uint64_t cells_written = 0;
+    uint64_t bytes_written = 0;
+  };
+
+  TerminalScreen();
+  ~TerminalScreen();
+
+  TerminalScreen(const TerminalScreen &) = delete;
+  TerminalScreen &operator=(const TerminalScreen &) = delete;
+
+  /** @brief False if stdout is not a terminal; nothing is drawn then. */
+  explicit operator bool() const noexcept { return active_; }
+
+  int width() const noexcept { return width_; }
+  int height() const noexcept { return height_; }
+
+  /**
+   * @brief Start a frame: blank the cell buffer, picking up a new terminal
+   * size (the next present() then redraws everything).
+   */
+  void clear();
+
+  /**
+   * @brief Draw UTF-8 text, one code point per cell, clipped at the right
+   * edge. @return Cells drawn.
+   */
+  int text(int x, int y, std::string_view utf8,
+           TerminalColor fg = TERMINAL_DEFAULT_COLOR,
+           TerminalColor bg = TERMINAL_DEFAULT_COLOR);
+
+  void glyph(int x, int y, char32_t ch, TerminalColor fg,
+             TerminalColor bg = TERMINAL_DEFAULT_COLOR);
+
+  /** @brief Set the background of @p w cells, keeping their glyphs. */
+  void fill(int x, int y, int w, TerminalColor bg);
+
+  /**
+   * @brief The last @p w values as block characters (U+2581..U+2588),
+   * scaled to their own min..max; non-finite values are left blank.
+   */
+  void sparkline(int x, int y, int w, std::span<const float> values,
+                 TerminalColor fg, TerminalColor bg = TERMINAL_DEFAULT_COLOR);
+
+  /** @brief Send the changed cells to the terminal. */
+  void present();
+
+  /**
+   * @brief Wait up to @p timeout_ms for a key. @return An ASCII code, a Key,
+   * or KEY_NONE on timeout or signal.
+   */
+  int read_key(int timeout_ms);
+
+  /** @brief SIGINT or SIGTERM arrived while the screen was up. */
+  static bool interrupted() noexcept;
+
+  /** @brief Newest captured log lines, oldest first. */
+  std::vector<std::string> recent_log(size_t n) const;
+
+  const Stats &stats() const noexcept { return stats_; }
+
+private:
+  struct Cell {
+    char32_t ch = U' ';
+    TerminalColor fg = TERMINAL_DEFAULT_COLOR;
+    TerminalColor bg = TERMINAL_DEFAULT_COLOR;
+    bool operator==(const Cell &) const = default;
+  };
+  struct Saved;
+  struct LogCapture;
+
+  Cell *cell(int x, int y) noexcept {
+    return x >= 0 && y >= 0 && x < width_ && y < height_
+               ? &back_[static_cast<size_t>(y) * width_ + x]
+               : nullptr;
+  }
+
+  bool active_ = false;
+  int width_ = 0;
+  int height_ = 0;
+  bool full_redraw_ = true;
+  std::vector<Cell> front_; ///< What the terminal shows
+  std::vector<Cell> back_;  ///< The frame being drawn
+  std::string out_;         ///< Reused escape-sequence buffer
+  Stats stats_;
+  std::unique_ptr<Saved> saved_;
+  std::unique_ptr<LogCapture> log_;
+};
+
+/**
+ * @class BrailleCanvas
+ * @brief A cols x rows cell plot with 2x4 dots per cell (U+2800..U+28FF).
+ */
+class BrailleCanvas {
+public:
+  BrailleCanvas(int cols, int rows);
+
+  int cols() const noexcept { return cols_; }
+  int rows() const noexcept { return rows_; }
+  int dots_x() const noexcept { return cols_ * 2; }
+  int dots_y() const noexcept { return rows_ * 4; }
+
+  void clear();
+
+  /** @brief Set dot (x, y); y = 0 is the top. Out-of-range dots are ignored. */
+  void set(int x, int y);
+
+  void line(int x0, int y0, int x1, int y1);
+
+  /**
+   * @brief Connect the points (xs[i], ys[i]) within the given ranges; an
+   * empty y range (lo >= hi) is widened around the data. Non-finite points
+   * are skipped and break the line.
+   */
+  void plot(std::span<const float> xs, std::span<const float> ys, float x_lo,
+            float x_hi, float y_lo, float y_hi);
+
+  /**
+   * @brief Draw the cells with dots; empty cells keep their glyph and only
+   * take @p bg.
+   */
+  void draw(TerminalScreen &screen, int x, int y, TerminalColor fg,
+            TerminalColor bg = TERMINAL_DEFAULT_COLOR) const;
+
+private:
+  int cols_;
+  int rows_;
+  std::vector<uint8_t> bits_; ///< One braille pattern per cell
+};
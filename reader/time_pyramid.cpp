@@ -0,0 +1,185 @@
+/**
+ * @file time_pyramid.cpp
+ * @brief PyramidWriter (incremental level building) and TimePyramid queries.
+ */
+
+#include "time_pyramid.hpp"
+
+#include <algorithm>
+#include <filesystem>
+#include <limits>
+#include <spdlog/spdlog.h>
+
+std::string pyramid_level_path(const std::string &raw_path,
+                               const PyramidLevelSpec &level) {
+  std::string stem = raw_path;
+  if (stem.ends_with(".pmcol"))
+    stem.resize(stem.size() - 6);
+  return stem + "." + level.label + ".pmcol";
+}
+
+uint64_t pyramid_chunk_bytes(uint32_t sample_bytes) {
+  const auto level_cells = 3 * (sample_bytes / 4) + 1;
+  uint64_t bytes = 0;
+  for (size_t i = 0; i < PYRAMID_LEVELS.size(); ++i)
+    bytes += columnar_chunk_bytes(pyramid_chunk_rows(i), level_cells);
+  return bytes;
+}
+
+PyramidWriter::PyramidWriter(const std::string &raw_path,
+                             uint32_t sample_bytes, uint32_t pm_table_version)
+    : n_cells_{sample_bytes / 4}, row_(3 * size_t{sample_bytes / 4} + 1) {
+  const auto level_bytes = static_cast<uint32_t>(row_.size() * 4);
+  for (size_t i = 0; i < PYRAMID_LEVELS.size(); ++i) {
+    const PyramidLevelSpec &spec = PYRAMID_LEVELS[i];
+    const std::string extra =
+        "\"pyramid\": {\"bucket_ns\": " + std::to_string(spec.bucket_ns) +
+        ", \"n_source_cells\": " + std::to_string(n_cells_) +
+        ", \"cells\": [\"min\", \"max\", \"mean\", \"count\"]}";
+    Level level;
+    level.bucket_ns = spec.bucket_ns;
+    level.file = std::make_unique<ColumnarFileWriter>(
+        pyramid_level_path(raw_path, spec), level_bytes, pm_table_version,
+        pyramid_chunk_rows(i), extra);
+    level.min.resize(n_cells_);
+    level.max.resize(n_cells_);
+    level.sum.resize(n_cells_);
+    ok_ = ok_ && static_cast<bool>(*level.file);
+    levels_.push_back(std::move(level));
+  }
+}
+
+void PyramidWriter::open_bucket(Level &level, uint64_t bucket) {
+  level.bucket = bucket;
+  level.count = 0;
+  std::fill(level.min.begin(), level.min.end(),
+            std::numeric_limits<float>::infinity());
+  std::fill(level.max.begin(), level.max.end(),
+            -std::numeric_limits<float>::infinity());
+  std::fill(level.sum.begin(), level.sum.end(), 0.0);
+}
+
+/**
+ * @brief Write the open bucket of a level and merge it into the next one.
+ */
+bool PyramidWriter::emit(size_t level_index) {
+  Level &level = levels_[level_index];
+  if (level.count == 0)
+    return true;
+  const uint64_t start = level.bucket * level.bucket_ns;
+  const double inv_count = 1.0 / static_cast<double>(level.count);
+  std::copy(level.min.begin(), level.min.end(), row_.begin());
+  std::copy(level.max.begin(), level.max.end(), row_.begin() + n_cells_);
+  for (size_t c = 0; c < n_cells_; ++c)
+    row_[2 * n_cells_ + c] = static_cast<float>(level.sum[c] * inv_count);
+  row_.back() = static_cast<float>(level.count);
+  bool ok = level.file->add(start, row_.data());
+
+  if (level_index + 1 < levels_.size()) {
+    Level &parent = levels_[level_index + 1];
+    const uint64_t bucket = start / parent.bucket_ns;
+    if (parent.count > 0 && bucket != parent.bucket)
+      ok = emit(level_index + 1) && ok;
+    if (parent.count == 0)
+      open_bucket(parent, bucket);
+    for (size_t c = 0; c < n_cells_; ++c) {
+      parent.min[c] = level.min[c] < parent.min[c] ? level.min[c]
+                                                    : parent.min[c];
+      parent.max[c] = level.max[c] > parent.max[c] ? level.max[c]
+                                                    : parent.max[c];
+      parent.sum[c] += level.sum[c];
+    }
+    parent.count += level.count;
+  }
+  level.count = 0;
+  return ok;
+}
+
+bool PyramidWriter::add_rows(const uint64_t *timestamps, const uint32_t *rows,
+                             size_t n) {
+  if (!ok_)
+    return false;
+  Level &level = levels_.front();
+  bool ok = true;
+  for (size_t i = 0; i < n; ++i) {
+    const uint64_t bucket = timestamps[i] / level.bucket_ns;
+    if (level.count > 0 && bucket != level.bucket)
+      ok = emit(0) && ok;
+    if (level.count == 0)
+      open_bucket(level, bucket);
+    const auto *values = reinterpret_cast<const float *>(rows + i * n_cells_);
+    // Comparisons are false for NaN, so NaN cells never replace min/max.
+    for (size_t c = 0; c < n_cells_; ++c) {
+      const float v = values[c];
+      level.min[c] = v < level.min[c] ? v : level.min[c];
+      level.max[c] = v > level.max[c] ? v : level.max[c];
+      level.sum[c] += v;
+    }
+    ++level.count;
+  }
+  return ok;
+}
+
+bool PyramidWriter::close() {
+  bool ok = true;
+  for (size_t i = 0; i < levels_.size(); ++i)
+    ok = emit(i) && ok;
+  for (auto &level : levels_)
+    ok = level.file->close() && ok;
+  return ok;
+}
+
+TimePyramid::TimePyramid(const std::string &raw_path)
+    : raw_{std::make_unique<ColumnarReader>(raw_path)} {
+  for (const auto &spec : PYRAMID_LEVELS) {
+    const std::string path = pyramid_level_path(raw_path, spec);
+    if (!std::filesystem::exists(path))
+      continue;
+    auto reader = std::make_unique<ColumnarReader>(path);
+    if (*reader && reader->n_cells() == 3 * raw_->n_cells() + 1)
+      levels_.emplace_back(spec.bucket_ns, std::move(reader));
+  }
+  SPDLOG_DEBUG("{}: {} pyramid levels.", raw_path, levels_.size());
+}
+
+uint64_t TimePyramid::choose_bucket_ns(uint64_t t0_ns, uint64_t t1_ns,
+                                       uint32_t pixel_width) const {
+  const uint64_t per_pixel =
+      (t1_ns > t0_ns ? t1_ns - t0_ns : 0) / std::max<uint32_t>(pixel_width, 1);
+  uint64_t chosen = 0;
+  for (const auto &[bucket_ns, reader] : levels_) {
+    if (bucket_ns <= per_pixel)
+      chosen = bucket_ns;
+  }
+  return chosen;
+}
+
+TimePyramid::Series TimePyramid::query(uint32_t cell, uint64_t t0_ns,
+                                       uint64_t t1_ns,
+                                       uint32_t pixel_width) const {
+  Series series;
+  if (!*this || cell >= raw_->n_cells())
+    return series;
+  series.bucket_ns = choose_bucket_ns(t0_ns, t1_ns, pixel_width);
+
+  if (series.bucket_ns == 0) {
+    raw_->read_window(cell, t0_ns, t1_ns, series.timestamps, series.mean);
+    series.min = series.mean;
+    series.max = series.mean;
+    return series;
+  }
+
+  const auto &reader =
+      std::ranges::find(levels_, series.bucket_ns,
+                        [](const auto &level) { return level.first; })
+          ->second;
+  const uint32_t n = raw_->n_cells();
+  // Include the bucket that contains t0.
+  const uint64_t start = t0_ns - t0_ns % series.bucket_ns;
+  std::vector<uint64_t> scratch;
+  reader->read_window(cell, start, t1_ns, series.timestamps, series.min);
+  reader->read_window(n + cell, start, t1_ns, scratch, series.max);
+  scratch.clear();
+  reader->read_window(2 * n + cell, start, t1_ns, scratch, series.mean);
+  return series;
+}
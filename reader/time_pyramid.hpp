@@ -0,0 +1,132 @@
+/**
+ * @file time_pyramid.hpp
+ * @brief Multi-resolution summaries (min/max/mean/count) next to a .pmcol.
+ *
+ * For a recording `x.pmcol` the levels are stored as `x.10ms.pmcol`,
+ * `x.100ms.pmcol`, `x.1s.pmcol` and `x.10s.pmcol`. Each level is itself a
+ * columnar file (so the same readers and numpy.memmap apply) whose samples
+ * are buckets aligned to multiples of the bucket width since the epoch:
+ *
+ *   timestamp = bucket start
+ *   cells     = min[n], max[n], mean[n], count   (3 n + 1 float columns)
+ *
+ * Levels are built incrementally: raw samples feed the 10 ms level and every
+ * finished bucket is merged into the next coarser level. A coarser level has
+ * a tenth of the rows, so its chunks are smaller too (pyramid_chunk_rows);
+ * one chunk spans 10-20 s at every level.
+ */
+
+#pragma once
+#include "columnar_log.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+struct PyramidLevelSpec {
+  const char *label;
+  uint64_t bucket_ns;
+};
+
+inline constexpr std::array<PyramidLevelSpec, 4> PYRAMID_LEVELS = {{
+    {"10ms", 10'000'000ull},
+    {"100ms", 100'000'000ull},
+    {"1s", 1'000'000'000ull},
+    {"10s", 10'000'000'000ull},
+}};
+
+/// Chunk rows of the 10 ms level; each coarser level uses 8x fewer.
+inline constexpr uint32_t PYRAMID_BASE_CHUNK_ROWS = 1024;
+inline constexpr uint32_t PYRAMID_CHUNK_SHIFT = 3;
+
+constexpr uint32_t pyramid_chunk_rows(size_t level_index) {
+  return std::max<uint32_t>(
+      1, PYRAMID_BASE_CHUNK_ROWS >> (PYRAMID_CHUNK_SHIFT * level_index));
+}
+
+/**
+ * @brief Chunk buffers of all level writers of a table of @p sample_bytes,
+ * the pyramid's steady-state memory.
+ */
+uint64_t pyramid_chunk_bytes(uint32_t sample_bytes);
+
+/** @brief Path of a level file next to the raw .pmcol recording. */
+std::string pyramid_level_path(const std::string &raw_path,
+                               const PyramidLevelSpec &level);
+
+/**
+ * @class PyramidWriter
+ * @brief Builds all levels from row-major raw samples (float cells).
+ */
+class PyramidWriter {
+public:
+  PyramidWriter(const std::string &raw_path, uint32_t sample_bytes,
+                uint32_t pm_table_version);
+
+  explicit operator bool() const noexcept { return ok_; }
+
+  bool add_rows(const uint64_t *timestamps, const uint32_t *rows, size_t n);
+
+  /** @brief Emit the open buckets and close every level file. */
+  bool close();
+
+private:
+  struct Level {
+    uint64_t bucket_ns;
+    std::unique_ptr<ColumnarFileWriter> file;
+    uint64_t bucket = 0; ///< Index of the open bucket (valid if count > 0)
+    uint64_t count = 0;
+    std::vector<float> min, max;
+    std::vector<double> sum;
+  };
+
+  void open_bucket(Level &level, uint64_t bucket);
+  bool emit(size_t level_index);
+
+  uint32_t n_cells_;
+  std::vector<Level> levels_;
+  std::vector<float> row_; ///< Scratch: one output row of 3 n + 1 floats
+  bool ok_ = true;
+};
+
+/**
+ * @class TimePyramid
+ * @brief Query side: picks the coarsest level that still resolves the
+ * requested pixel width, so any zoom level reads a bounded number of values.
+ */
+class TimePyramid {
+public:
+  /** @brief Min/max/mean per bucket; raw samples have min == max == mean. */
+  struct Series {
+    uint64_t bucket_ns = 0; ///< 0 for raw samples
+    std::vector<uint64_t> timestamps;
+    std::vector<float> min, max, mean;
+  };
+
+  explicit TimePyramid(const std::string &raw_path);
+
+  explicit operator bool() const noexcept { return raw_ && *raw_; }
+
+  uint32_t n_cells() const { return raw_->n_cells(); }
+  uint64_t first_timestamp_ns() const { return raw_->first_timestamp_ns(); }
+  uint64_t last_timestamp_ns() const { return raw_->last_timestamp_ns(); }
+
+  /**
+   * @brief Bucket width query() uses for this range and width (0 = raw):
+   * the coarsest level with at least one bucket per pixel.
+   */
+  uint64_t choose_bucket_ns(uint64_t t0_ns, uint64_t t1_ns,
+                            uint32_t pixel_width) const;
+
+  Series query(uint32_t cell, uint64_t t0_ns, uint64_t t1_ns,
+               uint32_t pixel_width) const;
+
+private:
+  std::unique_ptr<ColumnarReader> raw_;
+  /// Available levels, finest first.
+  std::vector<std::pair<uint64_t, std::unique_ptr<ColumnarReader>>> levels_;
+};
@@ -0,0 +1,455 @@
+/**
+ * @file trace_export.cpp
+ * @brief TraceExporter: Perfetto protobuf and Chrome JSON encoders.
+ */
+
+#include "trace_export.hpp"
+#include "float_bits.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <cerrno>
+#include <charconv>
+#include <cstring>
+#include <ctime>
+#include <fcntl.h>
+#include <spdlog/spdlog.h>
+#include <unistd.h>
+
+namespace {
+
+// Field numbers from perfetto/protos/perfetto/trace/*.proto.
+namespace pb {
+constexpr uint32_t TRACE_PACKET = 1;
+
+constexpr uint32_t PACKET_CLOCK_SNAPSHOT = 6;
+constexpr uint32_t PACKET_TIMESTAMP = 8;
+constexpr uint32_t PACKET_SEQUENCE_ID = 10; ///< trusted_packet_sequence_id
+constexpr uint32_t PACKET_TRACK_EVENT = 11;
+constexpr uint32_t PACKET_SEQUENCE_FLAGS = 13;
+constexpr uint32_t PACKET_TIMESTAMP_CLOCK_ID = 58;
+constexpr uint32_t PACKET_TRACK_DESCRIPTOR = 60;
+
+constexpr uint32_t CLOCK_SNAPSHOT_CLOCKS = 1;
+constexpr uint32_t CLOCK_ID = 1;
+constexpr uint32_t CLOCK_TIMESTAMP = 2;
+
+constexpr uint32_t TRACK_UUID = 1;
+constexpr uint32_t TRACK_NAME = 2;
+constexpr uint32_t TRACK_PROCESS = 3;
+constexpr uint32_t TRACK_PARENT_UUID = 5;
+constexpr uint32_t TRACK_COUNTER = 8;
+constexpr uint32_t PROCESS_PID = 1;
+constexpr uint32_t PROCESS_NAME = 6;
+constexpr uint32_t COUNTER_UNIT_NAME = 6;
+
+constexpr uint32_t EVENT_TYPE = 9;
+constexpr uint32_t EVENT_TRACK_UUID = 11;
+constexpr uint32_t EVENT_NAME = 23;
+constexpr uint32_t EVENT_DOUBLE_COUNTER_VALUE = 44;
+constexpr uint64_t TYPE_INSTANT = 3;
+constexpr uint64_t TYPE_COUNTER = 4;
+
+constexpr uint64_t BUILTIN_CLOCK_MONOTONIC = 3;
+constexpr uint64_t BUILTIN_CLOCK_BOOTTIME = 6;
+constexpr uint64_t SEQ_INCREMENTAL_STATE_CLEARED = 1;
+constexpr uint64_t SEQUENCE_ID = 1;
+
+enum Wire : uint32_t { VARINT = 0, FIXED64 = 1, BYTES = 2 };
+
+void put_varint(std::string &out, uint64_t value) {
+  while (value >= 0x80) {
+    out.push_back(static_cast<char>(value | 0x80));
+    value >>= 7;
+  }
+  out.push_back(static_cast<char>(value));
+}
+
+void put_uint(std::string &out, uint32_t field, uint64_t value) {
+  put_varint(out, field << 3 | VARINT);
+  put_varint(out, value);
+}
+
+void put_double(std::string &out, uint32_t field, double value) {
+  put_varint(out, field << 3 | FIXED64);
+  const auto bits = std::bit_cast<uint64_t>(value);
+  for (int i = 0; i < 8; ++i)
+    out.push_back(static_cast<char>(bits >> (8 * i)));
+}
+
+void put_bytes(std::string &out, uint32_t field, std::string_view bytes) {
+  put_varint(out, field << 3 | BYTES);
+  put_varint(out, bytes.size());
+  out.append(bytes);
+}
+
+/// Fields every packet of this writer carries.
+void put_packet_header(std::string &packet, uint64_t timestamp_ns) {
+  put_uint(packet, PACKET_TIMESTAMP, timestamp_ns);
+  put_uint(packet, PACKET_TIMESTAMP_CLOCK_ID, BUILTIN_CLOCK_MONOTONIC);
+  put_uint(packet, PACKET_SEQUENCE_ID, SEQUENCE_ID);
+}
+} // namespace pb
+
+/// A counter computed from named cells; tables must be >= min_floats.
+struct DerivedChannel {
+  const char *name;
+  const char *unit;
+  float (*value)(const PmTableLayout &, const float *);
+};
+
+constexpr DerivedChannel DERIVED_CHANNELS[] = {
+    {"Socket power", "W",
+     [](const PmTableLayout &l, const float *t) { return t[l.socket_power]; }},
+    {"Core power (sum)", "W",
+     [](const PmTableLayout &l, const float *t) {
+       float sum = 0.0f;
+       for (size_t c = 0; c < l.n_cores; ++c)
+         sum += t[l.core_power + c];
+       return sum;
+     }},
+    {"Core temperature (max)", "degC",
+     [](const PmTableLayout &l, const float *t) {
+       return *std::max_element(t + l.core_temp, t + l.core_temp + l.n_cores);
+     }},
+    {"SoC temperature", "degC",
+     [](const PmTableLayout &l, const float *t) { return t[l.soc_temp]; }},
+    {"STAPM headroom", "W",
+     [](const PmTableLayout &l, const float *t) {
+       return t[l.stapm_limit] - t[l.stapm_value];
+     }},
+    {"PPT headroom", "W",
+     [](const PmTableLayout &l, const float *t) {
+       return t[l.ppt_limit] - t[l.ppt_value];
+     }},
+    {"Thermal headroom", "degC",
+     [](const PmTableLayout &l, const float *t) {
+       return t[l.thm_limit] - t[l.thm_value];
+     }},
+    {"PROCHOT", "",
+     [](const PmTableLayout &l, const float *t) {
+       return t[l.prochot] > 0.5f ? 1.0f : 0.0f;
+     }},
+};
+
+/// Chrome JSON wants microseconds; keep the nanoseconds as decimals.
+void put_json_timestamp(std::string &out, uint64_t timestamp_ns) {
+  char digits[24];
+  auto *end = std::to_chars(digits, digits + sizeof(digits),
+                            timestamp_ns / 1000)
+                  .ptr;
+  out.append(digits, end);
+  const auto frac = static_cast<unsigned>(timestamp_ns % 1000);
+  out.push_back('.');
+  out.push_back(static_cast<char>('0' + frac / 100));
+  out.push_back(static_cast<char>('0' + frac / 10 % 10));
+  out.push_back(static_cast<char>('0' + frac % 10));
+}
+
+void put_json_string(std::string &out, std::string_view s) {
+  out.push_back('"');
+  for (const char c : s) {
+    if (c == '"' || c == '\\')
+      out.push_back('\\');
+    if (static_cast<unsigned char>(c) >= 0x20)
+      out.push_back(c);
+  }
+  out.push_back('"');
+}
+
+std::string chrome_name(const std::string &name, const std::string &unit) {
+  return unit.empty() ? name : name + " (" + unit + ")";
+}
+
+uint64_t clock_ns(clockid_t clock) {
+  timespec ts{};
+  clock_gettime(clock, &ts);
+  return static_cast<uint64_t>(ts.tv_sec) * 1'000'000'000ull +
+         static_cast<uint64_t>(ts.tv_nsec);
+}
+
+} // namespace
+
+TraceExporter::Format TraceExporter::format_for_path(const std::string &path) {
+  constexpr std::string_view json = ".json";
+  return path.size() >= json.size() &&
+                 path.compare(path.size() - json.size(), json.size(),
+                              json) == 0
+             ? Format::ChromeJson
+             : Format::Perfetto;
+}
+
+TraceExporter::TraceExporter(const std::string &path, Config config)
+    : path_{path}, config_{std::move(config)} {
+  buffer_.resize(std::max<size_t>(config_.buffer_bytes, 64u << 10));
+  fd_ = ::open(path_.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  if (fd_ < 0) {
+    SPDLOG_ERROR("Failed to open {}: {}", path_, std::strerror(errno));
+    return;
+  }
+
+  // Track uuids only need to be unique within the trace; derive them from
+  // the pid so traces of different runs can be merged.
+  const auto pid = static_cast<uint64_t>(::getpid());
+  process_uuid_ = 0x706d'0000'0000'0000ull | pid << 20;
+  events_uuid_ = process_uuid_ + 1;
+
+  for (const int cell : config_.cells)
+    tracks_.push_back({.name = "v" + std::to_string(cell), .unit = {}});
+  n_cell_tracks_ = tracks_.size();
+  if (config_.layout) {
+    for (const auto &channel : DERIVED_CHANNELS)
+      tracks_.push_back({.name = channel.name, .unit = channel.unit});
+  }
+  for (size_t i = 0; i < tracks_.size(); ++i)
+    tracks_[i].uuid = events_uuid_ + 1 + i;
+
+  write_preamble();
+  for (const auto &track : tracks_)
+    write_track_descriptor(track);
+  SPDLOG_INFO("Writing {} trace to {} ({} counter tracks).",
+              config_.format == Format::Perfetto ? "Perfetto" : "Chrome JSON",
+              path_, tracks_.size());
+}
+
+TraceExporter::~TraceExporter() { close(); }
+
+int TraceExporter::add_track(std::string name, std::string unit) {
+  Track track{.name = std::move(name), .unit = std::move(unit)};
+  track.uuid = events_uuid_ + 1 + tracks_.size();
+  tracks_.push_back(std::move(track));
+  if (fd_ >= 0)
+    write_track_descriptor(tracks_.back());
+  return static_cast<int>(tracks_.size() - 1);
+}
+
+void TraceExporter::add_sample(uint64_t timestamp_ns, const float *table,
+                               size_t n_floats) {
+  if (fd_ < 0)
+    return;
+  ++stats_.samples;
+  for (size_t i = 0; i < n_cell_tracks_; ++i) {
+    const auto cell = static_cast<size_t>(config_.cells[i]);
+    if (cell < n_floats)
+      write_counter(timestamp_ns, tracks_[i], table[cell]);
+  }
+  const PmTableLayout *layout = config_.layout;
+  if (!layout || n_floats < layout->min_floats)
+    return;
+  for (size_t i = 0; i < std::size(DERIVED_CHANNELS); ++i)
+    write_counter(timestamp_ns, tracks_[n_cell_tracks_ + i],
+                  DERIVED_CHANNELS[i].value(*layout, table));
+
+  // Same rising-edge triggers as the flight recorder.
+  const bool prochot = table[layout->prochot] > 0.5f;
+  const bool thermal_limit =
+      table[layout->thm_value] >= table[layout->thm_limit];
+  if (prochot && !prochot_active_)
+    add_instant(timestamp_ns, "PROCHOT");
+  if (thermal_limit && !thermal_limit_active_)
+    add_instant(timestamp_ns, "thermal limit");
+  prochot_active_ = prochot;
+  thermal_limit_active_ = thermal_limit;
+}
+
+void TraceExporter::set_value(uint64_t timestamp_ns, int track, float value) {
+  if (fd_ >= 0 && track >= 0 && static_cast<size_t>(track) < tracks_.size())
+    write_counter(timestamp_ns, tracks_[static_cast<size_t>(track)], value);
+}
+
+void TraceExporter::add_instant(uint64_t timestamp_ns, std::string_view name) {
+  if (fd_ < 0)
+    return;
+  ++stats_.instant_events;
+  scratch_.clear();
+  if (config_.format == Format::Perfetto) {
+    nested_.clear();
+    pb::put_uint(nested_, pb::EVENT_TYPE, pb::TYPE_INSTANT);
+    pb::put_uint(nested_, pb::EVENT_TRACK_UUID, events_uuid_);
+    pb::put_bytes(nested_, pb::EVENT_NAME, name);
+    pb::put_packet_header(scratch_, timestamp_ns);
+    pb::put_bytes(scratch_, pb::PACKET_TRACK_EVENT, nested_);
+    write_packet(scratch_);
+    return;
+  }
+  scratch_ += first_event_ ? "\n" : ",\n";
+  first_event_ = false;
+  scratch_ += R"({"ph":"i","s":"p","pid":1,"tid":0,"name":)";
+  put_json_string(scratch_, name);
+  scratch_ += R"(,"ts":)";
+  put_json_timestamp(scratch_, timestamp_ns);
+  scratch_ += '}';
+  append(scratch_);
+}
+
+bool TraceExporter::close() {
+  if (fd_ < 0)
+    return !failed_;
+  if (config_.format == Format::ChromeJson)
+    append("\n]}\n");
+  flush();
+  if (::close(fd_) != 0)
+    failed_ = true;
+  fd_ = -1;
+  return !failed_;
+}
+
+/**
+ * @brief Perfetto: clock snapshot and process/events track descriptors.
+ * Chrome JSON: array header and process name metadata.
+ */
+void TraceExporter::write_preamble() {
+  scratch_.clear();
+  if (config_.format == Format::ChromeJson) {
+    scratch_ += R"({"displayTimeUnit":"ms","traceEvents":[)";
+    scratch_ += "\n";
+    scratch_ += R"({"ph":"M","pid":1,"name":"process_name","args":{"name":)";
+    put_json_string(scratch_, config_.process_name);
+    scratch_ += "}}";
+    first_event_ = false;
+    append(scratch_);
+    return;
+  }
+
+  // MONOTONIC and BOOTTIME read back to back; the trace processor converts
+  // every MONOTONIC timestamp to its BOOTTIME trace clock with it.
+  std::string clocks, clock;
+  const uint64_t monotonic = clock_ns(CLOCK_MONOTONIC);
+  const uint64_t boottime = clock_ns(CLOCK_BOOTTIME);
+  for (const auto &[id, value] :
+       {std::pair{pb::BUILTIN_CLOCK_MONOTONIC, monotonic},
+        std::pair{pb::BUILTIN_CLOCK_BOOTTIME, boottime}}) {
+    clock.clear();
+    pb::put_uint(clock, pb::CLOCK_ID, id);
+    pb::put_uint(clock, pb::CLOCK_TIMESTAMP, value);
+    pb::put_bytes(clocks, pb::CLOCK_SNAPSHOT_CLOCKS, clock);
+  }
+  pb::put_uint(scratch_, pb::PACKET_TIMESTAMP, boottime);
+  pb::put_uint(scratch_, pb::PACKET_SEQUENCE_ID, pb::SEQUENCE_ID);
+  pb::put_uint(scratch_, pb::PACKET_SEQUENCE_FLAGS,
+               pb::SEQ_INCREMENTAL_STATE_CLEARED);
+  pb::put_bytes(scratch_, pb::PACKET_CLOCK_SNAPSHOT, clocks);
+  write_packet(scratch_);
+
+  std::string process;
+  pb::put_uint(process, pb::PROCESS_PID, ::getpid());
+  pb::put_bytes(process, pb::PROCESS_NAME, config_.process_name);
+  nested_.clear();
+  pb::put_uint(nested_, pb::TRACK_UUID, process_uuid_);
+  pb::put_bytes(nested_, pb::TRACK_PROCESS, process);
+  scratch_.clear();
+  pb::put_uint(scratch_, pb::PACKET_SEQUENCE_ID, pb::SEQUENCE_ID);
+  pb::put_bytes(scratch_, pb::PACKET_TRACK_DESCRIPTOR, nested_);
+  write_packet(scratch_);
+
+  nested_.clear();
+  pb::put_uint(nested_, pb::TRACK_UUID, events_uuid_);
+  pb::put_bytes(nested_, pb::TRACK_NAME, "Events");
+  pb::put_uint(nested_, pb::TRACK_PARENT_UUID, process_uuid_);
+  scratch_.clear();
+  pb::put_uint(scratch_, pb::PACKET_SEQUENCE_ID, pb::SEQUENCE_ID);
+  pb::put_bytes(scratch_, pb::PACKET_TRACK_DESCRIPTOR, nested_);
+  write_packet(scratch_);
+}
+
+void TraceExporter::write_track_descriptor(const Track &track) {
+  // Chrome JSON counters are declared by their first event.
+  if (config_.format != Format::Perfetto)
+    return;
+  std::string counter;
+  if (!track.unit.empty())
+    pb::put_bytes(counter, pb::COUNTER_UNIT_NAME, track.unit);
+  nested_.clear();
+  pb::put_uint(nested_, pb::TRACK_UUID, track.uuid);
+  pb::put_bytes(nested_, pb::TRACK_NAME, track.name);
+  pb::put_uint(nested_, pb::TRACK_PARENT_UUID, process_uuid_);
+  pb::put_bytes(nested_, pb::TRACK_COUNTER, counter);
+  scratch_.clear();
+  pb::put_uint(scratch_, pb::PACKET_SEQUENCE_ID, pb::SEQUENCE_ID);
+  pb::put_bytes(scratch_, pb::PACKET_TRACK_DESCRIPTOR, nested_);
+  write_packet(scratch_);
+}
+
+void TraceExporter::write_counter(uint64_t timestamp_ns, Track &track,
+                                  float value) {
+  if (is_nan(value) || (track.has_last && value == track.last))
+    return;
+  track.last = value;
+  track.has_last = true;
+  ++stats_.counter_events;
+  scratch_.clear();
+  if (config_.format == Format::Perfetto) {
+    nested_.clear();
+    pb::put_uint(nested_, pb::EVENT_TYPE, pb::TYPE_COUNTER);
+    pb::put_uint(nested_, pb::EVENT_TRACK_UUID, track.uuid);
+    pb::put_double(nested_, pb::EVENT_DOUBLE_COUNTER_VALUE, value);
+    pb::put_packet_header(scratch_, timestamp_ns);
+    pb::put_bytes(scratch_, pb::PACKET_TRACK_EVENT, nested_);
+    write_packet(scratch_);
+    return;
+  }
+  scratch_ += first_event_ ? "\n" : ",\n";
+  first_event_ = false;
+  scratch_ += R"({"ph":"C","pid":1,"name":)";
+  put_json_string(scratch_, chrome_name(track.name, track.unit));
+  scratch_ += R"(,"ts":)";
+  put_json_timestamp(scratch_, timestamp_ns);
+  scratch_ += R"(,"args":{"value":)";
+  if (is_finite(value)) {
+    char digits[24];
+    scratch_.append(digits,
+                    std::to_chars(digits, digits + sizeof(digits), value).ptr);
+  } else {
+    scratch_ += "null"; // to_chars would write inf, which is not JSON
+  }
+  scratch_ += "}}";
+  append(scratch_);
+}
+
+/// A Trace is a sequence of length-delimited `packet` fields.
+void TraceExporter::write_packet(const std::string &packet) {
+  char header[11];
+  size_t n = 0;
+  header[n++] = static_cast<char>(pb::TRACE_PACKET << 3 | pb::BYTES);
+  uint64_t size = packet.size();
+  for (; size >= 0x80; size >>= 7)
+    header[n++] = static_cast<char>(size | 0x80);
+  header[n++] = static_cast<char>(size);
+  append({header, n});
+  append(packet);
+}
+
+/// After a write error everything is dropped, so the file is a prefix of
+/// the trace rather than one with holes in it.
+void TraceExporter::append(std::string_view bytes) {
+  if (failed_ || (fill_ + bytes.size() > buffer_.size() && !flush()))
+    return;
+  if (bytes.size() > buffer_.size())
+    buffer_.resize(bytes.size());
+  std::memcpy(buffer_.data() + fill_, bytes.data(), bytes.size());
+  fill_ += bytes.size();
+}
+
+bool TraceExporter::flush() {
+  if (failed_) {
+    fill_ = 0;
+    return false;
+  }
+  size_t done = 0;
+  while (done < fill_) {
+    const ssize_t n = ::write(fd_, buffer_.data() + done, fill_ - done);
+    if (n < 0) {
+      if (errno == EINTR)
+        continue;
+      SPDLOG_ERROR("Trace write to {} failed: {}", path_,
+                   std::strerror(errno));
+      failed_ = true;
+      fill_ = 0;
+      return false;
+    }
+    done += static_cast<size_t>(n);
+  }
+  stats_.bytes += fill_;
+  fill_ = 0;
+  return true;
+}
@@ -0,0 +1,120 @@
+/**
+ * @file trace_export.hpp
+ * @brief Export sensor timelines as Perfetto / Chrome trace counter tracks.
+ *
+ * Selected pm_table cells and derived channels (socket power, summed core
+ * power, hottest core, limit headroom) become counter tracks of one process
+ * named "pm_table"; callers may add tracks of their own (worker state) and
+ * instant events (markers). PROCHOT and thermal-limit rising edges are added
+ * as instants automatically when the layout is known.
+ *
+ * Two encodings:
+ *  - Perfetto protobuf (`.pftrace`, `.perfetto-trace`), streamed packet by
+ *    packet with a small hand-written encoder. Timestamps are CLOCK_MONOTONIC
+ *    (clock id 3) and a ClockSnapshot ties them to BOOTTIME, so the trace
+ *    lines up with perf / ftrace traces of the same machine in ui.perfetto.dev.
+ *  - Chrome JSON (`.json`), "ph":"C" counters and "ph":"i" instants in
+ *    microseconds. Readable by every viewer but several times larger; meant
+ *    for short exports.
+ *
+ * A counter value is emitted only when it changes (both formats hold the
+ * last value), which removes most of the slowly updating cells.
+ */
+
+#pragma once
+#include "pm_table_layout.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/**
+ * @class TraceExporter
+ * @brief Single-threaded streaming trace writer.
+ */
+class TraceExporter {
+public:
+  enum class Format { ChromeJson, Perfetto };
+
+  struct Config {
+    Format format = Format::Perfetto;
+    std::vector<int> cells; ///< pm_table indices, one "vNN" track each
+    const PmTableLayout *layout = nullptr; ///< Enables the derived channels
+    std::string process_name = "pm_table";
+    size_t buffer_bytes = 1u << 20;
+  };
+
+  struct Stats {
+    uint64_t samples = 0;
+    uint64_t counter_events = 0;
+    uint64_t instant_events = 0;
+    uint64_t bytes = 0;
+  };
+
+  /** @brief ChromeJson for `.json`, Perfetto otherwise. */
+  static Format format_for_path(const std::string &path);
+
+  TraceExporter(const std::string &path, Config config);
+  ~TraceExporter();
+
+  TraceExporter(const TraceExporter &) = delete;
+  TraceExporter &operator=(const TraceExporter &) = delete;
+
+  explicit operator bool() const noexcept { return fd_ >= 0; }
+
+  /** @brief Add a counter track; returns the id for set_value(). */
+  int add_track(std::string name, std::string unit = {});
+
+  /**
+   * @brief Emit the selected cells and derived channels of one table.
+   * @param timestamp_ns CLOCK_MONOTONIC.
+   */
+  void add_sample(uint64_t timestamp_ns, const float *table, size_t n_floats);
+
+  /** @brief Emit a value on a track from add_track() (if it changed). */
+  void set_value(uint64_t timestamp_ns, int track, float value);
+
+  /** @brief Instant event on the process's "Events" track. */
+  void add_instant(uint64_t timestamp_ns, std::string_view name);
+
+  /**
+   * @brief Finish the trace (closes the JSON array) and close the file.
+   * @return false if a write failed; output after the first error is dropped.
+   */
+  bool close();
+
+  Stats stats() const { return stats_; }
+
+private:
+  struct Track {
+    std::string name;
+    std::string unit;
+    uint64_t uuid = 0;
+    float last = 0.0f;
+    bool has_last = false;
+  };
+
+  void write_preamble();
+  void write_track_descriptor(const Track &track);
+  void write_counter(uint64_t timestamp_ns, Track &track, float value);
+  void write_packet(const std::string &packet);
+  void append(std::string_view bytes);
+  bool flush();
+
+  std::string path_;
+  Config config_;
+  std::vector<Track> tracks_; ///< cells, then derived channels, then extras
+  size_t n_cell_tracks_ = 0;
+  uint64_t process_uuid_ = 0, events_uuid_ = 0;
+  bool prochot_active_ = false, thermal_limit_active_ = false;
+  bool first_event_ = true; ///< JSON: no comma before the first event
+
+  std::string scratch_, nested_; ///< Reused encoding buffers
+  std::vector<char> buffer_;
+  size_t fill_ = 0;
+  int fd_ = -1;
+  bool failed_ = false;
+  Stats stats_;
+};
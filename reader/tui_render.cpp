@@ -0,0 +1,178 @@
+// Terminal rendering of the eye diagrams (--tui), decoupled from any data
+// processing like gui_render.cpp.
+
+#include "tui_render.hpp"
+
+#include "eye_snapshot.hpp"
+#include "flight_recorder.hpp"
+#include "terminal_ui.hpp"
+#include <algorithm>
+#include <span>
+#include <spdlog/fmt/fmt.h>
+
+namespace {
+
+constexpr int TILE_WIDTH = 24;  // Cells, plus one column of spacing
+constexpr int PLOT_ROWS = 4;    // Braille rows below the label
+constexpr int HEADER_ROWS = 3;
+
+constexpr TerminalColor MEAN_COLOR = 0xFFFF00; // Yellow, as the GUI
+constexpr TerminalColor DIM_COLOR = 0x808080;
+constexpr TerminalColor PLOT_BACKGROUND = 0x1A1A1A;
+
+int grid_columns(const TerminalScreen &screen) {
+  return std::max(1, (screen.width() + 1) / (TILE_WIDTH + 1));
+}
+
+int visible_grid_rows(const TerminalScreen &screen) {
+  return std::max(1, (screen.height() - HEADER_ROWS - 1) / (PLOT_ROWS + 1));
+}
+
+} // namespace
+
+void render_tui(
+    TerminalScreen &screen,
+    const std::vector<std::atomic<DisplayData *>> &gui_display_pointers,
+    const std::vector<int> &interesting_indices,
+    const std::string &experiment_status, bool manual_mode, int marker,
+    const FlightRecorder *flight_recorder,
+    const EyeSnapshotWriter *snapshot_writer, int &scroll) {
+  screen.clear();
+
+  int accumulation_count = 0;
+  for (const auto &atomic_ptr : gui_display_pointers) {
+    const DisplayData *plot = atomic_ptr.load(std::memory_order_acquire);
+    if (plot && plot->accumulation_count > 0) {
+      accumulation_count = plot->accumulation_count;
+      break;
+    }
+  }
+  screen.text(0, 0,
+              fmt::format("{} | {} | traces: {} | marker: {}",
+                          experiment_status, manual_mode ? "manual" : "auto",
+                          accumulation_count, marker));
+
+  std::string line;
+  if (flight_recorder) {
+    const auto fr = flight_recorder->stats();
+    line += fmt::format("flight recorder {}dumps: {}, lost: {}, last: {:.0f} "
+                        "ms  ",
+                        fr.dumping ? "[writing] " : "", fr.dumps,
+                        fr.lost_samples, fr.last_latency_ms);
+  }
+  if (snapshot_writer) {
+    const auto es = snapshot_writer->stats();
+    line += fmt::format("snapshots: {}, skipped: {}", es.written, es.skipped);
+  }
+  screen.text(0, 1, line, DIM_COLOR);
+  screen.text(0, 2,
+              "q quit  m marker  t manual/auto  ←/→ core  s snapshot  "
+              "d dump  ↑/↓ scroll",
+              DIM_COLOR);
+
+  const int columns = grid_columns(screen);
+  const int total_rows =
+      (static_cast<int>(interesting_indices.size()) + columns - 1) / columns;
+  scroll = std::clamp(scroll, 0,
+                      std::max(0, total_rows - visible_grid_rows(screen)));
+
+  BrailleCanvas canvas(TILE_WIDTH, PLOT_ROWS);
+  for (int row = scroll; row < total_rows; ++row) {
+    const int y = HEADER_ROWS + (row - scroll) * (PLOT_ROWS + 1);
+    if (y + PLOT_ROWS >= screen.height() - 1)
+      break;
+    for (int col = 0; col < columns; ++col) {
+      const size_t i = static_cast<size_t>(row) * columns + col;
+      if (i >= interesting_indices.size())
+        break;
+      const int x = col * (TILE_WIDTH + 1);
+      const DisplayData *plot =
+          gui_display_pointers[i].load(std::memory_order_acquire);
+
+      std::string label = fmt::format("#{}", interesting_indices[i]);
+      if (plot && !plot->y_data_mean.empty()) {
+        const auto [lo, hi] = std::ranges::minmax(plot->y_data_mean);
+        label += fmt::format(" {:.4g}..{:.4g}", lo, hi);
+      }
+      screen.text(x, y, label, DIM_COLOR);
+
+      for (int r = 1; r <= PLOT_ROWS; ++r)
+        screen.fill(x, y + r, TILE_WIDTH, PLOT_BACKGROUND);
+      if (plot && !plot->x_data.empty()) {
+        // The GUI's x range: from the trigger to the end of the window.
+        canvas.clear();
+        canvas.plot(plot->x_data, plot->y_data_mean, 0.0f,
+                    static_cast<float>(plot->window_after_ms), 0.0f, 0.0f);
+        canvas.draw(screen, x, y + 1, MEAN_COLOR, PLOT_BACKGROUND);
+      }
+    }
+  }
+
+  int footer_x = 0;
+  if (total_rows > visible_grid_rows(screen)) {
+    footer_x = screen.text(
+                   0, screen.height() - 1,
+                   fmt::format("rows {}-{} of {}", scroll + 1,
+                               std::min(total_rows,
+                                        scroll + visible_grid_rows(screen)),
+                               total_rows),
+                   DIM_COLOR) +
+               2;
+  }
+  const auto log = screen.recent_log(1);
+  if (!log.empty())
+    screen.text(footer_x, screen.height() - 1, log.back(), DIM_COLOR);
+  screen.present();
+}
+
+bool handle_tui_key(int key, CommandQueue &command_queue,
+                    std::atomic<bool> &manual_mode,
+                    std::atomic<int> &manual_core_to_test,
+                    std::atomic<int> &marker, FlightRecorder *flight_recorder,
+                    const EyeSnapshotWriter *snapshot_writer,
+                    int num_hardware_threads, int &scroll) {
+  switch (key) {
+  case 'q':
+  case 'Q':
+    return false;
+  case 'm':
+    // Markers split the energy report into phases (also: kill -USR1 <pid>).
+    marker.fetch_add(1, std::memory_order_relaxed);
+    break;
+  case 't':
+    manual_mode.store(!manual_mode.load());
+    break;
+  case TerminalScreen::KEY_LEFT:
+  case TerminalScreen::KEY_RIGHT:
+    if (manual_mode.load()) {
+      const int core =
+          std::clamp(manual_core_to_test.load() +
+                         (key == TerminalScreen::KEY_RIGHT ? 1 : -1),
+                     1, std::max(1, num_hardware_threads - 1));
+      manual_core_to_test.store(core);
+      command_queue.push(ChangeCoreCmd{core});
+    }
+    break;
+  case 's':
+    if (snapshot_writer)
+      command_queue.push(SaveSnapshotCmd{});
+    break;
+  case 'd':
+    if (flight_recorder)
+      flight_recorder->trigger("manual");
+    break;
+  case TerminalScreen::KEY_UP:
+    --scroll;
+    break;
+  case TerminalScreen::KEY_DOWN:
+    ++scroll;
+    break;
+  case TerminalScreen::KEY_PAGE_UP:
+    scroll -= 4;
+    break;
+  case TerminalScreen::KEY_PAGE_DOWN:
+    scroll += 4;
+    break;
+  }
+  return true;
+}
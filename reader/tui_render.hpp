@@ -0,0 +1,29 @@
+#pragma once
+
+#include "shared_data_types.hpp"
+#include <atomic>
+#include <string>
+#include <vector>
+
+class EyeSnapshotWriter;
+class FlightRecorder;
+class TerminalScreen;
+
+// Terminal counterpart of render_gui (--tui): the eye diagrams of the
+// interesting sensors as braille plots, read from the same display pointers.
+// scroll is the first grid row shown.
+void render_tui(
+    TerminalScreen &screen,
+    const std::vector<std::atomic<DisplayData *>> &gui_display_pointers,
+    const std::vector<int> &interesting_indices,
+    const std::string &experiment_status, bool manual_mode, int marker,
+    const FlightRecorder *flight_recorder,
+    const EyeSnapshotWriter *snapshot_writer, int &scroll);
+
+// The GUI's controls as keys. Returns false when the user quits.
+bool handle_tui_key(int key, CommandQueue &command_queue,
+                    std::atomic<bool> &manual_mode,
+                    std::atomic<int> &manual_core_to_test,
+                    std::atomic<int> &marker, FlightRecorder *flight_recorder,
+                    const EyeSnapshotWriter *snapshot_writer,
+                    int num_hardware_threads, int &scroll);
@@ -32,7 +32,7 @@ struct CellStats {
     float current_val = 0.0f;
     double mean = 0.0;
     double m2 = 0.0; // Sum of squares of differences from the mean
-    int count = 0;
+    long long count = 0;
 
     // For correlation analysis
     static constexpr int HISTORY_SIZE = 2'000; // Increased to 2000 for hover graph
@@ -43,6 +43,17 @@ struct CellStats {
 
 
     void add_sample(float value, long long timestamp_ns) {
+        accumulate(value);
+
+        // Add to history for correlation analysis
+        history.push_back({timestamp_ns, value});
+        if (history.size() > HISTORY_SIZE) {
+            history.pop_front();
+        }
+    }
+
+    // Statistics only, without history (offline analysis of recordings).
+    void accumulate(float value) {
         current_val = value;
         if (value < min_val) min_val = value;
         if (value > max_val) max_val = value;
@@ -53,12 +64,29 @@ struct CellStats {
         mean += delta / count;
         double delta2 = value - mean;
         m2 += delta * delta2;
+    }
 
-        // Add to history for correlation analysis
-        history.push_back({timestamp_ns, value});
-        if (history.size() > HISTORY_SIZE) {
-            history.pop_front();
+    // Combine with the statistics of a later, disjoint set of samples (Chan et al.), so chunks
+    // of a recording can be analyzed in parallel. The history is not merged.
+    void merge(const CellStats& other) {
+        if (other.count == 0) return;
+        if (count == 0) {
+            min_val = other.min_val;
+            max_val = other.max_val;
+            current_val = other.current_val;
+            mean = other.mean;
+            m2 = other.m2;
+            count = other.count;
+            return;
         }
+        const double n = static_cast<double>(count + other.count);
+        const double delta = other.mean - mean;
+        mean += delta * other.count / n;
+        m2 += other.m2 + delta * delta * count * other.count / n;
+        count += other.count;
+        min_val = std::min(min_val, other.min_val);
+        max_val = std::max(max_val, other.max_val);
+        current_val = other.current_val;
     }
 
     [[nodiscard]] float get_stddev() const {
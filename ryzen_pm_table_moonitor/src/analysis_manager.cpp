@@ -1,5 +1,5 @@
 #include "analysis_manager.hpp"
-#include "measurement_namer.hpp" // NEW: To access MeasurementNamer::to_chess_index
+#include "sensor_catalog.hpp"
 #include <spdlog/spdlog.h>
 #include <numeric>
 #include <algorithm> // For std::sort and std::find_if
@@ -85,6 +85,7 @@ void AnalysisManager::run_correlation_analysis(StressTester* stress_tester) {
         SPDLOG_INFO("Analysis: Measuring core {}...", stressed_core_id);
 
         // --- Step 1: Baseline Measurement (Core Idle) ---
+        notify_phase("core " + std::to_string(stressed_core_id) + " baseline");
         {
             std::lock_guard<std::mutex> lock(results_mutex_);
             for (auto& result : analysis_results_) result.history.clear();
@@ -101,6 +102,7 @@ void AnalysisManager::run_correlation_analysis(StressTester* stress_tester) {
 
         // --- Step 2: Active Measurement (Core Stressed) ---
         stress_tester->set_thread_busy_state(stressed_core_id, true);
+        notify_phase("core " + std::to_string(stressed_core_id) + " active");
         {
             std::lock_guard<std::mutex> lock(results_mutex_);
             for (auto& result : analysis_results_) result.history.clear();
@@ -117,17 +119,11 @@ void AnalysisManager::run_correlation_analysis(StressTester* stress_tester) {
             std::lock_guard<std::mutex> lock(results_mutex_);
             for (size_t i = 0; i < analysis_results_.size(); ++i) {
                 // Get stddev from the history that has been accumulating.
-                float active = analysis_results_[i].get_stddev();
-                float baseline = baseline_stddevs[i];
-                float correlation_strength = 0.0f;
-                float denominator = (active + baseline + 1e-9f);
-                if (denominator > 0) {
-                    correlation_strength = std::max(0.0f, (active - baseline) / denominator);
-                }
-                correlation_strength = sqrtf(correlation_strength);
+                const float strength =
+                    correlation_strength(analysis_results_[i].get_stddev(), baseline_stddevs[i]);
 
                 // This function updates the list that the GUI thread is reading from.
-                update_or_insert_correlation(analysis_results_[i], stressed_core_id, correlation_strength);
+                update_or_insert_correlation(analysis_results_[i], stressed_core_id, strength);
             }
         }
 
@@ -142,8 +138,28 @@ void AnalysisManager::run_correlation_analysis(StressTester* stress_tester) {
     for (int i = 0; i < core_count; ++i) {
         stress_tester->set_thread_busy_state(i, true); // Restore all cores to busy by default
     }
+    notify_phase("");
     SPDLOG_INFO("Full correlation analysis complete. All results are now displayed.");
 }
+float AnalysisManager::correlation_strength(float active_stddev, float baseline_stddev) {
+    float strength = 0.0f;
+    float denominator = (active_stddev + baseline_stddev + 1e-9f);
+    if (denominator > 0) {
+        strength = std::max(0.0f, (active_stddev - baseline_stddev) / denominator);
+    }
+    return sqrtf(strength);
+}
+
+void AnalysisManager::set_phase_listener(std::function<void(const std::string& phase)> listener) {
+    phase_listener_ = std::move(listener);
+}
+
+void AnalysisManager::notify_phase(const std::string& phase) {
+    if (phase_listener_) {
+        phase_listener_(phase);
+    }
+}
+
 /**
  * @brief Helper to update the correlation list for a single cell.
  *
@@ -190,15 +206,36 @@ void AnalysisManager::reset_stats() {
     }
 }
 
+void AnalysisManager::set_analysis_results(std::vector<CellStats> results) {
+    std::lock_guard<std::mutex> lock(results_mutex_);
+    analysis_results_ = std::move(results);
+}
+
 std::vector<CellStats> AnalysisManager::get_analysis_results() {
     std::lock_guard<std::mutex> lock(results_mutex_);
     return analysis_results_;
 }
 
+void AnalysisManager::copy_analysis_summary(std::vector<CellStats>& out) {
+    std::lock_guard<std::mutex> lock(results_mutex_);
+    out.resize(analysis_results_.size());
+    for (size_t i = 0; i < analysis_results_.size(); ++i) {
+        const CellStats& from = analysis_results_[i];
+        CellStats& to = out[i];
+        to.min_val = from.min_val;
+        to.max_val = from.max_val;
+        to.current_val = from.current_val;
+        to.mean = from.mean;
+        to.m2 = from.m2;
+        to.count = from.count;
+        to.top_correlations = from.top_correlations;
+    }
+}
+
 // NEW: Implementation of the save function
 void AnalysisManager::save_correlation_results_to_files(
     const std::string& base_filename_prefix,
-    std::function<std::string(int index)> get_name_func
+    const SensorCatalog& catalog
 ) {
     std::lock_guard<std::mutex> lock(results_mutex_); // Lock access to analysis_results_
 
@@ -247,11 +284,11 @@ void AnalysisManager::save_correlation_results_to_files(
     // --- Write Table Data and collect strengths ---
     for (size_t i = 0; i < analysis_results_.size(); ++i) {
         const auto& stats = analysis_results_[i];
-        std::string name = get_name_func(static_cast<int>(i));
+        const int index = static_cast<int>(i);
 
         table_file << i << ","
-                   << MeasurementNamer::to_chess_index(static_cast<int>(i)) << ","
-                   << "\"" << name << "\"," // Enclose name in quotes to handle commas
+                   << catalog.chess(index) << ","
+                   << "\"" << catalog.name(index) << "\"," // Enclose name in quotes to handle commas
                    << std::fixed << std::setprecision(3) << stats.current_val << ","
                    << std::fixed << std::setprecision(3) << stats.min_val << ","
                    << std::fixed << std::setprecision(3) << stats.max_val << ","
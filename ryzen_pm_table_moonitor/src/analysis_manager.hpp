@@ -7,6 +7,8 @@
 #include <atomic>
 #include <functional> // NEW: For std::function
 
+class SensorCatalog;
+
 // Struct to hold a vector of raw data with its capture timestamp
 struct TimestampedData {
     long long timestamp_ns;
@@ -20,6 +22,10 @@ public:
     // The GUI thread calls this to get the latest results for rendering.
     std::vector<CellStats> get_analysis_results();
 
+    // The same results without the sample history, for views that only show values and
+    // correlations (the terminal UI). Reuses the storage of out, so refreshing is cheap.
+    void copy_analysis_summary(std::vector<CellStats>& out);
+
     // The pipeline will call this for each new data packet.
     // CHANGE: Take by const reference to read from the shared buffer without moving.
     void process_data_packet(const TimestampedData& data);
@@ -30,19 +36,34 @@ public:
     // This will be called by a task submitted from the GUI.
     void reset_stats();
 
+    // Called with "core N baseline" / "core N active" when the correlation analysis changes
+    // phase, and with an empty string when it is done. Used to book energy per phase.
+    void set_phase_listener(std::function<void(const std::string& phase)> listener);
+
+    // Replace the results wholesale, e.g. with statistics computed offline from a recording,
+    // so they can be saved with save_correlation_results_to_files().
+    void set_analysis_results(std::vector<CellStats> results);
+
+    // Correlation of a cell with a core from its stddev with the core stressed (active) and
+    // idle (baseline): sqrt(max(0, (active - baseline) / (active + baseline))).
+    static float correlation_strength(float active_stddev, float baseline_stddev);
+
+    // Update a cell's correlation list after a core is measured; keeps the top 4.
+    static void update_or_insert_correlation(CellStats& stats, int core_id, float new_strength);
+
     // NEW: Save correlation results and statistics to files.
-    // get_name_func: A function that takes a decimal index (int) and returns its corresponding string name.
+    // catalog: Names and chess indices of the cells, e.g. MeasurementNamer::catalog().
     void save_correlation_results_to_files(
         const std::string& base_filename_prefix,
-        std::function<std::string(int index)> get_name_func
+        const SensorCatalog& catalog
     );
 
 private:
 
-    // A helper to update a cell's correlation list after a core is measured.
-    void update_or_insert_correlation(CellStats& stats, int core_id, float new_strength);
-
     // Analysis results remain, protected by a mutex for GUI access.
     std::vector<CellStats> analysis_results_;
     std::mutex results_mutex_;
+
+    std::function<void(const std::string&)> phase_listener_;
+    void notify_phase(const std::string& phase);
 };
\ No newline at end of file
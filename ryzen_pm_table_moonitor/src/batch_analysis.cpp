@@ -0,0 +1,306 @@
+#include "batch_analysis.hpp"
+#include "analysis_manager.hpp"
+#include "sample_recording_format.hpp" // From ../reader
+#include <spdlog/spdlog.h>
+#include <taskflow/taskflow.hpp>
+#include <taskflow/algorithm/for_each.hpp>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <fcntl.h>
+#include <mutex>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+RecordingView::RecordingView(const std::string& path) {
+    const int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        SPDLOG_ERROR("Failed to open {}: {}", path, std::strerror(errno));
+        return;
+    }
+    struct stat st{};
+    if (::fstat(fd, &st) != 0 || st.st_size < 64) {
+        SPDLOG_ERROR("{} is empty or unreadable.", path);
+        ::close(fd);
+        return;
+    }
+    const auto file_bytes = static_cast<size_t>(st.st_size);
+
+    // .pmrs starts with a magic; a pm_reader .bin log with {timestamp, size} of its first record.
+    SampleRecordingHeader header{};
+    if (::pread(fd, &header, sizeof(header), 0) != static_cast<ssize_t>(sizeof(header))) {
+        ::close(fd);
+        return;
+    }
+    if (std::memcmp(header.magic, SAMPLE_RECORDING_MAGIC, 4) == 0) {
+        if (header.format_version != SAMPLE_RECORDING_FORMAT_VERSION ||
+            header.record_bytes != 8 + 4 * (SAMPLE_RECORD_HEADER_WORDS + header.n_floats)) {
+            SPDLOG_ERROR("{}: unsupported sample recording (format {}).", path, header.format_version);
+            ::close(fd);
+            return;
+        }
+        data_offset_ = sizeof(header);
+        record_bytes_ = header.record_bytes;
+        table_offset_ = 8 + 4 * SAMPLE_RECORD_HEADER_WORDS;
+        n_floats_ = header.n_floats;
+        pm_table_version_ = header.pm_table_version;
+        has_worker_state_ = true;
+    } else {
+        uint64_t first[2] = {};
+        std::memcpy(first, &header, sizeof(first));
+        if (first[1] == 0 || first[1] > 16384 || first[1] % 4 != 0) {
+            SPDLOG_ERROR("{} is neither a .pmrs recording nor a pm_reader .bin log.", path);
+            ::close(fd);
+            return;
+        }
+        data_offset_ = 0;
+        record_bytes_ = 16 + first[1];
+        table_offset_ = 16;
+        n_floats_ = first[1] / 4;
+    }
+    // A truncated last record (crash while recording) is ignored.
+    n_records_ = (file_bytes - data_offset_) / record_bytes_;
+
+    void* map = ::mmap(nullptr, file_bytes, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (map == MAP_FAILED) {
+        SPDLOG_ERROR("Failed to map {}: {}", path, std::strerror(errno));
+        return;
+    }
+    base_ = static_cast<const char*>(map);
+    map_bytes_ = file_bytes;
+    ::madvise(map, map_bytes_, MADV_SEQUENTIAL);
+}
+
+RecordingView::~RecordingView() {
+    if (base_) {
+        ::munmap(const_cast<char*>(base_), map_bytes_);
+    }
+}
+
+uint64_t RecordingView::timestamp_ns(uint64_t i) const {
+    uint64_t t = 0;
+    std::memcpy(&t, record(i), sizeof(t)); // .pmrs records are only 4-byte aligned
+    return t;
+}
+
+const float* RecordingView::table(uint64_t i) const {
+    return reinterpret_cast<const float*>(record(i) + table_offset_);
+}
+
+int RecordingView::core(uint64_t i) const {
+    if (!has_worker_state_) return -1;
+    int32_t core = 0;
+    std::memcpy(&core, record(i) + 8, sizeof(core));
+    return core;
+}
+
+int RecordingView::worker_state(uint64_t i) const {
+    if (!has_worker_state_) return 0;
+    int32_t state = 0;
+    std::memcpy(&state, record(i) + 12, sizeof(state));
+    return state;
+}
+
+void RecordingView::release(uint64_t first, uint64_t last) const {
+    const size_t page = static_cast<size_t>(::sysconf(_SC_PAGESIZE));
+    const size_t begin = (data_offset_ + first * record_bytes_ + page - 1) / page * page;
+    const size_t end = (data_offset_ + last * record_bytes_) / page * page;
+    if (end > begin) {
+        ::madvise(const_cast<char*>(base_) + begin, end - begin, MADV_DONTNEED);
+    }
+}
+
+void EyeAccumulator::merge(const EyeAccumulator& other) {
+    if (bins.empty()) {
+        *this = other;
+        return;
+    }
+    for (size_t i = 0; i < bins.size(); ++i) {
+        const Bin& o = other.bins[i];
+        if (o.count == 0) continue;
+        bins[i].sum += o.sum;
+        bins[i].min = std::min(bins[i].min, o.min);
+        bins[i].max = std::max(bins[i].max, o.max);
+        bins[i].count += o.count;
+    }
+    windows += other.windows;
+}
+
+namespace {
+
+// Per core under test: statistics over all its samples and over its idle (worker off) samples.
+// Their stddevs play the roles of the live analysis' active and baseline phases.
+struct CoreStats {
+    std::vector<CellStats> all;
+    std::vector<CellStats> idle;
+};
+
+void merge_cells(std::vector<CellStats>& into, const std::vector<CellStats>& from) {
+    if (into.empty()) {
+        into.resize(from.size());
+    }
+    for (size_t i = 0; i < from.size(); ++i) {
+        into[i].merge(from[i]);
+    }
+}
+
+bool is_rising_edge(const RecordingView& view, uint64_t i) {
+    return i > 0 && view.worker_state(i) == 1 && view.worker_state(i - 1) == 0;
+}
+
+// Accumulate the window around the rising edge at i if it completes, i.e. a sample at least
+// window_after_ms later arrives before the next rising edge (pm_measure restarts the capture
+// on every rising edge). Bins use the same truncation to whole milliseconds as pm_measure.
+bool accumulate_window(const RecordingView& view, uint64_t i, const std::vector<int>& interesting,
+                       const BatchOptions& options, EyeAccumulator& eye) {
+    const auto t0 = static_cast<int64_t>(view.timestamp_ns(i));
+    const int core = view.core(i);
+    auto bin_of = [&](uint64_t j) {
+        return (static_cast<int64_t>(view.timestamp_ns(j)) - t0) / 1'000'000 + options.window_before_ms;
+    };
+    const int64_t n_bins = options.window_before_ms + options.window_after_ms;
+
+    uint64_t end = i;
+    for (;; ++end) {
+        if (end >= view.size() || (end > i && is_rising_edge(view, end))) return false;
+        if (bin_of(end) >= n_bins) break;
+    }
+
+    auto add = [&](uint64_t j) {
+        if (view.core(j) != core) return;
+        const float* table = view.table(j);
+        const auto bin = static_cast<int>(bin_of(j));
+        for (size_t k = 0; k < interesting.size(); ++k) {
+            eye.add(k, bin, table[interesting[k]]);
+        }
+    };
+    for (uint64_t j = i; j-- > 0 && bin_of(j) >= 0;) {
+        add(j);
+    }
+    for (uint64_t j = i; j < end; ++j) {
+        add(j);
+    }
+    ++eye.windows;
+    return true;
+}
+
+} // namespace
+
+FileAnalysis analyze_recording(const std::string& path, const BatchOptions& options, tf::Executor& executor) {
+    const auto start = std::chrono::steady_clock::now();
+    FileAnalysis result;
+    result.path = path;
+
+    RecordingView view(path);
+    if (!view || view.size() == 0) {
+        return result;
+    }
+    result.samples = view.size();
+    result.n_floats = view.n_floats();
+    result.pm_table_version = view.pm_table_version();
+    result.has_worker_state = view.has_worker_state();
+    result.duration_s = static_cast<double>(view.timestamp_ns(view.size() - 1) - view.timestamp_ns(0)) / 1e9;
+
+    const uint64_t chunk = std::max<uint64_t>(1, options.chunk_samples);
+    const size_t n_chunks = static_cast<size_t>((view.size() + chunk - 1) / chunk);
+    const size_t n_floats = view.n_floats();
+    std::mutex merge_mutex;
+
+    // --- Pass 1: statistics per chunk, merged as each chunk finishes ---
+    std::map<int, CoreStats> cores;
+    {
+        tf::Taskflow pass;
+        pass.for_each_index(size_t{0}, n_chunks, size_t{1}, [&](size_t c) {
+            const uint64_t first = c * chunk;
+            const uint64_t last = std::min<uint64_t>(first + chunk, view.size());
+            std::vector<CellStats> cells(n_floats);
+            std::map<int, CoreStats> chunk_cores;
+            CoreStats* core_stats = nullptr;
+            int current_core = -2;
+            for (uint64_t i = first; i < last; ++i) {
+                const float* table = view.table(i);
+                for (size_t k = 0; k < n_floats; ++k) {
+                    cells[k].accumulate(table[k]);
+                }
+                if (!view.has_worker_state()) continue;
+                if (const int core = view.core(i); core != current_core) {
+                    current_core = core;
+                    core_stats = &chunk_cores[core];
+                    if (core_stats->all.empty()) {
+                        core_stats->all.resize(n_floats);
+                        core_stats->idle.resize(n_floats);
+                    }
+                }
+                const bool idle = view.worker_state(i) == 0;
+                for (size_t k = 0; k < n_floats; ++k) {
+                    core_stats->all[k].accumulate(table[k]);
+                    if (idle) core_stats->idle[k].accumulate(table[k]);
+                }
+            }
+            view.release(first, last);
+
+            std::lock_guard<std::mutex> lock(merge_mutex);
+            merge_cells(result.cells, cells);
+            for (const auto& [core, stats] : chunk_cores) {
+                merge_cells(cores[core].all, stats.all);
+                merge_cells(cores[core].idle, stats.idle);
+            }
+        });
+        executor.corun(pass);
+    }
+
+    // Chunks merge in completion order; the live value is the last sample's.
+    const float* last_table = view.table(view.size() - 1);
+    for (size_t k = 0; k < n_floats; ++k) {
+        result.cells[k].current_val = last_table[k];
+        const float stddev = result.cells[k].get_stddev();
+        if (stddev * stddev > options.variance_threshold) {
+            result.interesting.push_back(static_cast<int>(k));
+        }
+    }
+
+    for (const auto& [core, stats] : cores) {
+        if (core < 0) continue;
+        for (size_t k = 0; k < n_floats; ++k) {
+            if (stats.idle[k].count < 2 || stats.all[k].count <= stats.idle[k].count) continue;
+            AnalysisManager::update_or_insert_correlation(
+                result.cells[k], core,
+                AnalysisManager::correlation_strength(stats.all[k].get_stddev(), stats.idle[k].get_stddev()));
+        }
+    }
+
+    // --- Pass 2: eye diagrams around rising worker edges (edges belong to the chunk they are in) ---
+    if (view.has_worker_state() && !result.interesting.empty()) {
+        const int n_bins = options.window_before_ms + options.window_after_ms;
+        tf::Taskflow pass;
+        pass.for_each_index(size_t{0}, n_chunks, size_t{1}, [&](size_t c) {
+            const uint64_t first = c * chunk;
+            const uint64_t last = std::min<uint64_t>(first + chunk, view.size());
+            std::map<int, EyeAccumulator> eyes;
+            uint64_t edges = 0;
+            for (uint64_t i = std::max<uint64_t>(first, 1); i < last; ++i) {
+                if (!is_rising_edge(view, i)) continue;
+                ++edges;
+                auto [it, inserted] = eyes.try_emplace(view.core(i));
+                if (inserted) {
+                    it->second = EyeAccumulator(result.interesting.size(), n_bins);
+                }
+                accumulate_window(view, i, result.interesting, options, it->second);
+            }
+            view.release(first, last);
+
+            std::lock_guard<std::mutex> lock(merge_mutex);
+            result.rising_edges += edges;
+            for (const auto& [core, eye] : eyes) {
+                result.eyes[core].merge(eye);
+            }
+        });
+        executor.corun(pass);
+    }
+
+    result.ok = true;
+    result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return result;
+}
@@ -0,0 +1,110 @@
+#pragma once
+
+#include "analysis.hpp"
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace tf {
+class Executor;
+}
+
+// Read-only memory map of a recording with fixed-size records: pm_reader .bin logs, or
+// pm_measure .pmrs sample recordings, which also carry the worker state and the core under test.
+class RecordingView {
+public:
+    explicit RecordingView(const std::string& path);
+    ~RecordingView();
+
+    RecordingView(const RecordingView&) = delete;
+    RecordingView& operator=(const RecordingView&) = delete;
+
+    explicit operator bool() const { return base_ != nullptr; }
+
+    [[nodiscard]] uint64_t size() const { return n_records_; }
+    [[nodiscard]] size_t n_floats() const { return n_floats_; }
+    [[nodiscard]] uint32_t pm_table_version() const { return pm_table_version_; }
+    [[nodiscard]] bool has_worker_state() const { return has_worker_state_; }
+
+    [[nodiscard]] uint64_t timestamp_ns(uint64_t i) const;
+    [[nodiscard]] const float* table(uint64_t i) const;
+    [[nodiscard]] int core(uint64_t i) const;         // -1 without worker state
+    [[nodiscard]] int worker_state(uint64_t i) const; // 0 without worker state
+
+    // Drop the mapped pages of records [first, last) from this process once a chunk is done.
+    // They stay in the page cache, so the resident set stays bounded however large the file.
+    void release(uint64_t first, uint64_t last) const;
+
+private:
+    [[nodiscard]] const char* record(uint64_t i) const { return base_ + data_offset_ + i * record_bytes_; }
+
+    const char* base_ = nullptr;
+    size_t map_bytes_ = 0;
+    size_t data_offset_ = 0;  // First record
+    size_t record_bytes_ = 0;
+    size_t table_offset_ = 0; // Within a record
+    size_t n_floats_ = 0;
+    uint64_t n_records_ = 0;
+    uint32_t pm_table_version_ = 0;
+    bool has_worker_state_ = false;
+};
+
+struct BatchOptions {
+    uint64_t chunk_samples = 65'536; // Unit of parallel work within a file
+    int window_before_ms = 50;       // Eye window around each rising worker edge,
+    int window_after_ms = 150;       // as in pm_measure
+    float variance_threshold = 1e-9f; // "Interesting" cells, as in pm_measure's pre-check
+};
+
+// Eye diagram of the interesting cells for one core under test: per 1 ms bin relative to the
+// rising worker edge, the mean / min / max over all complete windows.
+struct EyeAccumulator {
+    struct Bin {
+        double sum = 0.0;
+        float min = std::numeric_limits<float>::max();
+        float max = std::numeric_limits<float>::lowest();
+        uint32_t count = 0;
+    };
+
+    EyeAccumulator() = default;
+    EyeAccumulator(size_t n_cells, int n_bins) : n_bins(n_bins), bins(n_cells * n_bins) {}
+
+    void add(size_t cell, int bin, float value) {
+        Bin& b = bins[cell * n_bins + bin];
+        b.sum += value;
+        b.min = std::min(b.min, value);
+        b.max = std::max(b.max, value);
+        ++b.count;
+    }
+
+    void merge(const EyeAccumulator& other);
+
+    int n_bins = 0;
+    std::vector<Bin> bins; // [interesting cell][bin]
+    uint64_t windows = 0;
+};
+
+struct FileAnalysis {
+    std::string path;
+    bool ok = false;
+    uint64_t samples = 0;
+    size_t n_floats = 0;
+    uint32_t pm_table_version = 0;
+    bool has_worker_state = false;
+    double duration_s = 0.0; // Recorded time span
+    double seconds = 0.0;    // Analysis time
+
+    std::vector<CellStats> cells;      // Every cell; correlations filled for .pmrs input
+    std::vector<int> interesting;      // Cells whose variance exceeds the threshold
+    uint64_t rising_edges = 0;
+    std::map<int, EyeAccumulator> eyes; // By core under test
+};
+
+// Analyze one recording: per-cell statistics, interesting cells and, for .pmrs input,
+// per-core correlation strengths and eye diagrams. Chunks are processed in parallel with
+// executor.corun(), so this must run on a worker of executor (e.g. inside a task).
+FileAnalysis analyze_recording(const std::string& path, const BatchOptions& options, tf::Executor& executor);
@@ -0,0 +1,443 @@
+#include "energy_attribution.hpp"
+#include <algorithm>
+#include <charconv>
+#include <cstring>
+#include <ctime>
+#include <dirent.h>
+#include <fcntl.h>
+#include <fstream>
+#include <iomanip>
+#include <map>
+#include <spdlog/spdlog.h>
+#include <sstream>
+#include <thread>
+#include <unistd.h>
+
+namespace {
+    // Reads a small procfs file into buf with a single read(); returns the number of bytes or -1.
+    // Deliberately avoids iostreams: this runs for every process on every pass.
+    ssize_t read_proc_file(const char *path, char *buf, size_t cap) {
+        int fd = ::open(path, O_RDONLY | O_CLOEXEC);
+        if (fd < 0) return -1;
+        ssize_t n = ::read(fd, buf, cap - 1);
+        ::close(fd);
+        if (n >= 0) buf[n] = '\0';
+        return n;
+    }
+
+    unsigned long long parse_ull(const char *&p, const char *end) {
+        while (p < end && *p == ' ') ++p;
+        unsigned long long v = 0;
+        auto [next, ec]      = std::from_chars(p, end, v);
+        p                    = next;
+        return ec == std::errc() ? v : 0;
+    }
+
+    // The fields of /proc/<pid>/stat we need. The comm field may contain spaces and parentheses,
+    // so fields are counted from the last ')'.
+    struct StatFields {
+        std::string        comm;
+        unsigned long long cpu_ticks  = 0; // utime + stime
+        unsigned long long start_time = 0;
+        int                processor  = -1;
+    };
+
+    bool parse_stat(const char *buf, ssize_t len, StatFields &out, bool want_comm) {
+        const char *end    = buf + len;
+        const char *open   = std::strchr(buf, '(');
+        const char *close  = std::strrchr(buf, ')');
+        if (!open || !close || close < open) return false;
+        if (want_comm) out.comm.assign(open + 1, close);
+        out.cpu_ticks = 0;
+        out.processor = -1;
+
+        // Field 3 (state) starts two characters after ')'. Count fields from there.
+        const char *p     = close + 2;
+        int         field = 3;
+        while (p < end && field < 39) {
+            if (field == 14 || field == 15 || field == 22) {
+                const unsigned long long v = parse_ull(p, end);
+                if (field == 22) out.start_time = v;
+                else out.cpu_ticks += v;
+            } else {
+                while (p < end && *p != ' ') ++p;
+            }
+            while (p < end && *p == ' ') ++p;
+            ++field;
+        }
+        if (field == 39) out.processor = static_cast<int>(parse_ull(p, end));
+        return true;
+    }
+
+    template<typename Dir>
+    void for_each_numeric_entry(const char *path, Dir &&fn) {
+        DIR *dir = ::opendir(path);
+        if (!dir) return;
+        while (const dirent *ent = ::readdir(dir)) {
+            if (ent->d_name[0] < '0' || ent->d_name[0] > '9') continue;
+            pid_t id     = 0;
+            const char *s = ent->d_name;
+            std::from_chars(s, s + std::strlen(s), id);
+            fn(id);
+        }
+        ::closedir(dir);
+    }
+
+    std::string timestamp_string() {
+        auto              now   = std::chrono::system_clock::now();
+        std::time_t       now_c = std::chrono::system_clock::to_time_t(now);
+        std::stringstream ss;
+        ss << std::put_time(std::localtime(&now_c), "%Y%m%d_%H%M%S");
+        return ss.str();
+    }
+} // namespace
+
+EnergyAttributor::EnergyAttributor(Config config) : config_(std::move(config)) {
+    load_topology();
+    last_export_ = std::chrono::steady_clock::now();
+    last_update_.store(last_export_);
+    cgroups_.push_back({"[unknown]"});
+    cgroup_index_["[unknown]"] = 0;
+}
+
+// Maps every logical CPU to the index of its physical core in the pm_table core arrays.
+// core_id values are not necessarily contiguous, so they are ranked.
+void EnergyAttributor::load_topology() {
+    const unsigned   n_cpus = std::max(1u, std::thread::hardware_concurrency());
+    std::vector<int> core_ids(n_cpus, -1);
+    std::map<int, int> rank;
+    for (unsigned cpu = 0; cpu < n_cpus; ++cpu) {
+        std::ifstream f("/sys/devices/system/cpu/cpu" + std::to_string(cpu) + "/topology/core_id");
+        int           id = -1;
+        if (f >> id) {
+            core_ids[cpu] = id;
+            rank.emplace(id, 0);
+        }
+    }
+    int next = 0;
+    for (auto &[id, r] : rank) r = next++;
+
+    cpu_to_core_.assign(n_cpus, 0);
+    threads_per_core_.assign(std::max(1, next), 0);
+    for (unsigned cpu = 0; cpu < n_cpus; ++cpu) {
+        // Without topology information fall back to one thread per core.
+        const int core      = core_ids[cpu] >= 0 ? rank[core_ids[cpu]] : static_cast<int>(cpu);
+        cpu_to_core_[cpu]   = core;
+        if (core >= static_cast<int>(threads_per_core_.size())) threads_per_core_.resize(core + 1, 0);
+        threads_per_core_[core]++;
+    }
+    SPDLOG_INFO("EnergyAttributor: {} logical CPUs on {} physical cores", n_cpus, threads_per_core_.size());
+}
+
+void EnergyAttributor::add_power_sample(long long timestamp_ns, const std::vector<float> &core_power) {
+    std::lock_guard<std::mutex> lock(power_mutex_);
+    if (core_joules_.size() != core_power.size()) {
+        core_joules_.assign(core_power.size(), 0.0);
+        last_power_        = core_power;
+        last_timestamp_ns_ = timestamp_ns;
+        return;
+    }
+    // The pipeline's consumer stage is parallel, so samples can arrive slightly out of order.
+    // Dropping those loses at most a millisecond of integration.
+    if (timestamp_ns <= last_timestamp_ns_) return;
+
+    const double dt = static_cast<double>(timestamp_ns - last_timestamp_ns_) * 1e-9;
+    for (size_t i = 0; i < core_power.size(); ++i) {
+        core_joules_[i] += 0.5 * (core_power[i] + last_power_[i]) * dt;
+        last_power_[i] = core_power[i];
+    }
+    last_timestamp_ns_ = timestamp_ns;
+}
+
+bool EnergyAttributor::try_schedule() {
+    if (std::chrono::steady_clock::now() - last_update_.load() < config_.interval) return false;
+    bool expected = false;
+    return in_flight_.compare_exchange_strong(expected, true);
+}
+
+size_t EnergyAttributor::intern_cgroup(pid_t pid) {
+    char path[64];
+    char buf[4096];
+    std::snprintf(path, sizeof(path), "/proc/%d/cgroup", pid);
+    ssize_t n = read_proc_file(path, buf, sizeof(buf));
+    if (n <= 0) return 0;
+
+    // cgroup v2 has a single "0::/path" line; with v1 the last hierarchy listed is used.
+    std::string_view content(buf, static_cast<size_t>(n));
+    while (!content.empty() && content.back() == '\n') content.remove_suffix(1);
+    const size_t line_start = content.rfind('\n');
+    std::string_view line   = line_start == std::string_view::npos ? content : content.substr(line_start + 1);
+    const size_t colon      = line.find(':', line.find(':') + 1);
+    std::string  cgroup(colon == std::string_view::npos ? line : line.substr(colon + 1));
+    if (cgroup.empty()) return 0;
+
+    auto [it, inserted] = cgroup_index_.try_emplace(cgroup, cgroups_.size());
+    if (inserted) cgroups_.push_back({cgroup});
+    return it->second;
+}
+
+// Drops cgroups no process or task refers to any more (index 0, "[unknown]", is kept) and
+// renumbers the rest. Without drop_exported only those that never used energy go.
+void EnergyAttributor::prune_cgroups(bool drop_exported) {
+    std::vector<uint8_t> used(cgroups_.size(), 0);
+    used[0] = 1;
+    for (const auto &[pid, ps] : processes_) used[ps.cgroup_id] = 1;
+    for (const auto &[tid, ts] : tasks_) used[ts.cgroup_id] = 1;
+
+    std::vector<size_t> remap(cgroups_.size());
+    size_t              kept = 0;
+    for (size_t i = 0; i < cgroups_.size(); ++i) {
+        if (!used[i] && (drop_exported || cgroups_[i].joules <= 0)) continue;
+        remap[i] = kept;
+        if (kept != i) cgroups_[kept] = std::move(cgroups_[i]);
+        ++kept;
+    }
+    if (kept == cgroups_.size()) return;
+    cgroups_.resize(kept);
+    cgroup_index_.clear();
+    for (size_t i = 0; i < cgroups_.size(); ++i) cgroup_index_.emplace(cgroups_[i].path, i);
+    for (auto &[pid, ps] : processes_) ps.cgroup_id = remap[ps.cgroup_id];
+    for (auto &[tid, ts] : tasks_) ts.cgroup_id = remap[ts.cgroup_id];
+}
+
+void EnergyAttributor::scan_tasks(std::vector<PendingRuntime> &pending) {
+    char       path[96];
+    char       buf[1024];
+    StatFields st;
+
+    pid_scratch_.clear();
+    for_each_numeric_entry("/proc", [&](pid_t pid) { pid_scratch_.push_back(pid); });
+
+    // Stage 1: one stat read per process to find the ones that consumed CPU time.
+    std::vector<pid_t> dirty;
+    for (pid_t pid : pid_scratch_) {
+        std::snprintf(path, sizeof(path), "/proc/%d/stat", pid);
+        ssize_t n = read_proc_file(path, buf, sizeof(buf));
+        if (n <= 0 || !parse_stat(buf, n, st, false)) continue;
+
+        auto [it, inserted] = processes_.try_emplace(pid);
+        ProcessState &ps    = it->second;
+        if (inserted || ps.start_time != st.start_time) {
+            ps            = ProcessState{};
+            ps.start_time = st.start_time;
+            ps.cgroup_id  = intern_cgroup(pid);
+        } else if (ps.cpu_ticks == st.cpu_ticks) {
+            ps.last_seen_pass = pass_;
+            continue; // idle since the last pass, none of its threads can have run
+        }
+        ps.last_seen_pass = pass_;
+        dirty.push_back(pid);
+    }
+
+    // Stage 2: read the threads of busy processes, bounded by the per-pass budget. When the budget
+    // is exhausted the remaining processes keep their old cpu_ticks and stay dirty for the next
+    // pass; starting at a rotating offset keeps that fair.
+    size_t budget = config_.max_tasks_per_scan;
+    tasks_scanned_ = 0;
+    if (dirty.empty()) return;
+    const size_t start = scan_cursor_ % dirty.size();
+    size_t       done  = 0;
+    for (; done < dirty.size() && budget > 0; ++done) {
+        const pid_t pid = dirty[(start + done) % dirty.size()];
+        ProcessState &ps = processes_[pid];
+
+        std::snprintf(path, sizeof(path), "/proc/%d/task", pid);
+        for_each_numeric_entry(path, [&](pid_t tid) {
+            if (budget == 0) return;
+            --budget;
+            ++tasks_scanned_;
+
+            std::snprintf(path, sizeof(path), "/proc/%d/task/%d/schedstat", pid, tid);
+            ssize_t n = read_proc_file(path, buf, sizeof(buf));
+            if (n <= 0) return;
+            const char *p             = buf;
+            const unsigned long long runtime = parse_ull(p, buf + n);
+
+            std::snprintf(path, sizeof(path), "/proc/%d/task/%d/stat", pid, tid);
+            n = read_proc_file(path, buf, sizeof(buf));
+            if (n <= 0) return;
+            auto [it, inserted] = tasks_.try_emplace(static_cast<unsigned long long>(tid));
+            TaskState &ts       = it->second;
+            if (!parse_stat(buf, n, st, inserted || ts.comm.empty())) return;
+
+            if (inserted || ts.start_time != st.start_time) {
+                ts              = TaskState{};
+                ts.tgid         = pid;
+                ts.start_time   = st.start_time;
+                ts.last_runtime = runtime; // first sighting: nothing to attribute yet
+                ts.comm         = st.comm;
+            } else if (runtime > ts.last_runtime) {
+                pending.push_back({it->first, st.processor, runtime - ts.last_runtime});
+                ts.last_runtime = runtime;
+            }
+            ts.cgroup_id      = ps.cgroup_id;
+            ts.last_cpu       = st.processor;
+            ts.last_seen_pass = pass_;
+        });
+        if (budget > 0) {
+            // All threads read: accept the new process time so it is skipped while idle.
+            std::snprintf(path, sizeof(path), "/proc/%d/stat", pid);
+            ssize_t n = read_proc_file(path, buf, sizeof(buf));
+            if (n > 0 && parse_stat(buf, n, st, false)) ps.cpu_ticks = st.cpu_ticks;
+            ps.threads_pass = pass_;
+        }
+    }
+    scan_cursor_ = start + done;
+}
+
+void EnergyAttributor::distribute(const std::vector<double> &core_joules, const std::vector<PendingRuntime> &pending,
+                                  double interval_s) {
+    const size_t        n_cores = core_joules.size();
+    std::vector<double> core_runtime_ns(n_cores, 0.0);
+    auto core_of = [&](int cpu) {
+        return (cpu >= 0 && cpu < static_cast<int>(cpu_to_core_.size())) ? cpu_to_core_[cpu] : -1;
+    };
+    for (const auto &p : pending) {
+        const int core = core_of(p.cpu);
+        if (core >= 0 && core < static_cast<int>(n_cores)) core_runtime_ns[core] += static_cast<double>(p.delta_ns);
+    }
+
+    // A core's energy is shared over its capacity (interval * SMT threads); whatever no task
+    // used is idle. When run time exceeds capacity (carried-over deltas) it is normalised.
+    std::vector<double> denominator(n_cores, 1.0);
+    for (size_t c = 0; c < n_cores; ++c) {
+        const int    threads  = c < threads_per_core_.size() ? std::max(1, threads_per_core_[c]) : 1;
+        const double capacity = interval_s * 1e9 * threads;
+        denominator[c]        = std::max(capacity, core_runtime_ns[c]);
+        if (denominator[c] > 0) idle_joules_ += core_joules[c] * (1.0 - core_runtime_ns[c] / denominator[c]);
+        total_joules_ += core_joules[c];
+    }
+
+    for (auto &[tid, ts] : tasks_) ts.watts = 0.0;
+    for (auto &cg : cgroups_) cg.watts = 0.0;
+    for (const auto &p : pending) {
+        const int core = core_of(p.cpu);
+        if (core < 0 || core >= static_cast<int>(n_cores) || denominator[core] <= 0) continue;
+        const double joules = core_joules[core] * static_cast<double>(p.delta_ns) / denominator[core];
+        TaskState   &ts     = tasks_[p.task_key];
+        ts.joules += joules;
+        ts.watts += joules / interval_s;
+        CgroupState &cg = cgroups_[ts.cgroup_id];
+        cg.joules += joules;
+        cg.watts += joules / interval_s;
+    }
+}
+
+void EnergyAttributor::update() {
+    std::lock_guard<std::mutex> update_lock(update_mutex_);
+    const auto                  pass_start = std::chrono::steady_clock::now();
+    ++pass_;
+
+    std::vector<PendingRuntime> pending;
+    scan_tasks(pending);
+
+    std::vector<double> core_joules;
+    {
+        std::lock_guard<std::mutex> lock(power_mutex_);
+        core_joules = core_joules_;
+        std::fill(core_joules_.begin(), core_joules_.end(), 0.0);
+    }
+    const auto   now        = std::chrono::steady_clock::now();
+    const auto   previous   = last_update_.exchange(now);
+    const double interval_s = std::chrono::duration<double>(now - previous).count();
+    interval_ms_            = std::chrono::duration_cast<std::chrono::milliseconds>(now - previous).count();
+    if (interval_s > 0) distribute(core_joules, pending, interval_s);
+
+    // Forget exited processes and threads; their energy stays in the cgroup totals. A thread is gone
+    // when its process is, or when this pass listed all of its process's threads without it (threads
+    // of a process that was skipped or cut off by the budget were not looked at).
+    std::erase_if(processes_, [&](const auto &kv) { return kv.second.last_seen_pass != pass_; });
+    std::erase_if(tasks_, [&](const auto &kv) {
+        const auto it = processes_.find(kv.second.tgid);
+        return it == processes_.end() || (it->second.threads_pass == pass_ && kv.second.last_seen_pass != pass_);
+    });
+    prune_cgroups(false);
+    scan_ms_ = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - pass_start).count();
+
+    // Build the top-N tables by current power.
+    EnergySnapshot snap;
+    snap.total_joules  = total_joules_;
+    snap.idle_joules   = idle_joules_;
+    snap.tasks_seen    = tasks_.size();
+    snap.tasks_scanned = tasks_scanned_;
+    snap.scan_ms       = scan_ms_;
+    snap.interval_ms   = interval_ms_;
+
+    std::vector<const std::pair<const unsigned long long, TaskState> *> ranked;
+    ranked.reserve(tasks_.size());
+    for (const auto &kv : tasks_)
+        if (kv.second.joules > 0) ranked.push_back(&kv);
+    const size_t n_tasks = std::min(config_.top_n, ranked.size());
+    std::partial_sort(ranked.begin(), ranked.begin() + n_tasks, ranked.end(),
+                      [](auto *a, auto *b) { return a->second.watts > b->second.watts; });
+    for (size_t i = 0; i < n_tasks; ++i) {
+        const TaskState &ts = ranked[i]->second;
+        snap.top_tasks.push_back({ts.tgid, ts.comm, cgroups_[ts.cgroup_id].path, ts.joules, ts.watts});
+    }
+
+    std::vector<const CgroupState *> ranked_cg;
+    for (const auto &cg : cgroups_)
+        if (cg.joules > 0) ranked_cg.push_back(&cg);
+    const size_t n_cg = std::min(config_.top_n, ranked_cg.size());
+    std::partial_sort(ranked_cg.begin(), ranked_cg.begin() + n_cg, ranked_cg.end(),
+                      [](auto *a, auto *b) { return a->watts > b->watts; });
+    for (size_t i = 0; i < n_cg; ++i) snap.top_cgroups.push_back({0, ranked_cg[i]->path, ranked_cg[i]->path,
+                                                                 ranked_cg[i]->joules, ranked_cg[i]->watts});
+    {
+        std::lock_guard<std::mutex> lock(results_mutex_);
+        snapshot_ = std::move(snap);
+    }
+
+    const bool export_due = now - last_export_ >= config_.export_period;
+    in_flight_.store(false);
+    if (export_due) {
+        last_export_ = now;
+        write_export_files(); // still under update_mutex_, so the tables are consistent
+    }
+}
+
+void EnergyAttributor::write_export_files() {
+    const std::string stamp = timestamp_string();
+    std::ofstream     tasks_file(config_.export_prefix + "_tasks_" + stamp + ".csv");
+    std::ofstream     cgroups_file(config_.export_prefix + "_cgroups_" + stamp + ".csv");
+    if (!tasks_file.is_open() || !cgroups_file.is_open()) {
+        SPDLOG_ERROR("Failed to open energy attribution export files with prefix {}", config_.export_prefix);
+        return;
+    }
+    tasks_file << "TID,PID,Comm,Cgroup,Joules,Watts\n";
+    for (const auto &[tid, ts] : tasks_) {
+        if (ts.joules <= 0) continue;
+        tasks_file << tid << "," << ts.tgid << ",\"" << ts.comm << "\",\"" << cgroups_[ts.cgroup_id].path << "\","
+                   << std::fixed << std::setprecision(6) << ts.joules << "," << ts.watts << "\n";
+    }
+    cgroups_file << "Cgroup,Joules,Watts\n";
+    for (const auto &cg : cgroups_) {
+        if (cg.joules <= 0) continue;
+        cgroups_file << "\"" << cg.path << "\"," << std::fixed << std::setprecision(6) << cg.joules << ","
+                     << cg.watts << "\n";
+    }
+    SPDLOG_INFO("Energy attribution exported ({} tasks, {} cgroups)", tasks_.size(), cgroups_.size());
+    prune_cgroups(true);
+}
+
+void EnergyAttributor::export_to_files() {
+    {
+        std::lock_guard<std::mutex> lock(update_mutex_);
+        last_export_ = std::chrono::steady_clock::time_point{};
+    }
+    update();
+}
+
+EnergySnapshot EnergyAttributor::get_snapshot() {
+    std::lock_guard<std::mutex> lock(results_mutex_);
+    return snapshot_;
+}
+
+void EnergyAttributor::reset() {
+    std::lock_guard<std::mutex> update_lock(update_mutex_);
+    for (auto &[tid, ts] : tasks_) ts.joules = ts.watts = 0.0;
+    for (auto &cg : cgroups_) cg.joules = cg.watts = 0.0;
+    total_joules_ = idle_joules_ = 0.0;
+    std::lock_guard<std::mutex> lock(results_mutex_);
+    snapshot_ = EnergySnapshot{};
+}
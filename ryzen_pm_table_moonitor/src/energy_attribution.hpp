@@ -0,0 +1,157 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <sys/types.h>
+
+// Energy charged to a single task (thread) or aggregated over a cgroup.
+struct EnergyEntry {
+    pid_t       pid = 0; // tgid of the owning process, 0 for cgroup entries
+    std::string name;    // comm for tasks, cgroup path for cgroups
+    std::string cgroup;
+    double      joules = 0.0; // accumulated since the attributor was started/reset
+    double      watts  = 0.0; // average over the last attribution interval
+};
+
+// What the GUI and the exporter read. Copied out under the lock, like AnalysisManager results.
+struct EnergySnapshot {
+    std::vector<EnergyEntry> top_tasks;
+    std::vector<EnergyEntry> top_cgroups;
+    double                   total_joules    = 0.0;
+    double                   idle_joules     = 0.0; // core energy that no task ran during
+    size_t                   tasks_seen      = 0;
+    size_t                   tasks_scanned   = 0; // tasks whose schedstat was read in the last pass
+    double                   scan_ms         = 0.0;
+    long long                interval_ms     = 0;
+};
+
+/**
+ * Apportions per-core energy from the pm_table core_power array to the tasks and cgroups
+ * that ran on each core.
+ *
+ * The pipeline integrates core power (trapezoidal, on the pm_table timestamps) at full rate
+ * through add_power_sample(). Once per interval update() samples the per-thread run time from
+ * /proc/<pid>/task/<tid>/schedstat together with the CPU it last ran on (field 39 of .../stat)
+ * and splits each core's energy over the interval in proportion to the run time of the tasks
+ * that were charged to that core. Energy of a core that is not covered by run time is booked as
+ * idle.
+ *
+ * A task's run time over the whole interval is charged to the CPU it was on when it was sampled;
+ * /proc has no per-CPU run time per task. A task that migrated during the interval therefore
+ * takes its share from the wrong core, which averages out for tasks that stay put or move a lot
+ * but can be off for one that moved once. Shortening the interval reduces the error.
+ *
+ * Cgroups that no live process belongs to are dropped: at once if they never used energy, and
+ * after the next export otherwise, so their totals appear in one export and the table does not
+ * grow with every short-lived scope.
+ *
+ * Overhead is bounded in two ways: a process whose utime+stime did not move since the last pass
+ * is skipped without opening its threads, and at most max_tasks_per_scan threads are read per
+ * pass (the remainder is picked up round-robin on the next pass, with its run time carried over).
+ */
+class EnergyAttributor {
+public:
+    struct Config {
+        size_t                    top_n              = 20;
+        size_t                    max_tasks_per_scan = 4096;
+        std::chrono::milliseconds interval{1000};
+        std::chrono::seconds      export_period{60};
+        std::string               export_prefix = "energy_attribution";
+    };
+
+    explicit EnergyAttributor(Config config);
+    EnergyAttributor() : EnergyAttributor(Config{}) {}
+
+    // Hot path, called by the pipeline for every decoded pm_table sample.
+    void add_power_sample(long long timestamp_ns, const std::vector<float> &core_power);
+
+    // Runs one /proc pass and distributes the energy integrated since the previous pass.
+    // Meant to be submitted as a task; concurrent calls are serialised.
+    void update();
+
+    // Returns true (and marks a pass as in flight) when the interval has elapsed and no pass is
+    // running; the caller is then expected to run update() exactly once.
+    bool try_schedule();
+
+    EnergySnapshot get_snapshot();
+    void           reset();
+
+    // Writes the full task and cgroup tables to <prefix>_tasks_<time>.csv / _cgroups_<time>.csv.
+    void export_to_files();
+
+private:
+    struct TaskState {
+        pid_t              tgid           = 0;
+        unsigned long long start_time     = 0; // to detect pid reuse
+        unsigned long long last_runtime   = 0; // ns, from schedstat
+        int                last_cpu       = -1;
+        unsigned           last_seen_pass = 0;
+        size_t             cgroup_id      = 0;
+        std::string        comm;
+        double             joules = 0.0;
+        double             watts  = 0.0;
+    };
+    struct ProcessState {
+        unsigned long long cpu_ticks      = 0; // utime + stime
+        unsigned long long start_time     = 0;
+        size_t             cgroup_id      = 0;
+        unsigned           last_seen_pass = 0;
+        unsigned           threads_pass   = 0; // last pass that read all of its threads
+    };
+    struct CgroupState {
+        std::string path;
+        double      joules = 0.0;
+        double      watts  = 0.0;
+    };
+    struct PendingRuntime {
+        size_t             task_key;
+        int                cpu;
+        unsigned long long delta_ns;
+    };
+
+    void   load_topology();
+    size_t intern_cgroup(pid_t pid);
+    void   prune_cgroups(bool drop_exported);
+    void   scan_tasks(std::vector<PendingRuntime> &pending);
+    void   write_export_files();
+    void   distribute(const std::vector<double> &core_joules, const std::vector<PendingRuntime> &pending,
+                      double interval_s);
+
+    Config config_;
+
+    // Integration state, touched at 1 kHz from the pipeline.
+    std::mutex          power_mutex_;
+    std::vector<double> core_joules_; // energy per physical core since the last update()
+    std::vector<float>  last_power_;
+    long long           last_timestamp_ns_ = 0;
+
+    // Attribution state, owned by update() and export_to_files() (serialised by update_mutex_).
+    std::mutex                                 update_mutex_;
+    std::vector<int>                           cpu_to_core_; // logical cpu -> index into core_power
+    std::vector<int>                           threads_per_core_;
+    std::unordered_map<unsigned long long, TaskState> tasks_; // key: tid
+    std::unordered_map<pid_t, ProcessState>    processes_;
+    std::vector<CgroupState>                   cgroups_;
+    std::unordered_map<std::string, size_t>    cgroup_index_;
+    std::vector<pid_t>                         pid_scratch_;
+    size_t                                     scan_cursor_ = 0;
+    unsigned                                   pass_        = 0;
+    double                                     total_joules_ = 0.0;
+    double                                     idle_joules_  = 0.0;
+    size_t                                     tasks_scanned_ = 0;
+    double                                     scan_ms_       = 0.0;
+    long long                                  interval_ms_   = 0;
+    // Written by update(), read by try_schedule() on the pipeline thread without update_mutex_.
+    std::atomic<std::chrono::steady_clock::time_point> last_update_;
+    std::chrono::steady_clock::time_point      last_export_;
+    std::atomic_bool                           in_flight_{false};
+
+    // Top-N tables rebuilt at the end of each pass; the GUI only copies this.
+    std::mutex     results_mutex_;
+    EnergySnapshot snapshot_;
+};
@@ -1,6 +1,7 @@
 #include <chrono>
 #include <iostream>
 #include <spdlog/spdlog.h>
+#include <spdlog/fmt/chrono.h>
 #include <thread>
 #include <vector>
 #include <map>
@@ -23,6 +24,10 @@
 #include "analysis_manager.hpp"
 #include "analysis.hpp"
 #include "jitter_monitor.hpp"
+#include "energy_attribution.hpp"
+#include "energy_accountant.hpp"
+#include "float_bits.hpp"  // From ../reader
+#include "frame_pacer.hpp" // From ../reader
 #include <atomic> // For the stop flag
 #include <algorithm> // For std::find
 
@@ -31,6 +36,10 @@
 #include "toml++/toml.hpp"
 
 #include "measurement_namer.hpp" // NEW: Include the new header for MeasurementNamer
+#include "popl.hpp"      // From ../reader
+#include "shm_ring.hpp"  // From ../reader
+#include "terminal_monitor.hpp"
+#include <memory>
 
 
 // Required headers for thread scheduling and affinity
@@ -147,18 +156,20 @@ void RenderTextWithOutline(const char* text, const ImVec4& text_color)
 // Helper function to render the detailed content for a given cell.
 // UPDATED with an 'is_editable' flag to differentiate between hover tooltips and pinned windows.
 void RenderCellDetails(int index, const CellStats& stats, const StressTester& stress_tester, const std::vector<ImVec4>& core_colors, MeasurementNamer& namer, bool is_editable) {
-    std::string chess_index = MeasurementNamer::to_chess_index(index);
+    const SensorCatalog& catalog = namer.catalog();
+    const std::string_view chess_index = catalog.chess(index);
 
 
     // --- UPDATED: Display/Edit Measurement Name Conditionally ---
-    std::string current_name = namer.get_name(index).value_or("");
+    const std::string_view current_name = catalog.name(index);
 
     if (is_editable) {
         // --- Editable version for the pinned window ---
         // Use a static buffer to hold the text being edited.
         static char name_buffer[128];
-        strncpy(name_buffer, current_name.c_str(), sizeof(name_buffer) - 1);
-        name_buffer[sizeof(name_buffer) - 1] = '\0';
+        const size_t length = std::min(current_name.size(), sizeof(name_buffer) - 1);
+        current_name.copy(name_buffer, length);
+        name_buffer[length] = '\0';
 
         // Set a reasonable fixed width for the input text to avoid layout issues.
         ImGui::SetNextItemWidth(ImGui::GetContentRegionAvail().x - ImGui::CalcTextSize("Save").x - ImGui::GetStyle().FramePadding.x * 3);
@@ -175,11 +186,16 @@ void RenderCellDetails(int index, const CellStats& stats, const StressTester& st
         // --- Read-only version for the hover tooltip ---
         // Just display the name using a label. This is safe for auto-sizing windows.
         if (!current_name.empty()) {
-            ImGui::LabelText("Name", "%s", current_name.c_str());
+            ImGui::LabelText("Name", "%.*s", static_cast<int>(current_name.size()), current_name.data());
         }
     }
     ImGui::Text("Index: %5d, Bytes: %5d .. %5d", index, index * 4, index * 4 + 3);
-    ImGui::Text("Chess Index: %s", chess_index.c_str());
+    ImGui::Text("Chess Index: %.*s", static_cast<int>(chess_index.size()), chess_index.data());
+    if (const std::string_view category = catalog.category(index); !category.empty()) {
+        const std::string_view unit = catalog.unit(index);
+        ImGui::Text("%.*s [%.*s]", static_cast<int>(category.size()), category.data(), static_cast<int>(unit.size()),
+                    unit.data());
+    }
 
     ImGui::Separator();
     ImGui::Text("Live: %8.3f", stats.current_val);
@@ -354,58 +370,114 @@ public:
     }
 };
 
-int main() {
+int main(int argc, char** argv) {
+    popl::OptionParser op("Allowed options");
+    auto help_option = op.add<popl::Switch>("h", "help", "produce help message");
+    auto shm_option = op.add<popl::Value<std::string>>(
+        "", "shm", "Take samples from a running pm_acqd (shared-memory name, e.g. pm_table) instead of sysfs");
+    auto tui_option = op.add<popl::Switch>(
+        "", "tui", "Show the summary and the analysis grid in this terminal instead of a window (no X server needed)");
+    auto tui_hz_option = op.add<popl::Value<double>>("", "tui-hz", "Redraws per second of --tui", 4.0);
+    auto gui_fps_option = op.add<popl::Value<double>>(
+        "", "gui-fps", "Most frames per second of the window; it only redraws on input or new data", 30.0);
+    auto gui_continuous_option =
+        op.add<popl::Switch>("", "gui-continuous", "Redraw the window continuously (for comparing GUI CPU use)");
+    op.parse(argc, argv);
+    if (help_option->is_set()) {
+        std::cout << op << std::endl;
+        return 0;
+    }
+    const bool tui = tui_option->is_set();
+    if (tui && !(tui_hz_option->value() > 0.0)) {
+        SPDLOG_ERROR("--tui-hz must be positive.");
+        return 1;
+    }
+    // A NaN --gui-fps has to fail here in -ffast-math builds too, hence the bit test.
+    if (!is_finite(gui_fps_option->value()) || gui_fps_option->value() <= 0.0) {
+        SPDLOG_ERROR("--gui-fps must be positive.");
+        return 1;
+    }
+    FramePacer::Config pacing;
+    pacing.max_fps = gui_fps_option->value();
+    pacing.continuous = gui_continuous_option->is_set();
+    FramePacer pacer(pacing);
+
     spdlog::set_pattern("[%T.%f] [%^%L%$] [thread %t] [src/%s:%# %!] %v");
     SPDLOG_INFO("Starting PM Table Monitor");
 
+    // With --shm the daemon owns the pm_table; its ring replaces the sysfs reads of stage 1.
+    std::unique_ptr<ShmRingConsumer> shm;
+    if (shm_option->is_set()) {
+        shm = std::make_unique<ShmRingConsumer>(shm_option->value(), "pm_monitor");
+        if (!*shm) return 1;
+    }
+
     // NEW: Instantiate the namer and load data from the TOML file.
     // Ensure "pm_table_names.toml" is in the same directory as the executable.
-    MeasurementNamer namer("pm_table_names.toml");
-
-    // Setup window
-    if (!glfwInit()) {
-        SPDLOG_ERROR("Failed to initialize GLFW");
-        return -1;
-    }
-    SPDLOG_INFO("GLFW initialized");
+    MeasurementNamer namer("pm_table_names.toml", &PM_TABLE_LAYOUT_0x400005);
+
+    // Setup window (not with --tui)
+    GLFWwindow *window = nullptr;
+    if (!tui) {
+        if (!glfwInit()) {
+            SPDLOG_ERROR("Failed to initialize GLFW");
+            return -1;
+        }
+        SPDLOG_INFO("GLFW initialized");
 
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
-    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+        glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
 
-    GLFWwindow *window = glfwCreateWindow(1280, 720, "PM Table Monitor", nullptr, nullptr);
-    if (window == nullptr) {
-        SPDLOG_ERROR("Failed to create GLFW window");
-        glfwTerminate();
-        return -1;
+        window = glfwCreateWindow(1280, 720, "PM Table Monitor", nullptr, nullptr);
+        if (window == nullptr) {
+            SPDLOG_ERROR("Failed to create GLFW window");
+            glfwTerminate();
+            return -1;
+        }
+        SPDLOG_INFO("GLFW window created");
+        glfwMakeContextCurrent(window);
+        // gladLoadGLLoader((GLADloadproc)glfwGetProcAddress);
+        // Before the ImGui backend, which chains to the pacer's input callbacks.
+        pacer.attach(window);
+
+        // Setup Dear ImGui context
+        IMGUI_CHECKVERSION();
+        ImGui::CreateContext();
+        ImPlot::CreateContext();
+        ImGuiIO &io = ImGui::GetIO();
+        (void) io;
+
+        // Setup Dear ImGui style
+        ImGui::StyleColorsDark();
+
+        // Setup Platform/Renderer backends
+        ImGui_ImplGlfw_InitForOpenGL(window, true);
+        ImGui_ImplOpenGL3_Init("#version 330");
     }
-    SPDLOG_INFO("GLFW window created");
-    glfwMakeContextCurrent(window);
-    // gladLoadGLLoader((GLADloadproc)glfwGetProcAddress);
-
-    // Setup Dear ImGui context
-    IMGUI_CHECKVERSION();
-    ImGui::CreateContext();
-    ImPlot::CreateContext();
-    ImGuiIO &io = ImGui::GetIO();
-    (void) io;
-
-    // Setup Dear ImGui style
-    ImGui::StyleColorsDark();
-
-    // Setup Platform/Renderer backends
-    ImGui_ImplGlfw_InitForOpenGL(window, true);
-    ImGui_ImplOpenGL3_Init("#version 330");
 
     // 1. === Centralized Concurrency Setup ===
     const size_t num_workers = 2;
     tf::Executor executor(num_workers, tf::make_worker_interface<HighPriorityWorkerBehavior>());
     std::atomic<bool> stop_pipeline{false};
+    // Bumped per decoded sample; the window redraws when it changes (at most --gui-fps times per second).
+    std::atomic<uint64_t> gui_generation{0};
 
     // 2. === Instantiate Simplified Components ===
     StressTester stress_tester;
     AnalysisManager analysis_manager;
     PMTableReader pm_table_reader;
+    EnergyAttributor energy_attributor;
+
+    // Energy per correlation-analysis phase. The consumer stage is parallel, so samples can
+    // arrive slightly out of order; the accountant skips those and integrates across them.
+    EnergyAccountant energy_accountant(PM_TABLE_LAYOUT_0x400005);
+    std::mutex energy_mutex;
+    const int analysis_phase = energy_accountant.add_dimension("analysis");
+    analysis_manager.set_phase_listener([&](const std::string& phase) {
+        std::lock_guard<std::mutex> lock(energy_mutex);
+        energy_accountant.set_phase(analysis_phase, phase);
+    });
 
     // 3. === Define the Data Processing Pipeline ===
 
@@ -418,12 +490,29 @@ int main() {
     tf::Taskflow taskflow("PM_Table_Pipeline");
     tf::Pipeline pipeline(num_concurrent_pipelines,
         // Stage 1: Producer (Reads from file and WRITES to the shared buffer)
-        tf::Pipe{tf::PipeType::SERIAL, [&stop_pipeline, &pm_table_reader, &data_buffer](tf::Pipeflow& pf) {
+        tf::Pipe{tf::PipeType::SERIAL, [&stop_pipeline, &pm_table_reader, &data_buffer, &shm](tf::Pipeflow& pf) {
             if (stop_pipeline.load(std::memory_order_relaxed)) {
                 pf.stop();
                 return;
             }
 
+            if (shm) {
+                // pm_acqd paces and timestamps the samples (CLOCK_MONOTONIC, like steady_clock).
+                static auto shm_buffer = std::vector<float>(shm->sample_bytes() / sizeof(float));
+                ShmRingConsumer::Sample sample;
+                while (!shm->next(sample, shm_buffer.data())) {
+                    if (stop_pipeline.load(std::memory_order_relaxed) || !shm->alive()) {
+                        if (!stop_pipeline) SPDLOG_ERROR("pm_acqd stopped publishing.");
+                        stop_pipeline = true;
+                        pf.stop();
+                        return;
+                    }
+                    std::this_thread::sleep_for(std::chrono::microseconds(200));
+                }
+                data_buffer[pf.line()] = {static_cast<long long>(sample.monotonic_ns), shm_buffer};
+                return;
+            }
+
             static std::ifstream pm_table_file(pm_table_reader.pm_table_path_, std::ios::binary);
             static auto read_buffer = std::vector<float>(1024);
             static int bytes_to_read = -1;
@@ -479,7 +568,8 @@ int main() {
         }},
 
         // Stage 2: Consumer (READS from the shared buffer and processes data)
-        tf::Pipe{tf::PipeType::PARALLEL, [&data_buffer, &analysis_manager, &pm_table_reader](const tf::Pipeflow& pf) {
+        tf::Pipe{tf::PipeType::PARALLEL, [&data_buffer, &analysis_manager, &pm_table_reader, &energy_attributor, &energy_accountant,
+                                        &energy_mutex, &gui_generation](const tf::Pipeflow& pf) {
             // Get a reference to the data produced by stage 1 on the same line.
             const auto line = pf.line();
             const TimestampedData& data = data_buffer[line];
@@ -488,11 +578,20 @@ int main() {
             // 2a. Update the high-frequency analysis data
             analysis_manager.process_data_packet(data);
 
-            // 2b. Update the decoded data for the GUI's "Decoded View" tab
+            // 2b. Integrate per-core power for the energy attribution
+            auto decoded = parse_pm_table_0x400005(data.data);
+            energy_attributor.add_power_sample(data.timestamp_ns, decoded.core_power);
+            {
+                std::lock_guard<std::mutex> lock(energy_mutex);
+                energy_accountant.add_sample(data.timestamp_ns, data.data, 0);
+            }
+
+            // 2c. Update the decoded data for the GUI's "Decoded View" tab
             {
                 std::lock_guard<std::mutex> lock(pm_table_reader.data_mutex_);
-                pm_table_reader.latest_data_ = parse_pm_table_0x400005(data.data);
+                pm_table_reader.latest_data_ = std::move(decoded);
             }
+            gui_generation.fetch_add(1, std::memory_order_release);
         }}
     );
 
@@ -504,6 +603,52 @@ int main() {
     // This runs the pipeline indefinitely until pf.stop() is called.
     executor.run(taskflow);
 
+    // What the buttons of the "Correlation Analysis" tab (and the keys of --tui) do.
+    TerminalMonitorActions actions;
+    actions.run_analysis = [&]() {
+        if (stress_tester.is_running()) {
+            // 5. === Submit Analysis as a Detached Task ===
+            // This runs the heavy analysis on the executor without blocking the GUI or the pipeline.
+            executor.silent_async([&]() {
+                {
+                    std::lock_guard<std::mutex> lock(energy_mutex);
+                    energy_accountant.reset();
+                }
+                analysis_manager.run_correlation_analysis(&stress_tester);
+
+                // NEW: After analysis, save results to files
+                analysis_manager.save_correlation_results_to_files(
+                    "correlation_report", // Base filename prefix
+                    namer.catalog()       // Names as of now; later edits publish a new version
+                );
+
+                std::lock_guard<std::mutex> lock(energy_mutex);
+                energy_accountant.log_summary();
+                energy_accountant.write_csv(fmt::format(
+                    "energy_report_{:%Y%m%d_%H%M%S}.csv", fmt::localtime(std::time(nullptr))));
+            });
+            SPDLOG_INFO("Analysis task submitted.");
+        } else {
+            SPDLOG_WARN("Start stress threads before running analysis.");
+        }
+    };
+    actions.reset_stats = [&]() {
+        // Also submit as a task to ensure thread safety.
+        executor.silent_async([&]() {
+            analysis_manager.reset_stats();
+        });
+    };
+
+    if (tui) {
+        const bool ok = run_terminal_monitor(pm_table_reader, analysis_manager, stress_tester, namer, actions,
+                                             tui_hz_option->value());
+        stop_pipeline = true;
+        executor.wait_for_all();
+        stress_tester.stop();
+        SPDLOG_INFO("Shutdown complete");
+        return ok ? 0 : 1;
+    }
+
 
     // Buffers for grouped plots
     // Frequencies
@@ -546,7 +691,7 @@ int main() {
     SPDLOG_INFO("Entering main loop");
     while (!glfwWindowShouldClose(window)) {
         float history = 10.0f;
-        glfwPollEvents();
+        pacer.wait_for_frame(gui_generation);
 
         // Start the Dear ImGui frame
         ImGui_ImplOpenGL3_NewFrame();
@@ -593,6 +738,11 @@ int main() {
         }
 
 
+        // The /proc scan for energy attribution runs on the executor once per interval.
+        if (energy_attributor.try_schedule()) {
+            executor.silent_async([&]() { energy_attributor.update(); });
+        }
+
         auto data = pm_table_reader.get_latest_data();
         if (data) {
             t += ImGui::GetIO().DeltaTime;
@@ -850,31 +1000,11 @@ int main() {
                 }
                 ImGui::SameLine();
                 if (ImGui::Button("Run Analysis")) {
-                    if (stress_tester.is_running()) {
-                        // 5. === Submit Analysis as a Detached Task ===
-                        // This runs the heavy analysis on the executor without blocking the GUI or the pipeline.
-                        executor.silent_async([&]() {
-                            analysis_manager.run_correlation_analysis(&stress_tester);
-
-                            // NEW: After analysis, save results to files
-                            analysis_manager.save_correlation_results_to_files(
-                                "correlation_report", // Base filename prefix
-                                [&](int index) { // Lambda function to get name for a given decimal index
-                                    return namer.get_name(index).value_or("");
-                                }
-                            );
-                        });
-                        SPDLOG_INFO("Analysis task submitted.");
-                    } else {
-                        SPDLOG_WARN("Start stress threads before running analysis.");
-                    }
+                    actions.run_analysis();
                 }
                 ImGui::SameLine();
                 if (ImGui::Button("Reset Stats")) {
-                    // Also submit as a task to ensure thread safety.
-                    executor.silent_async([&]() {
-                       analysis_manager.reset_stats();
-                   });
+                    actions.reset_stats();
                 }
 
                 // Add a small instruction text for the user
@@ -960,6 +1090,7 @@ int main() {
 
                     ImGui::TableHeadersRow();
 
+                    const SensorCatalog& catalog = namer.catalog(); // One snapshot per frame
                     for (int i = 0; i < analysis_results.size(); ++i) {
                         ImGui::PushID(i);
                         if (i % num_columns == 0) ImGui::TableNextRow();
@@ -1005,8 +1136,7 @@ int main() {
 
                         ImGui::TableSetBgColor(ImGuiTableBgTarget_CellBg, ImGui::ColorConvertFloat4ToU32(cell_color));
                         bool is_interesting = stats.get_stddev() > 0.00001f;
-                        std::string current_name = namer.get_name(i).value_or("");
-                        bool has_name = !current_name.empty();
+                        bool has_name = catalog.has_name(i);
 
                         ImVec4 text_color = is_interesting ? ImVec4(1.0f, 1.0f, 0.0f, 1.0f)  // Yellow for interesting
                                        : ImGui::GetStyle().Colors[ImGuiCol_Text]; // Default text color otherwise
@@ -1043,11 +1173,64 @@ int main() {
                 ImGui::EndTabItem();
             }
 
+            // --- Tab 4: Energy Attribution ---
+            if (ImGui::BeginTabItem("Energy Attribution")) {
+                const EnergySnapshot energy = energy_attributor.get_snapshot();
+                ImGui::Text("Core energy: %.1f J (idle %.1f J) | %zu tasks tracked, %zu read in last pass (%.1f ms, interval %lld ms)",
+                            energy.total_joules, energy.idle_joules, energy.tasks_seen, energy.tasks_scanned,
+                            energy.scan_ms, energy.interval_ms);
+                if (ImGui::Button("Export Now")) {
+                    executor.silent_async([&]() { energy_attributor.export_to_files(); });
+                }
+                ImGui::SameLine();
+                if (ImGui::Button("Reset Energy")) {
+                    executor.silent_async([&]() { energy_attributor.reset(); });
+                }
+                ImGui::Separator();
+
+                auto draw_energy_table = [](const char* id, const char* name_header, const std::vector<EnergyEntry>& rows, bool show_pid) {
+                    const int columns = show_pid ? 5 : 3;
+                    if (!ImGui::BeginTable(id, columns, ImGuiTableFlags_Borders | ImGuiTableFlags_RowBg | ImGuiTableFlags_Resizable))
+                        return;
+                    if (show_pid) ImGui::TableSetupColumn("PID", ImGuiTableColumnFlags_WidthFixed);
+                    ImGui::TableSetupColumn(name_header, ImGuiTableColumnFlags_WidthStretch);
+                    if (show_pid) ImGui::TableSetupColumn("Cgroup", ImGuiTableColumnFlags_WidthStretch);
+                    ImGui::TableSetupColumn("Power (W)", ImGuiTableColumnFlags_WidthFixed);
+                    ImGui::TableSetupColumn("Energy (J)", ImGuiTableColumnFlags_WidthFixed);
+                    ImGui::TableHeadersRow();
+                    for (const auto& row : rows) {
+                        ImGui::TableNextRow();
+                        int col = 0;
+                        if (show_pid) {
+                            ImGui::TableSetColumnIndex(col++);
+                            ImGui::Text("%d", row.pid);
+                        }
+                        ImGui::TableSetColumnIndex(col++);
+                        ImGui::TextUnformatted(row.name.c_str());
+                        if (show_pid) {
+                            ImGui::TableSetColumnIndex(col++);
+                            ImGui::TextUnformatted(row.cgroup.c_str());
+                        }
+                        ImGui::TableSetColumnIndex(col++);
+                        ImGui::Text("%8.3f", row.watts);
+                        ImGui::TableSetColumnIndex(col++);
+                        ImGui::Text("%10.2f", row.joules);
+                    }
+                    ImGui::EndTable();
+                };
+                ImGui::TextUnformatted("Top tasks:");
+                draw_energy_table("EnergyTasks", "Task", energy.top_tasks, true);
+                ImGui::TextUnformatted("Top cgroups:");
+                draw_energy_table("EnergyCgroups", "Cgroup", energy.top_cgroups, false);
+                ImGui::EndTabItem();
+            }
+
             ImGui::EndTabBar();
         }
         // --- END: Tab Bar ---
 
         ImGui::End();
+        if (ImGui::IsAnyItemActive()) pacer.request_frame(); // Dragging a slider or a plot
 
         // Rendering
         ImGui::Render();
@@ -1059,7 +1242,9 @@ int main() {
         ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
 
         glfwSwapBuffers(window);
+        pacer.end_frame();
     }
+    pacer.log_stats("GUI");
 
     SPDLOG_INFO("Exiting main loop...");
     // 6. === Coordinated Shutdown ===
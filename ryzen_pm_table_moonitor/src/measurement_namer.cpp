@@ -3,20 +3,36 @@
 #include <spdlog/spdlog.h>
 #include "toml++/toml.hpp" // Required for TOML parsing
 
-MeasurementNamer::MeasurementNamer(std::string filepath) : filepath_(std::move(filepath)) {
+MeasurementNamer::MeasurementNamer(std::string filepath, const PmTableLayout* layout, size_t n_cells)
+    : filepath_(std::move(filepath)), layout_(layout), n_cells_(n_cells) {
     load_from_file();
 }
 
+void MeasurementNamer::publish_locked() {
+    const uint64_t version = versions_.empty() ? 1 : versions_.back()->version() + 1;
+    versions_.push_back(std::make_unique<const SensorCatalog>(names_, layout_, version));
+    catalog_.store(versions_.back().get(), std::memory_order_release);
+}
+
 void MeasurementNamer::load_from_file() {
     std::lock_guard<std::mutex> lock(mutex_);
     try {
         toml::table tbl = toml::parse_file(filepath_);
         if (auto names_table = tbl["names"].as_table()) {
+            int beyond_table = 0;
             for (auto&& [key, val] : *names_table) {
-                if (val.is_string()) {
-                    names_[std::string(key)] = val.as_string()->get();
+                const auto index = parse_index(std::string(key.str()));
+                if (!index || *index < 0) {
+                    SPDLOG_WARN("Ignoring name with invalid index '{}' in {}", key.str(), filepath_);
+                } else if (static_cast<size_t>(*index) >= n_cells_) {
+                    ++beyond_table;
+                } else if (val.is_string()) {
+                    names_[*index] = val.as_string()->get();
                 }
             }
+            if (beyond_table > 0) {
+                SPDLOG_WARN("Ignoring {} names in {} beyond the {}-cell table", beyond_table, filepath_, n_cells_);
+            }
             SPDLOG_INFO("Successfully loaded {} names from {}", names_.size(), filepath_);
         }
     } catch (const toml::parse_error& err) {
@@ -24,13 +40,14 @@ void MeasurementNamer::load_from_file() {
     } catch (const std::exception& e) {
         SPDLOG_ERROR("Error loading names file '{}': {}", filepath_, e.what());
     }
+    publish_locked();
 }
 
 void MeasurementNamer::save_to_file() {
     std::lock_guard<std::mutex> lock(mutex_);
     toml::table names_table;
     for (const auto& [key, val] : names_) {
-        names_table.insert(key, val);
+        names_table.insert(std::to_string(key), val);
     }
 
     toml::table root_table;
@@ -45,22 +62,25 @@ void MeasurementNamer::save_to_file() {
     }
 }
 
-std::optional<std::string> MeasurementNamer::get_name(int index) {
-    std::string chess_index_str = to_chess_index(index);
-    std::lock_guard<std::mutex> lock(mutex_);
-    auto it = names_.find(chess_index_str);
-    if (it != names_.end()) {
-        return it->second;
+std::optional<std::string> MeasurementNamer::get_name(int index) const {
+    const std::string_view name = catalog().name(index);
+    if (name.empty()) {
+        return std::nullopt;
     }
-    return std::nullopt;
+    return std::string(name);
 }
 
 void MeasurementNamer::set_name(int index, const std::string& name) {
-    std::string chess_index_str = to_chess_index(index);
+    if (index < 0 || static_cast<size_t>(index) >= n_cells_) return;
     std::lock_guard<std::mutex> lock(mutex_);
+    const auto it = names_.find(index);
+    if (name.empty() ? it == names_.end() : it != names_.end() && it->second == name) {
+        return; // Unchanged, no new version
+    }
     if (name.empty()) {
-        names_.erase(chess_index_str);
+        names_.erase(it);
     } else {
-        names_[chess_index_str] = name;
+        names_[index] = name;
     }
+    publish_locked();
 }
\ No newline at end of file
@@ -1,19 +1,36 @@
 #pragma once
 
+#include <atomic>
+#include <memory>
 #include <string>
 #include <map>
 #include <mutex>
 #include <optional>
+#include <vector>
 #include <algorithm> // For std::toupper
 #include <stdexcept> // For std::stoi exceptions
 #include <fmt/format.h> // For fmt::format, assuming it's available or adapt to std::format in C++20
+#include "sensor_catalog.hpp"
+
+struct PmTableLayout;
 
 // NEW: A class to manage loading, saving, and accessing measurement names
+// Readers go through catalog(), an immutable snapshot loaded with one atomic read; set_name() and
+// load_from_file() build the next version under the mutex and publish it. Old versions stay alive until the
+// namer is destroyed, so a catalog reference taken by a frame or an export task never dangles (edits are
+// interactive and rare, a version is about 100 KiB).
 class MeasurementNamer {
 private:
     std::string filepath_;
-    std::map<std::string, std::string> names_;
+    const PmTableLayout* layout_;
+    size_t n_cells_; // Names at or beyond this index are rejected
+    std::map<int, std::string> names_; // Writer side, by decimal index
     std::mutex mutex_;
+    std::vector<std::unique_ptr<const SensorCatalog>> versions_;
+    std::atomic<const SensorCatalog*> catalog_{nullptr};
+
+    // Build and publish the next catalog version; mutex_ must be held.
+    void publish_locked();
 
     // Helper to convert chess index string to a decimal index (0-indexed)
     static std::optional<int> from_chess_index(const std::string& chess_index) {
@@ -21,7 +38,7 @@ private:
             return std::nullopt;
         }
         char col_char = static_cast<char>(std::toupper(chess_index[0]));
-        if (col_char < 'A' || col_char > 'H') { // Assuming columns A-H
+        if (col_char < 'A' || col_char > 'P') { // Columns A-P, as in to_chess_index
             return std::nullopt;
         }
         int col = col_char - 'A';
@@ -37,14 +54,17 @@ private:
             }
 
             int row = std::stoi(chess_index.substr(row_str_start));
-            return row * 8 + col; // Assuming 8 columns per row
+            return row * 16 + col;
         } catch (const std::exception&) {
             return std::nullopt;
         }
     }
 
 public:
-    explicit MeasurementNamer(std::string filepath);
+    // layout supplies the catalog's units and categories; may be null. n_cells is the pm_table size in floats;
+    // the default is the largest table any tool reads.
+    explicit MeasurementNamer(std::string filepath, const PmTableLayout* layout = nullptr,
+                              size_t n_cells = SensorCatalog::MIN_CELLS);
 
     // Convert an integer index (0-indexed) to its chess notation (e.g., 0 -> "A0", 8 -> "A1")
     static std::string to_chess_index(int index) {
@@ -72,8 +92,12 @@ public:
         }
     }
 
+    // Keys in the file may be decimal ("38") or chess indices ("G2"); saving writes decimal keys.
     void load_from_file();
     void save_to_file();
-    std::optional<std::string> get_name(int index);
+    std::optional<std::string> get_name(int index) const;
     void set_name(int index, const std::string& name);
-};
\ No newline at end of file
+
+    // The current catalog; lock-free, valid for the namer's lifetime. Take it once per frame or export.
+    const SensorCatalog& catalog() const { return *catalog_.load(std::memory_order_acquire); }
+};
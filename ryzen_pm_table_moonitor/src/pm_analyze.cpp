@@ -0,0 +1,312 @@
+// pm_analyze: offline analysis of many recordings in parallel.
+//
+// Each recording (pm_reader .bin log or pm_measure --record .pmrs file) gets the same report
+// the GUI writes after a correlation analysis, plus its eye diagrams; summary.csv lists one line
+// per file and fleet.csv aggregates the cell statistics over all files of the same pm_table.
+// With --report, each file also gets a PNG/SVG of its eye diagrams and correlation grid.
+#include "analysis_manager.hpp"
+#include "batch_analysis.hpp"
+#include "measurement_namer.hpp"
+#include "pm_table_layout.hpp" // From ../reader
+#include "popl.hpp" // From ../reader
+#include "report_render.hpp"
+#include "terminal_ui.hpp"
+#include <spdlog/spdlog.h>
+#include <taskflow/taskflow.hpp>
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace {
+
+// Cell statistics of all files with the same pm_table (version, size), named with that table's layout.
+struct FleetGroup {
+    std::unique_ptr<MeasurementNamer> namer;
+    std::vector<CellStats> cells;
+    std::vector<int> files;              // Per cell: files contributing
+    std::vector<int> interesting_files;  // Per cell: files where it changes
+    std::vector<std::map<int, int>> top_core_votes; // Per cell: core -> files where it correlates best
+};
+
+std::string quoted(const std::string& s) { return "\"" + s + "\""; }
+
+void write_eye_csv(const std::string& filename, const FileAnalysis& file, const BatchOptions& options,
+                   const SensorCatalog& catalog) {
+    std::ofstream out(filename);
+    if (!out.is_open()) {
+        SPDLOG_ERROR("Failed to open {}", filename);
+        return;
+    }
+    out << "Core,Index,Chess Index,Name,Time ms,Windows,Mean,Min,Max\n";
+    for (const auto& [core, eye] : file.eyes) {
+        for (size_t k = 0; k < file.interesting.size(); ++k) {
+            const int index = file.interesting[k];
+            const std::string name = quoted(std::string(catalog.name(index)));
+            for (int bin = 0; bin < eye.n_bins; ++bin) {
+                const auto& b = eye.bins[k * eye.n_bins + bin];
+                if (b.count == 0) continue;
+                out << core << "," << index << "," << catalog.chess(index) << "," << name << ","
+                    << bin - options.window_before_ms << "," << eye.windows << "," << std::fixed
+                    << std::setprecision(4) << b.sum / b.count << "," << b.min << "," << b.max << "\n";
+            }
+        }
+    }
+}
+
+// Eyes per core (mean over min..max; the batch accumulators keep no distribution) and the cell means
+// on the GUI's correlation colors: hue by the best correlated core, saturation by its strength.
+Report make_report(const FileAnalysis& file, const BatchOptions& options, const SensorCatalog& catalog) {
+    auto label = [&catalog](int index) { return std::string(catalog.label(index).substr(0, 16)); };
+    Report report;
+    report.title = std::filesystem::path(file.path).filename().string();
+    for (const auto& [core, eye] : file.eyes) {
+        ReportSection section{fmt::format("Core {}, {} windows", core, eye.windows), "ms", {}};
+        for (size_t k = 0; k < file.interesting.size(); ++k) {
+            ReportPlot plot;
+            plot.title = label(file.interesting[k]);
+            plot.marker_x = 0.0f;
+            plot.bands.resize(1);
+            for (int bin = 0; bin < eye.n_bins; ++bin) {
+                const auto& b = eye.bins[k * eye.n_bins + bin];
+                if (b.count == 0) continue;
+                plot.x.push_back(static_cast<float>(bin - options.window_before_ms));
+                plot.mean.push_back(static_cast<float>(b.sum / b.count));
+                plot.bands[0].lo.push_back(b.min);
+                plot.bands[0].hi.push_back(b.max);
+            }
+            section.plots.push_back(std::move(plot));
+        }
+        report.sections.push_back(std::move(section));
+    }
+
+    ReportGrid grid;
+    grid.title = "Cell means, colored by the best correlated core";
+    for (size_t i = 0; i < file.cells.size(); ++i) {
+        const CellStats& stats = file.cells[i];
+        grid.values.push_back(static_cast<float>(stats.mean));
+        uint32_t background = terminal_rgb(0.1f, 0.1f, 0.1f);
+        if (!stats.top_correlations.empty() && stats.top_correlations[0].correlation_strength > 0.1f) {
+            const auto& top_corr = stats.top_correlations[0];
+            background = terminal_hsv(std::fmod(static_cast<float>(top_corr.core_id) * 0.61803398875f, 1.0f),
+                                      0.85f * top_corr.correlation_strength, 0.95f);
+        }
+        grid.background.push_back(background);
+        const bool is_interesting = stats.get_stddev() > 0.00001f;
+        const bool has_name = catalog.has_name(static_cast<int>(i));
+        grid.foreground.push_back(terminal_rgb(1.0f, has_name ? 1.0f : 0.0f, is_interesting ? 0.0f : 1.0f));
+    }
+    report.grids.push_back(std::move(grid));
+    return report;
+}
+
+void write_summary_csv(const std::string& filename, const std::vector<FileAnalysis>& files) {
+    std::ofstream out(filename);
+    if (!out.is_open()) {
+        SPDLOG_ERROR("Failed to open {}", filename);
+        return;
+    }
+    out << "File,Samples,Floats,PM Table Version,Duration s,Rate Hz,Interesting Cells,Rising Edges,Eye Windows,"
+           "Analysis s\n";
+    for (const auto& file : files) {
+        uint64_t windows = 0;
+        for (const auto& [core, eye] : file.eyes) windows += eye.windows;
+        out << quoted(file.path) << "," << file.samples << "," << file.n_floats << ",0x" << std::hex
+            << file.pm_table_version << std::dec << "," << std::fixed << std::setprecision(3) << file.duration_s
+            << "," << (file.duration_s > 0 ? static_cast<double>(file.samples - 1) / file.duration_s : 0.0) << ","
+            << file.interesting.size() << "," << file.rising_edges << "," << windows << "," << file.seconds
+            << "\n";
+    }
+}
+
+void write_fleet_csv(const std::string& filename, const std::map<std::pair<uint32_t, size_t>, FleetGroup>& groups) {
+    std::ofstream out(filename);
+    if (!out.is_open()) {
+        SPDLOG_ERROR("Failed to open {}", filename);
+        return;
+    }
+    out << "PM Table Version,Floats,Index,Chess Index,Name,Files,Interesting In,Min Value,Max Value,Mean Value,"
+           "StdDev Value,Top Core,Top Core Files\n";
+    for (const auto& [key, group] : groups) {
+        const SensorCatalog& catalog = group.namer->catalog();
+        for (size_t i = 0; i < group.cells.size(); ++i) {
+            const auto& stats = group.cells[i];
+            int top_core = -1, top_votes = 0;
+            for (const auto& [core, votes] : group.top_core_votes[i]) {
+                if (votes > top_votes) {
+                    top_core = core;
+                    top_votes = votes;
+                }
+            }
+            out << "0x" << std::hex << key.first << std::dec << "," << key.second << "," << i << ","
+                << catalog.chess(static_cast<int>(i)) << ","
+                << quoted(std::string(catalog.name(static_cast<int>(i)))) << "," << group.files[i] << ","
+                << group.interesting_files[i] << "," << std::fixed << std::setprecision(3) << stats.min_val << ","
+                << stats.max_val << "," << stats.mean << "," << stats.get_stddev() << "," << top_core << ","
+                << top_votes << "\n";
+        }
+    }
+}
+
+// Output name per input: its stem, prefixed with the parent directory where inputs share a stem (fleet
+// collections are usually host/pm_table_log.bin), and suffixed with the input index if that still collides.
+std::vector<std::string> output_stems(const std::vector<std::string>& paths) {
+    std::map<std::string, int> count;
+    for (const auto& path : paths) ++count[std::filesystem::path(path).stem().string()];
+    std::vector<std::string> stems;
+    std::map<std::string, int> used;
+    for (const auto& path : paths) {
+        const std::filesystem::path p(path);
+        std::string stem = p.stem().string();
+        if (count[stem] > 1) {
+            const std::string parent = std::filesystem::absolute(p).parent_path().filename().string();
+            if (!parent.empty()) stem = parent + "_" + stem;
+        }
+        stems.push_back(stem);
+        ++used[stem];
+    }
+    for (size_t i = 0; i < stems.size(); ++i) {
+        if (used[stems[i]] > 1) stems[i] += "_" + std::to_string(i);
+    }
+    return stems;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    using namespace popl;
+
+    OptionParser op("Usage: pm_analyze [options] <recording>...\n"
+                    "Recordings are pm_reader .bin logs or pm_measure --record .pmrs files.");
+    auto help_option = op.add<Switch>("h", "help", "produce help message");
+    auto output_option = op.add<Value<std::string>>("o", "output-dir", "Directory for the reports", "pm_analyze_out");
+    auto threads_option = op.add<Value<unsigned>>("j", "threads", "Worker threads (0 = all hardware threads)", 0);
+    auto chunk_option = op.add<Value<uint64_t>>("", "chunk-samples", "Samples per unit of parallel work", 65'536);
+    auto before_option = op.add<Value<int>>("", "eye-before-ms", "Eye window before the rising worker edge", 50);
+    auto after_option = op.add<Value<int>>("", "eye-after-ms", "Eye window after the rising worker edge", 150);
+    auto names_option = op.add<Value<std::string>>("", "names", "Cell names", "pm_table_names.toml");
+    auto report_option =
+        op.add<Switch>("", "report", "Also write <file>_report.png/.svg (eye diagrams, correlation grid)");
+    auto report_columns_option = op.add<Value<int>>("", "report-columns", "Mini-plots per row of --report", 8);
+    op.parse(argc, argv);
+
+    const auto& paths = op.non_option_args();
+    if (help_option->is_set() || paths.empty()) {
+        std::cout << op << std::endl;
+        return help_option->is_set() ? 0 : 1;
+    }
+
+    BatchOptions options;
+    options.chunk_samples = std::max<uint64_t>(1, chunk_option->value());
+    options.window_before_ms = std::max(0, before_option->value());
+    options.window_after_ms = std::max(1, after_option->value());
+
+    const std::filesystem::path output_dir = output_option->value();
+    std::error_code ec;
+    std::filesystem::create_directories(output_dir, ec);
+    if (ec) {
+        SPDLOG_ERROR("Failed to create {}: {}", output_dir.string(), ec.message());
+        return 1;
+    }
+
+    const unsigned n_threads =
+        threads_option->value() > 0 ? threads_option->value() : std::max(1u, std::thread::hardware_concurrency());
+    tf::Executor executor(n_threads);
+    SPDLOG_INFO("Analyzing {} recordings with {} threads.", paths.size(), executor.num_workers());
+
+    // One task per file; each splits its file into chunks on the same executor, so a single large
+    // recording uses every worker as well as many small ones do.
+    const auto start = std::chrono::steady_clock::now();
+    std::vector<FileAnalysis> files(paths.size());
+    tf::Taskflow taskflow;
+    for (size_t i = 0; i < paths.size(); ++i) {
+        taskflow.emplace([&, i] {
+            files[i] = analyze_recording(paths[i], options, executor);
+            if (files[i].ok) {
+                SPDLOG_INFO("{}: {} samples, {} interesting cells, {} rising edges in {:.2f} s.", paths[i],
+                            files[i].samples, files[i].interesting.size(), files[i].rising_edges, files[i].seconds);
+            }
+        });
+    }
+    executor.run(taskflow).wait();
+    const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    // --- Reports (sequential; small next to the analysis) ---
+    AnalysisManager analysis_manager;
+    std::map<std::pair<uint32_t, size_t>, FleetGroup> groups;
+    uint64_t total_samples = 0;
+    uint64_t total_bytes = 0;
+    int failed = 0;
+    const std::vector<std::string> stems = output_stems(paths);
+    for (size_t f = 0; f < files.size(); ++f) {
+        auto& file = files[f];
+        if (!file.ok) {
+            ++failed;
+            continue;
+        }
+        total_samples += file.samples;
+        total_bytes += std::filesystem::file_size(file.path, ec);
+
+        auto& group = groups[{file.pm_table_version, file.n_floats}];
+        if (!group.namer) {
+            const PmTableLayout* layout = find_pm_table_layout(file.pm_table_version, file.n_floats);
+            if (!layout) {
+                SPDLOG_WARN("No known layout for pm_table 0x{:x} with {} floats; cells get names only, no units.",
+                            file.pm_table_version, file.n_floats);
+            }
+            group.namer = std::make_unique<MeasurementNamer>(names_option->value(), layout, file.n_floats);
+        }
+        const SensorCatalog& catalog = group.namer->catalog();
+
+        const std::string stem = (output_dir / stems[f]).string();
+        if (stems[f] != std::filesystem::path(file.path).stem().string()) {
+            SPDLOG_INFO("{}: writing {}_*.", file.path, stems[f]);
+        }
+        write_eye_csv(stem + "_eye.csv", file, options, catalog);
+        if (report_option->is_set()) {
+            ReportOptions report_options;
+            report_options.panels_per_row = std::max(1, report_columns_option->value());
+            report_options.threads = n_threads;
+            write_report(make_report(file, options, catalog), stem + "_report", report_options);
+        }
+
+        if (group.cells.empty()) {
+            group.cells.resize(file.n_floats);
+            group.files.resize(file.n_floats);
+            group.interesting_files.resize(file.n_floats);
+            group.top_core_votes.resize(file.n_floats);
+        }
+        for (size_t i = 0; i < file.n_floats; ++i) {
+            group.cells[i].merge(file.cells[i]);
+            ++group.files[i];
+            if (!file.cells[i].top_correlations.empty()) {
+                ++group.top_core_votes[i][file.cells[i].top_correlations.front().core_id];
+            }
+        }
+        for (const int i : file.interesting) {
+            ++group.interesting_files[i];
+        }
+
+        analysis_manager.set_analysis_results(std::move(file.cells));
+        analysis_manager.save_correlation_results_to_files(stem, catalog);
+    }
+    write_summary_csv((output_dir / "summary.csv").string(), files);
+    write_fleet_csv((output_dir / "fleet.csv").string(), groups);
+
+    SPDLOG_INFO("Analyzed {} samples ({:.1f} MiB) from {} files in {:.2f} s: {:.0f} samples/s, {:.1f} MiB/s.",
+                total_samples, total_bytes / 1048576.0, files.size() - failed, seconds,
+                seconds > 0 ? total_samples / seconds : 0.0,
+                seconds > 0 ? total_bytes / 1048576.0 / seconds : 0.0);
+    if (failed > 0) {
+        SPDLOG_WARN("{} of {} recordings could not be read.", failed, files.size());
+    }
+    return failed == static_cast<int>(files.size()) ? 1 : 0;
+}
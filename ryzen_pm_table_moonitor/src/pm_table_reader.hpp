@@ -83,5 +83,5 @@ private:
     PMTableData latest_data_;
 
     // Friend declaration to allow main pipeline to access private members
-    friend int main();
+    friend int main(int, char**);
 };
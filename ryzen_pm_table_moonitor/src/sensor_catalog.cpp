@@ -0,0 +1,82 @@
+#include "sensor_catalog.hpp"
+#include "measurement_namer.hpp"
+#include "pm_table_layout.hpp"
+
+#include <algorithm>
+#include <unordered_map>
+
+namespace {
+
+struct CellKind {
+    const char* unit = "";
+    const char* category = "";
+};
+
+// Units and categories of the cells the layout knows; the rest of the table stays anonymous.
+std::vector<CellKind> cell_kinds(const PmTableLayout* layout, size_t n_cells) {
+    std::vector<CellKind> kinds(n_cells);
+    if (!layout) return kinds;
+    auto set = [&](size_t index, const char* unit, const char* category) {
+        if (index < n_cells) kinds[index] = {unit, category};
+    };
+    for (size_t core = 0; core < layout->n_cores; ++core) {
+        set(layout->core_power + core, "W", "Core power");
+        set(layout->core_voltage + core, "V", "Core voltage");
+        set(layout->core_temp + core, "degC", "Core temperature");
+        set(layout->core_freq + core, "MHz", "Core frequency");
+        set(layout->core_c0 + core, "%", "Core C0");
+    }
+    set(layout->stapm_limit, "W", "Limit");
+    set(layout->stapm_value, "W", "Limit");
+    set(layout->ppt_limit, "W", "Limit");
+    set(layout->ppt_value, "W", "Limit");
+    set(layout->tdc_limit, "A", "Limit");
+    set(layout->tdc_value, "A", "Limit");
+    set(layout->edc_limit, "A", "Limit");
+    set(layout->edc_value, "A", "Limit");
+    set(layout->thm_limit, "degC", "Limit");
+    set(layout->thm_value, "degC", "Limit");
+    set(layout->vddcr_cpu_power, "W", "Power");
+    set(layout->vddcr_soc_power, "W", "Power");
+    set(layout->socket_power, "W", "Power");
+    set(layout->soc_temp, "degC", "Temperature");
+    set(layout->prochot, "", "Status");
+    return kinds;
+}
+
+} // namespace
+
+SensorCatalog::SensorCatalog(const std::map<int, std::string>& names, const PmTableLayout* layout,
+                             uint64_t version)
+    : version_(version) {
+    size_t n_cells = MIN_CELLS;
+    if (layout) n_cells = std::max(n_cells, layout->min_floats);
+    if (!names.empty()) n_cells = std::max(n_cells, static_cast<size_t>(std::max(0, names.rbegin()->first)) + 1);
+    const std::vector<CellKind> kinds = cell_kinds(layout, n_cells);
+
+    // Interning: units, categories and the empty string repeat; names and labels mostly do not.
+    std::unordered_map<std::string, Ref> interned;
+    auto intern = [&](const std::string& s) {
+        auto [it, inserted] = interned.try_emplace(s);
+        if (inserted) {
+            it->second = {static_cast<uint32_t>(strings_.size()), static_cast<uint32_t>(s.size())};
+            strings_ += s;
+        }
+        return it->second;
+    };
+
+    entries_.resize(n_cells);
+    for (size_t i = 0; i < n_cells; ++i) {
+        const int index = static_cast<int>(i);
+        const auto it = names.find(index);
+        const std::string name = it != names.end() ? it->second : std::string();
+        const std::string chess = MeasurementNamer::to_chess_index(index);
+        Entry& entry = entries_[i];
+        entry.name = intern(name);
+        entry.unit = intern(kinds[i].unit);
+        entry.category = intern(kinds[i].category);
+        entry.chess = intern(chess);
+        entry.label = name.empty() ? entry.chess : intern(chess + " " + name);
+    }
+    strings_.shrink_to_fit();
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <string>
+#include <string_view>
+#include <vector>
+
+struct PmTableLayout;
+
+// Immutable per-cell metadata: user name (from the names TOML), unit and category (from the pm_table layout)
+// and the chess label. All strings are interned into one buffer and the entries are contiguous and indexed by
+// cell, so lookups are an array access with no formatting and no locking. Edits build a new catalog with the
+// next version; MeasurementNamer publishes it atomically.
+class SensorCatalog {
+public:
+    // At least this many cells, so every cell of a known table is covered.
+    static constexpr size_t MIN_CELLS = 2048;
+
+    // names: cell index -> user name. layout may be null (no units or categories).
+    SensorCatalog(const std::map<int, std::string>& names, const PmTableLayout* layout, uint64_t version);
+
+    SensorCatalog(const SensorCatalog&) = delete;
+    SensorCatalog& operator=(const SensorCatalog&) = delete;
+
+    uint64_t version() const noexcept { return version_; }
+    size_t size() const noexcept { return entries_.size(); }
+
+    // Out-of-range cells (and negative indices) give empty strings.
+    std::string_view name(int index) const noexcept { return view(index, &Entry::name); }
+    std::string_view unit(int index) const noexcept { return view(index, &Entry::unit); }
+    std::string_view category(int index) const noexcept { return view(index, &Entry::category); }
+    std::string_view chess(int index) const noexcept { return view(index, &Entry::chess); }
+    bool has_name(int index) const noexcept { return !name(index).empty(); }
+
+    // "<chess> <name>", or just the chess label for unnamed cells; precomputed for plot titles and tooltips.
+    std::string_view label(int index) const noexcept { return view(index, &Entry::label); }
+
+private:
+    struct Ref {
+        uint32_t offset = 0;
+        uint32_t length = 0;
+    };
+    struct Entry {
+        Ref name, unit, category, chess, label;
+    };
+
+    std::string_view view(int index, Ref Entry::*field) const noexcept {
+        if (index < 0 || static_cast<size_t>(index) >= entries_.size()) return {};
+        const Ref& ref = entries_[static_cast<size_t>(index)].*field;
+        return {strings_.data() + ref.offset, ref.length};
+    }
+
+    uint64_t version_;
+    std::string strings_;        // Interned, each distinct string once
+    std::vector<Entry> entries_; // By cell
+};
@@ -0,0 +1,205 @@
+#include "terminal_monitor.hpp"
+
+#include "analysis_manager.hpp"
+#include "measurement_namer.hpp"
+#include "pm_table_reader.hpp"
+#include "stress_tester.hpp"
+#include "terminal_ui.hpp" // From ../reader
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <spdlog/spdlog.h>
+#include <string>
+#include <vector>
+
+namespace {
+
+constexpr int NUM_COLUMNS = 16;    // As the GUI's analysis grid
+constexpr int CELL_WIDTH = 9;      // "{:8.2f}" and a space
+constexpr int ROW_LABEL_WIDTH = 6; // Index of the row's first cell
+constexpr int SPARK_WIDTH = 32;
+constexpr size_t HISTORY = 256;    // Sparkline samples kept per series
+
+constexpr TerminalColor DIM_COLOR = 0x808080;
+constexpr TerminalColor SPARK_COLOR = 0x66CCFF;
+constexpr TerminalColor CELL_BACKGROUND = terminal_rgb(0.1f, 0.1f, 0.1f);
+
+// Same hues as generate_color_for_core() in main.cpp, with the saturation scaled by the strength.
+TerminalColor core_color(int core_id, float strength) {
+    const float hue = std::fmod(static_cast<float>(core_id) * 0.61803398875f, 1.0f);
+    return terminal_hsv(hue, 0.85f * strength, 0.95f);
+}
+
+// -1: no stress thread busy, -2: several, >= 0: the single busy core (as the GUI's grid coloring).
+int single_selected_core(const StressTester& stress_tester) {
+    if (!stress_tester.is_running()) return -1;
+    int selected = -1, count = 0;
+    for (int i = 0; i < static_cast<int>(stress_tester.get_core_count()); ++i) {
+        if (stress_tester.get_thread_busy_state(i)) {
+            ++count;
+            selected = i;
+        }
+    }
+    return count > 1 ? -2 : selected;
+}
+
+TerminalColor cell_background(const CellStats& stats, int single_selected_core_id) {
+    if (single_selected_core_id >= 0) {
+        for (const auto& corr : stats.top_correlations) {
+            if (corr.core_id == single_selected_core_id) {
+                if (corr.correlation_strength > 0.01f)
+                    return core_color(single_selected_core_id, corr.correlation_strength);
+                break;
+            }
+        }
+    } else if (!stats.top_correlations.empty() && stats.top_correlations[0].correlation_strength > 0.1f) {
+        const auto& top_corr = stats.top_correlations[0];
+        return core_color(top_corr.core_id, top_corr.correlation_strength);
+    }
+    return CELL_BACKGROUND;
+}
+
+// A series for a sparkline, sampled once per frame.
+void push_history(std::vector<float>& series, float value) {
+    if (series.size() == HISTORY) series.erase(series.begin());
+    series.push_back(value);
+}
+
+struct SummaryHistory {
+    std::vector<float> socket_power;
+    std::vector<std::vector<float>> core_freq;
+};
+
+// The decoded view: limits, power, clocks and one line per core. Returns the next free row.
+int draw_summary(TerminalScreen& screen, int y, const PMTableData& data, SummaryHistory& history) {
+    push_history(history.socket_power, data.socket_power);
+    int x = screen.text(0, y, fmt::format("Socket {:6.1f} W  Package {:6.1f} W  CPU {:6.1f} W  SoC {:6.1f} W  ",
+                                          data.socket_power, data.package_power, data.vddcr_cpu_power,
+                                          data.vddcr_soc_power));
+    screen.sparkline(x, y, SPARK_WIDTH, history.socket_power, SPARK_COLOR);
+    ++y;
+    screen.text(0, y++, fmt::format("STAPM {:5.1f}/{:5.1f}  PPT {:5.1f}/{:5.1f}  TDC {:5.1f}/{:5.1f}  "
+                                    "EDC {:5.1f}/{:5.1f}  THM {:5.1f}/{:5.1f}",
+                                    data.stapm_value, data.stapm_limit, data.ppt_value, data.ppt_limit,
+                                    data.tdc_value, data.tdc_limit, data.edc_value, data.edc_limit,
+                                    data.thm_value, data.thm_limit));
+    screen.text(0, y++, fmt::format("SoC {:5.1f} C  Peak {:5.1f} C  {:5.3f} V  FCLK {:5.0f}  UCLK {:5.0f}  "
+                                    "MEMCLK {:5.0f} MHz",
+                                    data.soc_temp, data.peak_temp, data.peak_voltage, data.fclk_freq,
+                                    data.uclk_freq, data.memclk_freq));
+
+    const size_t cores = data.core_freq.size();
+    history.core_freq.resize(cores);
+    screen.text(0, y++, "Core    MHz    eff      W     C      V    C0%  frequency", DIM_COLOR);
+    auto at = [](const std::vector<float>& v, size_t i) { return i < v.size() ? v[i] : 0.0f; };
+    for (size_t i = 0; i < cores; ++i) {
+        push_history(history.core_freq[i], data.core_freq[i]);
+        x = screen.text(0, y, fmt::format("C{:<3} {:6.0f} {:6.0f} {:6.2f} {:5.1f} {:6.3f} {:6.1f}  ", i,
+                                          at(data.core_freq, i), at(data.core_freq_eff, i),
+                                          at(data.core_power, i), at(data.core_temp, i),
+                                          at(data.core_voltage, i), at(data.core_c0, i)));
+        screen.sparkline(x, y, SPARK_WIDTH, history.core_freq[i], core_color(static_cast<int>(i), 1.0f));
+        ++y;
+    }
+    return y;
+}
+
+// The analysis grid as in the GUI's "Correlation Analysis" tab, from the given first row.
+void draw_grid(TerminalScreen& screen, int y, const std::vector<CellStats>& results, const SensorCatalog& catalog,
+               int single_selected_core_id, int& scroll) {
+    const int total_rows = (static_cast<int>(results.size()) + NUM_COLUMNS - 1) / NUM_COLUMNS;
+    const int visible_rows = std::max(1, screen.height() - y - 2); // Header and log line
+    scroll = std::clamp(scroll, 0, std::max(0, total_rows - visible_rows));
+
+    for (int col = 0; col < NUM_COLUMNS; ++col)
+        screen.text(ROW_LABEL_WIDTH + col * CELL_WIDTH + CELL_WIDTH - 2, y, std::string(1, 'A' + col), DIM_COLOR);
+    if (total_rows > visible_rows)
+        screen.text(ROW_LABEL_WIDTH + NUM_COLUMNS * CELL_WIDTH + 2, y,
+                    fmt::format("rows {}-{} of {}", scroll + 1, std::min(total_rows, scroll + visible_rows),
+                                total_rows), DIM_COLOR);
+    ++y;
+    for (int row = scroll; row < total_rows && row < scroll + visible_rows; ++row, ++y) {
+        screen.text(0, y, fmt::format("{:5}", row * NUM_COLUMNS), DIM_COLOR);
+        for (int col = 0; col < NUM_COLUMNS; ++col) {
+            const int i = row * NUM_COLUMNS + col;
+            if (i >= static_cast<int>(results.size())) break;
+            const CellStats& stats = results[i];
+            // The GUI's text colors: yellow/red for changing cells, white/magenta for constant ones;
+            // the second of each pair if the cell has no name yet.
+            const bool is_interesting = stats.get_stddev() > 0.00001f;
+            const bool has_name = catalog.has_name(i);
+            const TerminalColor text_color = terminal_rgb(1.0f, has_name ? 1.0f : 0.0f, is_interesting ? 0.0f : 1.0f);
+            screen.text(ROW_LABEL_WIDTH + col * CELL_WIDTH, y, fmt::format("{:8.2f}", stats.current_val),
+                        text_color, cell_background(stats, single_selected_core_id));
+        }
+    }
+}
+
+} // namespace
+
+bool run_terminal_monitor(PMTableReader& pm_table_reader, AnalysisManager& analysis_manager,
+                          StressTester& stress_tester, MeasurementNamer& namer,
+                          const TerminalMonitorActions& actions, double refresh_hz) {
+    TerminalScreen screen;
+    if (!screen) {
+        SPDLOG_ERROR("--tui needs a terminal on stdout.");
+        return false;
+    }
+
+    std::vector<CellStats> results;
+    SummaryHistory history;
+    int scroll = 0;
+    const auto period = std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+        std::chrono::duration<double>(1.0 / refresh_hz));
+    auto next_frame = std::chrono::steady_clock::now();
+
+    while (!TerminalScreen::interrupted()) {
+        screen.clear();
+        analysis_manager.copy_analysis_summary(results);
+        const int selected = single_selected_core(stress_tester);
+
+        screen.text(0, 0, fmt::format("PM Table Monitor | stress threads: {} | {} cells",
+                                      stress_tester.is_running() ? "running" : "stopped", results.size()));
+        screen.text(0, 1, "q quit  s start/stop stress  a run analysis  r reset stats  ↑/↓ scroll", DIM_COLOR);
+
+        int y = 3;
+        if (auto data = pm_table_reader.get_latest_data()) {
+            y = draw_summary(screen, y, *data, history) + 1;
+        }
+        draw_grid(screen, y, results, namer.catalog(), selected, scroll);
+
+        const auto log = screen.recent_log(1);
+        if (!log.empty()) screen.text(0, screen.height() - 1, log.back(), DIM_COLOR);
+        screen.present();
+
+        // The wait for a key paces the frames; a key redraws at once.
+        next_frame += period;
+        const auto now = std::chrono::steady_clock::now();
+        if (next_frame < now) next_frame = now;
+        const int key = screen.read_key(static_cast<int>(
+            std::chrono::duration_cast<std::chrono::milliseconds>(next_frame - now).count()));
+        if (key == TerminalScreen::KEY_NONE) continue;
+        next_frame = std::chrono::steady_clock::now();
+        switch (key) {
+        case 'q':
+        case 'Q':
+            return true;
+        case 's':
+            if (stress_tester.is_running()) stress_tester.stop();
+            else stress_tester.start();
+            break;
+        case 'a':
+            actions.run_analysis();
+            break;
+        case 'r':
+            actions.reset_stats();
+            break;
+        case TerminalScreen::KEY_UP: --scroll; break;
+        case TerminalScreen::KEY_DOWN: ++scroll; break;
+        case TerminalScreen::KEY_PAGE_UP: scroll -= 8; break;
+        case TerminalScreen::KEY_PAGE_DOWN: scroll += 8; break;
+        default: break;
+        }
+    }
+    return true;
+}
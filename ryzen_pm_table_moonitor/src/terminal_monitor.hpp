@@ -0,0 +1,22 @@
+#pragma once
+
+#include <functional>
+
+class AnalysisManager;
+class MeasurementNamer;
+class PMTableReader;
+class StressTester;
+
+// What the GUI's buttons do, so the terminal UI submits exactly the same tasks.
+struct TerminalMonitorActions {
+    std::function<void()> run_analysis;
+    std::function<void()> reset_stats;
+};
+
+// pm_monitor in the terminal (--tui) for hosts without an X server: the decoded summary with
+// sparklines and the correlation cell grid, drawn with ANSI escapes (../reader/terminal_ui.hpp)
+// refresh_hz times per second. Reads the same PMTableReader and AnalysisManager results as the
+// GUI. Returns when the user presses q or on SIGINT/SIGTERM; returns false without a terminal.
+bool run_terminal_monitor(PMTableReader& pm_table_reader, AnalysisManager& analysis_manager,
+                          StressTester& stress_tester, MeasurementNamer& namer,
+                          const TerminalMonitorActions& actions, double refresh_hz);